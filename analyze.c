@@ -0,0 +1,618 @@
+/*
+ * File: analyze.c
+ * Description: Offline analysis of a recording: per metric percentiles from
+ *              mergeable log-linear histograms, the peak window and the time
+ *              spent above a threshold, in one pass split across threads.
+ *
+ * Notes:
+ *      The recording is mapped once and its keyframes are split into one
+ *      run per thread. Each thread decodes its run with a decoder of its
+ *      own, starting one keyframe early so that its first sample has one
+ *      before it to take rates against, and keeps a metric for every
+ *      number the rules name: the cpu rates of the total line, the busy
+ *      percentage of each cpu, the context switch rate and the running and
+ *      blocked processes, the memory percentages and meminfo fields, and
+ *      the rates of each interface. Which metric each number goes to is
+ *      worked out again only on a keyframe whose layout differs.
+ *
+ *      A metric holds a fixed size histogram and a few sums, so memory
+ *      does not grow with the length of the recording, and the metrics of
+ *      the threads are merged in file order once they are done: the
+ *      histograms bucket by bucket, the window each run started and ended
+ *      in with the one next to it, and the runs above the threshold at the
+ *      ends of each thread's samples with those of its neighbours. The
+ *      merged result is the one a single thread would have found, sums
+ *      added in a different order aside.
+ */
+#include <math.h>
+#include <stdarg.h>
+#include <fnmatch.h>
+#include <pthread.h>
+
+#include "sys_mon.h"
+#include "record.h"
+#include "rules.h"
+#include "analyze.h"
+
+#define ANALYZE_MIN_SLOTS           64
+
+struct analysis analysis;
+
+/*
+* A thread's run of the recording, its metrics and the plan of where the
+* numbers of the current layout go. plan has, in the order analyze_sample
+* produces them, the metric of each number or -1 when --metrics leaves it
+* out.
+*/
+struct analysis_worker
+{
+    pthread_t thread;
+    struct replay replay;
+    size_t start_offset;                //Frames before it only warm up the previous sample
+    uint64_t window_ns;
+    struct analysis_table table;
+
+    int *plan;
+    int plan_capacity;
+    int cpu_value[NUM_CPU_FIELDS];      //Where each field of cpu 0 sits among the values
+    int scalar_value;
+    int mem_value;
+    int network_value[NUM_NETWORK_FIELDS];
+
+    int num_cpus;                       //The layout the plan is for
+    int num_devices;
+    unsigned int mem_present;
+    uint8_t *online;
+    char (*faces)[MAX_NETWORK_FACE_LENGTH];
+
+    uint64_t *previous;                 //The sample before, flattened
+    int previous_capacity;
+    int have_previous;
+    uint64_t previous_ns;
+
+    uint64_t samples;
+    uint64_t first_ns;
+    uint64_t last_ns;
+};
+
+/*
+* The net/dev field each network_rate_field is the rate of.
+*/
+const int analysis_network_fields[NUM_NETWORK_RATES] =
+{
+    NET_R_BYTES, NET_R_PACKETS, NET_R_DROP, NET_T_BYTES, NET_T_PACKETS, NET_T_DROP
+};
+
+/*
+* @brief Reads a --threshold of GLOB=VALUE, such as 'cpu*.busy_pct=95'.
+*/
+void add_analysis_threshold(const char *text)
+{
+    const char *equals = strrchr(text, '=');
+    char *end = NULL;
+    double value = equals != NULL ? strtod(equals + 1, &end) : 0;
+    if(equals == NULL || equals == text || end == equals + 1 || *end != '\0') fatal_error("--threshold takes GLOB=VALUE, not ", text);
+    if(analysis.num_thresholds == ANALYZE_MAX_THRESHOLDS) fatal_error("too many thresholds at ", text);
+
+    size_t length = (size_t)(equals - text);
+    char *glob = (char*)counted_malloc(length + 1);
+    memcpy(glob, text, length);
+    glob[length] = '\0';
+    analysis.thresholds[analysis.num_thresholds].glob = glob;
+    analysis.thresholds[analysis.num_thresholds].value = value;
+    analysis.num_thresholds++;
+}
+
+static inline uint32_t analysis_slot(const char *name, uint32_t slot_mask)
+{
+    uint32_t hash = 2166136261u;
+    for(; *name != '\0'; name++) hash = (hash ^ (uint8_t)*name) * 16777619u;
+    return hash & slot_mask;
+}
+
+/*
+* @returns the metric called name in table, or NULL
+*/
+struct analysis_metric *find_analysis_metric(const struct analysis_table *table, const char *name)
+{
+    if(table->slots == NULL) return NULL;
+    for(uint32_t slot = analysis_slot(name, table->slot_mask); table->slots[slot] >= 0; slot = (slot + 1) & table->slot_mask)
+    {
+        struct analysis_metric *metric = &table->metrics[table->slots[slot]];
+        if(strcmp(metric->name, name) == 0) return metric;
+    }
+    return NULL;
+}
+
+/*
+* @returns the index of the metric called name in table, added with the
+*          threshold of the first --threshold matching it if it is new
+*/
+int add_analysis_metric(struct analysis_table *table, const char *name)
+{
+    struct analysis_metric *found = find_analysis_metric(table, name);
+    if(found != NULL) return (int)(found - table->metrics);
+
+    if((uint32_t)(table->num_metrics + 1) * 2 > (table->slots != NULL ? table->slot_mask + 1 : 0))
+    {
+        uint32_t num_slots = table->slots != NULL ? (table->slot_mask + 1) * 2 : ANALYZE_MIN_SLOTS;
+        free(table->slots);
+        table->slots = (int*)counted_malloc(num_slots * sizeof(int));
+        memset(table->slots, 0xff, num_slots * sizeof(int));
+        table->slot_mask = num_slots - 1;
+        for(int i = 0; i < table->num_metrics; i++)
+        {
+            uint32_t slot = analysis_slot(table->metrics[i].name, table->slot_mask);
+            while(table->slots[slot] >= 0) slot = (slot + 1) & table->slot_mask;
+            table->slots[slot] = i;
+        }
+    }
+    if(table->num_metrics == table->capacity)
+    {
+        table->capacity = table->capacity ? table->capacity * 2 : 64;
+        table->metrics = counted_realloc(table->metrics, (size_t)table->capacity * sizeof(struct analysis_metric));
+    }
+
+    int index = table->num_metrics++;
+    struct analysis_metric *metric = &table->metrics[index];
+    memset(metric, 0, sizeof(*metric));
+    snprintf(metric->name, sizeof(metric->name), "%s", name);
+    metric->threshold = NAN;
+    for(int i = 0; i < analysis.num_thresholds; i++)
+    {
+        if(fnmatch(analysis.thresholds[i].glob, name, 0) == 0)
+        {
+            metric->threshold = analysis.thresholds[i].value;
+            break;
+        }
+    }
+
+    uint32_t slot = analysis_slot(metric->name, table->slot_mask);
+    while(table->slots[slot] >= 0) slot = (slot + 1) & table->slot_mask;
+    table->slots[slot] = index;
+    return index;
+}
+
+void free_analysis_table(struct analysis_table *table)
+{
+    free(table->metrics);
+    free(table->slots);
+    memset(table, 0, sizeof(*table));
+}
+
+/*
+* @brief Frees the merged metrics and the --threshold globs.
+*/
+void free_analysis()
+{
+    free_analysis_table(&analysis.table);
+    for(int i = 0; i < analysis.num_thresholds; i++) free((char*)analysis.thresholds[i].glob);
+    analysis.num_thresholds = 0;
+}
+
+static inline int analysis_bucket(double value)
+{
+    if(!(value < 1e16)) return NUM_ANALYZE_BUCKETS - 1;
+    uint64_t hundredths = (uint64_t)(value * ANALYZE_SCALE + 0.5);
+    if(hundredths < ANALYZE_SUB_BUCKETS) return (int)hundredths;
+    int exponent = 63 - __builtin_clzll(hundredths);
+    if(exponent > ANALYZE_MAX_EXPONENT) return NUM_ANALYZE_BUCKETS - 1;
+    int sub = (int)(hundredths >> (exponent - ANALYZE_SUB_BUCKET_BITS)) & (ANALYZE_SUB_BUCKETS - 1);
+    return (exponent - ANALYZE_SUB_BUCKET_BITS + 1) * ANALYZE_SUB_BUCKETS + sub;
+}
+
+/*
+* @brief Finds the value below which fraction of a metric's samples fall.
+*
+* @returns the middle of the bucket the percentile is in, kept between the
+*          minimum and the maximum seen, or 0 if the metric has no samples
+*/
+double analysis_percentile(const struct analysis_metric *metric, double fraction)
+{
+    if(metric->count == 0) return 0;
+    uint64_t rank = (uint64_t)(fraction * (double)metric->count);
+    if(rank >= metric->count) rank = metric->count - 1;
+
+    uint64_t seen = 0;
+    for(int bucket = 0; bucket < NUM_ANALYZE_BUCKETS; bucket++)
+    {
+        seen += metric->buckets[bucket];
+        if(seen <= rank) continue;
+
+        double middle = bucket;
+        if(bucket >= ANALYZE_SUB_BUCKETS)
+        {
+            int exponent = bucket / ANALYZE_SUB_BUCKETS + ANALYZE_SUB_BUCKET_BITS - 1;
+            uint64_t width = 1ull << (exponent - ANALYZE_SUB_BUCKET_BITS);
+            uint64_t low = (uint64_t)(ANALYZE_SUB_BUCKETS + bucket % ANALYZE_SUB_BUCKETS) * width;
+            middle = (double)low + (double)(width - 1) / 2;
+        }
+        double value = middle / ANALYZE_SCALE;
+        return value < metric->min ? metric->min : value > metric->max ? metric->max : value;
+    }
+    return metric->max;
+}
+
+/*
+* @brief Makes window the peak if its mean is higher, or the same and it
+*        came first.
+*/
+static inline void consider_peak(struct analysis_window *peak, const struct analysis_window *window)
+{
+    if(window->count == 0) return;
+    if(peak->count > 0)
+    {
+        double mean = window->sum / (double)window->count;
+        double peak_mean = peak->sum / (double)peak->count;
+        if(mean < peak_mean || (mean == peak_mean && window->start_ns > peak->start_ns)) return;
+    }
+    *peak = *window;
+}
+
+/*
+* @brief Adds one sample of a metric, taken at time_ns, interval_ns after
+*        the one before.
+*/
+static inline void add_analysis_sample(struct analysis_metric *metric, double value, uint64_t time_ns, uint64_t interval_ns,
+                                       uint64_t window_ns)
+{
+    if(!(value >= 0)) value = 0;
+    metric->buckets[analysis_bucket(value)]++;
+    if(metric->count == 0 || value < metric->min) metric->min = value;
+    if(metric->count == 0 || value > metric->max)
+    {
+        metric->max = value;
+        metric->max_ns = time_ns;
+    }
+    metric->count++;
+    metric->sum += value;
+    metric->covered_ns += interval_ns;
+
+    uint64_t window_start = time_ns - time_ns % window_ns;
+    if(metric->last.count > 0 && metric->last.start_ns != window_start)
+    {
+        if(metric->first.count == 0) metric->first = metric->last;
+        else consider_peak(&metric->peak, &metric->last);
+        metric->last.count = 0;
+        metric->last.sum = 0;
+    }
+    metric->last.start_ns = window_start;
+    metric->last.count++;
+    metric->last.sum += value;
+
+    if(isnan(metric->threshold)) return;
+    if(value > metric->threshold)
+    {
+        metric->above_ns += interval_ns;
+        metric->above_samples++;
+        metric->run_above_ns += interval_ns;
+        if(!metric->below_seen) metric->leading_above_ns += interval_ns;
+        if(metric->run_above_ns > metric->longest_above_ns) metric->longest_above_ns = metric->run_above_ns;
+    }
+    else
+    {
+        metric->run_above_ns = 0;
+        metric->below_seen = 1;
+    }
+}
+
+/*
+* @brief Makes window the last window of a merged metric, first closing
+*        the one it had unless they are the same window.
+*/
+static inline void follow_window(struct analysis_metric *into, const struct analysis_window *window)
+{
+    if(window->count == 0) return;
+    if(into->last.count > 0 && into->last.start_ns == window->start_ns)
+    {
+        into->last.count += window->count;
+        into->last.sum += window->sum;
+        return;
+    }
+    consider_peak(&into->peak, &into->last);
+    into->last = *window;
+}
+
+/*
+* @brief Merges the metric of the run of samples that comes after the
+*        ones into has.
+*/
+void merge_analysis_metric(struct analysis_metric *into, const struct analysis_metric *from)
+{
+    if(from->count == 0) return;
+    for(int bucket = 0; bucket < NUM_ANALYZE_BUCKETS; bucket++) into->buckets[bucket] += from->buckets[bucket];
+    if(into->count == 0 || from->min < into->min) into->min = from->min;
+    if(into->count == 0 || from->max > into->max || (from->max == into->max && from->max_ns < into->max_ns))
+    {
+        into->max = from->max;
+        into->max_ns = from->max_ns;
+    }
+    into->count += from->count;
+    into->sum += from->sum;
+    into->covered_ns += from->covered_ns;
+
+    //The windows of from come after every one of into
+    follow_window(into, &from->first);
+    consider_peak(&into->peak, &from->peak);
+    follow_window(into, &from->last);
+
+    into->above_ns += from->above_ns;
+    into->above_samples += from->above_samples;
+    if(into->run_above_ns + from->leading_above_ns > into->longest_above_ns) into->longest_above_ns = into->run_above_ns + from->leading_above_ns;
+    if(from->longest_above_ns > into->longest_above_ns) into->longest_above_ns = from->longest_above_ns;
+    if(!into->below_seen) into->leading_above_ns += from->leading_above_ns;
+    into->run_above_ns = from->below_seen ? from->run_above_ns : into->run_above_ns + from->run_above_ns;
+    into->below_seen |= from->below_seen;
+}
+
+/*
+* @brief Adds the metric called by format, -1 if --metrics leaves it out.
+*/
+int plan_metric(struct analysis_worker *worker, const char *format, ...)
+{
+    char name[ANALYZE_NAME_LENGTH];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(name, sizeof(name), format, arguments);
+    va_end(arguments);
+    if(analysis.metrics_glob != NULL && fnmatch(analysis.metrics_glob, name, 0) != 0) return -1;
+    return add_analysis_metric(&worker->table, name);
+}
+
+/*
+* @returns 1 if the codec's layout is the one the worker's plan is for
+*/
+int same_layout(const struct analysis_worker *worker, const struct record_codec *codec)
+{
+    if(worker->plan == NULL || codec->num_cpus != worker->num_cpus || codec->num_devices != worker->num_devices) return 0;
+    if(codec->mem_present != worker->mem_present) return 0;
+    if(memcmp(codec->online, worker->online, (size_t)codec->num_cpus) != 0) return 0;
+    return memcmp(codec->faces, worker->faces, (size_t)codec->num_devices * MAX_NETWORK_FACE_LENGTH) == 0;
+}
+
+/*
+* @brief Works out which metric each number of the codec's layout goes to,
+*        in the order analyze_sample produces them, and keeps the layout.
+*/
+void plan_layout(struct analysis_worker *worker, const struct record_codec *codec)
+{
+    int num_cpus = codec->num_cpus;
+    int num_devices = codec->num_devices;
+    int length = NUM_CPU_RATES + num_cpus + 3 + NUM_RULE_MEM_PCTS + NUM_MEM_FIELDS + num_devices * NUM_NETWORK_RATES;
+    if(length > worker->plan_capacity)
+    {
+        worker->plan = (int*)counted_realloc(worker->plan, (size_t)length * sizeof(int));
+        worker->plan_capacity = length;
+    }
+    worker->online = (uint8_t*)counted_realloc(worker->online, (size_t)num_cpus + 1);
+    worker->faces = counted_realloc(worker->faces, ((size_t)num_devices + 1) * MAX_NETWORK_FACE_LENGTH);
+    memcpy(worker->online, codec->online, (size_t)num_cpus);
+    memcpy(worker->faces, codec->faces, (size_t)num_devices * MAX_NETWORK_FACE_LENGTH);
+    worker->num_cpus = num_cpus;
+    worker->num_devices = num_devices;
+    worker->mem_present = codec->mem_present;
+
+    for(int field = 0; field < NUM_CPU_FIELDS; field++) worker->cpu_value[field] = record_cpu_value(codec, field, 0);
+    worker->scalar_value = record_scalar_value(codec, 0);
+    worker->mem_value = record_mem_value(codec, 0);
+    for(int field = 0; field < NUM_NETWORK_FIELDS; field++) worker->network_value[field] = record_network_value(codec, field, 0);
+
+    int *plan = worker->plan;
+    for(int rate = 0; rate < NUM_CPU_RATES; rate++) *plan++ = plan_metric(worker, "cpu.%s", rule_cpu_rate_names[rate]);
+    for(int cpu = 0; cpu < num_cpus; cpu++) *plan++ = plan_metric(worker, "cpu%d.%s", cpu, rule_cpu_rate_names[CPU_RATE_BUSY]);
+    *plan++ = plan_metric(worker, "cpu.%s", rule_cpu_counter_names[RULE_CPU_CONTEXT_SWITCHES]);
+    *plan++ = plan_metric(worker, "cpu.%s", rule_cpu_counter_names[RULE_CPU_RUNNING]);
+    *plan++ = plan_metric(worker, "cpu.%s", rule_cpu_counter_names[RULE_CPU_BLOCKED]);
+
+    unsigned int needed = (1u << MEM_TOTAL) | (1u << MEM_AVAILABLE);
+    for(int pct = 0; pct < NUM_RULE_MEM_PCTS; pct++)
+    {
+        *plan++ = (codec->mem_present & needed) == needed ? plan_metric(worker, "mem.%s", rule_mem_pct_names[pct]) : -1;
+    }
+    for(int field = 0; field < NUM_MEM_FIELDS; field++)
+    {
+        //mem_field_keys end with the colon of the meminfo line
+        const char *key = mem_field_keys[field];
+        *plan++ = codec->mem_present & (1u << field) ? plan_metric(worker, "mem.%.*s", (int)strlen(key) - 1, key) : -1;
+    }
+    for(int i = 0; i < num_devices; i++)
+    {
+        for(int rate = 0; rate < NUM_NETWORK_RATES; rate++)
+        {
+            *plan++ = plan_metric(worker, "net.%s.%s", codec->faces[i], rule_network_rate_names[rate]);
+        }
+    }
+}
+
+static inline void add_planned_sample(struct analysis_worker *worker, int metric, double value, uint64_t time_ns, uint64_t interval_ns)
+{
+    if(metric >= 0) add_analysis_sample(&worker->table.metrics[metric], value, time_ns, interval_ns, worker->window_ns);
+}
+
+/*
+* @brief Adds every metric of the sample in the codec, taken against the
+*        previous one.
+*/
+void analyze_sample(struct analysis_worker *worker, const struct record_codec *codec)
+{
+    const uint64_t *value = codec->value;
+    const uint64_t *previous = worker->previous;
+    const int *plan = worker->plan;
+    int num_cpus = codec->num_cpus;
+    uint64_t time_ns = codec->time_ns;
+    uint64_t interval_ns = time_ns - worker->previous_ns;
+    double seconds = (double)interval_ns / 1e9;
+
+    uint64_t current_line[NUM_CPU_FIELDS];
+    uint64_t previous_line[NUM_CPU_FIELDS];
+    float pct[NUM_CPU_RATES];
+    for(int field = 0; field < NUM_CPU_FIELDS; field++)
+    {
+        current_line[field] = value[worker->cpu_value[field] + num_cpus];
+        previous_line[field] = previous[worker->cpu_value[field] + num_cpus];
+    }
+    cpu_line_rates(current_line, previous_line, pct);
+    for(int rate = 0; rate < NUM_CPU_RATES; rate++) add_planned_sample(worker, *plan++, pct[rate], time_ns, interval_ns);
+
+    for(int cpu = 0; cpu < num_cpus; cpu++)
+    {
+        int metric = *plan++;
+        if(metric < 0 || !codec->online[cpu]) continue;
+        for(int field = 0; field < NUM_CPU_FIELDS; field++)
+        {
+            current_line[field] = value[worker->cpu_value[field] + cpu];
+            previous_line[field] = previous[worker->cpu_value[field] + cpu];
+        }
+        cpu_line_rates(current_line, previous_line, pct);
+        add_planned_sample(worker, metric, pct[CPU_RATE_BUSY], time_ns, interval_ns);
+    }
+
+    const uint64_t *scalar = value + worker->scalar_value;
+    uint64_t switches = jiffies_delta(scalar[RECORD_CONTEXT_SWITCHES], previous[worker->scalar_value + RECORD_CONTEXT_SWITCHES]);
+    add_planned_sample(worker, *plan++, (double)switches / seconds, time_ns, interval_ns);
+    add_planned_sample(worker, *plan++, (double)scalar[RECORD_RUNNING], time_ns, interval_ns);
+    add_planned_sample(worker, *plan++, (double)scalar[RECORD_BLOCKED], time_ns, interval_ns);
+
+    const uint64_t *memory = value + worker->mem_value;
+    double total = memory[MEM_TOTAL] > 0 ? (double)memory[MEM_TOTAL] : 1;
+    double available_pct = 100.0 * (double)memory[MEM_AVAILABLE] / total;
+    add_planned_sample(worker, *plan++, 100.0 - available_pct, time_ns, interval_ns);
+    add_planned_sample(worker, *plan++, available_pct, time_ns, interval_ns);
+    for(int field = 0; field < NUM_MEM_FIELDS; field++) add_planned_sample(worker, *plan++, (double)memory[field], time_ns, interval_ns);
+
+    for(int i = 0; i < codec->num_devices; i++)
+    {
+        for(int rate = 0; rate < NUM_NETWORK_RATES; rate++)
+        {
+            int slot = worker->network_value[analysis_network_fields[rate]] + i;
+            add_planned_sample(worker, *plan++, (double)counter_delta(value[slot], previous[slot]) / seconds, time_ns, interval_ns);
+        }
+    }
+}
+
+/*
+* @brief Analyses a worker's run of the recording.
+*/
+void *analyze_run(void *argument)
+{
+    struct analysis_worker *worker = (struct analysis_worker*)argument;
+    struct replay *replay = &worker->replay;
+    struct record_codec *codec = &replay->codec;
+    for(;;)
+    {
+        size_t frame_offset = replay->offset;
+        if(!replay_next_values(replay)) break;
+        if(replay->keyframe && !same_layout(worker, codec))
+        {
+            plan_layout(worker, codec);
+            worker->have_previous = 0;
+        }
+
+        //A sample stamped before the one it follows has no rates
+        if(worker->have_previous && frame_offset >= worker->start_offset && codec->time_ns > worker->previous_ns)
+        {
+            analyze_sample(worker, codec);
+            if(worker->samples == 0) worker->first_ns = codec->time_ns;
+            worker->last_ns = codec->time_ns;
+            worker->samples++;
+        }
+
+        if(codec->num_values > worker->previous_capacity)
+        {
+            worker->previous = (uint64_t*)counted_realloc(worker->previous, (size_t)codec->num_values * sizeof(uint64_t));
+            worker->previous_capacity = codec->num_values;
+        }
+        memcpy(worker->previous, codec->value, (size_t)codec->num_values * sizeof(uint64_t));
+        worker->previous_ns = codec->time_ns;
+        worker->have_previous = 1;
+    }
+
+    //The window the run ended in is the first as well when there was one
+    for(int i = 0; i < worker->table.num_metrics; i++)
+    {
+        struct analysis_metric *metric = &worker->table.metrics[i];
+        if(metric->first.count > 0) continue;
+        metric->first = metric->last;
+        memset(&metric->last, 0, sizeof(metric->last));
+    }
+    return NULL;
+}
+
+/*
+* @brief Analyses the recording at path on up to num_threads threads, each
+*        taking a run of its keyframes, and merges what they found into
+*        analysis.table, with the peak windows window_ns long.
+*/
+void analyze_recording(const char *path, int num_threads, uint64_t window_ns)
+{
+    uint64_t start = monotonic_ns();
+    if(analysis.num_thresholds == 0)
+    {
+        add_analysis_threshold(DEFAULT_ANALYZE_THRESHOLD);
+        add_analysis_threshold(DEFAULT_ANALYZE_MEM_THRESHOLD);
+    }
+    free_analysis_table(&analysis.table);
+    analysis.window_ns = window_ns;
+    analysis.samples = 0;
+    analysis.first_ns = 0;
+    analysis.last_ns = 0;
+    analysis.memory = 0;
+
+    struct replay replay;
+    open_replay(&replay, path);
+    analysis.rebuilt_index = replay.index_copy != NULL;
+    if(num_threads > ANALYZE_MAX_THREADS) num_threads = ANALYZE_MAX_THREADS;
+    if((size_t)num_threads > replay.num_keyframes) num_threads = replay.num_keyframes > 0 ? (int)replay.num_keyframes : 1;
+    analysis.num_threads = num_threads;
+
+    struct analysis_worker *workers = (struct analysis_worker*)counted_malloc((size_t)num_threads * sizeof(struct analysis_worker));
+    memset(workers, 0, (size_t)num_threads * sizeof(struct analysis_worker));
+    for(int i = 0; i < num_threads; i++)
+    {
+        struct analysis_worker *worker = &workers[i];
+        size_t first_keyframe = replay.num_keyframes * (size_t)i / (size_t)num_threads;
+        size_t end_keyframe = replay.num_keyframes * (size_t)(i + 1) / (size_t)num_threads;
+        share_replay(&worker->replay, &replay, first_keyframe > 0 ? first_keyframe - 1 : 0, end_keyframe);
+        worker->start_offset = first_keyframe < end_keyframe ? replay_keyframe_offset(&replay, first_keyframe) : 0;
+        worker->window_ns = window_ns;
+        if(i > 0 && pthread_create(&worker->thread, NULL, analyze_run, worker) != 0) fatal_error("failed to start an analysis thread", "");
+    }
+    analyze_run(&workers[0]);
+
+    for(int i = 0; i < num_threads; i++)
+    {
+        struct analysis_worker *worker = &workers[i];
+        if(i > 0) pthread_join(worker->thread, NULL);
+        analysis.memory += (size_t)worker->table.capacity * sizeof(struct analysis_metric);
+        for(int m = 0; m < worker->table.num_metrics; m++)
+        {
+            const struct analysis_metric *metric = &worker->table.metrics[m];
+            if(metric->count == 0) continue;
+            int index = add_analysis_metric(&analysis.table, metric->name);
+            merge_analysis_metric(&analysis.table.metrics[index], metric);
+        }
+        if(worker->samples > 0)
+        {
+            if(analysis.samples == 0) analysis.first_ns = worker->first_ns;
+            analysis.last_ns = worker->last_ns;
+            analysis.samples += worker->samples;
+        }
+
+        close_replay(&worker->replay);
+        free_analysis_table(&worker->table);
+        free(worker->plan);
+        free(worker->online);
+        free(worker->faces);
+        free(worker->previous);
+    }
+    free(workers);
+    close_replay(&replay);
+
+    //The window the recording ended in is a candidate too
+    for(int i = 0; i < analysis.table.num_metrics; i++)
+    {
+        struct analysis_metric *metric = &analysis.table.metrics[i];
+        consider_peak(&metric->peak, &metric->last);
+    }
+    analysis.duration_ns = monotonic_ns() - start;
+}
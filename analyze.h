@@ -0,0 +1,123 @@
+/*
+ * File: analyze.h
+ * Description: Offline analysis of a recording: per metric percentiles from
+ *              mergeable log-linear histograms, the peak window and the time
+ *              spent above a threshold, in one pass split across threads.
+ */
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sys_mon.h"
+#include "record.h"
+
+#define ANALYZE_SUB_BUCKET_BITS     6
+#define ANALYZE_SUB_BUCKETS         (1 << ANALYZE_SUB_BUCKET_BITS)
+#define ANALYZE_MAX_EXPONENT        47  //Values of 2^48 hundredths (2.8e12) and more share the last bucket
+#define NUM_ANALYZE_BUCKETS         ((ANALYZE_MAX_EXPONENT - ANALYZE_SUB_BUCKET_BITS + 2) * ANALYZE_SUB_BUCKETS)
+#define ANALYZE_SCALE               100 //Values are bucketed in hundredths
+#define ANALYZE_MAX_THREADS         16
+#define ANALYZE_MAX_THRESHOLDS      16
+#define ANALYZE_NAME_LENGTH         48
+#define DEFAULT_ANALYZE_THRESHOLD   "*busy_pct=90"
+#define DEFAULT_ANALYZE_MEM_THRESHOLD "mem.used_pct=90"
+
+/*
+* A window of --window length, aligned to the epoch, of one metric.
+*/
+struct analysis_window
+{
+    uint64_t start_ns;
+    uint64_t count;                     //0 when there is no window
+    double sum;
+};
+
+/*
+* A --threshold: the metrics whose names match glob are measured against
+* value.
+*/
+struct analysis_threshold
+{
+    const char *glob;
+    double value;
+};
+
+/*
+* Everything known about one metric over a run of samples, all of which
+* two runs can be merged from. The values are counted in a log-linear
+* histogram of ANALYZE_SUB_BUCKETS buckets per power of two, so a
+* percentile is within 1% of the true value. The windows and runs above
+* the threshold cut by the ends of the run are kept apart until it is
+* merged with the runs next to it.
+*/
+struct analysis_metric
+{
+    char name[ANALYZE_NAME_LENGTH];
+    double threshold;                   //NAN when no --threshold matches the name
+    uint64_t count;
+    double sum;
+    double min;
+    double max;
+    uint64_t max_ns;                    //When the maximum was first seen
+    uint64_t covered_ns;                //Each sample stands for the time since the one before
+
+    struct analysis_window first;       //The window the run started in
+    struct analysis_window last;        //The window being filled
+    struct analysis_window peak;        //The one with the highest mean between them
+
+    uint64_t above_ns;
+    uint64_t above_samples;
+    uint64_t leading_above_ns;          //Above the threshold since the run started
+    uint64_t run_above_ns;              //Above the threshold since the last sample that was not
+    uint64_t longest_above_ns;
+    int below_seen;
+
+    uint32_t buckets[NUM_ANALYZE_BUCKETS];
+};
+
+/*
+* Metrics in the order they were first seen, found by name through an open
+* addressing table.
+*/
+struct analysis_table
+{
+    struct analysis_metric *metrics;
+    int num_metrics;
+    int capacity;
+    int *slots;                         //-1 for an empty slot
+    uint32_t slot_mask;
+};
+
+/*
+* What analyze_recording is asked for and what it found. The metrics of
+* every thread are merged into table.
+*/
+struct analysis
+{
+    const char *metrics_glob;           //--metrics, NULL for every metric
+    struct analysis_threshold thresholds[ANALYZE_MAX_THRESHOLDS];
+    int num_thresholds;
+    uint64_t window_ns;
+
+    struct analysis_table table;
+    uint64_t samples;
+    uint64_t first_ns;                  //Times of the first and last samples analysed
+    uint64_t last_ns;
+    int num_threads;                    //Threads the recording was split across
+    int rebuilt_index;                  //The recording was not closed
+    uint64_t duration_ns;
+    size_t memory;                      //Bytes of metrics the threads held at once
+};
+
+extern struct analysis analysis;
+
+void add_analysis_threshold(const char *text);
+void analyze_recording(const char *path, int num_threads, uint64_t window_ns);
+double analysis_percentile(const struct analysis_metric *metric, double fraction);
+struct analysis_metric *find_analysis_metric(const struct analysis_table *table, const char *name);
+void free_analysis_table(struct analysis_table *table);
+void free_analysis();
+
+#endif
@@ -0,0 +1,2721 @@
+/*
+ * Program Name: sys_mon_bench
+ * Description: Benchmarks the cpu, memory, network and disk collectors against
+ *              generated proc fixtures, or against any directory laid out
+ *              like /proc, and reports what one sample costs. The network
+ *              backends are compared on real interfaces in a network
+ *              namespace of the bench's own, when it may make one.
+ *
+ * Compilation: ./build.sh
+ * Usage: ./sys_mon_bench [--proc-root DIR] [--fixtures DIR] [--samples N]
+ *                        [--processes N] [--threads N]
+ *
+ * Notes:
+ *      Without --proc-root the fixtures are generated into a temporary
+ *      directory and removed afterwards, unless --fixtures names a
+ *      directory to keep them in.
+ */
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <linux/sched.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/veth.h>
+
+#include "sys_mon.h"
+#include "scan.h"
+#include "record.h"
+#include "proctop.h"
+#include "disk.h"
+#include "netlink.h"
+#include "interrupts.h"
+#include "exporter.h"
+#include "shm.h"
+#include "scheduler.h"
+#include "pipeline.h"
+#include "meminfo.h"
+#include "pressure.h"
+#include "rules.h"
+#include "cgroup.h"
+#include "analyze.h"
+#include "screen.h"
+#include "history.h"
+
+#define DEFAULT_SAMPLES             200
+#define FIXTURE_NUM_IRQS            4096
+#define FIXTURE_NUM_SOFTIRQS        10
+#define RECORDING_CPUS              64
+#define RECORDING_INTERFACES        4
+#define DEFAULT_PROCESSES           50000
+#define PROC_TOP_REFRESHES          5
+#define PROC_TOP_GOAL_NS            1000ull //A refresh of 50000 processes in 50 ms
+#define FIXTURE_DISKS               256
+#define FIXTURE_MOUNTS              500
+#define LINK_REQUEST_SIZE           256
+#define FIXTURE_IRQ_CPUS            256
+#define FIXTURE_IRQ_LINES           4000
+#define FIXTURE_OFFLINE_CPU         3 //Left out of /proc/interrupts like an offline cpu
+#define EXPORT_BENCH_CPUS           256
+#define EXPORT_BENCH_INTERFACES     1000
+#define EXPORT_BENCH_CLIENTS        256
+#define EXPORT_BENCH_ROUNDS         8
+#define SHM_BENCH_READS             100000
+#define SHM_BENCH_RACE_NS           200000000ull //How long the reader races a writer thread
+#define PIPELINE_BENCH_INTERVAL_NS  5000000ull //Of the collector threads
+#define PIPELINE_BENCH_NS           1000000000ull
+#define PIPELINE_BENCH_STALL_US     40000 //A slow frame, every PIPELINE_BENCH_STALL_EVERY drains
+#define PIPELINE_BENCH_STALL_EVERY  20
+#define CGROUP_BENCH_PARENTS        40
+#define CGROUP_BENCH_CHILDREN       25
+#define ANALYZE_BENCH_CPUS          256
+#define ANALYZE_BENCH_INTERFACES    4   //And one more from two thirds of the way
+#define ANALYZE_BENCH_SAMPLES       36000 //Ten hours of 1 s samples
+#define ANALYZE_BENCH_RUN           3000 //Samples above the threshold in a row, across the middle
+#define ANALYZE_BENCH_WINDOW_NS     60000000000ull
+#define FIXTURE_NUMA_NODES          3
+#define BENCH_RULES                 500
+#define BENCH_RULE_LENGTH           128
+#define SCHEDULER_BENCH_NS          500000000ull
+#define SCHEDULER_BENCH_FAST_NS     20000000ull
+#define SCHEDULER_BENCH_SLOW_NS     50000000ull
+#define SCHEDULER_BENCH_OVERRUN     8   //Tick of the fast job that takes SCHEDULER_BENCH_OVERRUN_NS
+#define SCHEDULER_BENCH_OVERRUN_NS  70000000ull //Three and a half fast intervals
+#define SCHEDULER_BENCH_MAX_TICKS   64
+#define HISTORY_BENCH_SAMPLES       1000 //1 s apart, with a HISTORY_BENCH_GAP_NS gap at HISTORY_BENCH_GAP_AT
+#define HISTORY_BENCH_METRICS       4
+#define HISTORY_BENCH_GAP_AT        600
+#define HISTORY_BENCH_GAP_NS        30000000000ull
+#define SCREEN_BENCH_ROWS           64
+#define SCREEN_BENCH_CHANGED        4   //Rows whose numbers move between the two frames
+
+const int backend_interface_counts[] = {10, 1000, 5000};
+const uint32_t history_bench_capacities[] = {400, 120}; //Room for the 5m window and wrapping, and less than it
+
+/*
+* Size of a generated machine.
+*/
+struct fixture_set
+{
+    const char *name;
+    int num_cpus;
+    int num_interfaces;
+    int edge_cases;                     //20 digit counters, names glued to them, no newline at the end
+};
+
+const struct fixture_set fixture_sets[] =
+{
+    {"small", 8, 4, 0},
+    {"host-128", 128, 500, 0},
+    {"large", 1024, 5000, 0},
+    {"edges", 4, 6, 1},
+};
+
+/*
+* What the last write_stat_fixture and write_network_fixture wrote, for
+* the parsed snapshots to be compared with field by field.
+*/
+struct fixture_values
+{
+    int num_cpus;
+    uint64_t *cpu_time;                 //num_cpus + 1 rows of NUM_CPU_FIELDS, the total first
+    uint64_t num_interrupts;
+    uint64_t num_context_switches;
+    uint64_t boot_time;
+    uint64_t num_processes_created;
+    uint64_t processes_running;
+    uint64_t processes_blocked;
+    uint64_t num_softirqs;
+
+    int num_interfaces;
+    char (*faces)[MAX_NETWORK_FACE_LENGTH];
+    uint64_t *counters;                 //NUM_NETWORK_FIELDS per interface
+};
+
+struct fixture_values written_fixture;
+int fixture_edge_cases = 0;             //The writers produce the edge_cases of a fixture_set
+
+const char *fixture_meminfo_keys[] =
+{
+    "MemTotal", "MemFree", "MemAvailable", "Buffers", "Cached", "SwapCached",
+    "Active", "Inactive", "Active(anon)", "Inactive(anon)", "Active(file)",
+    "Inactive(file)", "Unevictable", "Mlocked", "SwapTotal", "SwapFree",
+    "Zswap", "Zswapped", "Dirty", "Writeback", "AnonPages", "Mapped", "Shmem",
+    "KReclaimable", "Slab", "SReclaimable", "SUnreclaim", "KernelStack",
+    "PageTables", "SecPageTables", "NFS_Unstable", "Bounce", "WritebackTmp",
+    "CommitLimit", "Committed_AS", "VmallocTotal", "VmallocUsed", "VmallocChunk",
+    "Percpu", "HardwareCorrupted", "AnonHugePages", "ShmemHugePages",
+    "ShmemPmdMapped", "FileHugePages", "FilePmdMapped", "CmaTotal", "CmaFree",
+    "Unaccepted", "HugePages_Total", "HugePages_Free", "HugePages_Rsvd",
+    "HugePages_Surp", "Hugepagesize", "Hugetlb", "DirectMap4k", "DirectMap2M",
+    "DirectMap1G"
+};
+
+uint64_t fixture_random_state = 88172645463325252ull;
+
+/*
+* @brief Deterministic xorshift so every run generates the same fixtures.
+*/
+uint64_t fixture_random(uint64_t limit)
+{
+    fixture_random_state ^= fixture_random_state << 13;
+    fixture_random_state ^= fixture_random_state >> 7;
+    fixture_random_state ^= fixture_random_state << 17;
+    return fixture_random_state % limit;
+}
+
+/*
+* @brief A random counter of the full 20 digits, or one below limit when
+*        the fixture has no edge cases.
+*/
+uint64_t fixture_counter(uint64_t limit)
+{
+    if(!fixture_edge_cases) return fixture_random(limit);
+    return 10000000000000000000ull + fixture_random(UINT64_MAX - 10000000000000000000ull) + 1;
+}
+
+/*
+* @brief Opens a fixture file for writing, exiting if it cannot be created.
+*/
+FILE *open_fixture(const char *dir, const char *name)
+{
+    char path[PROC_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    if(file == NULL) fatal_error("failed to create fixture ", path);
+    return file;
+}
+
+/*
+* @brief Writes a stat file the way the kernel formats it, intr and softirq
+*        lines included as they make up most of its size on big machines.
+*        The cpu lines come from cpu_time, num_cpus + 1 rows of
+*        NUM_CPU_FIELDS starting with the total, followed by ctxt and
+*        processes, or are random if it is NULL. What was written is kept
+*        in written_fixture.
+*/
+void write_stat_fixture(const char *dir, int num_cpus, const uint64_t *cpu_time)
+{
+    FILE *file = open_fixture(dir, CPU_STATS_FILE);
+    struct fixture_values *written = &written_fixture;
+    written->num_cpus = num_cpus;
+    written->cpu_time = realloc(written->cpu_time, (size_t)(num_cpus + 1) * NUM_CPU_FIELDS * sizeof(uint64_t));
+    if(written->cpu_time == NULL) fatal_error("out of memory for the values of ", CPU_STATS_FILE);
+
+    uint64_t *time = written->cpu_time;
+    for(int cpu = -1; cpu < num_cpus; cpu++)
+    {
+        if(cpu < 0) fprintf(file, "cpu ");
+        else fprintf(file, "cpu%d", cpu);
+        for(int field = 0; field < NUM_CPU_FIELDS; field++)
+        {
+            if(cpu_time != NULL) *time = *cpu_time++;
+            else if(fixture_edge_cases && time == written->cpu_time) *time = UINT64_MAX;
+            else *time = fixture_counter(cpu < 0 ? 100000000000ull : 1000000000ull);
+            fprintf(file, " %" PRIu64, *time++);
+        }
+        fprintf(file, "\n");
+    }
+
+    written->num_interrupts = fixture_counter(10000000000ull);
+    fprintf(file, "intr %" PRIu64, written->num_interrupts);
+    for(int irq = 0; irq < FIXTURE_NUM_IRQS; irq++) fprintf(file, " %" PRIu64, irq % 7 == 0 ? fixture_random(100000000ull) : 0);
+    written->num_context_switches = cpu_time != NULL ? *cpu_time++ : fixture_counter(100000000000ull);
+    written->boot_time = 1792180665;
+    written->num_processes_created = cpu_time != NULL ? *cpu_time++ : fixture_counter(10000000ull);
+    written->processes_running = fixture_random(256);
+    written->processes_blocked = fixture_random(16);
+    written->num_softirqs = fixture_counter(10000000000ull);
+    fprintf(file, "\nctxt %" PRIu64 "\n", written->num_context_switches);
+    fprintf(file, "btime %" PRIu64 "\n", written->boot_time);
+    fprintf(file, "processes %" PRIu64 "\n", written->num_processes_created);
+    fprintf(file, "procs_running %" PRIu64 "\n", written->processes_running);
+    fprintf(file, "procs_blocked %" PRIu64 "\n", written->processes_blocked);
+    fprintf(file, "softirq %" PRIu64, written->num_softirqs);
+    for(int softirq = 0; softirq < FIXTURE_NUM_SOFTIRQS; softirq++) fprintf(file, " %" PRIu64, fixture_counter(1000000000ull));
+    if(!fixture_edge_cases) fprintf(file, "\n"); //Otherwise the file ends inside the last number
+
+    fclose(file);
+}
+
+/*
+* @brief Writes a meminfo file with the keys of a current kernel.
+*/
+void write_meminfo_fixture(const char *dir)
+{
+    FILE *file = open_fixture(dir, MEM_INFO_FILE);
+
+    int num_keys = (int)(sizeof(fixture_meminfo_keys) / sizeof(fixture_meminfo_keys[0]));
+    for(int i = 0; i < num_keys; i++)
+    {
+        char key[64];
+        snprintf(key, sizeof(key), "%s:", fixture_meminfo_keys[i]);
+        if(strncmp(key, "HugePages_", 10) == 0) fprintf(file, "%-15s %8" PRIu64 "\n", key, fixture_random(4096));
+        else fprintf(file, "%-15s %8" PRIu64 " kB\n", key, fixture_random(1000000000ull));
+    }
+
+    fclose(file);
+}
+
+/*
+* @brief Writes a net/dev file with the kernel's column widths. Past the
+*        first two interfaces they are named like container veths. The
+*        counters come from counters, NUM_NETWORK_FIELDS per interface, or
+*        are random if it is NULL. What was written is kept in
+*        written_fixture.
+*/
+void write_network_fixture(const char *dir, int num_interfaces, const uint64_t *counters)
+{
+    char net_dir[PROC_PATH_LENGTH];
+    snprintf(net_dir, sizeof(net_dir), "%s/net", dir);
+    mkdir(net_dir, 0755);
+    struct fixture_values *written = &written_fixture;
+    written->num_interfaces = num_interfaces;
+    written->faces = realloc(written->faces, (size_t)num_interfaces * MAX_NETWORK_FACE_LENGTH);
+    written->counters = realloc(written->counters, (size_t)num_interfaces * NUM_NETWORK_FIELDS * sizeof(uint64_t));
+    if(num_interfaces > 0 && (written->faces == NULL || written->counters == NULL))
+    {
+        fatal_error("out of memory for the values of ", NETWORK_ACTIVITY_FILE);
+    }
+
+    FILE *file = open_fixture(dir, NETWORK_ACTIVITY_FILE);
+    fprintf(file, "Inter-|   Receive                                                |  Transmit\n");
+    fprintf(file, " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n");
+    for(int i = 0; i < num_interfaces; i++)
+    {
+        char *face = written->faces[i];
+        if(i == 0) snprintf(face, MAX_NETWORK_FACE_LENGTH, "lo");
+        else if(i == 1) snprintf(face, MAX_NETWORK_FACE_LENGTH, "eth0");
+        else if(fixture_edge_cases) snprintf(face, MAX_NETWORK_FACE_LENGTH, "veth%d", i - 2);
+        else snprintf(face, MAX_NETWORK_FACE_LENGTH, "veth%07d", i);
+
+        uint64_t *counter = written->counters + (size_t)i * NUM_NETWORK_FIELDS;
+        for(int field = 0; field < NUM_NETWORK_FIELDS; field++)
+        {
+            if(counters != NULL) counter[field] = *counters++;
+            else if(fixture_edge_cases && field == 0 && i % 2 == 0) counter[field] = fixture_random(1000); //As in veth0:123
+            else counter[field] = fixture_counter(field % 8 < 2 ? 10000000000000ull : 1000);
+        }
+
+        if(fixture_edge_cases)
+        {
+            //No padding, every name runs into its first counter
+            fprintf(file, "%s:%" PRIu64, face, counter[0]);
+            for(int field = 1; field < NUM_NETWORK_FIELDS; field++) fprintf(file, " %" PRIu64, counter[field]);
+            if(i + 1 < num_interfaces) fprintf(file, "\n");
+            continue;
+        }
+        fprintf(file, "%6s:%8" PRIu64 " %7" PRIu64 " %4" PRIu64 " %4" PRIu64 " %4" PRIu64 " %5" PRIu64 " %10" PRIu64 " %9" PRIu64
+                      " %8" PRIu64 " %7" PRIu64 " %4" PRIu64 " %4" PRIu64 " %4" PRIu64 " %5" PRIu64 " %7" PRIu64 " %10" PRIu64 "\n",
+                face, counter[0], counter[1], counter[2], counter[3], counter[4], counter[5], counter[6], counter[7],
+                counter[8], counter[9], counter[10], counter[11], counter[12], counter[13], counter[14], counter[15]);
+    }
+    fclose(file);
+}
+
+/*
+* @brief Removes a fixture directory and the files written into it.
+*/
+void remove_fixture_set(const char *dir)
+{
+    const char *files[] = {CPU_STATS_FILE, MEM_INFO_FILE, NETWORK_ACTIVITY_FILE, "net"};
+    for(int i = 0; i < (int)(sizeof(files) / sizeof(files[0])); i++)
+    {
+        char path[PROC_PATH_LENGTH];
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        if(remove(path) != 0) printf("WARNING: could not remove %s\n", path);
+    }
+    rmdir(dir);
+}
+
+/*
+* @brief Times samples of one collector once its file is open and its
+*        buffers are sized, then times the parser alone on the same data.
+*/
+void bench_collector(const char *name, void (*sample)(), void (*parse)(), int samples)
+{
+    sample();
+
+    struct sampler_stats before = sampler_stats;
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < samples; i++) sample();
+    uint64_t sample_ns = monotonic_ns() - start;
+    struct sampler_stats after = sampler_stats;
+
+    start = monotonic_ns();
+    for(int i = 0; i < samples; i++) parse();
+    uint64_t parse_ns = monotonic_ns() - start;
+
+    printf("  %-10s %14.0f %14.0f %14.2f %14.1f %14.0f\n", name,
+           (double)sample_ns / samples,
+           (double)parse_ns / samples,
+           (double)(after.allocations - before.allocations) / samples,
+           (double)(after.read_syscalls - before.read_syscalls) / samples,
+           (double)(after.bytes_read - before.bytes_read) / samples);
+}
+
+/*
+* @brief Compares cpu_stats and network_info field by field with the
+*        values the fixture writers emitted, printing the first field
+*        that differs in each.
+*
+* @returns the number of fields that differ
+*/
+int check_parsed_fixture(const struct fixture_values *expected)
+{
+    int cpu_mismatches = 0;
+    for(int cpu = -1; cpu < expected->num_cpus && cpu < cpu_stats.num_cpus; cpu++)
+    {
+        for(int field = 0; field < NUM_CPU_FIELDS; field++)
+        {
+            uint64_t want = expected->cpu_time[(size_t)(cpu + 1) * NUM_CPU_FIELDS + (size_t)field];
+            uint64_t got = cpu < 0 ? cpu_stats.total.time[field] : cpu_stats.time[field][cpu];
+            if(got == want) continue;
+            if(cpu_mismatches++ > 0) continue;
+            char name[16] = "the total";
+            if(cpu >= 0) snprintf(name, sizeof(name), "cpu%d", cpu);
+            printf("  MISMATCH: field %d of %s parsed as %" PRIu64 ", fixture has %" PRIu64 "\n", field, name, got, want);
+        }
+    }
+    const uint64_t stat_lines[][2] = {
+        {cpu_stats.num_interrupts, expected->num_interrupts},
+        {cpu_stats.num_context_switches, expected->num_context_switches},
+        {cpu_stats.boot_time, expected->boot_time},
+        {cpu_stats.num_proccesses_created, expected->num_processes_created},
+        {cpu_stats.proccesses_running, expected->processes_running},
+        {cpu_stats.proccesses_blocked, expected->processes_blocked},
+        {cpu_stats.num_softirqs, expected->num_softirqs},
+    };
+    const char *stat_names[] = {"intr", "ctxt", "btime", "processes", "procs_running", "procs_blocked", "softirq"};
+    for(int i = 0; i < (int)(sizeof(stat_lines) / sizeof(stat_lines[0])); i++)
+    {
+        if(stat_lines[i][0] == stat_lines[i][1]) continue;
+        printf("  MISMATCH: %s parsed as %" PRIu64 ", fixture has %" PRIu64 "\n", stat_names[i], stat_lines[i][0], stat_lines[i][1]);
+        cpu_mismatches++;
+    }
+
+    int network_mismatches = 0;
+    for(int i = 0; i < expected->num_interfaces && i < network_info.num_devices; i++)
+    {
+        const struct network_device *device = &network_info.devices[i];
+        if(strcmp(device->face, expected->faces[i]) != 0 && network_mismatches++ == 0)
+        {
+            printf("  MISMATCH: interface %d parsed as %s, fixture has %s\n", i, device->face, expected->faces[i]);
+        }
+        for(int field = 0; field < NUM_NETWORK_FIELDS; field++)
+        {
+            uint64_t want = expected->counters[(size_t)i * NUM_NETWORK_FIELDS + (size_t)field];
+            if(device->counter[field] == want || network_mismatches++ > 0) continue;
+            printf("  MISMATCH: field %d of %s parsed as %" PRIu64 ", fixture has %" PRIu64 "\n", field, expected->faces[i],
+                   device->counter[field], want);
+        }
+    }
+    return cpu_mismatches + network_mismatches;
+}
+
+/*
+* @brief Benchmarks all three collectors against the proc root in dir.
+*        When expected is not NULL what was parsed is checked against it.
+*
+* @returns 0 if the parsed snapshots matched
+*/
+int bench_proc_root(const char *label, const char *dir, int samples, const struct fixture_values *expected)
+{
+    close_collectors();
+    set_proc_root(dir);
+    init_collectors();
+
+    printf("%s (%s)\n", label, dir);
+    printf("  %-10s %14s %14s %14s %14s %14s\n", "collector", "ns/sample", "parse ns", "allocs/sample", "reads/sample", "bytes/sample");
+    bench_collector("cpu", sample_cpu_stats, update_cpu_stats, samples);
+    bench_collector("memory", sample_mem_info, update_meminfo, samples);
+    bench_collector("network", sample_network_info, update_network_info, samples);
+
+    int failed = 0;
+    if(expected != NULL && cpu_stats.num_online != expected->num_cpus)
+    {
+        printf("  MISMATCH: parsed %d cpus, fixture has %d\n", cpu_stats.num_online, expected->num_cpus);
+        failed = 1;
+    }
+    if(expected != NULL && (network_info.num_devices != expected->num_interfaces ||
+                            network_rates.num_interfaces != expected->num_interfaces))
+    {
+        printf("  MISMATCH: parsed %d interfaces with %d ids, fixture has %d\n", network_info.num_devices,
+               network_rates.num_interfaces, expected->num_interfaces);
+        failed = 1;
+    }
+    int mismatches = expected != NULL ? check_parsed_fixture(expected) : 0;
+    if(mismatches > 0)
+    {
+        printf("  MISMATCH: %d parsed values differ from the fixture\n", mismatches);
+        failed = 1;
+    }
+    printf("  parsed %d cpus, %d interfaces, %d meminfo keys%s\n\n", cpu_stats.num_online, network_info.num_devices,
+           __builtin_popcount(mem_info.present), expected != NULL && mismatches == 0 ? ", every value as written" : "");
+    return failed;
+}
+
+/*
+* @brief Hashes everything a recording keeps of the snapshots.
+*/
+uint64_t snapshot_hash()
+{
+    uint64_t hash = 14695981039346656037ull;
+    #define HASH(value) hash = (hash ^ (uint64_t)(value)) * 1099511628211ull
+    for(int field = 0; field < NUM_CPU_FIELDS; field++)
+    {
+        HASH(cpu_stats.total.time[field]);
+        for(int cpu = 0; cpu < cpu_stats.num_cpus; cpu++) HASH(cpu_stats.time[field][cpu]);
+    }
+    for(int cpu = 0; cpu < cpu_stats.num_cpus; cpu++) HASH(cpu_stats.online[cpu]);
+    HASH(cpu_stats.num_context_switches);
+    HASH(cpu_stats.num_proccesses_created);
+    HASH(cpu_stats.proccesses_running);
+    HASH(mem_info.present);
+    for(int field = 0; field < NUM_MEM_FIELDS; field++) HASH(mem_info.value[field]);
+    for(int i = 0; i < network_info.num_devices; i++)
+    {
+        for(int field = 0; field < NUM_NETWORK_FIELDS; field++) HASH(network_info.devices[i].counter[field]);
+        for(const char *c = network_info.devices[i].face; *c != '\0'; c++) HASH(*c);
+    }
+    #undef HASH
+    return hash;
+}
+
+/*
+* @brief Advances the counters of a 64 cpu machine by a second of a light,
+*        uneven load: each core has its own busy level, and two of the
+*        interfaces carry traffic.
+*/
+void advance_recording_counters(uint64_t *cpu_time, uint64_t *counters, const int *load)
+{
+    uint64_t *total = cpu_time;
+    memset(total, 0, NUM_CPU_FIELDS * sizeof(uint64_t));
+    for(int cpu = 0; cpu < RECORDING_CPUS; cpu++)
+    {
+        uint64_t *time = cpu_time + (size_t)(cpu + 1) * NUM_CPU_FIELDS;
+        uint64_t user = (uint64_t)load[cpu] + fixture_random(3);
+        uint64_t system = user / 4 + fixture_random(2);
+        uint64_t iowait = fixture_random(10) == 0;
+        uint64_t softirq = cpu < 4 ? fixture_random(3) : 0;
+        time[CPU_USER] += user;
+        time[CPU_SYSTEM] += system;
+        time[CPU_IOWAIT] += iowait;
+        time[CPU_SOFTIRQ] += softirq;
+        time[CPU_IDLE] += 100 - user - system - iowait - softirq;
+        for(int field = 0; field < NUM_CPU_FIELDS; field++) total[field] += time[field];
+    }
+    uint64_t *scalars = cpu_time + (size_t)(RECORDING_CPUS + 1) * NUM_CPU_FIELDS;
+    scalars[0] += 60000 + fixture_random(5000);
+    scalars[1] += fixture_random(20);
+
+    for(int i = 0; i < 2; i++)
+    {
+        uint64_t *counter = counters + (size_t)i * NUM_NETWORK_FIELDS;
+        uint64_t packets = 800 + fixture_random(400);
+        counter[NET_R_PACKETS] += packets;
+        counter[NET_R_BYTES] += packets * (600 + fixture_random(300));
+        counter[NET_T_PACKETS] += packets / 2;
+        counter[NET_T_BYTES] += packets / 2 * 90;
+    }
+}
+
+/*
+* @brief Records a minute sequence of a 64 cpu machine through the
+*        collectors, replays it and seeks into it, checking every sample
+*        comes back as it was recorded.
+*
+* @returns 0 if the replay matched
+*/
+int bench_recording(const char *base_dir, int samples)
+{
+    char dir[PROC_PATH_LENGTH];
+    char path[PROC_PATH_LENGTH];
+    snprintf(dir, sizeof(dir), "%s/recording", base_dir);
+    snprintf(path, sizeof(path), "%s/recording.bin", base_dir);
+    mkdir(dir, 0755);
+
+    if(samples < 2 * RECORD_KEYFRAME_INTERVAL) samples = 2 * RECORD_KEYFRAME_INTERVAL;
+    uint64_t *cpu_time = calloc((size_t)(RECORDING_CPUS + 1) * NUM_CPU_FIELDS + 2, sizeof(uint64_t));
+    uint64_t *counters = calloc((size_t)RECORDING_INTERFACES * NUM_NETWORK_FIELDS, sizeof(uint64_t));
+    uint64_t *hashes = calloc((size_t)samples, sizeof(uint64_t));
+    uint64_t *times = calloc((size_t)samples, sizeof(uint64_t));
+    int load[RECORDING_CPUS];
+    for(int cpu = 0; cpu < RECORDING_CPUS; cpu++) load[cpu] = (int)fixture_random(40);
+
+    close_collectors();
+    set_proc_root(dir);
+    write_meminfo_fixture(dir);
+    advance_recording_counters(cpu_time, counters, load);
+    write_stat_fixture(dir, RECORDING_CPUS, cpu_time);
+    write_network_fixture(dir, RECORDING_INTERFACES, counters);
+    init_collectors();
+
+    struct recorder recorder;
+    open_recorder(&recorder, path);
+    uint64_t encode_ns = 0;
+    uint64_t time_ns = 1792180665000000000ull;
+    for(int i = 0; i < samples; i++)
+    {
+        advance_recording_counters(cpu_time, counters, load);
+        write_stat_fixture(dir, RECORDING_CPUS, cpu_time);
+        write_network_fixture(dir, RECORDING_INTERFACES, counters);
+        sample_cpu_stats();
+        sample_mem_info();
+        sample_network_info();
+
+        time_ns += 1000000000ull + fixture_random(2000000);
+        uint64_t start = monotonic_ns();
+        record_sample(&recorder, time_ns);
+        encode_ns += monotonic_ns() - start;
+        hashes[i] = snapshot_hash();
+        times[i] = time_ns;
+    }
+    uint64_t frames_bytes = recorder.offset - RECORD_MAGIC_LENGTH;
+    close_recorder(&recorder);
+
+    struct replay replay;
+    open_replay(&replay, path);
+    int mismatches = 0;
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < samples; i++)
+    {
+        if(!replay_next(&replay) || snapshot_hash() != hashes[i]) mismatches++;
+    }
+    uint64_t decode_ns = monotonic_ns() - start;
+    if(replay_next(&replay)) mismatches++;
+
+    int seeks = 100;
+    start = monotonic_ns();
+    for(int i = 0; i < seeks; i++)
+    {
+        int target = (int)fixture_random((uint64_t)samples);
+        replay_seek(&replay, times[target]);
+        if(!replay_next(&replay) || snapshot_hash() != hashes[target]) mismatches++;
+    }
+    uint64_t seek_ns = monotonic_ns() - start;
+    close_replay(&replay);
+
+    printf("recording: %d cpus, %d interfaces, %d samples (%s)\n", RECORDING_CPUS, RECORDING_INTERFACES, samples, path);
+    printf("  %14s %14s %14s %14s\n", "bytes/sample", "encode ns", "decode ns", "seek ns");
+    printf("  %14.1f %14.0f %14.0f %14.0f\n", (double)frames_bytes / samples, (double)encode_ns / samples,
+           (double)decode_ns / samples, (double)seek_ns / seeks);
+    if(mismatches > 0) printf("  MISMATCH: %d replayed samples differ from what was recorded\n", mismatches);
+    printf("\n");
+
+    free(cpu_time);
+    free(counters);
+    free(hashes);
+    free(times);
+    return mismatches > 0;
+}
+
+/*
+* @returns the busy percentage of every cpu in sample i of the analysis
+*          bench: an even spread of 0 to 100, and 95 through a run in the
+*          middle
+*/
+int analysis_bench_busy(int i)
+{
+    int run_start = ANALYZE_BENCH_SAMPLES / 2 - ANALYZE_BENCH_RUN * 2 / 5;
+    if(i >= run_start && i < run_start + ANALYZE_BENCH_RUN) return 95;
+    return (int)((uint64_t)i * 37 % 101);
+}
+
+/*
+* @brief Compares the percentiles, time above the threshold, longest run
+*        and peak window of cpu.busy_pct with what the bench put in.
+*
+* @returns the number of them that differ
+*/
+int check_analysis(const char *label, const uint64_t *busy_count, uint64_t count, uint64_t above_ns, uint64_t longest_ns,
+                   const struct analysis_window *peak)
+{
+    const struct analysis_metric *metric = find_analysis_metric(&analysis.table, "cpu.busy_pct");
+    if(metric == NULL)
+    {
+        printf("  MISMATCH: %s has no cpu.busy_pct\n", label);
+        return 1;
+    }
+    int mismatches = 0;
+    const double fractions[] = {0.5, 0.9, 0.99, 0.999};
+    for(int i = 0; i < 4; i++)
+    {
+        uint64_t rank = (uint64_t)(fractions[i] * (double)count);
+        uint64_t seen = 0;
+        int expected = 0;
+        while(seen + busy_count[expected] <= rank) seen += busy_count[expected++];
+        double value = analysis_percentile(metric, fractions[i]);
+        if(fabs(value - expected) > expected * 0.01 + 0.01)
+        {
+            printf("  MISMATCH: %s p%g of cpu.busy_pct is %.2f, not %d\n", label, fractions[i] * 100, value, expected);
+            mismatches++;
+        }
+    }
+    if(metric->count != count || metric->above_ns != above_ns || metric->longest_above_ns != longest_ns)
+    {
+        printf("  MISMATCH: %s cpu.busy_pct has %" PRIu64 " samples, %" PRIu64 " ns above 90 and %" PRIu64 " ns in a row, not %"
+               PRIu64 ", %" PRIu64 " and %" PRIu64 "\n", label, metric->count, metric->above_ns, metric->longest_above_ns,
+               count, above_ns, longest_ns);
+        mismatches++;
+    }
+    if(metric->peak.start_ns != peak->start_ns || metric->peak.count != peak->count || metric->peak.sum != peak->sum)
+    {
+        printf("  MISMATCH: %s peak window of cpu.busy_pct starts at %" PRIu64 " with %" PRIu64 " samples, not %" PRIu64 " with %"
+               PRIu64 "\n", label, metric->peak.start_ns, metric->peak.count, peak->start_ns, peak->count);
+        mismatches++;
+    }
+    return mismatches;
+}
+
+/*
+* @brief Records ten hours of a 256 cpu machine straight from the
+*        snapshots and analyses it on one thread and on num_threads,
+*        checking cpu.busy_pct against the values put in and that the
+*        threads merged into what one thread found.
+*
+* @returns 0 if everything matched
+*/
+int bench_analysis(const char *base_dir, int num_threads)
+{
+    char path[PROC_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/analysis.bin", base_dir);
+    int samples = ANALYZE_BENCH_SAMPLES;
+    int new_interface = samples * 2 / 3;
+
+    close_collectors();
+    resize_cpu_stats(ANALYZE_BENCH_CPUS);
+    for(int cpu = 0; cpu < ANALYZE_BENCH_CPUS; cpu++) cpu_stats.online[cpu] = 1;
+    cpu_stats.num_online = ANALYZE_BENCH_CPUS;
+    mem_info.present = (1u << NUM_MEM_FIELDS) - 1;
+    reserve_network_devices(ANALYZE_BENCH_INTERFACES + 1);
+    for(int i = 0; i <= ANALYZE_BENCH_INTERFACES; i++)
+    {
+        memset(&network_info.devices[i], 0, sizeof(network_info.devices[i]));
+        snprintf(network_info.devices[i].face, MAX_NETWORK_FACE_LENGTH, "eth%d", i);
+    }
+
+    //What cpu.busy_pct should come out as: every sample but the first and
+    //the one the new interface's layout starts over at
+    uint64_t busy_count[101] = {0};
+    uint64_t count = 0, above_ns = 0, run_ns = 0, longest_ns = 0;
+    struct analysis_window window = {0, 0, 0};
+    struct analysis_window peak = {0, 0, 0};
+
+    struct recorder recorder;
+    open_recorder(&recorder, path);
+    uint64_t time_ns = 1792180665000000000ull;
+    uint64_t previous_ns = 0;
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < samples; i++)
+    {
+        int busy = analysis_bench_busy(i);
+        for(int cpu = 0; cpu < ANALYZE_BENCH_CPUS; cpu++)
+        {
+            uint64_t user = (uint64_t)busy * 3 / 4;
+            cpu_stats.time[CPU_USER][cpu] += user;
+            cpu_stats.time[CPU_SYSTEM][cpu] += (uint64_t)busy - user;
+            cpu_stats.time[CPU_IDLE][cpu] += 100 - (uint64_t)busy;
+        }
+        for(int field = 0; field < NUM_CPU_FIELDS; field++)
+        {
+            cpu_stats.total.time[field] = 0;
+            for(int cpu = 0; cpu < ANALYZE_BENCH_CPUS; cpu++) cpu_stats.total.time[field] += cpu_stats.time[field][cpu];
+        }
+        cpu_stats.num_context_switches += 60000 + fixture_random(5000);
+        cpu_stats.proccesses_running = 1 + fixture_random(ANALYZE_BENCH_CPUS);
+        for(int field = 0; field < NUM_MEM_FIELDS; field++) mem_info.value[field] = 16000000 - (uint64_t)field * 1000000;
+        mem_info.value[MEM_AVAILABLE] = 4000000 + fixture_random(8000000);
+        network_info.num_devices = i < new_interface ? ANALYZE_BENCH_INTERFACES : ANALYZE_BENCH_INTERFACES + 1;
+        for(int d = 0; d < network_info.num_devices; d++)
+        {
+            uint64_t packets = 800 + fixture_random(400);
+            network_info.devices[d].counter[NET_R_PACKETS] += packets;
+            network_info.devices[d].counter[NET_R_BYTES] += packets * (600 + fixture_random(300));
+            network_info.devices[d].counter[NET_T_PACKETS] += packets / 2;
+            network_info.devices[d].counter[NET_T_BYTES] += packets / 2 * 90;
+        }
+        time_ns += 1000000000ull + fixture_random(2000000);
+        record_sample(&recorder, time_ns);
+
+        if(i > 0 && i != new_interface)
+        {
+            busy_count[busy]++;
+            count++;
+            uint64_t interval_ns = time_ns - previous_ns;
+            if(busy > 90)
+            {
+                above_ns += interval_ns;
+                run_ns += interval_ns;
+                if(run_ns > longest_ns) longest_ns = run_ns;
+            }
+            else run_ns = 0;
+
+            uint64_t window_start = time_ns - time_ns % ANALYZE_BENCH_WINDOW_NS;
+            if(window.count > 0 && window.start_ns != window_start)
+            {
+                if(window.sum * (double)peak.count > peak.sum * (double)window.count || peak.count == 0) peak = window;
+                window.count = 0;
+                window.sum = 0;
+            }
+            window.start_ns = window_start;
+            window.count++;
+            window.sum += busy;
+        }
+        previous_ns = time_ns;
+    }
+    if(window.sum * (double)peak.count > peak.sum * (double)window.count) peak = window;
+    uint64_t encode_ns = monotonic_ns() - start;
+    uint64_t recording_bytes = recorder.offset;
+    close_recorder(&recorder);
+
+    int mismatches = 0;
+    if(num_threads < 2) num_threads = 2;
+    analyze_recording(path, 1, ANALYZE_BENCH_WINDOW_NS);
+    uint64_t single_ns = analysis.duration_ns;
+    size_t single_memory = analysis.memory;
+    mismatches += check_analysis("1 thread", busy_count, count, above_ns, longest_ns, &peak);
+    struct analysis_table single = analysis.table;
+    memset(&analysis.table, 0, sizeof(analysis.table));
+
+    analyze_recording(path, num_threads, ANALYZE_BENCH_WINDOW_NS);
+    mismatches += check_analysis("threads", busy_count, count, above_ns, longest_ns, &peak);
+    if(analysis.table.num_metrics != single.num_metrics)
+    {
+        printf("  MISMATCH: %d threads found %d metrics, one thread %d\n", analysis.num_threads, analysis.table.num_metrics,
+               single.num_metrics);
+        mismatches++;
+    }
+    for(int i = 0; i < single.num_metrics; i++)
+    {
+        const struct analysis_metric *one = &single.metrics[i];
+        const struct analysis_metric *merged = find_analysis_metric(&analysis.table, one->name);
+        if(merged == NULL || merged->count != one->count || merged->min != one->min || merged->max != one->max ||
+           merged->max_ns != one->max_ns || merged->covered_ns != one->covered_ns || merged->above_ns != one->above_ns ||
+           merged->longest_above_ns != one->longest_above_ns || merged->peak.start_ns != one->peak.start_ns ||
+           fabs(merged->sum - one->sum) > fabs(one->sum) * 1e-9 ||
+           memcmp(merged->buckets, one->buckets, sizeof(one->buckets)) != 0)
+        {
+            printf("  MISMATCH: %s merged from %d threads differs from one thread's\n", one->name, analysis.num_threads);
+            mismatches++;
+        }
+    }
+
+    printf("analysis: %d cpus, %d interfaces, %d samples, %d metrics (%s)\n", ANALYZE_BENCH_CPUS,
+           ANALYZE_BENCH_INTERFACES + 1, samples, analysis.table.num_metrics, path);
+    printf("  %14s %14s %14s %14s %14s %14s\n", "MB recorded", "encode s", "1 thread s", "threads", "threads s", "metrics MB");
+    printf("  %14.1f %14.2f %14.2f %14d %14.2f %14.1f\n", (double)recording_bytes / 1048576, (double)encode_ns / 1e9,
+           (double)single_ns / 1e9, analysis.num_threads, (double)analysis.duration_ns / 1e9, (double)analysis.memory / 1048576);
+    printf("  a week of 1 s samples would take %.1f s on %d threads, %.1f s on one; one thread held %.1f MB\n",
+           (double)analysis.duration_ns / 1e9 * 604800 / samples, analysis.num_threads,
+           (double)single_ns / 1e9 * 604800 / samples, (double)single_memory / 1048576);
+    printf("\n");
+
+    free_analysis_table(&single);
+    free_analysis();
+    close_collectors();
+    return mismatches > 0;
+}
+
+/*
+* @brief Writes a diskstats of FIXTURE_DISKS devices and a mountinfo of
+*        FIXTURE_MOUNTS mounts, one in ten of them pseudo filesystems. The
+*        others are on directories made under dir, so statvfs has a real
+*        path to look at. Then a tmpfs mounted over by another at mnt/shm.
+*/
+void write_disk_fixture(const char *dir)
+{
+    FILE *file = open_fixture(dir, DISK_STATS_FILE);
+    for(int i = 0; i < FIXTURE_DISKS; i++)
+    {
+        fprintf(file, "%4d %7d nvme%dn1", 259, i, i);
+        for(int field = 0; field < 17; field++) fprintf(file, " %" PRIu64, fixture_random(field == DISK_IN_FLIGHT ? 64 : 1ull << 32));
+        fprintf(file, "\n");
+    }
+    fclose(file);
+
+    char self_dir[PROC_PATH_LENGTH];
+    snprintf(self_dir, sizeof(self_dir), "%s/self", dir);
+    mkdir(self_dir, 0755);
+    char mount_dir[PROC_PATH_LENGTH];
+    snprintf(mount_dir, sizeof(mount_dir), "%s/mnt", dir);
+    mkdir(mount_dir, 0755);
+    file = open_fixture(dir, MOUNT_INFO_FILE);
+    for(int i = 0; i < FIXTURE_MOUNTS; i++)
+    {
+        if(i % 10 == 9)
+        {
+            fprintf(file, "%d 1 0:%d / /sys/fs/cgroup/m%d rw,nosuid - cgroup2 cgroup2 rw\n", i + 2, i + 100, i);
+            continue;
+        }
+        char mount_point[PROC_PATH_LENGTH + 16];
+        snprintf(mount_point, sizeof(mount_point), "%s/m%d", mount_dir, i);
+        mkdir(mount_point, 0755);
+        fprintf(file, "%d 1 259:%d / %s rw,relatime shared:%d - ext4 /dev/nvme%dn1 rw\n", i + 2, i, mount_point, i, i);
+    }
+    fprintf(file, "%d 1 0:24 / %s/shm rw,nosuid,nodev - tmpfs tmpfs rw\n", FIXTURE_MOUNTS + 2, mount_dir);
+    fprintf(file, "%d %d 0:27 / %s/shm rw,nosuid,nodev - tmpfs shm rw\n", FIXTURE_MOUNTS + 3, FIXTURE_MOUNTS + 2, mount_dir);
+    fclose(file);
+}
+
+/*
+* @brief Times disk samples of a generated proc root once the mount table
+*        is read. Only the first sample should parse the mount table.
+*
+* @returns 0 if every device and mount was found
+*/
+int bench_disk(const char *base_dir, int samples)
+{
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/disk", base_dir);
+    mkdir(dir, 0755);
+    write_disk_fixture(dir);
+
+    close_collectors();
+    set_proc_root(dir);
+    close_disk_info();
+    sample_disk_info();
+
+    struct sampler_stats before = sampler_stats;
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < samples; i++) sample_disk_info();
+    uint64_t sample_ns = monotonic_ns() - start;
+    struct sampler_stats after = sampler_stats;
+
+    int expected_mounts = FIXTURE_MOUNTS - FIXTURE_MOUNTS / 10 + 1;
+    const struct filesystem *shm = &mount_table.filesystems[mount_table.num_filesystems - 1];
+    int shm_visible = mount_table.num_filesystems > 0 && shm->minor == 27 && strcmp(shm->source, "shm") == 0;
+    printf("disk: %d devices, %d mounts (%s)\n", FIXTURE_DISKS, FIXTURE_MOUNTS, dir);
+    printf("  %14s %14s %14s %14s\n", "ns/sample", "allocs/sample", "reads/sample", "table parses");
+    printf("  %14.0f %14.2f %14.1f %14" PRIu64 "\n", (double)sample_ns / samples,
+           (double)(after.allocations - before.allocations) / samples,
+           (double)(after.read_syscalls - before.read_syscalls) / samples, mount_table.parses);
+    int failed = 0;
+    if(disk_stats.num_devices != FIXTURE_DISKS || mount_table.num_filesystems != expected_mounts || mount_table.parses != 1 ||
+       !shm_visible)
+    {
+        printf("  MISMATCH: parsed %d devices and %d filesystems in %" PRIu64 " parses, expected %d and %d in 1, %s\n",
+               disk_stats.num_devices, mount_table.num_filesystems, mount_table.parses, FIXTURE_DISKS, expected_mounts,
+               shm_visible ? "the visible shm kept" : "not the visible shm");
+        failed = 1;
+    }
+    printf("\n");
+    close_disk_info();
+    return failed;
+}
+
+/*
+* @brief Writes an interrupts file the way the kernel formats it for
+*        FIXTURE_IRQ_CPUS possible cpus with one offline: numbered irqs of
+*        a NIC queue each, the per cpu architecture lines, then ERR and MIS.
+*/
+void write_interrupts_fixture(const char *dir)
+{
+    FILE *file = open_fixture(dir, INTERRUPTS_FILE);
+    fprintf(file, "     ");
+    for(int cpu = 0; cpu < FIXTURE_IRQ_CPUS; cpu++)
+    {
+        if(cpu != FIXTURE_OFFLINE_CPU) fprintf(file, "      CPU%-4d", cpu);
+    }
+    fprintf(file, "\n");
+
+    const char *arch_lines[][2] = {{"NMI", "Non-maskable interrupts"}, {"LOC", "Local timer interrupts"},
+                                   {"RES", "Rescheduling interrupts"}, {"CAL", "Function call interrupts"}};
+    int num_arch = (int)(sizeof(arch_lines) / sizeof(arch_lines[0]));
+    for(int line = 0; line < FIXTURE_IRQ_LINES; line++)
+    {
+        int arch = line - (FIXTURE_IRQ_LINES - num_arch);
+        if(arch >= 0) fprintf(file, "%s:", arch_lines[arch][0]);
+        else fprintf(file, "%4d:", line + 24);
+        for(int cpu = 0; cpu < FIXTURE_IRQ_CPUS; cpu++)
+        {
+            if(cpu == FIXTURE_OFFLINE_CPU) continue;
+            //A queue irq is served by one cpu, mostly
+            int served = arch >= 0 || cpu == line % FIXTURE_IRQ_CPUS;
+            fprintf(file, " %10" PRIu64, served ? fixture_random(4000000000ull) : fixture_random(50) == 0 ? fixture_random(100) : 0);
+        }
+        if(arch >= 0) fprintf(file, "   %s\n", arch_lines[arch][1]);
+        else fprintf(file, "  IR-PCI-MSIX-0000:3b:00.0   %d-edge      eth0-TxRx-%d\n", line, line);
+    }
+    fprintf(file, "ERR:          0\nMIS:          0\n");
+    fclose(file);
+}
+
+/*
+* @brief Times interrupt samples of a generated proc root, the parse and
+*        the rates of every irq on every cpu, and the top N after them.
+*
+* @returns 0 if every line and cpu was found
+*/
+int bench_interrupts(const char *base_dir, int samples)
+{
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/irq", base_dir);
+    mkdir(dir, 0755);
+    write_interrupts_fixture(dir);
+
+    set_proc_root(dir);
+    close_interrupts();
+    init_interrupts(DEFAULT_IRQ_TOP_N);
+    sample_interrupts(); //Once for each of the two sample buffers
+    sample_interrupts();
+
+    struct sampler_stats before = sampler_stats;
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < samples; i++) sample_interrupts();
+    uint64_t sample_ns = monotonic_ns() - start;
+    struct sampler_stats after = sampler_stats;
+
+    start = monotonic_ns();
+    for(int i = 0; i < samples; i++) update_interrupt_stats();
+    uint64_t parse_ns = monotonic_ns() - start;
+
+    start = monotonic_ns();
+    for(int i = 0; i < samples; i++) select_top_interrupts(0);
+    uint64_t top_ns = monotonic_ns() - start;
+
+    int expected_lines = FIXTURE_IRQ_LINES + 2;
+    printf("interrupts: %d cpus, %d irqs (%s)\n", FIXTURE_IRQ_CPUS, FIXTURE_IRQ_LINES, dir);
+    printf("  %14s %14s %14s %14s %14s\n", "ns/sample", "parse ns", "top N ns", "allocs/sample", "bytes/sample");
+    printf("  %14.0f %14.0f %14.0f %14.2f %14.0f\n", (double)sample_ns / samples, (double)parse_ns / samples,
+           (double)top_ns / samples, (double)(after.allocations - before.allocations) / samples,
+           (double)(after.bytes_read - before.bytes_read) / samples);
+    int failed = 0;
+    int last_cpu = interrupt_stats.num_columns > 0 ? interrupt_stats.column_cpu[interrupt_stats.num_columns - 1] : -1;
+    if(interrupt_stats.num_lines != expected_lines || interrupt_stats.num_columns != FIXTURE_IRQ_CPUS - 1 ||
+       last_cpu != FIXTURE_IRQ_CPUS - 1 || interrupt_rates.num_top != DEFAULT_IRQ_TOP_N)
+    {
+        printf("  MISMATCH: parsed %d lines on %d cpus up to cpu%d with %d on top, expected %d on %d up to cpu%d\n",
+               interrupt_stats.num_lines, interrupt_stats.num_columns, last_cpu, interrupt_rates.num_top,
+               expected_lines, FIXTURE_IRQ_CPUS - 1, FIXTURE_IRQ_CPUS - 1);
+        failed = 1;
+    }
+    printf("\n");
+    close_interrupts();
+    return failed;
+}
+
+/*
+* @brief Writes a meminfo file with every key of the generated table, in
+*        its order, and two a kernel could add that it does not have, then
+*        a meminfo file for each of FIXTURE_NUMA_NODES nodes numbered 0, 1,
+*        10... The table's values are kept in values.
+*/
+void write_full_meminfo_fixture(const char *dir, uint64_t *values)
+{
+    FILE *file = open_fixture(dir, MEM_INFO_FILE);
+    for(int key = 0; key < NUM_MEMINFO_KEYS; key++)
+    {
+        values[key] = fixture_random(meminfo_key_counts[key] ? 4096 : 1000000000ull);
+        char name[64];
+        snprintf(name, sizeof(name), "%s:", meminfo_key_names[key]);
+        fprintf(file, "%-15s %8" PRIu64 "%s\n", name, values[key], meminfo_key_counts[key] ? "" : " kB");
+    }
+    fprintf(file, "FutureTotal:    %8d kB\nFutureCount:    %8d\n", 1234, 7);
+    fclose(file);
+
+    for(int node = 0; node < FIXTURE_NUMA_NODES; node++)
+    {
+        int id = node < 2 ? node : node * 5;
+        char node_dir[PROC_PATH_LENGTH - 64];
+        snprintf(node_dir, sizeof(node_dir), "%s/nodes/node%d", dir, id);
+        mkdir(node_dir, 0755);
+        file = open_fixture(node_dir, MEM_INFO_FILE);
+        fprintf(file, "Node %d MemTotal:       %8d kB\nNode %d MemUsed:        %8d kB\nNode %d FilePages:      %8d kB\n",
+                id, 1000 + id, id, 100 + id, id, 10 + id);
+        fprintf(file, "Node %d HugePages_Total: %5d\n", id, id);
+        fclose(file);
+    }
+}
+
+/*
+* @brief Removes what write_full_meminfo_fixture wrote into dir.
+*/
+void remove_full_meminfo_fixture(const char *dir)
+{
+    char path[PROC_PATH_LENGTH];
+    for(int node = 0; node < FIXTURE_NUMA_NODES; node++)
+    {
+        snprintf(path, sizeof(path), "%s/nodes/node%d/%s", dir, node < 2 ? node : node * 5, MEM_INFO_FILE);
+        remove(path);
+        *strrchr(path, '/') = '\0';
+        rmdir(path);
+    }
+    snprintf(path, sizeof(path), "%s/nodes", dir);
+    rmdir(path);
+    snprintf(path, sizeof(path), "%s/%s", dir, MEM_INFO_FILE);
+    remove(path);
+    rmdir(dir);
+}
+
+/*
+* @brief The lookup the hash replaced: each line's key compared with the
+*        keys in turn, here against every key of the table.
+*/
+void parse_meminfo_linear(const char *text, struct meminfo_snapshot *snapshot)
+{
+    const char *cursor = text;
+    memset(snapshot->present, 0, sizeof(snapshot->present));
+    while(*cursor != '\0')
+    {
+        const char *token;
+        size_t length = scan_token(&cursor, &token);
+        for(int key = 0; length > 1 && key < NUM_MEMINFO_KEYS; key++)
+        {
+            if(meminfo_key_lengths[key] != length - 1 || memcmp(meminfo_key_names[key], token, length - 1) != 0) continue;
+            if(scan_fields(&cursor, &snapshot->value[key], 1) == 1) snapshot->present[key / 64] |= 1ull << (key % 64);
+            break;
+        }
+        cursor = skip_line(cursor);
+    }
+}
+
+/*
+* @brief Times parsing a meminfo file with every known key through the
+*        perfect hash and through comparing each key in turn, and reading
+*        the NUMA nodes' files.
+*
+* @returns 0 if every line went where it belongs
+*/
+int bench_meminfo(const char *base_dir, int samples)
+{
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/meminfo", base_dir);
+    mkdir(dir, 0755);
+    char node_dir[PROC_PATH_LENGTH];
+    snprintf(node_dir, sizeof(node_dir), "%s/nodes", dir);
+    mkdir(node_dir, 0755);
+    uint64_t values[NUM_MEMINFO_KEYS];
+    write_full_meminfo_fixture(dir, values);
+
+    close_collectors();
+    set_proc_root(dir);
+    init_node_meminfo(node_dir);
+    sample_mem_info();
+
+    struct sampler_stats before = sampler_stats;
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < samples; i++) sample_mem_info();
+    uint64_t sample_ns = monotonic_ns() - start;
+    struct sampler_stats after = sampler_stats;
+
+    start = monotonic_ns();
+    for(int i = 0; i < samples; i++) parse_meminfo(mem_source.buffer, &meminfo_snapshot, 0);
+    uint64_t hash_ns = monotonic_ns() - start;
+
+    static struct meminfo_snapshot linear;
+    start = monotonic_ns();
+    for(int i = 0; i < samples; i++) parse_meminfo_linear(mem_source.buffer, &linear);
+    uint64_t linear_ns = monotonic_ns() - start;
+
+    printf("meminfo: %d keys, 2 unknown, %d NUMA nodes (%s)\n", NUM_MEMINFO_KEYS, FIXTURE_NUMA_NODES, dir);
+    printf("  %14s %14s %14s %14s %14s\n", "ns/sample", "hash parse ns", "linear ns", "allocs/sample", "reads/sample");
+    printf("  %14.0f %14.0f %14.0f %14.2f %14.1f\n", (double)sample_ns / samples, (double)hash_ns / samples,
+           (double)linear_ns / samples, (double)(after.allocations - before.allocations) / samples,
+           (double)(after.read_syscalls - before.read_syscalls) / samples);
+
+    int failed = 0;
+    int wrong = 0;
+    for(int key = 0; key < NUM_MEMINFO_KEYS; key++)
+    {
+        wrong += !meminfo_has(&meminfo_snapshot, key) || meminfo_snapshot.value[key] != values[key] ||
+                 !meminfo_has(&linear, key) || linear.value[key] != values[key];
+    }
+    const struct meminfo_overflow *overflow = meminfo_snapshot.overflow;
+    if(wrong > 0 || meminfo_snapshot.num_present != NUM_MEMINFO_KEYS || __builtin_popcount(mem_info.present) != NUM_MEM_FIELDS ||
+       meminfo_snapshot.num_overflow != 2 || strcmp(overflow[0].key, "FutureTotal") != 0 || overflow[0].value != 1234 ||
+       overflow[0].count || strcmp(overflow[1].key, "FutureCount") != 0 || overflow[1].value != 7 || !overflow[1].count)
+    {
+        printf("  MISMATCH: %d keys wrong, %d present, %d overflowed\n", wrong, meminfo_snapshot.num_present,
+               meminfo_snapshot.num_overflow);
+        failed = 1;
+    }
+    for(int node = 0; node < node_meminfo.num_nodes; node++)
+    {
+        int id = node < 2 ? node : node * 5;
+        const struct meminfo_snapshot *snapshot = &node_meminfo.nodes[node];
+        if(node_meminfo.id[node] != id || snapshot->num_present != 4 || snapshot->value[MEMINFO_MEMUSED] != (uint64_t)(100 + id) ||
+           snapshot->value[MEMINFO_FILEPAGES] != (uint64_t)(10 + id) || snapshot->value[MEMINFO_HUGEPAGES_TOTAL] != (uint64_t)id)
+        {
+            printf("  MISMATCH: node%d parsed as node%d with %d keys\n", id, node_meminfo.id[node], snapshot->num_present);
+            failed = 1;
+        }
+    }
+    if(node_meminfo.num_nodes != FIXTURE_NUMA_NODES)
+    {
+        printf("  MISMATCH: found %d nodes, fixture has %d\n", node_meminfo.num_nodes, FIXTURE_NUMA_NODES);
+        failed = 1;
+    }
+    printf("\n");
+    close_collectors();
+    return failed;
+}
+
+/*
+* @brief Writes the pressure files the way a 5.x kernel formats them, cpu
+*        without a full line, with each some and full total stall time
+*        raised by stall_us.
+*/
+void write_pressure_fixture(const char *dir, uint64_t stall_us)
+{
+    for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+    {
+        FILE *file = open_fixture(dir, pressure_resource_names[resource]);
+        fprintf(file, "some avg10=%d.%02d avg60=0.50 avg300=0.05 total=%" PRIu64 "\n", resource, 5 + resource, 1000000 + stall_us);
+        if(resource != PRESSURE_CPU) fprintf(file, "full avg10=0.00 avg60=0.10 avg300=0.01 total=%" PRIu64 "\n", 200000 + stall_us / 2);
+        fclose(file);
+    }
+}
+
+/*
+* @brief Times pressure samples of a generated proc root, and checks the
+*        averages, the missing cpu full line and the share of time stalled
+*        when the totals grow by 250 ms over a second.
+*
+* @returns 0 if every line parsed to what was written
+*/
+int bench_pressure(const char *base_dir, int samples)
+{
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/psi", base_dir);
+    mkdir(dir, 0755);
+    char pressure_dir[PROC_PATH_LENGTH - 32];
+    snprintf(pressure_dir, sizeof(pressure_dir), "%s/%s", dir, PRESSURE_DIR);
+    mkdir(pressure_dir, 0755);
+    write_pressure_fixture(pressure_dir, 0);
+
+    set_proc_root(dir);
+    close_pressure();
+    int available = init_pressure();
+    struct sampler_stats before = sampler_stats;
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < samples; i++) sample_pressure();
+    uint64_t sample_ns = monotonic_ns() - start;
+    struct sampler_stats after = sampler_stats;
+
+    //A second later by the sample's clock, whatever the bench took
+    write_pressure_fixture(pressure_dir, 250000);
+    for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+    {
+        read_proc_source(&pressure_sources[resource]);
+        update_pressure_stats(resource);
+    }
+    pressure_stats.sample_ns = pressure_rates.previous_ns + 1000000000ull;
+    update_pressure_rates();
+
+    printf("pressure: %d resources (%s)\n", available, dir);
+    printf("  %14s %14s %14s\n", "ns/sample", "allocs/sample", "bytes/sample");
+    printf("  %14.0f %14.2f %14.0f\n", (double)sample_ns / samples,
+           (double)(after.allocations - before.allocations) / samples, (double)(after.bytes_read - before.bytes_read) / samples);
+    const struct pressure_line *io_some = &pressure_stats.line[PRESSURE_IO][PRESSURE_SOME];
+    const struct pressure_line *cpu_full = &pressure_stats.line[PRESSURE_CPU][PRESSURE_FULL];
+    double memory_some_pct = pressure_rates.stall_pct[PRESSURE_MEMORY][PRESSURE_SOME];
+    double memory_full_pct = pressure_rates.stall_pct[PRESSURE_MEMORY][PRESSURE_FULL];
+    int failed = 0;
+    if(available != NUM_PRESSURE_RESOURCES || !io_some->present || io_some->average[PRESSURE_AVG10] != 207 ||
+       io_some->average[PRESSURE_AVG60] != 50 || io_some->total_us != 1250000 || cpu_full->present ||
+       pressure_rates.valid[PRESSURE_CPU][PRESSURE_FULL] || memory_some_pct < 24.99 || memory_some_pct > 25.01 ||
+       memory_full_pct < 12.49 || memory_full_pct > 12.51)
+    {
+        printf("  MISMATCH: %d resources, io some avg10 %u avg60 %u total %" PRIu64 ", cpu full %s, memory stalled %.2f%% some %.2f%% full,"
+               " expected %d, 207, 50, 1250000, missing, 25%% and 12.5%%\n", available, io_some->average[PRESSURE_AVG10],
+               io_some->average[PRESSURE_AVG60], io_some->total_us, cpu_full->present ? "present" : "missing",
+               memory_some_pct, memory_full_pct, NUM_PRESSURE_RESOURCES);
+        failed = 1;
+    }
+    printf("\n");
+    close_pressure();
+    return failed;
+}
+
+/*
+* @brief Reads what has arrived on each bench client's socket, counting
+*        the bytes each has received.
+*
+* @returns the number of clients that have their whole response
+*/
+int drain_export_clients(const int *fds, size_t *received, size_t expected)
+{
+    char buffer[65536];
+    int complete = 0;
+    for(int i = 0; i < EXPORT_BENCH_CLIENTS; i++)
+    {
+        ssize_t length;
+        while(received[i] < expected && (length = recv(fds[i], buffer, sizeof(buffer), 0)) > 0) received[i] += (size_t)length;
+        if(received[i] >= expected) complete++;
+    }
+    return complete;
+}
+
+/*
+* @brief Compiles BENCH_RULES rules of every kind against two samples of a
+*        generated 64 cpu proc root and times evaluating all of them, then
+*        checks rules whose outcome is known: values read straight from
+*        the rates, a missing interface that never matches, and a for
+*        duration that holds a rule back until it has passed.
+*
+* @returns 0 if every known rule came out as expected and evaluating
+*          allocated nothing
+*/
+int bench_rules(const char *base_dir, int samples)
+{
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/rules", base_dir);
+    mkdir(dir, 0755);
+    uint64_t *cpu_time = calloc((size_t)(RECORDING_CPUS + 1) * NUM_CPU_FIELDS + 2, sizeof(uint64_t));
+    uint64_t *counters = calloc((size_t)RECORDING_INTERFACES * NUM_NETWORK_FIELDS, sizeof(uint64_t));
+    int load[RECORDING_CPUS];
+    for(int cpu = 0; cpu < RECORDING_CPUS; cpu++) load[cpu] = (int)fixture_random(40);
+
+    close_collectors();
+    set_proc_root(dir);
+    write_meminfo_fixture(dir);
+    for(int i = 0; i < 2; i++)
+    {
+        advance_recording_counters(cpu_time, counters, load);
+        write_stat_fixture(dir, RECORDING_CPUS, cpu_time);
+        write_network_fixture(dir, RECORDING_INTERFACES, counters);
+        if(i == 0) init_collectors();
+        sample_cpu_stats();
+        sample_mem_info();
+        sample_network_info();
+    }
+
+    const char *known[] = {"cpu.busy_pct >= 0", "net.eth0.rx_bytes_rate > 0", "-mem.MemTotal < 0",
+                           "net.missing0.rx_bytes_rate > 0 or mem.MemTotal < 0", "cpu3.busy_pct >= 0 for 10s",
+                           "cpu.busy_pct > 100-200", "mem.MemTotal-1 < mem.MemTotal",
+                           "net.eth0.rx_bytes_rate-1 < net.eth0.rx_bytes_rate", "net.veth-a.rx_bytes_rate >= 0"};
+    int num_known = (int)(sizeof(known) / sizeof(known[0]));
+    char (*texts)[BENCH_RULE_LENGTH] = calloc(BENCH_RULES, BENCH_RULE_LENGTH);
+    close_rules();
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < num_known; i++) add_rule(known[i]);
+    for(int i = 0; i < BENCH_RULES - num_known; i++)
+    {
+        switch(i % 5)
+        {
+            case 0: snprintf(texts[i], BENCH_RULE_LENGTH, "cpu%d.busy_pct > %d for 5s", i % RECORDING_CPUS, 50 + i % 50); break;
+            case 1: snprintf(texts[i], BENCH_RULE_LENGTH, "cpu.iowait_pct > %d for 5s", i % 20); break;
+            case 2: snprintf(texts[i], BENCH_RULE_LENGTH, "net.veth%07d.rx_drop_rate > %d", 2 + i % 2, i); break;
+            case 3: snprintf(texts[i], BENCH_RULE_LENGTH, "mem.MemAvailable < %dM and mem.Dirty > 100k", i % 64); break;
+            default: snprintf(texts[i], BENCH_RULE_LENGTH, "(net.eth0.rx_bytes_rate + net.eth0.tx_bytes_rate) / 1M > %d or "
+                              "cpu.context_switches_rate > 1M", i); break;
+        }
+        add_rule(texts[i]);
+    }
+    uint64_t compile_ns = monotonic_ns() - start;
+    open_rules(NULL);
+
+    uint64_t sample_ns = 1792180665000000000ull;
+    evaluate_rules(sample_ns);
+    struct sampler_stats before = sampler_stats;
+    start = monotonic_ns();
+    for(int i = 0; i < samples; i++) evaluate_rules(sample_ns);
+    uint64_t evaluate_ns = monotonic_ns() - start;
+    struct sampler_stats after = sampler_stats;
+
+    printf("rules: %d rules over %d cpus, %d interfaces (%s)\n", rule_set.num_rules, RECORDING_CPUS, RECORDING_INTERFACES, dir);
+    printf("  %14s %14s %14s %14s\n", "compile ns", "ns/evaluation", "ns/rule", "allocs/eval");
+    printf("  %14.0f %14.0f %14.1f %14.2f\n", (double)compile_ns / rule_set.num_rules, (double)evaluate_ns / samples,
+           (double)evaluate_ns / samples / rule_set.num_rules, (double)(after.allocations - before.allocations) / samples);
+
+    const struct rule *rules = rule_set.rules;
+    int held_back = rules[4].firing;
+    evaluate_rules(sample_ns + 10000000000ull);
+    int failed = 0;
+    //A minus after a number or a metric subtracts, one in an interface is part of its name
+    int minus_read = rules[5].firing && rules[6].firing && rules[7].firing && !rules[8].firing;
+    int dashed = 0;
+    for(int i = 0; i < rule_set.num_bindings; i++) dashed |= strcmp(rule_set.bindings[i].name, "veth-a") == 0;
+    if(!minus_read || !dashed)
+    {
+        printf("  MISMATCH: minus firing %d %d %d %d, veth-a %s\n", rules[5].firing, rules[6].firing, rules[7].firing,
+               rules[8].firing, dashed ? "bound" : "not bound");
+        failed = 1;
+    }
+    if(!rules[0].firing || rules[0].value != cpu_rates.total[CPU_RATE_BUSY] || !rules[1].firing ||
+       rules[1].value != network_rates.devices[1].rate[NET_RATE_R_BYTES] || !rules[2].firing ||
+       rules[2].value != (double)meminfo_snapshot.value[MEMINFO_MEMTOTAL] || rules[3].firing || held_back || !rules[4].firing ||
+       after.allocations != before.allocations)
+    {
+        printf("  MISMATCH: firing %d %d %d %d, %d before its for and %d after, values %.6g %.6g %.6g against %.6g %.6g %.6g,"
+               " %lu allocations\n", rules[0].firing, rules[1].firing, rules[2].firing, rules[3].firing, held_back, rules[4].firing,
+               rules[0].value, rules[1].value, rules[2].value, cpu_rates.total[CPU_RATE_BUSY],
+               network_rates.devices[1].rate[NET_RATE_R_BYTES], (double)meminfo_snapshot.value[MEMINFO_MEMTOTAL],
+               after.allocations - before.allocations);
+        failed = 1;
+    }
+    printf("\n");
+    close_rules();
+    free(texts);
+    free(cpu_time);
+    free(counters);
+    return failed;
+}
+
+/*
+* @brief Checks counter_delta tells a 32 bit wrap from a reset, on its own
+*        and through the rates of an interface whose counters dropped
+*        between two samples: eth0 recreated, its receive bytes going from
+*        1000000 to 500, and its transmit bytes wrapping at 2^32.
+*
+* @returns 0 if every delta came out as expected
+*/
+int bench_counters(const char *base_dir)
+{
+    const uint64_t cases[][3] = {
+        {500, 1000000, 500},                                //Reset well below 2^32
+        {100, UINT32_MAX - 99, 200},                        //Wrapped just past 2^32
+        {COUNTER_WRAP_MARGIN, UINT32_MAX, COUNTER_WRAP_MARGIN}, //Reset, too far past 2^32 to be a wrap
+        {COUNTER_WRAP_MARGIN - 2, UINT32_MAX, COUNTER_WRAP_MARGIN - 1},
+        {7, 5000000000ull, 7},                              //Reset of a 64 bit counter
+        {1000500, 1000000, 500},
+    };
+    int failed = 0;
+    printf("counters: wrap and reset\n");
+    for(int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+    {
+        uint64_t delta = counter_delta(cases[i][0], cases[i][1]);
+        if(delta != cases[i][2])
+        {
+            printf("  MISMATCH: %" PRIu64 " after %" PRIu64 " gave %" PRIu64 ", not %" PRIu64 "\n", cases[i][0], cases[i][1],
+                   delta, cases[i][2]);
+            failed = 1;
+        }
+    }
+
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/counters", base_dir);
+    mkdir(dir, 0755);
+    uint64_t counters[2 * NUM_NETWORK_FIELDS] = {0};
+    uint64_t *eth0 = counters + NUM_NETWORK_FIELDS;
+    eth0[NET_R_BYTES] = 1000000;
+    eth0[NET_T_BYTES] = UINT32_MAX - 99;
+    close_collectors();
+    set_proc_root(dir);
+    write_stat_fixture(dir, 1, NULL);
+    write_meminfo_fixture(dir);
+    write_network_fixture(dir, 2, counters);
+    init_collectors();
+    sample_network_info();
+    eth0[NET_R_BYTES] = 500;
+    eth0[NET_T_BYTES] = 100;
+    write_network_fixture(dir, 2, counters);
+    uint64_t first_ns = network_info.sample_ns;
+    sample_network_info();
+
+    const struct network_rate *rate = &network_rates.devices[1];
+    double seconds = (double)(network_info.sample_ns - first_ns) / 1e9;
+    double received = rate->rate[NET_RATE_R_BYTES] * seconds;
+    double sent = rate->rate[NET_RATE_T_BYTES] * seconds;
+    printf("  eth0 recreated: %.0f bytes received, %.0f sent across the wrap\n", received, sent);
+    if(!rate->valid || received < 499.5 || received > 500.5 || sent < 199.5 || sent > 200.5)
+    {
+        printf("  MISMATCH: eth0 %s, %.1f bytes received and %.1f sent, not 500 and 200\n",
+               rate->valid ? "valid" : "invalid", received, sent);
+        failed = 1;
+    }
+    printf("\n");
+    close_collectors();
+    remove_fixture_set(dir);
+    return failed;
+}
+
+/*
+* @brief Times writing the snapshot of a 256 cpu, 1000 interface proc root
+*        in every export format, then EXPORT_BENCH_CLIENTS clients on a
+*        Unix socket each scraping it EXPORT_BENCH_ROUNDS times over a kept
+*        alive connection, served from the one copy.
+*
+* @returns 0 if every client received the whole response every time
+*/
+int bench_exporter(const char *base_dir, int samples)
+{
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/export", base_dir);
+    mkdir(dir, 0755);
+    write_stat_fixture(dir, EXPORT_BENCH_CPUS, NULL);
+    write_meminfo_fixture(dir);
+    write_network_fixture(dir, EXPORT_BENCH_INTERFACES, NULL);
+
+    close_collectors();
+    set_proc_root(dir);
+    init_collectors();
+    sample_cpu_stats();
+    sample_mem_info();
+    sample_network_info();
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(snprintf(address.sun_path, sizeof(address.sun_path), "%s/export.sock", base_dir) >= (int)sizeof(address.sun_path))
+    {
+        fatal_error("socket path too long under ", base_dir);
+    }
+    char socket_address[EXPORT_ADDRESS_LENGTH];
+    snprintf(socket_address, sizeof(socket_address), "unix:%s", address.sun_path);
+    open_exporter(socket_address);
+    //Twice, as the first responses are still the latest while the next are written
+    publish_export_snapshot(realtime_ns());
+    publish_export_snapshot(realtime_ns());
+
+    struct sampler_stats before = sampler_stats;
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < samples; i++) publish_export_snapshot(realtime_ns());
+    uint64_t publish_ns = monotonic_ns() - start;
+    struct sampler_stats after = sampler_stats;
+
+    int fds[EXPORT_BENCH_CLIENTS];
+    size_t received[EXPORT_BENCH_CLIENTS];
+    for(int i = 0; i < EXPORT_BENCH_CLIENTS; i++)
+    {
+        fds[i] = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(fds[i] < 0 || connect(fds[i], (struct sockaddr*)&address, sizeof(address)) != 0) fatal_error("failed to connect to ", address.sun_path);
+    }
+    serve_exporter(exporter.epoll_fd);
+
+    const struct export_response *response = exporter.latest[EXPORT_PROMETHEUS];
+    size_t expected = response->end - response->start;
+    const char request[] = "GET /metrics HTTP/1.1\r\nHost: bench\r\n\r\n";
+    int failed = 0;
+    uint64_t requests_before = exporter.requests;
+    start = monotonic_ns();
+    for(int round = 0; round < EXPORT_BENCH_ROUNDS && !failed; round++)
+    {
+        for(int i = 0; i < EXPORT_BENCH_CLIENTS; i++)
+        {
+            received[i] = 0;
+            if(send(fds[i], request, sizeof(request) - 1, MSG_NOSIGNAL) != (ssize_t)sizeof(request) - 1) failed = 1;
+        }
+        uint64_t give_up = monotonic_ns() + 10000000000ull;
+        while(!failed && drain_export_clients(fds, received, expected) < EXPORT_BENCH_CLIENTS)
+        {
+            serve_exporter(exporter.epoll_fd);
+            if(monotonic_ns() > give_up) failed = 1;
+        }
+    }
+    uint64_t serve_ns = monotonic_ns() - start;
+    uint64_t requests = exporter.requests - requests_before;
+
+    printf("exporter: %d cpus, %d interfaces, %d clients (%s)\n", EXPORT_BENCH_CPUS, EXPORT_BENCH_INTERFACES,
+           EXPORT_BENCH_CLIENTS, address.sun_path);
+    printf("  %14s %14s %14s %14s %14s\n", "publish ns", "allocs/sample", "text bytes", "json bytes", "ns/request");
+    printf("  %14.0f %14.2f %14zu %14zu %14.0f\n", (double)publish_ns / samples,
+           (double)(after.allocations - before.allocations) / samples, expected,
+           exporter.latest[EXPORT_JSON]->end - exporter.latest[EXPORT_JSON]->start,
+           requests > 0 ? (double)serve_ns / requests : 0);
+    if(failed || requests != (uint64_t)EXPORT_BENCH_CLIENTS * EXPORT_BENCH_ROUNDS || exporter.num_clients != EXPORT_BENCH_CLIENTS)
+    {
+        printf("  MISMATCH: %" PRIu64 " of %d requests answered in full on %d connections\n", requests,
+               EXPORT_BENCH_CLIENTS * EXPORT_BENCH_ROUNDS, exporter.num_clients);
+        failed = 1;
+    }
+    printf("\n");
+
+    for(int i = 0; i < EXPORT_BENCH_CLIENTS; i++) close(fds[i]);
+    close_exporter();
+    close_collectors();
+    remove_fixture_set(dir);
+    return failed;
+}
+
+/*
+* @brief Publishes to shared memory as fast as it can until told to stop,
+*        with every counter the reader checks set to the publication number,
+*        so a torn copy shows as counters that differ.
+*/
+void *shm_writer_thread(void *stop)
+{
+    for(uint64_t i = 1; !__atomic_load_n((int*)stop, __ATOMIC_RELAXED); i++)
+    {
+        cpu_stats.total.time[CPU_USER] = i;
+        for(int cpu = 0; cpu < cpu_stats.num_cpus; cpu++) cpu_stats.time[CPU_USER][cpu] = i;
+        for(int device = 0; device < network_info.num_devices; device++) network_info.devices[device].counter[0] = i;
+        publish_shm_snapshot(i);
+    }
+    return NULL;
+}
+
+/*
+* @brief Times publishing a fixture's sample to shared memory and reading
+*        it back, the summary alone and whole, then races a reader against
+*        a writer thread to check no copy is torn, and grows the interfaces
+*        past the segment to check readers move to the new one.
+*
+* @returns 0 if every copy was consistent
+*/
+int bench_shm(const char *base_dir, int num_cpus, int num_interfaces, int samples)
+{
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/shm", base_dir);
+    mkdir(dir, 0755);
+    write_stat_fixture(dir, num_cpus, NULL);
+    write_meminfo_fixture(dir);
+    write_network_fixture(dir, num_interfaces, NULL);
+    close_collectors();
+    set_proc_root(dir);
+    init_collectors();
+    sample_cpu_stats();
+    sample_mem_info();
+    sample_network_info();
+
+    char name[SHM_NAME_LENGTH];
+    snprintf(name, sizeof(name), "/sys_mon_bench.%d", (int)getpid());
+    open_shm_publisher(name);
+    publish_shm_snapshot(realtime_ns());
+    struct shm_reader reader;
+    struct shm_snapshot snapshot;
+    if(shm_open_reader(&reader, &snapshot, name) != SHM_OK) fatal_error("failed to open the shared memory just published as ", name);
+
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < samples; i++) publish_shm_snapshot(realtime_ns());
+    uint64_t publish_ns = monotonic_ns() - start;
+    start = monotonic_ns();
+    for(int i = 0; i < SHM_BENCH_READS; i++) shm_read(&reader, &snapshot, 0);
+    uint64_t summary_ns = monotonic_ns() - start;
+    start = monotonic_ns();
+    for(int i = 0; i < SHM_BENCH_READS; i++) shm_read(&reader, &snapshot, SHM_READ_ALL);
+    uint64_t full_ns = monotonic_ns() - start;
+    int failed = snapshot.summary.num_cpus != (uint32_t)num_cpus || snapshot.summary.num_interfaces != (uint32_t)num_interfaces;
+
+    int stop = 0;
+    pthread_t writer;
+    if(pthread_create(&writer, NULL, shm_writer_thread, &stop) != 0) fatal_error("failed to start the writer thread for ", name);
+    uint64_t reads = 0;
+    uint64_t torn = 0;
+    uint64_t retries_before = snapshot.retries;
+    uint64_t race_end = monotonic_ns() + SHM_BENCH_RACE_NS;
+    while(monotonic_ns() < race_end)
+    {
+        if(shm_read(&reader, &snapshot, SHM_READ_ALL) != SHM_OK) continue;
+        uint64_t expected = snapshot.summary.cpu_total[CPU_USER];
+        int consistent = 1;
+        for(uint32_t cpu = 0; cpu < snapshot.summary.num_cpus; cpu++) consistent &= snapshot.cpus[cpu].time[CPU_USER] == expected;
+        for(uint32_t i = 0; i < snapshot.summary.num_interfaces; i++) consistent &= snapshot.interfaces[i].counter[0] == expected;
+        //Before the writer's first publication the counters are the fixture's
+        if(expected > 0 && snapshot.summary.sample_ns == expected) torn += !consistent;
+        reads++;
+    }
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    pthread_join(writer, NULL);
+    uint64_t retries = snapshot.retries - retries_before;
+
+    //A writer stopped, then killed, between making the sequence odd and even again
+    struct shm_header *header = shm_publisher.header;
+    __atomic_store_n(&header->sequence, header->sequence + 1, __ATOMIC_RELEASE);
+    start = monotonic_ns();
+    int busy = shm_read(&reader, &snapshot, 0);
+    uint64_t busy_ns = monotonic_ns() - start;
+    pid_t child = fork();
+    if(child < 0) fatal_error("failed to fork for a dead writer of ", name);
+    if(child == 0) _exit(0);
+    waitpid(child, NULL, 0);
+    header->writer_pid = (uint64_t)child;
+    int dead = shm_read(&reader, &snapshot, 0);
+    header->writer_pid = (uint64_t)getpid();
+    __atomic_store_n(&header->sequence, header->sequence + 1, __ATOMIC_RELEASE);
+    int recovered = shm_read(&reader, &snapshot, 0);
+
+    //More interfaces than the segment holds move the writer to a new one
+    uint32_t capacity = shm_publisher.header->interface_capacity;
+    reserve_network_devices((int)capacity + 1);
+    for(int i = network_info.num_devices; i <= (int)capacity; i++)
+    {
+        snprintf(network_info.devices[i].face, MAX_NETWORK_FACE_LENGTH, "grow%d", i);
+        network_info.devices[i].id = -1;
+    }
+    network_info.num_devices = (int)capacity + 1;
+    publish_shm_snapshot(realtime_ns());
+    int stale = shm_read(&reader, &snapshot, 0) == SHM_STALE;
+    int reopened = stale && shm_reopen(&reader, &snapshot) == SHM_OK && shm_read(&reader, &snapshot, SHM_READ_ALL) == SHM_OK &&
+                   snapshot.summary.num_interfaces == capacity + 1;
+
+    printf("shared memory: %d cpus, %d interfaces, %zu KB segment\n", num_cpus, num_interfaces, reader.size / 1024);
+    printf("  %14s %14s %14s %14s %14s %14s %14s\n", "publish ns", "summary ns", "full read ns", "race reads", "retries", "torn",
+           "busy ms");
+    printf("  %14.0f %14.1f %14.1f %14" PRIu64 " %14" PRIu64 " %14" PRIu64 " %14.1f\n", (double)publish_ns / samples,
+           (double)summary_ns / SHM_BENCH_READS, (double)full_ns / SHM_BENCH_READS, reads, retries, torn, (double)busy_ns / 1e6);
+    if(failed || torn > 0 || !reopened || busy != SHM_BUSY || dead != SHM_DEAD || recovered != SHM_OK)
+    {
+        printf("  MISMATCH: %" PRIu64 " torn copies, %s after growing to %u interfaces, a held sequence read as %d, %d with the"
+               " writer dead and %d released\n", torn, reopened ? "reopened" : "not reopened", capacity + 1, busy, dead, recovered);
+        failed = 1;
+    }
+    printf("\n");
+
+    shm_close_reader(&reader, &snapshot);
+    close_shm_publisher();
+    close_collectors();
+    remove_fixture_set(dir);
+    return failed;
+}
+
+/*
+* @brief The sinks' side of the collector threads in bench_pipeline.
+*/
+void bench_cpu_apply()
+{
+    update_cpu_stats();
+    update_cpu_rates();
+}
+
+void bench_network_apply()
+{
+    update_network_info();
+    update_network_rates();
+}
+
+/*
+* @brief Runs the cpu, memory and network collectors on threads every
+*        PIPELINE_BENCH_INTERVAL_NS against a fixture, with a sinks' thread
+*        that stalls now and then like a slow terminal. Reports for each
+*        queue what was read, applied and dropped, and the deadlines the
+*        threads missed, which a stalled sink should not cause.
+*
+* @returns 0 if every collector was applied, the stalls dropped samples
+*          instead of holding up the threads, and what was applied after a
+*          stall was read during it and never older than what came before
+*/
+int bench_pipeline(const char *base_dir)
+{
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/pipeline", base_dir);
+    mkdir(dir, 0755);
+    write_stat_fixture(dir, RECORDING_CPUS, NULL);
+    write_meminfo_fixture(dir);
+    write_network_fixture(dir, EXPORT_BENCH_INTERFACES, NULL);
+    close_collectors();
+    set_proc_root(dir);
+    init_collectors();
+    sample_cpu_stats();
+    sample_network_info();
+
+    add_pipeline_stage(schedule_job("cpu", PIPELINE_BENCH_INTERVAL_NS, NULL), &cpu_source, bench_cpu_apply, -1);
+    add_pipeline_stage(schedule_job("memory", PIPELINE_BENCH_INTERVAL_NS, NULL), &mem_source, update_meminfo, -1);
+    add_pipeline_stage(schedule_job("network", PIPELINE_BENCH_INTERVAL_NS, NULL), &network_source, bench_network_apply, -1);
+    start_pipeline();
+
+    int drains = 0;
+    int stalls = 0;
+    int backwards = 0;
+    int stale = 0;
+    uint64_t applied_ns[MAX_PIPELINE_STAGES] = {0};
+    uint64_t stall_end = 0;
+    struct pollfd wake = {pipeline.wake_fd, POLLIN, 0};
+    uint64_t end = monotonic_ns() + PIPELINE_BENCH_NS;
+    while(monotonic_ns() < end)
+    {
+        if(poll(&wake, 1, 100) <= 0) continue;
+        drain_pipeline(pipeline.wake_fd);
+        for(int i = 0; i < pipeline.num_stages; i++)
+        {
+            uint64_t read_ns = pipeline.stages[i].source->read_ns;
+            backwards += read_ns < applied_ns[i];
+            //Every thread read several times during the stall, the last of them is what should be shown
+            stale += stall_end > 0 && read_ns + 2 * PIPELINE_BENCH_INTERVAL_NS < stall_end;
+            applied_ns[i] = read_ns;
+        }
+        stall_end = 0;
+        if(++drains % PIPELINE_BENCH_STALL_EVERY == 0)
+        {
+            usleep(PIPELINE_BENCH_STALL_US);
+            stall_end = monotonic_ns();
+            stalls++;
+        }
+    }
+
+    stop_pipeline();
+    int failed = cpu_stats.num_cpus != RECORDING_CPUS || network_info.num_devices != EXPORT_BENCH_INTERFACES;
+    uint64_t total_dropped = 0;
+    printf("pipeline: %d collector threads every %.0f ms, %d sink stalls of %d ms\n", pipeline.num_stages,
+           (double)PIPELINE_BENCH_INTERVAL_NS / 1e6, stalls, PIPELINE_BENCH_STALL_US / 1000);
+    printf("  %9s %10s %10s %10s %10s %12s %12s\n", "thread", "read", "applied", "dropped", "missed", "latency us", "max us");
+    for(int i = 0; i < pipeline.num_stages; i++)
+    {
+        const struct pipeline_stage *stage = &pipeline.stages[i];
+        printf("  %9s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12.1f %12.1f\n", stage->job->name,
+               stage->queue.published, stage->applied, stage->queue.dropped, stage->job->missed,
+               stage->applied > 0 ? (double)stage->latency_sum_ns / stage->applied / 1000 : 0, (double)stage->latency_max_ns / 1000);
+        failed |= stage->applied == 0;
+        total_dropped += stage->queue.dropped;
+    }
+    if(failed || (stalls > 0 && total_dropped == 0) || backwards > 0 || stale > 0)
+    {
+        printf("  MISMATCH: %s, %d samples older than the one before, %d from before a stall applied after it\n",
+               failed ? "a collector was not applied in full" : total_dropped == 0 ? "the stalls dropped no sample" :
+               "every collector was applied", backwards, stale);
+        failed = 1;
+    }
+    printf("\n");
+
+    free_pipeline();
+    num_scheduled_jobs = 0;
+    close_collectors();
+    remove_fixture_set(dir);
+    return failed;
+}
+
+/*
+* Deadline and start of every tick of the two scheduler bench jobs.
+*/
+struct bench_ticks
+{
+    int count;
+    uint64_t deadline_ns[SCHEDULER_BENCH_MAX_TICKS];
+    uint64_t start_ns[SCHEDULER_BENCH_MAX_TICKS];
+};
+
+struct bench_ticks fast_ticks;
+struct bench_ticks slow_ticks;
+uint64_t scheduler_bench_end_ns;
+
+/*
+* @brief Notes the deadline being run and when it started.
+*/
+void note_bench_tick(struct bench_ticks *ticks)
+{
+    if(ticks->count == SCHEDULER_BENCH_MAX_TICKS) return;
+    ticks->deadline_ns[ticks->count] = scheduler_tick_ns;
+    ticks->start_ns[ticks->count] = realtime_ns();
+    ticks->count++;
+}
+
+void bench_fast_tick()
+{
+    note_bench_tick(&fast_ticks);
+    if(fast_ticks.count == SCHEDULER_BENCH_OVERRUN) usleep(SCHEDULER_BENCH_OVERRUN_NS / 1000);
+}
+
+void bench_slow_tick()
+{
+    note_bench_tick(&slow_ticks);
+    if(realtime_ns() >= scheduler_bench_end_ns) stop_requested = 1;
+}
+
+void bench_render()
+{
+}
+
+/*
+* @brief Checks that a job only ran on its aligned deadlines, each for the
+*        latest one due, and that the deadlines it skipped are the ones it
+*        counted as missed.
+*
+* @returns the number of ticks that broke one of those
+*/
+int check_bench_ticks(const struct scheduled_job *job, const struct bench_ticks *ticks)
+{
+    int bad = 0;
+    uint64_t skipped = 0;
+    for(int i = 0; i < ticks->count; i++)
+    {
+        uint64_t deadline = ticks->deadline_ns[i];
+        int off_grid = deadline % job->interval_ns != 0;
+        //Started before its deadline, or with a later deadline already due, as a burst of queued ticks would
+        int late = ticks->start_ns[i] < deadline || ticks->start_ns[i] >= deadline + job->interval_ns;
+        int backwards = i > 0 && deadline <= ticks->deadline_ns[i - 1];
+        if(i > 0 && !backwards) skipped += (deadline - ticks->deadline_ns[i - 1]) / job->interval_ns - 1;
+        if(off_grid || late || backwards)
+        {
+            printf("  MISMATCH: tick %d of %s for deadline %" PRIu64 " started %" PRIu64 " ns after it%s\n", i, job->name,
+                   deadline, ticks->start_ns[i] - deadline, off_grid ? ", off the grid" : backwards ? ", not after the last" : "");
+            bad++;
+        }
+    }
+    if(skipped != job->missed || (uint64_t)ticks->count != job->ticks)
+    {
+        printf("  MISMATCH: %s skipped %" PRIu64 " deadlines and counted %" PRIu64 " missed, %d ticks of %" PRIu64 "\n",
+               job->name, skipped, job->missed, ticks->count, job->ticks);
+        bad++;
+    }
+    return bad;
+}
+
+/*
+* @brief Runs a fast and a slow job together for SCHEDULER_BENCH_NS, the
+*        fast one overrunning once by several of its intervals, and checks
+*        that every tick lands on its aligned grid and that the overrun
+*        skips deadlines instead of running them back to back.
+*/
+int bench_scheduler()
+{
+    memset(&fast_ticks, 0, sizeof(fast_ticks));
+    memset(&slow_ticks, 0, sizeof(slow_ticks));
+    num_scheduled_jobs = 0;
+    stop_requested = 0;
+    struct scheduled_job *fast = schedule_job("fast", SCHEDULER_BENCH_FAST_NS, bench_fast_tick);
+    struct scheduled_job *slow = schedule_job("slow", SCHEDULER_BENCH_SLOW_NS, bench_slow_tick);
+    scheduler_bench_end_ns = realtime_ns() + SCHEDULER_BENCH_NS;
+    run_scheduler(bench_render);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    stop_requested = 0;
+
+    printf("scheduler: two jobs for %.0f ms, the fast one overrunning tick %d by %.0f ms\n", (double)SCHEDULER_BENCH_NS / 1e6,
+           SCHEDULER_BENCH_OVERRUN, (double)SCHEDULER_BENCH_OVERRUN_NS / 1e6);
+    printf("  %9s %12s %10s %10s %12s %12s\n", "job", "interval ms", "ticks", "missed", "jitter us", "max us");
+    const struct scheduled_job *jobs[] = {fast, slow};
+    for(int i = 0; i < 2; i++)
+    {
+        printf("  %9s %12.0f %10" PRIu64 " %10" PRIu64 " %12.1f %12.1f\n", jobs[i]->name, (double)jobs[i]->interval_ns / 1e6,
+               jobs[i]->ticks, jobs[i]->missed, jobs[i]->ticks > 0 ? (double)jobs[i]->jitter_sum_ns / jobs[i]->ticks / 1000 : 0,
+               (double)jobs[i]->jitter_max_ns / 1000);
+    }
+
+    int failed = check_bench_ticks(fast, &fast_ticks) + check_bench_ticks(slow, &slow_ticks) > 0;
+    //Of the deadlines that passed during the overrun only the latest is run
+    uint64_t overrun_skips = SCHEDULER_BENCH_OVERRUN_NS / SCHEDULER_BENCH_FAST_NS - 1;
+    if(fast_ticks.count <= SCHEDULER_BENCH_OVERRUN || fast->missed < overrun_skips || slow_ticks.count < 2)
+    {
+        printf("  MISMATCH: %d fast ticks missing %" PRIu64 " deadlines, at least %" PRIu64 " expected for the overrun, %d slow ticks\n",
+               fast_ticks.count, fast->missed, overrun_skips, slow_ticks.count);
+        failed = 1;
+    }
+    printf("\n");
+    num_scheduled_jobs = 0;
+    return failed;
+}
+
+/*
+* @brief Value of a metric in a sample of the history bench: random, random
+*        with NaN gaps (one longer than the 10s window), a sawtooth, and
+*        one with a value only every 50th sample.
+*/
+float history_bench_value(int metric, int sample)
+{
+    float value = (float)fixture_random(100000) / 100;
+    if(metric == 1 && (sample % 7 == 3 || (sample >= 300 && sample < 340))) return NAN;
+    if(metric == 2) return (float)(sample % 97);
+    if(metric == 3 && sample % 50 != 0) return NAN;
+    return value;
+}
+
+/*
+* @brief Works out the aggregates history_query gives by looking at every
+*        sample that is still in the ring and inside the window.
+*/
+void brute_force_window(const uint64_t *time_ns, const float *values, int num_samples, uint32_t capacity, int metric,
+                        int window, struct window_stats *stats, float *scratch)
+{
+    memset(stats, 0, sizeof(*stats));
+    uint64_t newest = time_ns[num_samples - 1];
+    uint64_t oldest = newest > history_window_ns[window] ? newest - history_window_ns[window] : 0;
+    int first = num_samples > (int)capacity ? num_samples - (int)capacity : 0;
+    int count = 0;
+    double sum = 0;
+    for(int sample = first; sample < num_samples; sample++)
+    {
+        float value = values[sample * HISTORY_BENCH_METRICS + metric];
+        if(time_ns[sample] <= oldest || isnan(value)) continue;
+        if(count == 0 || value < stats->min) stats->min = value;
+        if(count == 0 || value > stats->max) stats->max = value;
+        sum += value;
+        scratch[count++] = value;
+    }
+    stats->samples = count;
+    if(count == 0) return;
+    stats->mean = (float)(sum / count);
+
+    //Insertion sort, it is only a few hundred values
+    for(int i = 1; i < count; i++)
+    {
+        float value = scratch[i];
+        int j = i;
+        for(; j > 0 && scratch[j - 1] > value; j--) scratch[j] = scratch[j - 1];
+        scratch[j] = value;
+    }
+    int rank = (int)ceilf(0.95f * (float)count);
+    stats->p95 = scratch[rank > 0 ? rank - 1 : 0];
+}
+
+/*
+* @brief Pushes HISTORY_BENCH_SAMPLES samples into histories of each of
+*        history_bench_capacities and after every push checks history_query
+*        of every metric and window against a scan of the same samples.
+*
+* @returns 0 if every query matched
+*/
+int bench_history()
+{
+    uint64_t *time_ns = calloc(HISTORY_BENCH_SAMPLES, sizeof(uint64_t));
+    float *values = calloc((size_t)HISTORY_BENCH_SAMPLES * HISTORY_BENCH_METRICS, sizeof(float));
+    float *scratch = calloc(HISTORY_BENCH_SAMPLES, sizeof(float));
+    if(time_ns == NULL || values == NULL || scratch == NULL) fatal_error("out of memory for ", "the history bench");
+    uint64_t gap = 0;
+    for(int sample = 0; sample < HISTORY_BENCH_SAMPLES; sample++)
+    {
+        if(sample == HISTORY_BENCH_GAP_AT) gap = HISTORY_BENCH_GAP_NS;
+        time_ns[sample] = 1000000000000ull + (uint64_t)sample * 1000000000ull + gap + fixture_random(500000000ull);
+        for(int metric = 0; metric < HISTORY_BENCH_METRICS; metric++)
+        {
+            values[sample * HISTORY_BENCH_METRICS + metric] = history_bench_value(metric, sample);
+        }
+    }
+
+    int failed = 0;
+    printf("history: %d samples 1 s apart of %d metrics with NaN gaps, every window queried after each push\n",
+           HISTORY_BENCH_SAMPLES, HISTORY_BENCH_METRICS);
+    printf("  %9s %12s %12s %12s %12s %12s\n", "capacity", "queries", "empty", "mismatches", "push ns", "query ns");
+    for(int i = 0; i < (int)(sizeof(history_bench_capacities) / sizeof(history_bench_capacities[0])); i++)
+    {
+        uint32_t capacity = history_bench_capacities[i];
+        struct history history;
+        history_init(&history, HISTORY_BENCH_METRICS, capacity);
+        int queries = 0;
+        int empty = 0;
+        int mismatches = 0;
+        uint64_t push_ns = 0;
+        uint64_t query_ns = 0;
+        for(int sample = 0; sample < HISTORY_BENCH_SAMPLES; sample++)
+        {
+            uint64_t start = monotonic_ns();
+            history_push(&history, time_ns[sample], &values[sample * HISTORY_BENCH_METRICS]);
+            push_ns += monotonic_ns() - start;
+            for(int metric = 0; metric < HISTORY_BENCH_METRICS; metric++)
+            {
+                for(int window = 0; window < NUM_WINDOWS; window++)
+                {
+                    struct window_stats got;
+                    struct window_stats want;
+                    start = monotonic_ns();
+                    history_query(&history, metric, window, &got);
+                    query_ns += monotonic_ns() - start;
+                    brute_force_window(time_ns, values, sample + 1, capacity, metric, window, &want, scratch);
+                    queries++;
+                    empty += want.samples == 0;
+
+                    float tolerance = 1e-3f * (1 + fabsf(want.max));
+                    if(got.samples == want.samples && got.min == want.min && got.max == want.max &&
+                       fabsf(got.mean - want.mean) <= tolerance && got.p95 == want.p95) continue;
+                    if(mismatches++ > 0) continue;
+                    printf("  MISMATCH: sample %d metric %d over %s: %d samples min %g max %g mean %g p95 %g, "
+                           "a scan gives %d samples min %g max %g mean %g p95 %g\n", sample, metric,
+                           history_window_names[window], got.samples, got.min, got.max, got.mean, got.p95, want.samples,
+                           want.min, want.max, want.mean, want.p95);
+                }
+            }
+        }
+        printf("  %9u %12d %12d %12d %12.0f %12.0f\n", capacity, queries, empty, mismatches,
+               (double)push_ns / HISTORY_BENCH_SAMPLES, (double)query_ns / queries);
+        failed |= mismatches > 0;
+        history_free(&history);
+    }
+    printf("\n");
+    free(time_ns);
+    free(values);
+    free(scratch);
+    return failed;
+}
+
+/*
+* @brief Prints a frame shaped like the cpu table, with the numbers of the
+*        first changed rows depending on the frame.
+*/
+void draw_bench_frame(int frame, int changed)
+{
+    screen_begin_frame();
+    screen_printf("%-6s %8s %8s %8s %8s %20s\n", "cpu", "user", "system", "idle", "iowait", "interrupts");
+    for(int row = 0; row < SCREEN_BENCH_ROWS; row++)
+    {
+        int moved = row < changed ? frame : 0;
+        screen_printf("cpu%-3d %8.1f %8.1f %8.1f %8.1f %20" PRIu64 "\n", row, 10.0 + row + moved, 5.0 + moved,
+                      80.0 - row - moved, 1.5, (uint64_t)row * 1000003 + (uint64_t)moved * 7);
+    }
+    screen_end_frame();
+}
+
+/*
+* @brief Draws a full frame, one that changed in a few rows and the same
+*        one after a resize, and checks that only the changes are written
+*        until the resize redraws every cell.
+*/
+int bench_screen()
+{
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if(saved_stdout < 0 || null_fd < 0) fatal_error("Could not open /dev/null for the screen bench", NULL);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    size_t written[3];
+    int cleared[3];
+    open_screen();
+    for(int frame = 0; frame < 3; frame++)
+    {
+        if(frame == 2) screen_resized = 1;
+        draw_bench_frame(frame > 0 ? 1 : 0, SCREEN_BENCH_CHANGED);
+        written[frame] = screen.last_bytes;
+        cleared[frame] = memcmp(screen.output, "\033[2J", 4) == 0;
+    }
+    size_t frame_bytes = screen.last_frame_bytes;
+    int rows = screen.rows;
+    int columns = screen.columns;
+    close_screen();
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    const char *names[] = {"first", "changed", "resized"};
+    printf("screen: %d rows of text on %dx%d cells, %d rows changed\n", SCREEN_BENCH_ROWS + 1, columns, rows, SCREEN_BENCH_CHANGED);
+    printf("  %9s %12s %12s %8s\n", "frame", "frame bytes", "written", "cleared");
+    for(int frame = 0; frame < 3; frame++)
+        printf("  %9s %12zu %12zu %8s\n", names[frame], frame_bytes, written[frame], cleared[frame] ? "yes" : "no");
+
+    int failed = 0;
+    for(int frame = 0; frame < 3; frame += 2)
+    {
+        if(!cleared[frame] || written[frame] < frame_bytes)
+        {
+            printf("  MISMATCH: the %s frame wrote %zu bytes of %zu without %s a full redraw\n", names[frame],
+                   written[frame], frame_bytes, cleared[frame] ? "finishing" : "starting");
+            failed = 1;
+        }
+    }
+    if(cleared[1] || written[1] * 10 > frame_bytes)
+    {
+        printf("  MISMATCH: the changed frame wrote %zu bytes, more than a tenth of its %zu\n", written[1], frame_bytes);
+        failed = 1;
+    }
+    printf("\n");
+    return failed;
+}
+
+/*
+* @brief Writes the files proc-top reads for one process.
+*/
+void write_process_fixture(const char *dir, int pid)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%d", pid);
+    char pid_dir[PROC_PATH_LENGTH - 32];
+    snprintf(pid_dir, sizeof(pid_dir), "%s/%s", dir, name);
+    mkdir(pid_dir, 0755);
+
+    FILE *file = open_fixture(pid_dir, "stat");
+    fprintf(file, "%d (worker %d) S 1 %d %d 0 -1 4194560 %" PRIu64 " 0 0 0 %" PRIu64 " %" PRIu64 " 0 0 20 0 1 0 %" PRIu64
+                  " 8904704 %" PRIu64 " 18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+            pid, pid % 1000, pid, pid, fixture_random(100000), fixture_random(1000000), fixture_random(100000),
+            fixture_random(10000000), fixture_random(100000));
+    fclose(file);
+    file = open_fixture(pid_dir, "statm");
+    fprintf(file, "2174 %" PRIu64 " 325 4 0 164 0\n", fixture_random(100000));
+    fclose(file);
+    file = open_fixture(pid_dir, "io");
+    fprintf(file, "rchar: %" PRIu64 "\nwchar: %" PRIu64 "\nsyscr: 1022\nsyscw: 49\nread_bytes: %" PRIu64 "\nwrite_bytes: %" PRIu64
+                  "\ncancelled_write_bytes: 0\n", fixture_random(1ull << 32), fixture_random(1ull << 32),
+            fixture_random(1ull << 32), fixture_random(1ull << 32));
+    fclose(file);
+    //One in eight has no schedstat, as without CONFIG_SCHED_INFO, and one in eight all zeros, as with schedstats off
+    if(pid % 8 != 0)
+    {
+        file = open_fixture(pid_dir, "schedstat");
+        if(pid % 8 == 4) fprintf(file, "0 0 0\n");
+        else fprintf(file, "%" PRIu64 " %" PRIu64 " %d\n", fixture_random(1ull << 40), fixture_random(1ull << 36), pid * 3);
+        fclose(file);
+    }
+    if(pid % 4 == 0)
+    {
+        file = open_fixture(pid_dir, "status");
+        fprintf(file, "Name:\tworker %d\nUmask:\t0022\nState:\tS (sleeping)\nTgid:\t%d\nNgid:\t0\nPid:\t%d\nPPid:\t1\n"
+                      "TracerPid:\t0\nUid:\t0\t0\t0\t0\nGid:\t0\t0\t0\t0\nFDSize:\t64\nGroups:\t \nNStgid:\t%d\nNSpid:\t%d\n"
+                      "NSpgid:\t%d\nNSsid:\t%d\nKthread:\t0\nVmPeak:\t    8696 kB\nVmSize:\t    8696 kB\nVmLck:\t       0 kB\n"
+                      "VmPin:\t       0 kB\nVmHWM:\t    1300 kB\nVmRSS:\t    1300 kB\nRssAnon:\t       0 kB\n"
+                      "RssFile:\t    1300 kB\nRssShmem:\t       0 kB\nVmData:\t     360 kB\nVmStk:\t     132 kB\n"
+                      "VmExe:\t      20 kB\nVmLib:\t    1724 kB\nVmPTE:\t      56 kB\nVmSwap:\t       0 kB\n"
+                      "HugetlbPages:\t       0 kB\nCoreDumping:\t0\nTHP_enabled:\t1\nuntag_mask:\t0xffffffffffffffff\n"
+                      "Threads:\t1\nSigQ:\t0/63704\nSigPnd:\t0000000000000000\nShdPnd:\t0000000000000000\n"
+                      "SigBlk:\t0000000000000000\nSigIgn:\t0000000000000000\nSigCgt:\t0000000000000000\n"
+                      "CapInh:\t0000000000000000\nCapPrm:\t000001ffffffffff\nCapEff:\t000001ffffffffff\n"
+                      "CapBnd:\t000001ffffffffff\nCapAmb:\t0000000000000000\nNoNewPrivs:\t0\nSeccomp:\t0\n"
+                      "Seccomp_filters:\t0\nSpeculation_Store_Bypass:\tthread vulnerable\nSpeculationIndirectBranch:\tconditional enabled\n"
+                      "Cpus_allowed:\tff\nCpus_allowed_list:\t0-7\nMems_allowed:\t00000000,00000001\nMems_allowed_list:\t0\n"
+                      "voluntary_ctxt_switches:\t%d\nnonvoluntary_ctxt_switches:\t%d\n",
+                pid % 1000, pid, pid, pid, pid, pid, pid, pid, pid * 2);
+        fclose(file);
+    }
+}
+
+/*
+* @brief Removes what bench_proc_top generated.
+*/
+void remove_process_fixtures(const char *dir, int num_processes)
+{
+    const char *files[] = {"stat", "statm", "io", "schedstat", "status"};
+    char path[PROC_PATH_LENGTH];
+    for(int pid = 1; pid <= num_processes; pid++)
+    {
+        for(int i = 0; i < 5; i++)
+        {
+            snprintf(path, sizeof(path), "%s/%d/%s", dir, pid, files[i]);
+            remove(path);
+        }
+        snprintf(path, sizeof(path), "%s/%d", dir, pid);
+        rmdir(path);
+    }
+    snprintf(path, sizeof(path), "%s/loadavg", dir);
+    remove(path);
+    rmdir(dir);
+}
+
+/*
+* @brief Times proc-top refreshes of a proc root with num_processes
+*        generated processes: the first, which lists the directory and
+*        opens every file, and the ones after it, on one thread and on
+*        num_threads. Says whether a refresh meets PROC_TOP_GOAL_NS a
+*        process, 50 ms for 50000.
+*
+* @returns 0 if every process was found with the switches of its schedstat,
+*          or of its status when schedstat has none
+*/
+int bench_proc_top(const char *base_dir, int num_processes, int num_threads)
+{
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/processes", base_dir);
+    mkdir(dir, 0755);
+    FILE *file = open_fixture(dir, "loadavg");
+    fprintf(file, "0.52 0.58 0.59 3/%d %d\n", num_processes, num_processes);
+    fclose(file);
+    for(int pid = 1; pid <= num_processes; pid++) write_process_fixture(dir, pid);
+
+    close_collectors();
+    set_proc_root(dir);
+    int failed = 0;
+    printf("proc-top: %d processes (%s)\n", num_processes, dir);
+    printf("  %14s %14s %14s %14s %14s\n", "threads", "first ms", "refresh ms", "fds kept open", "allocs first");
+    int thread_counts[2] = {1, num_threads};
+    uint64_t best_ns = UINT64_MAX;
+    int best_threads = 1;
+    for(int run = 0; run < (num_threads > 1 ? 2 : 1); run++)
+    {
+        init_proc_top(DEFAULT_PROC_TOP_N, PROC_SORT_CPU, thread_counts[run]);
+        struct sampler_stats before = sampler_stats;
+        uint64_t start = monotonic_ns();
+        refresh_proc_top();
+        uint64_t first_ns = monotonic_ns() - start;
+        struct sampler_stats after = sampler_stats;
+
+        uint64_t refresh_ns = 0;
+        for(int i = 0; i < PROC_TOP_REFRESHES; i++)
+        {
+            start = monotonic_ns();
+            refresh_proc_top();
+            refresh_ns += monotonic_ns() - start;
+        }
+        refresh_ns /= PROC_TOP_REFRESHES;
+        if(refresh_ns < best_ns)
+        {
+            best_ns = refresh_ns;
+            best_threads = proc_top.num_threads;
+        }
+        printf("  %14d %14.1f %14.1f %14d %14lu\n", proc_top.num_threads, (double)first_ns / 1e6, (double)refresh_ns / 1e6,
+               proc_top.fds_open, after.allocations - before.allocations);
+
+        int wrong_switches = 0;
+        for(int i = 0; i < proc_top.num_entries; i++) wrong_switches += proc_top.entries[i].switches != (uint64_t)proc_top.entries[i].pid * 3;
+        if(proc_top.num_entries != num_processes || wrong_switches > 0)
+        {
+            printf("  MISMATCH: tracked %d processes, fixture has %d, %d with the wrong switches\n", proc_top.num_entries,
+                   num_processes, wrong_switches);
+            failed = 1;
+        }
+        free_proc_top();
+    }
+    uint64_t goal_ns = PROC_TOP_GOAL_NS * (uint64_t)num_processes;
+    printf("  goal %.1f ms: %s, %.1f ms on %d threads, %.2f us a process\n", (double)goal_ns / 1e6,
+           best_ns <= goal_ns ? "met" : "not met", (double)best_ns / 1e6, best_threads, (double)best_ns / num_processes / 1000);
+    printf("\n");
+    return failed;
+}
+
+/*
+* @brief Writes the files of a cgroup the way the kernel formats them,
+*        with its cpu time and bytes read raised by usage_usec and
+*        read_bytes. The root has no memory.current, as on a live system.
+*/
+void write_cgroup_fixture(const char *dir, int root, uint64_t usage_usec, uint64_t read_bytes)
+{
+    FILE *file = open_fixture(dir, "cpu.stat");
+    fprintf(file, "usage_usec %" PRIu64 "\nuser_usec %" PRIu64 "\nsystem_usec %" PRIu64 "\nnr_periods 0\nnr_throttled 0\n"
+            "throttled_usec 0\nnr_bursts 0\nburst_usec 0\n", 1000000 + usage_usec, 700000 + usage_usec, (uint64_t)300000);
+    fclose(file);
+    if(!root)
+    {
+        file = open_fixture(dir, "memory.current");
+        fprintf(file, "%d\n", 268435456);
+        fclose(file);
+    }
+    file = open_fixture(dir, "memory.stat");
+    fprintf(file, "anon 134217728\nfile 67108864\nkernel 4194304\nkernel_stack 65536\npagetables 262144\nsec_pagetables 0\n"
+            "percpu 0\nsock 0\nvmalloc 0\nshmem 0\nzswap 0\nzswapped 0\nfile_mapped 1048576\nfile_dirty 0\nfile_writeback 0\n"
+            "swapcached 0\nanon_thp 0\nfile_thp 0\nshmem_thp 0\ninactive_anon 134217728\nactive_anon 0\ninactive_file 33554432\n"
+            "active_file 33554432\nunevictable 0\nslab_reclaimable 1048576\nslab_unreclaimable 524288\nslab 1572864\n"
+            "workingset_refault_anon 0\nworkingset_refault_file 0\npgfault 12345\npgmajfault 12\n");
+    fclose(file);
+    file = open_fixture(dir, "io.stat");
+    fprintf(file, "8:0 rbytes=%" PRIu64 " wbytes=4096 rios=10 wios=1 dbytes=0 dios=0\n"
+            "259:0 rbytes=1048576 wbytes=0 rios=5 wios=0 dbytes=0 dios=0\n", 2097152 + read_bytes);
+    fclose(file);
+    for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%s.pressure", pressure_resource_names[resource]);
+        file = open_fixture(dir, name);
+        fprintf(file, "some avg10=0.%02d avg60=0.00 avg300=0.00 total=%d\nfull avg10=0.00 avg60=0.00 avg300=0.00 total=0\n",
+                resource, 1000 * resource);
+        fclose(file);
+    }
+}
+
+/*
+* @brief Creates the cgroup dir with its files.
+*/
+void add_cgroup_fixture(const char *dir)
+{
+    if(mkdir(dir, 0755) != 0) fatal_error("failed to create fixture ", dir);
+    write_cgroup_fixture(dir, 0, 0, 0);
+}
+
+/*
+* @brief Removes a generated cgroup and everything under it.
+*/
+void remove_cgroup_fixture(const char *dir)
+{
+    DIR *listing = opendir(dir);
+    if(listing == NULL) return;
+    struct dirent *entry;
+    while((entry = readdir(listing)) != NULL)
+    {
+        if(entry->d_name[0] == '.') continue;
+        char path[PROC_PATH_LENGTH];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if(entry->d_type == DT_DIR) remove_cgroup_fixture(path);
+        else remove(path);
+    }
+    closedir(listing);
+    rmdir(dir);
+}
+
+/*
+* @returns the index of the cgroup at path in cgroup_tree, or -1
+*/
+int find_bench_cgroup(const char *path)
+{
+    for(int i = 0; i < cgroup_tree.num_slots; i++)
+    {
+        if(cgroup_tree.entries[i].in_use && strcmp(cgroup_tree.entries[i].path, path) == 0) return i;
+    }
+    return -1;
+}
+
+/*
+* @brief Times samples of a generated hierarchy of CGROUP_BENCH_PARENTS
+*        cgroups of CGROUP_BENCH_CHILDREN each, checks the rates of one
+*        whose cpu time and reads grow by half a second and 1 MB over a
+*        second, then creates and removes cgroups and checks that inotify
+*        alone brings the tree up to date, without walking it.
+*
+* @returns 0 if every cgroup was tracked and the rates are right
+*/
+int bench_cgroups(const char *base_dir, int samples)
+{
+    char dir[PROC_PATH_LENGTH - 64];
+    snprintf(dir, sizeof(dir), "%s/cgroup", base_dir);
+    mkdir(dir, 0755);
+    write_cgroup_fixture(dir, 1, 0, 0);
+    char path[PROC_PATH_LENGTH];
+    for(int parent = 0; parent < CGROUP_BENCH_PARENTS; parent++)
+    {
+        snprintf(path, sizeof(path), "%s/pod%d", dir, parent);
+        add_cgroup_fixture(path);
+        for(int child = 0; child < CGROUP_BENCH_CHILDREN; child++)
+        {
+            snprintf(path, sizeof(path), "%s/pod%d/container%d", dir, parent, child);
+            add_cgroup_fixture(path);
+        }
+    }
+    int num_cgroups = 1 + CGROUP_BENCH_PARENTS * (1 + CGROUP_BENCH_CHILDREN);
+
+    init_cgroups(dir, DEFAULT_CGROUP_TOP_N, CGROUP_SORT_CPU);
+    int found = cgroup_tree.num_cgroups;
+    uint64_t sample_ns = 1000000000ull;
+    sample_cgroups(sample_ns);
+    int passes = samples / 20 + 1;
+    struct sampler_stats before = sampler_stats;
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < passes; i++) sample_cgroups(sample_ns += 1000000000ull);
+    uint64_t pass_ns = monotonic_ns() - start;
+    struct sampler_stats after = sampler_stats;
+
+    //A second later by the samples' clock, whatever the bench took
+    snprintf(path, sizeof(path), "%s/pod3/container7", dir);
+    write_cgroup_fixture(path, 0, 500000, 1048576);
+    sample_cgroups(sample_ns += 1000000000ull);
+    select_top_cgroups(1);
+    int busy = find_bench_cgroup("pod3/container7");
+    struct cgroup_entry busy_entry;
+    const struct cgroup_entry *entry = NULL;
+    if(busy >= 0)
+    {
+        busy_entry = cgroup_tree.entries[busy];
+        entry = &busy_entry;
+    }
+    int busy_top = cgroup_tree.num_top > 0 && cgroup_tree.top[0] == busy;
+    int root_missing = cgroup_tree.entries[0].missing;
+
+    //Ten new cgroups, two nested ones and five removed, found from the events alone
+    for(int i = 0; i < 10; i++)
+    {
+        snprintf(path, sizeof(path), "%s/pod0/new%d", dir, i);
+        add_cgroup_fixture(path);
+    }
+    snprintf(path, sizeof(path), "%s/pod1/nested", dir);
+    add_cgroup_fixture(path);
+    snprintf(path, sizeof(path), "%s/pod1/nested/inner", dir);
+    add_cgroup_fixture(path);
+    for(int i = 0; i < 5; i++)
+    {
+        snprintf(path, sizeof(path), "%s/pod2/container%d", dir, i);
+        remove_cgroup_fixture(path);
+    }
+    start = monotonic_ns();
+    serve_cgroup_events(cgroup_tree.inotify_fd);
+    uint64_t events_ns = monotonic_ns() - start;
+    int expected = num_cgroups + 10 + 2 - 5;
+    int tracked = cgroup_tree.num_cgroups;
+    int inner = find_bench_cgroup("pod1/nested/inner");
+    int inner_missing = inner >= 0 ? (int)cgroup_tree.entries[inner].missing : -1;
+    uint64_t walks = cgroup_tree.walks;
+
+    //As after an inotify queue overflow: the walk changes nothing
+    cgroup_tree.rescan = 1;
+    sample_cgroups(sample_ns += 1000000000ull);
+
+    printf("cgroups: %d cgroups, %d descriptors kept open (%s)\n", found, cgroup_tree.fds_open, dir);
+    printf("  %14s %14s %14s %14s %14s\n", "walk ms", "sample ms", "allocs/sample", "bytes/sample", "events us");
+    printf("  %14.2f %14.2f %14.2f %14.0f %14.1f\n", (double)cgroup_tree.walk_ns / 1e6, (double)pass_ns / passes / 1e6,
+           (double)(after.allocations - before.allocations) / passes, (double)(after.bytes_read - before.bytes_read) / passes,
+           (double)events_ns / 1000);
+    int failed = 0;
+    if(found != num_cgroups || entry == NULL || !busy_top || entry->cpu_pct < 49.99 || entry->cpu_pct > 50.01 ||
+       entry->read_rate < 1048575 || entry->read_rate > 1048577 || entry->memory_bytes != 268435456 ||
+       entry->anon_bytes != 134217728 || entry->some_total_us[PRESSURE_IO] != 2000 ||
+       (root_missing & (1u << CGROUP_MEMORY_CURRENT)) == 0)
+    {
+        printf("  MISMATCH: %d cgroups, busy one %s, cpu %.2f%%, read %.0f B/s, memory %" PRIu64 " anon %" PRIu64 ", io stall %" PRIu64
+               " us, root memory.current %s; expected %d, first, 50%%, 1048576, 268435456, 134217728, 2000 and missing\n",
+               found, busy_top ? "first" : "not first", entry != NULL ? entry->cpu_pct : 0, entry != NULL ? entry->read_rate : 0,
+               entry != NULL ? entry->memory_bytes : 0, entry != NULL ? entry->anon_bytes : 0,
+               entry != NULL ? entry->some_total_us[PRESSURE_IO] : 0,
+               (root_missing & (1u << CGROUP_MEMORY_CURRENT)) ? "missing" : "present", num_cgroups);
+        failed = 1;
+    }
+    if(tracked != expected || inner_missing != 0 || walks != 1 || cgroup_tree.num_cgroups != expected || cgroup_tree.walks != 2)
+    {
+        printf("  MISMATCH: %d cgroups after the events, %d after a walk, nested one %s, %" PRIu64 " walks before the"
+               " rescan; expected %d, with every file and 1\n", tracked, cgroup_tree.num_cgroups,
+               inner < 0 ? "not found" : inner_missing == 0 ? "with every file" : "missing files", walks, expected);
+        failed = 1;
+    }
+    printf("\n");
+    close_cgroups();
+    return failed;
+}
+
+/*
+* @brief Appends a netlink attribute to the message in request.
+*
+* @returns the attribute, for nesting others in it
+*/
+struct rtattr *add_link_attribute(struct nlmsghdr *request, int type, const void *data, size_t size)
+{
+    struct rtattr *attribute = (struct rtattr*)((char*)request + NLMSG_ALIGN(request->nlmsg_len));
+    attribute->rta_type = (unsigned short)type;
+    attribute->rta_len = (unsigned short)RTA_LENGTH(size);
+    if(size > 0) memcpy(RTA_DATA(attribute), data, size);
+    request->nlmsg_len = NLMSG_ALIGN(request->nlmsg_len) + RTA_ALIGN(attribute->rta_len);
+    return attribute;
+}
+
+/*
+* @brief Creates the veth pair bench_a<index> and bench_b<index> and waits
+*        for the kernel to acknowledge it.
+*
+* @returns 0 on success, -1 with errno set on failure
+*/
+int add_veth_pair(int fd, int index)
+{
+    uint64_t buffer[LINK_REQUEST_SIZE / sizeof(uint64_t)];
+    struct nlmsghdr *request = (struct nlmsghdr*)buffer;
+    char name[MAX_NETWORK_FACE_LENGTH];
+
+    memset(buffer, 0, sizeof(buffer));
+    request->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    request->nlmsg_type = RTM_NEWLINK;
+    request->nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK;
+    request->nlmsg_seq = (uint32_t)index + 1;
+    snprintf(name, sizeof(name), "bench_a%d", index);
+    add_link_attribute(request, IFLA_IFNAME, name, strlen(name) + 1);
+
+    struct rtattr *link_info = add_link_attribute(request, IFLA_LINKINFO, NULL, 0);
+    add_link_attribute(request, IFLA_INFO_KIND, "veth", 5);
+    struct rtattr *info_data = add_link_attribute(request, IFLA_INFO_DATA, NULL, 0);
+    struct rtattr *peer = add_link_attribute(request, VETH_INFO_PEER, NULL, 0);
+    request->nlmsg_len += sizeof(struct ifinfomsg);
+    snprintf(name, sizeof(name), "bench_b%d", index);
+    add_link_attribute(request, IFLA_IFNAME, name, strlen(name) + 1);
+    char *end = (char*)request + request->nlmsg_len;
+    peer->rta_len = (unsigned short)(end - (char*)peer);
+    info_data->rta_len = (unsigned short)(end - (char*)info_data);
+    link_info->rta_len = (unsigned short)(end - (char*)link_info);
+
+    if(send(fd, request, request->nlmsg_len, 0) < 0) return -1;
+    ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+    if(length < 0) return -1;
+    const struct nlmsghdr *reply = (const struct nlmsghdr*)buffer;
+    if(!NLMSG_OK(reply, (int)length) || reply->nlmsg_type != NLMSG_ERROR) {errno = EPROTO; return -1;}
+    const struct nlmsgerr *error = (const struct nlmsgerr*)NLMSG_DATA(reply);
+    if(error->error != 0) {errno = -error->error; return -1;}
+    return 0;
+}
+
+/*
+* @brief Times network samples from one backend of the live proc root.
+*/
+void bench_network_backend(int backend, int num_interfaces, int samples)
+{
+    network_backend = backend;
+    sample_network_info();
+
+    struct sampler_stats before = sampler_stats;
+    uint64_t start = monotonic_ns();
+    for(int i = 0; i < samples; i++) sample_network_info();
+    uint64_t sample_ns = monotonic_ns() - start;
+    struct sampler_stats after = sampler_stats;
+
+    printf("  %10d %10s %14.0f %14.2f %14.1f %14.0f %14d\n", num_interfaces, network_backend_names[backend],
+           (double)sample_ns / samples,
+           (double)(after.allocations - before.allocations) / samples,
+           (double)(after.read_syscalls - before.read_syscalls) / samples,
+           (double)(after.bytes_read - before.bytes_read) / samples, network_info.num_devices);
+}
+
+/*
+* @brief Compares /proc/net/dev with the netlink dump in a network namespace
+*        of its own, filled with veth pairs up to each of
+*        backend_interface_counts. Runs in a child process so the
+*        namespace and its interfaces go away with it.
+*
+* @returns 0 if both backends saw every interface, or the bench could not
+*          make a namespace
+*/
+int run_network_backends(int samples)
+{
+    if(syscall(SYS_unshare, CLONE_NEWNET) != 0)
+    {
+        printf("network backends: skipped, no network namespace of our own: %s\n\n", strerror(errno));
+        return 0;
+    }
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if(fd < 0) fatal_error("failed to open a netlink socket", "");
+
+    close_collectors();
+    set_proc_root(PROC_ROOT);
+    init_collectors();
+
+    printf("network backends: veth pairs in a private network namespace\n");
+    printf("  %10s %10s %14s %14s %14s %14s %14s\n", "interfaces", "backend", "ns/sample", "allocs/sample",
+           "reads/sample", "bytes/sample", "parsed");
+    int failed = 0;
+    int num_interfaces = 1; //lo
+    int num_pairs = 0;
+    for(int i = 0; i < (int)(sizeof(backend_interface_counts) / sizeof(backend_interface_counts[0])); i++)
+    {
+        while(num_interfaces + 2 <= backend_interface_counts[i])
+        {
+            if(add_veth_pair(fd, num_pairs) != 0)
+            {
+                printf("  stopped at %d interfaces, could not add a veth pair: %s\n\n", num_interfaces, strerror(errno));
+                close(fd);
+                return 0;
+            }
+            num_pairs++;
+            num_interfaces += 2;
+        }
+
+        for(int backend = 0; backend < NUM_NETWORK_BACKENDS; backend++)
+        {
+            bench_network_backend(backend, num_interfaces, samples);
+            if(network_info.num_devices != num_interfaces || network_backend != backend)
+            {
+                printf("  MISMATCH: %s parsed %d interfaces, the namespace has %d\n", network_backend_names[backend],
+                       network_info.num_devices, num_interfaces);
+                failed = 1;
+            }
+        }
+    }
+    printf("  netlink took %" PRIu64 " link dumps and %" PRIu64 " stats dumps\n\n", netlink_source.link_dumps, netlink_source.stats_dumps);
+    close(fd);
+    close_collectors();
+    return failed;
+}
+
+/*
+* @brief Runs run_network_backends in a child process.
+*
+* @returns what it returned
+*/
+int bench_network_backends(int samples)
+{
+    fflush(stdout);
+    pid_t child = fork();
+    if(child < 0) fatal_error("failed to fork for the network backends", "");
+    if(child == 0) exit(run_network_backends(samples));
+
+    int status = 0;
+    if(waitpid(child, &status, 0) != child) return 1;
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+/*
+* @breif Main entry point
+*/
+int main(int argc, char **argv)
+{
+    const char *proc_root_arg = NULL;
+    const char *fixtures_arg = NULL;
+    int samples = DEFAULT_SAMPLES;
+    int num_processes = DEFAULT_PROCESSES;
+    int num_threads = 0;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(i + 1 >= argc) fatal_error("missing value for option ", argv[i]);
+        if(strcmp(argv[i], "--proc-root") == 0) proc_root_arg = argv[++i];
+        else if(strcmp(argv[i], "--fixtures") == 0) fixtures_arg = argv[++i];
+        else if(strcmp(argv[i], "--samples") == 0) samples = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--processes") == 0) num_processes = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--threads") == 0) num_threads = atoi(argv[++i]);
+        else fatal_error("unknown option ", argv[i]);
+    }
+    if(samples < 1) samples = 1;
+    if(num_threads < 1)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (int)(online < 1 ? 1 : online > 8 ? 8 : online);
+    }
+
+    if(proc_root_arg != NULL)
+    {
+        bench_proc_root("proc root", proc_root_arg, samples, NULL);
+        close_collectors();
+        exit(EXIT_SUCCESS);
+    }
+
+    char temp_dir[] = "/tmp/sys_mon_bench.XXXXXX";
+    const char *base_dir = fixtures_arg;
+    if(base_dir == NULL)
+    {
+        if(mkdtemp(temp_dir) == NULL) fatal_error("failed to create ", temp_dir);
+        base_dir = temp_dir;
+    }
+    else mkdir(base_dir, 0755);
+
+    int failed = 0;
+    for(int i = 0; i < (int)(sizeof(fixture_sets) / sizeof(fixture_sets[0])); i++)
+    {
+        const struct fixture_set *set = &fixture_sets[i];
+        char dir[PROC_PATH_LENGTH];
+        snprintf(dir, sizeof(dir), "%s/%s", base_dir, set->name);
+        mkdir(dir, 0755);
+
+        fixture_edge_cases = set->edge_cases;
+        write_stat_fixture(dir, set->num_cpus, NULL);
+        write_meminfo_fixture(dir);
+        write_network_fixture(dir, set->num_interfaces, NULL);
+        fixture_edge_cases = 0;
+
+        char label[128];
+        snprintf(label, sizeof(label), "%s: %d cpus, %d interfaces%s", set->name, set->num_cpus, set->num_interfaces,
+                 set->edge_cases ? ", 20 digit counters glued to the names" : "");
+        failed |= bench_proc_root(label, dir, samples, &written_fixture);
+
+        if(fixtures_arg == NULL) remove_fixture_set(dir);
+    }
+
+    failed |= bench_counters(base_dir);
+    failed |= bench_recording(base_dir, samples);
+    failed |= bench_analysis(base_dir, num_threads);
+    failed |= bench_disk(base_dir, samples);
+    failed |= bench_interrupts(base_dir, samples);
+    failed |= bench_meminfo(base_dir, samples);
+    failed |= bench_pressure(base_dir, samples);
+    failed |= bench_rules(base_dir, samples);
+    failed |= bench_cgroups(base_dir, samples);
+    failed |= bench_exporter(base_dir, samples);
+    failed |= bench_shm(base_dir, 8, 4, samples);
+    failed |= bench_shm(base_dir, EXPORT_BENCH_CPUS, EXPORT_BENCH_INTERFACES, samples);
+    failed |= bench_pipeline(base_dir);
+    failed |= bench_scheduler();
+    failed |= bench_screen();
+    failed |= bench_history();
+    failed |= bench_network_backends(samples);
+    if(num_processes > 0) failed |= bench_proc_top(base_dir, num_processes, num_threads);
+    if(fixtures_arg == NULL)
+    {
+        char path[PROC_PATH_LENGTH];
+        snprintf(path, sizeof(path), "%s/recording", base_dir);
+        remove_fixture_set(path);
+        snprintf(path, sizeof(path), "%s/rules", base_dir);
+        remove_fixture_set(path);
+        snprintf(path, sizeof(path), "%s/recording.bin", base_dir);
+        remove(path);
+        snprintf(path, sizeof(path), "%s/analysis.bin", base_dir);
+        remove(path);
+        snprintf(path, sizeof(path), "%s/disk/%s", base_dir, DISK_STATS_FILE);
+        remove(path);
+        snprintf(path, sizeof(path), "%s/disk/%s", base_dir, MOUNT_INFO_FILE);
+        remove(path);
+        snprintf(path, sizeof(path), "%s/disk/self", base_dir);
+        rmdir(path);
+        snprintf(path, sizeof(path), "%s/disk/mnt", base_dir);
+        remove_cgroup_fixture(path);
+        snprintf(path, sizeof(path), "%s/disk", base_dir);
+        rmdir(path);
+        snprintf(path, sizeof(path), "%s/irq/%s", base_dir, INTERRUPTS_FILE);
+        remove(path);
+        snprintf(path, sizeof(path), "%s/irq", base_dir);
+        rmdir(path);
+        for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+        {
+            snprintf(path, sizeof(path), "%s/psi/%s/%s", base_dir, PRESSURE_DIR, pressure_resource_names[resource]);
+            remove(path);
+        }
+        snprintf(path, sizeof(path), "%s/psi/%s", base_dir, PRESSURE_DIR);
+        rmdir(path);
+        snprintf(path, sizeof(path), "%s/psi", base_dir);
+        rmdir(path);
+        snprintf(path, sizeof(path), "%s/meminfo", base_dir);
+        remove_full_meminfo_fixture(path);
+        snprintf(path, sizeof(path), "%s/cgroup", base_dir);
+        remove_cgroup_fixture(path);
+        snprintf(path, sizeof(path), "%s/processes", base_dir);
+        remove_process_fixtures(path, num_processes);
+    }
+    close_collectors();
+    free(written_fixture.cpu_time);
+    free(written_fixture.faces);
+    free(written_fixture.counters);
+    if(fixtures_arg == NULL) rmdir(base_dir);
+
+    exit(failed ? EXIT_FAILED : EXIT_SUCCESS);
+}
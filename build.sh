@@ -1,2 +1,6 @@
-gcc -Wall -Wextra -o sys_mon main.c
+gcc -Wall -Wextra -O2 -o meminfo_gen meminfo_gen.c && ./meminfo_gen meminfo_keys.h meminfo_keys.c
+gcc -Wall -Wextra -O2 -c shmreader.c -o shmreader.o && ar rcs libsysmonshm.a shmreader.o
+gcc -Wall -Wextra -O2 -o sys_mon main.c collectors.c scan.c history.c record.c scheduler.c highfreq.c selfstats.c screen.c proctop.c disk.c netlink.c interrupts.c pressure.c rules.c cgroup.c analyze.c exporter.c shm.c pipeline.c meminfo.c meminfo_keys.c -L. -lsysmonshm -lm -lrt -pthread
+gcc -Wall -Wextra -O2 -o sys_mon_bench bench.c collectors.c scan.c history.c record.c scheduler.c selfstats.c proctop.c disk.c netlink.c interrupts.c pressure.c rules.c cgroup.c analyze.c exporter.c shm.c pipeline.c screen.c meminfo.c meminfo_keys.c -L. -lsysmonshm -lm -lrt -pthread
+gcc -Wall -Wextra -O2 -U__SSE2__ -o sys_mon_bench_scalar bench.c collectors.c scan.c history.c record.c scheduler.c selfstats.c proctop.c disk.c netlink.c interrupts.c pressure.c rules.c cgroup.c analyze.c exporter.c shm.c pipeline.c screen.c meminfo.c meminfo_keys.c -L. -lsysmonshm -lm -lrt -pthread
 ./sys_mon
@@ -0,0 +1,665 @@
+/*
+ * File: cgroup.c
+ * Description: Per cgroup cpu, memory, io and pressure from the cgroup v2
+ *              hierarchy, with the cgroups found once and then followed
+ *              through inotify, and the top N of them by one of those.
+ *
+ * Notes:
+ *      Walking the hierarchy means a getdents and an open per directory,
+ *      which on a host with thousands of containers costs more than
+ *      reading their files. The tree is walked once; every directory gets
+ *      an inotify watch before it is listed, so a cgroup created while
+ *      its parent is listed shows up in the listing, as an event, or both,
+ *      and an event for one already known is ignored. mkdir and rmdir of
+ *      a cgroup raise IN_CREATE and IN_DELETE on its parent's watch.
+ *
+ *      Enabling or disabling a controller does not go through the VFS, so
+ *      the files it adds or takes away raise no event. The write to the
+ *      parent's cgroup.subtree_control does, as IN_MODIFY, and the files
+ *      of each child are looked for again. A file that went away fails
+ *      its next read and is marked missing.
+ *
+ *      Events are rare next to samples, so the cgroup a watch descriptor
+ *      belongs to is found by looking through the array.
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "sys_mon.h"
+#include "scan.h"
+#include "cgroup.h"
+
+#define CGROUP_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ONLYDIR)
+
+struct cgroup_tree cgroup_tree = {.root_fd = -1, .inotify_fd = -1};
+const char *cgroup_sort_names[NUM_CGROUP_SORTS] = {"cpu", "memory", "io", "pressure"};
+const char *cgroup_file_names[NUM_CGROUP_FILES] = {"cpu.stat", "memory.current", "memory.stat", "io.stat",
+                                                   "cpu.pressure", "memory.pressure", "io.pressure"};
+
+/*
+* @brief Finds where cgroup v2 is mounted: CGROUP_ROOT, or with the hybrid
+*        layout of systemd, where v1 controllers are mounted there,
+*        CGROUP_HYBRID_ROOT.
+*/
+const char *find_cgroup_root()
+{
+    if(access(CGROUP_ROOT "/cgroup.controllers", F_OK) != 0 && access(CGROUP_HYBRID_ROOT "/cgroup.controllers", F_OK) == 0)
+    {
+        return CGROUP_HYBRID_ROOT;
+    }
+    return CGROUP_ROOT;
+}
+
+/*
+* @brief Writes the path of name in a cgroup, relative to the root, into
+*        path. An empty name gives the cgroup's directory.
+*/
+void cgroup_path(char *path, const struct cgroup_entry *entry, const char *name)
+{
+    const char *separator = entry->path[0] != '\0' && name[0] != '\0' ? "/" : "";
+    int length = snprintf(path, CGROUP_PATH_LENGTH, "%s%s%s", entry->path, separator, name);
+    if(length < 0 || length >= CGROUP_PATH_LENGTH) fatal_error("cgroup path too long for ", entry->path);
+    if(length == 0) memcpy(path, ".", 2);
+}
+
+/*
+* @brief Opens a file of a cgroup. One that cannot be opened for any
+*        reason but the descriptor limit is marked missing.
+*
+* @returns the descriptor, or -1
+*/
+int open_cgroup_file(struct cgroup_entry *entry, int file)
+{
+    char path[CGROUP_PATH_LENGTH];
+    cgroup_path(path, entry, cgroup_file_names[file]);
+    int fd = openat(cgroup_tree.root_fd, path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0 && errno != EMFILE && errno != ENFILE) entry->missing |= 1u << file;
+    return fd;
+}
+
+/*
+* @brief Closes a file of a cgroup kept open.
+*/
+void close_cgroup_file(struct cgroup_entry *entry, int file)
+{
+    if(entry->fd[file] < 0) return;
+    close(entry->fd[file]);
+    entry->fd[file] = -1;
+    cgroup_tree.fds_open--;
+}
+
+/*
+* @brief Looks for the files of a cgroup that are not open, keeping those
+*        found open while the descriptor budget allows. Over the budget
+*        they are only marked as there to be read, and opened on each read.
+*/
+void open_cgroup_files(struct cgroup_entry *entry)
+{
+    for(int file = 0; file < NUM_CGROUP_FILES; file++)
+    {
+        if(entry->fd[file] >= 0) continue;
+        entry->missing &= ~(1u << file);
+        if(cgroup_tree.fds_open >= cgroup_tree.fd_budget) continue;
+        entry->fd[file] = open_cgroup_file(entry, file);
+        if(entry->fd[file] >= 0) cgroup_tree.fds_open++;
+    }
+}
+
+/*
+* @brief Watches a cgroup's directory for cgroups created and removed in it.
+*/
+void watch_cgroup(struct cgroup_entry *entry)
+{
+    char path[CGROUP_PATH_LENGTH];
+    int length = snprintf(path, sizeof(path), "%s/%s", cgroup_tree.root, entry->path);
+    if(length < 0 || (size_t)length >= sizeof(path)) fatal_error("cgroup path too long for ", entry->path);
+    entry->watch = inotify_add_watch(cgroup_tree.inotify_fd, path, CGROUP_WATCH_EVENTS);
+    if(entry->watch < 0) cgroup_tree.unwatched++;
+}
+
+/*
+* @returns the index of the cgroup called name in parent, or -1
+*/
+int find_cgroup_child(int parent, const char *name)
+{
+    for(int child = cgroup_tree.entries[parent].first_child; child >= 0; child = cgroup_tree.entries[child].next_sibling)
+    {
+        if(strcmp(cgroup_tree.entries[child].name, name) == 0) return child;
+    }
+    return -1;
+}
+
+/*
+* @returns the index of the cgroup a watch descriptor is of, or -1
+*/
+int find_cgroup_watch(int watch)
+{
+    for(int i = 0; i < cgroup_tree.num_slots; i++)
+    {
+        if(cgroup_tree.entries[i].in_use && cgroup_tree.entries[i].watch == watch) return i;
+    }
+    return -1;
+}
+
+void walk_cgroup(int index, int fresh);
+
+/*
+* @brief Adds the cgroup called name in parent, or the root when parent is
+*        -1, with its files open and its directory watched, then the
+*        cgroups under it.
+*
+* @returns its index
+*/
+int add_cgroup(int parent, const char *name)
+{
+    int index = cgroup_tree.free_slot;
+    while(index < cgroup_tree.num_slots && cgroup_tree.entries[index].in_use) index++;
+    if(index == cgroup_tree.capacity)
+    {
+        cgroup_tree.capacity = cgroup_tree.capacity > 0 ? cgroup_tree.capacity * 2 : 64;
+        cgroup_tree.entries = counted_realloc(cgroup_tree.entries, (size_t)cgroup_tree.capacity * sizeof(struct cgroup_entry));
+    }
+    if(index == cgroup_tree.num_slots) cgroup_tree.num_slots++;
+    cgroup_tree.free_slot = index + 1;
+
+    struct cgroup_entry *entry = &cgroup_tree.entries[index];
+    memset(entry, 0, sizeof(*entry));
+    const char *parent_path = parent >= 0 ? cgroup_tree.entries[parent].path : "";
+    size_t parent_length = strlen(parent_path);
+    size_t name_length = strlen(name);
+    entry->path = counted_malloc(parent_length + name_length + 2);
+    memcpy(entry->path, parent_path, parent_length);
+    if(parent_length > 0) entry->path[parent_length++] = '/';
+    memcpy(entry->path + parent_length, name, name_length + 1);
+    entry->name = entry->path + parent_length;
+    entry->in_use = 1;
+    entry->parent = parent;
+    entry->depth = parent >= 0 ? cgroup_tree.entries[parent].depth + 1 : 0;
+    entry->first_child = -1;
+    entry->next_sibling = -1;
+    entry->seen_walk = cgroup_tree.walk;
+    for(int file = 0; file < NUM_CGROUP_FILES; file++) entry->fd[file] = -1;
+    if(parent >= 0)
+    {
+        entry->next_sibling = cgroup_tree.entries[parent].first_child;
+        cgroup_tree.entries[parent].first_child = index;
+    }
+    cgroup_tree.num_cgroups++;
+    cgroup_tree.added++;
+
+    open_cgroup_files(entry);
+    watch_cgroup(entry);
+    walk_cgroup(index, 1);
+    return index;
+}
+
+/*
+* @brief Removes a cgroup and any still under it, closing their files.
+*/
+void remove_cgroup(int index)
+{
+    struct cgroup_entry *entry = &cgroup_tree.entries[index];
+    while(entry->first_child >= 0) remove_cgroup(entry->first_child);
+
+    if(entry->parent >= 0)
+    {
+        int *link = &cgroup_tree.entries[entry->parent].first_child;
+        while(*link != index) link = &cgroup_tree.entries[*link].next_sibling;
+        *link = entry->next_sibling;
+    }
+    for(int file = 0; file < NUM_CGROUP_FILES; file++) close_cgroup_file(entry, file);
+    //Gone already when the directory was removed, but not when it was moved away
+    if(entry->watch >= 0) inotify_rm_watch(cgroup_tree.inotify_fd, entry->watch);
+    free(entry->path);
+    entry->path = NULL;
+    entry->in_use = 0;
+    cgroup_tree.num_cgroups--;
+    cgroup_tree.removed++;
+    if(index < cgroup_tree.free_slot) cgroup_tree.free_slot = index;
+}
+
+/*
+* @brief Lists a cgroup's directory and adds the cgroups in it. A fresh
+*        cgroup was just added, so none of its children are known; on a
+*        walk of the whole tree, those already known are marked seen and
+*        walked in turn.
+*/
+void walk_cgroup(int index, int fresh)
+{
+    char path[CGROUP_PATH_LENGTH];
+    cgroup_path(path, &cgroup_tree.entries[index], "");
+    int fd = openat(cgroup_tree.root_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0) return;
+    DIR *dir = fdopendir(fd);
+    if(dir == NULL)
+    {
+        close(fd);
+        return;
+    }
+
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(entry->d_name[0] == '.') continue;
+        if(entry->d_type != DT_DIR)
+        {
+            struct stat info;
+            if(entry->d_type != DT_UNKNOWN || fstatat(fd, entry->d_name, &info, AT_SYMLINK_NOFOLLOW) != 0 ||
+               !S_ISDIR(info.st_mode)) continue;
+        }
+
+        int child = fresh ? -1 : find_cgroup_child(index, entry->d_name);
+        if(child < 0)
+        {
+            add_cgroup(index, entry->d_name);
+            continue;
+        }
+        struct cgroup_entry *known = &cgroup_tree.entries[child];
+        known->seen_walk = cgroup_tree.walk;
+        if(known->watch < 0) watch_cgroup(known);
+        open_cgroup_files(known);
+        walk_cgroup(child, 0);
+    }
+    closedir(dir);
+}
+
+/*
+* @brief Walks the whole tree again, adding the cgroups that are not known
+*        and removing the known ones that are gone. Only needed when events
+*        were lost, or could not be had for some directory.
+*/
+void walk_cgroups()
+{
+    uint64_t start = monotonic_ns();
+    cgroup_tree.walk++;
+    struct cgroup_entry *root = &cgroup_tree.entries[0];
+    root->seen_walk = cgroup_tree.walk;
+    if(root->watch < 0) watch_cgroup(root);
+    open_cgroup_files(root);
+    walk_cgroup(0, 0);
+    for(int i = 1; i < cgroup_tree.num_slots; i++)
+    {
+        if(cgroup_tree.entries[i].in_use && cgroup_tree.entries[i].seen_walk != cgroup_tree.walk) remove_cgroup(i);
+    }
+    cgroup_tree.unwatched = 0;
+    for(int i = 0; i < cgroup_tree.num_slots; i++)
+    {
+        if(cgroup_tree.entries[i].in_use && cgroup_tree.entries[i].watch < 0) cgroup_tree.unwatched++;
+    }
+    cgroup_tree.rescan = 0;
+    cgroup_tree.samples_since_walk = 0;
+    cgroup_tree.walks++;
+    cgroup_tree.walk_ns = monotonic_ns() - start;
+}
+
+/*
+* @brief Opens the hierarchy at root, CGROUP_ROOT on a live system, and
+*        walks it once. Exits if root is not a directory.
+*/
+void init_cgroups(const char *root, int top_n, int sort)
+{
+    close_cgroups();
+    int length = snprintf(cgroup_tree.root, sizeof(cgroup_tree.root), "%s", root);
+    if(length < 0 || (size_t)length >= sizeof(cgroup_tree.root)) fatal_error("cgroup path too long for ", root);
+    cgroup_tree.root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(cgroup_tree.root_fd < 0) fatal_error("failed to open the cgroup hierarchy at ", root);
+    cgroup_tree.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(cgroup_tree.inotify_fd < 0) fatal_error("failed to create an inotify descriptor for ", root);
+    cgroup_tree.events = counted_malloc(CGROUP_INOTIFY_BUFFER);
+    cgroup_tree.buffer_capacity = PROC_SOURCE_INITIAL_SIZE;
+    cgroup_tree.buffer = counted_malloc(cgroup_tree.buffer_capacity);
+    cgroup_tree.top_n = top_n;
+    cgroup_tree.sort = sort;
+    cgroup_tree.top = counted_malloc((size_t)top_n * sizeof(int));
+    cgroup_tree.top_ranks = counted_malloc((size_t)top_n * sizeof(double));
+
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        if(limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+            getrlimit(RLIMIT_NOFILE, &limit);
+        }
+        rlim_t budget = limit.rlim_cur > CGROUP_FD_RESERVE ? limit.rlim_cur - CGROUP_FD_RESERVE : 0;
+        cgroup_tree.fd_budget = budget > 0x40000000 ? 0x40000000 : (int)budget;
+    }
+
+    uint64_t start = monotonic_ns();
+    add_cgroup(-1, "");
+    cgroup_tree.walks = 1;
+    cgroup_tree.walk_ns = monotonic_ns() - start;
+    cgroup_tree.added = 0;
+}
+
+/*
+* @brief Handles a directory or file created in or removed from a cgroup,
+*        or a write to its cgroup.subtree_control.
+*/
+void apply_cgroup_event(int index, const struct inotify_event *event)
+{
+    if(event->len == 0) return;
+    const char *name = event->name;
+    if(event->mask & IN_ISDIR)
+    {
+        int child = find_cgroup_child(index, name);
+        if((event->mask & (IN_CREATE | IN_MOVED_TO)) && child < 0) add_cgroup(index, name);
+        if((event->mask & (IN_DELETE | IN_MOVED_FROM)) && child >= 0) remove_cgroup(child);
+        return;
+    }
+    if(event->mask & IN_MODIFY)
+    {
+        if(strcmp(name, "cgroup.subtree_control") != 0) return;
+        for(int child = cgroup_tree.entries[index].first_child; child >= 0; child = cgroup_tree.entries[child].next_sibling)
+        {
+            open_cgroup_files(&cgroup_tree.entries[child]);
+        }
+        return;
+    }
+
+    //A file of the cgroup itself, which only comes and goes this way outside cgroupfs
+    struct cgroup_entry *entry = &cgroup_tree.entries[index];
+    for(int file = 0; file < NUM_CGROUP_FILES; file++)
+    {
+        if(strcmp(name, cgroup_file_names[file]) != 0) continue;
+        if(event->mask & (IN_CREATE | IN_MOVED_TO)) open_cgroup_files(entry);
+        else
+        {
+            close_cgroup_file(entry, file);
+            entry->missing |= 1u << file;
+        }
+    }
+}
+
+/*
+* @brief Reads every event queued on the inotify descriptor and applies
+*        it. Called by the scheduler when the descriptor is readable.
+*
+* @returns 0, the cgroups changed are shown on the next frame
+*/
+int serve_cgroup_events(int fd)
+{
+    while(1)
+    {
+        ssize_t bytes = read(fd, cgroup_tree.events, CGROUP_INOTIFY_BUFFER);
+        if(bytes < 0 && errno == EINTR) continue;
+        if(bytes <= 0) break;
+
+        for(char *p = cgroup_tree.events; p < cgroup_tree.events + bytes;)
+        {
+            const struct inotify_event *event = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+            cgroup_tree.events_read++;
+            if(event->mask & IN_Q_OVERFLOW)
+            {
+                cgroup_tree.rescan = 1;
+                continue;
+            }
+            int index = find_cgroup_watch(event->wd);
+            if(index < 0) continue;
+            if(event->mask & IN_IGNORED) cgroup_tree.entries[index].watch = -1;
+            else apply_cgroup_event(index, event);
+        }
+    }
+    return 0;
+}
+
+/*
+* @brief Reads a file of a cgroup into the tree's buffer, nul terminated
+*        and padded. A file kept open that can no longer be read, as its
+*        controller was disabled or the cgroup removed, is closed and
+*        marked missing.
+*
+* @returns 0, or -1 if it could not be read
+*/
+int read_cgroup_file(struct cgroup_entry *entry, int file)
+{
+    int fd = entry->fd[file];
+    int kept = fd >= 0;
+    if(!kept && (fd = open_cgroup_file(entry, file)) < 0) return -1;
+
+    size_t length = 0;
+    int failed = 0;
+    while(1)
+    {
+        if(cgroup_tree.buffer_capacity - length < SCAN_PADDING + 2)
+        {
+            cgroup_tree.buffer_capacity *= 2;
+            cgroup_tree.buffer = counted_realloc(cgroup_tree.buffer, cgroup_tree.buffer_capacity);
+        }
+        ssize_t bytes = pread(fd, cgroup_tree.buffer + length, cgroup_tree.buffer_capacity - length - SCAN_PADDING - 1, (off_t)length);
+        sampler_stats.read_syscalls++;
+        if(bytes < 0 && errno == EINTR) continue;
+        if(bytes < 0) failed = 1;
+        if(bytes <= 0) break;
+        length += (size_t)bytes;
+    }
+    if(!kept) close(fd);
+    if(failed)
+    {
+        close_cgroup_file(entry, file);
+        entry->missing |= 1u << file;
+        return -1;
+    }
+
+    memset(cgroup_tree.buffer + length, 0, SCAN_PADDING + 1);
+    sampler_stats.bytes_read += length;
+    return 0;
+}
+
+/*
+* @brief Parses the lines of a flat keyed file such as cpu.stat or
+*        memory.stat, "key value", setting the value of each key in keys
+*        found.
+*/
+void parse_cgroup_keys(const char *text, const char **keys, uint64_t **values, int num_keys)
+{
+    const char *cursor = text;
+    while(*cursor != '\0')
+    {
+        const char *token;
+        size_t length = scan_token(&cursor, &token);
+        for(int key = 0; key < num_keys; key++)
+        {
+            if(token_is(token, length, keys[key]))
+            {
+                scan_fields(&cursor, values[key], 1);
+                break;
+            }
+        }
+        cursor = skip_line(cursor);
+    }
+}
+
+/*
+* @brief Parses io.stat, a line per device of "MAJ:MIN rbytes=N wbytes=N
+*        rios=N wios=N ...", into the sums over every device.
+*/
+void parse_cgroup_io(const char *text, struct cgroup_entry *entry)
+{
+    const char *cursor = text;
+    entry->read_bytes = 0;
+    entry->write_bytes = 0;
+    entry->ios = 0;
+    while(*cursor != '\0')
+    {
+        const char *token;
+        scan_token(&cursor, &token);
+        size_t length;
+        while((length = scan_token(&cursor, &token)) > 0)
+        {
+            if(length > 7 && memcmp(token, "rbytes=", 7) == 0) entry->read_bytes += scan_pressure_value(token, length, 0);
+            else if(length > 7 && memcmp(token, "wbytes=", 7) == 0) entry->write_bytes += scan_pressure_value(token, length, 0);
+            else if(length > 5 && (memcmp(token, "rios=", 5) == 0 || memcmp(token, "wios=", 5) == 0))
+            {
+                entry->ios += scan_pressure_value(token, length, 0);
+            }
+        }
+        cursor = skip_line(cursor);
+    }
+}
+
+/*
+* @brief Per second, from counters over elapsed_ns, 0 if a counter went back.
+*/
+static inline float cgroup_rate(uint64_t now, uint64_t then, uint64_t elapsed_ns)
+{
+    return now >= then ? (float)((double)(now - then) * 1e9 / (double)elapsed_ns) : 0;
+}
+
+/*
+* @brief Reads every file a cgroup has and works out its rates since its
+*        previous sample.
+*/
+void sample_cgroup(struct cgroup_entry *entry, uint64_t sample_ns)
+{
+    static const char *cpu_keys[] = {"usage_usec", "throttled_usec"};
+    static const char *memory_keys[] = {"anon", "file"};
+    struct cgroup_entry previous = *entry;
+
+    for(int file = 0; file < NUM_CGROUP_FILES; file++)
+    {
+        if((entry->missing & (1u << file)) || read_cgroup_file(entry, file) != 0) continue;
+        const char *text = cgroup_tree.buffer;
+        if(file == CGROUP_CPU_STAT)
+        {
+            uint64_t *values[] = {&entry->usage_usec, &entry->throttled_usec};
+            parse_cgroup_keys(text, cpu_keys, values, 2);
+        }
+        else if(file == CGROUP_MEMORY_CURRENT) scan_fields(&text, &entry->memory_bytes, 1);
+        else if(file == CGROUP_MEMORY_STAT)
+        {
+            uint64_t *values[] = {&entry->anon_bytes, &entry->file_bytes};
+            parse_cgroup_keys(text, memory_keys, values, 2);
+        }
+        else if(file == CGROUP_IO_STAT) parse_cgroup_io(text, entry);
+        else
+        {
+            struct pressure_line lines[NUM_PRESSURE_KINDS];
+            parse_pressure_lines(text, lines);
+            int resource = file - CGROUP_CPU_PRESSURE;
+            entry->some_avg10[resource] = lines[PRESSURE_SOME].average[PRESSURE_AVG10];
+            entry->some_total_us[resource] = lines[PRESSURE_SOME].total_us;
+        }
+    }
+
+    entry->sample_ns = sample_ns;
+    if(!entry->have_previous || sample_ns <= previous.sample_ns)
+    {
+        entry->have_previous = 1;
+        return;
+    }
+    //Microsecond counters per second are millionths of the time, a hundred times that is a percentage
+    uint64_t elapsed_ns = sample_ns - previous.sample_ns;
+    entry->cpu_pct = cgroup_rate(entry->usage_usec, previous.usage_usec, elapsed_ns) / 10000;
+    entry->throttled_pct = cgroup_rate(entry->throttled_usec, previous.throttled_usec, elapsed_ns) / 10000;
+    entry->read_rate = cgroup_rate(entry->read_bytes, previous.read_bytes, elapsed_ns);
+    entry->write_rate = cgroup_rate(entry->write_bytes, previous.write_bytes, elapsed_ns);
+    entry->io_rate = cgroup_rate(entry->ios, previous.ios, elapsed_ns);
+    for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+    {
+        entry->stall_pct[resource] = cgroup_rate(entry->some_total_us[resource], previous.some_total_us[resource], elapsed_ns) / 10000;
+    }
+}
+
+/*
+* @brief Samples every known cgroup, walking the tree first only if events
+*        were lost or some directory is not watched.
+*/
+void sample_cgroups(uint64_t sample_ns)
+{
+    uint64_t start = monotonic_ns();
+    if(cgroup_tree.rescan || (cgroup_tree.unwatched > 0 && ++cgroup_tree.samples_since_walk >= CGROUP_RESCAN_SAMPLES)) walk_cgroups();
+    for(int i = 0; i < cgroup_tree.num_slots; i++)
+    {
+        if(cgroup_tree.entries[i].in_use) sample_cgroup(&cgroup_tree.entries[i], sample_ns);
+    }
+    cgroup_tree.sample_ns = sample_ns;
+    cgroup_tree.sample_duration_ns = monotonic_ns() - start;
+}
+
+/*
+* @returns what a cgroup is ranked by: its rates, or when not by_rate what
+*          it used since it was created
+*/
+double cgroup_rank(const struct cgroup_entry *entry, int by_rate)
+{
+    switch(cgroup_tree.sort)
+    {
+        case CGROUP_SORT_MEMORY:
+            return (double)entry->memory_bytes;
+        case CGROUP_SORT_IO:
+            return by_rate ? (double)entry->read_rate + entry->write_rate : (double)(entry->read_bytes + entry->write_bytes);
+        case CGROUP_SORT_PRESSURE:
+        {
+            double highest = 0;
+            for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+            {
+                double stall = by_rate ? entry->stall_pct[resource] : entry->some_avg10[resource];
+                if(stall > highest) highest = stall;
+            }
+            return highest;
+        }
+        default:
+            return by_rate ? entry->cpu_pct : (double)entry->usage_usec;
+    }
+}
+
+/*
+* @brief Picks the top_n cgroups by --cgroup-sort, the root left out as
+*        the system wide collectors show it.
+*/
+void select_top_cgroups(int by_rate)
+{
+    double *ranks = cgroup_tree.top_ranks;
+    cgroup_tree.num_top = 0;
+    for(int i = 1; i < cgroup_tree.num_slots; i++)
+    {
+        const struct cgroup_entry *entry = &cgroup_tree.entries[i];
+        if(!entry->in_use || (by_rate && !entry->have_previous)) continue;
+        double rank = cgroup_rank(entry, by_rate);
+        int position = cgroup_tree.num_top;
+        if(position == cgroup_tree.top_n && rank <= ranks[position - 1]) continue;
+        if(position == cgroup_tree.top_n) position--;
+        else cgroup_tree.num_top++;
+        while(position > 0 && ranks[position - 1] < rank)
+        {
+            ranks[position] = ranks[position - 1];
+            cgroup_tree.top[position] = cgroup_tree.top[position - 1];
+            position--;
+        }
+        ranks[position] = rank;
+        cgroup_tree.top[position] = i;
+    }
+}
+
+/*
+* @brief Closes every cgroup's files and the inotify descriptor, and frees
+*        the tree.
+*/
+void close_cgroups()
+{
+    for(int i = 0; i < cgroup_tree.num_slots; i++)
+    {
+        struct cgroup_entry *entry = &cgroup_tree.entries[i];
+        if(!entry->in_use) continue;
+        for(int file = 0; file < NUM_CGROUP_FILES; file++) close_cgroup_file(entry, file);
+        free(entry->path);
+    }
+    if(cgroup_tree.inotify_fd >= 0) close(cgroup_tree.inotify_fd);
+    if(cgroup_tree.root_fd >= 0) close(cgroup_tree.root_fd);
+    free(cgroup_tree.entries);
+    free(cgroup_tree.events);
+    free(cgroup_tree.buffer);
+    free(cgroup_tree.top);
+    free(cgroup_tree.top_ranks);
+    memset(&cgroup_tree, 0, sizeof(cgroup_tree));
+    cgroup_tree.root_fd = -1;
+    cgroup_tree.inotify_fd = -1;
+}
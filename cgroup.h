@@ -0,0 +1,143 @@
+/*
+ * File: cgroup.h
+ * Description: Per cgroup cpu, memory, io and pressure from the cgroup v2
+ *              hierarchy, with the cgroups found once and then followed
+ *              through inotify, and the top N of them by one of those.
+ */
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <stdint.h>
+
+#include "sys_mon.h"
+#include "pressure.h"
+
+#define CGROUP_ROOT                 "/sys/fs/cgroup"
+#define CGROUP_HYBRID_ROOT          CGROUP_ROOT "/unified" //Where systemd mounts cgroup v2 next to v1
+#define DEFAULT_CGROUP_TOP_N        20
+#define CGROUP_FD_RESERVE           64      //Descriptors left for everything else
+#define CGROUP_INOTIFY_BUFFER       65536
+#define CGROUP_RESCAN_SAMPLES       10      //Samples between walks of the tree while a directory could not be watched
+#define CGROUP_PATH_LENGTH          4096
+
+enum cgroup_file
+{
+    CGROUP_CPU_STAT,
+    CGROUP_MEMORY_CURRENT,
+    CGROUP_MEMORY_STAT,
+    CGROUP_IO_STAT,
+    CGROUP_CPU_PRESSURE,                //The pressure files in pressure_resource order
+    CGROUP_MEMORY_PRESSURE,
+    CGROUP_IO_PRESSURE,
+    NUM_CGROUP_FILES
+};
+
+enum cgroup_sort
+{
+    CGROUP_SORT_CPU,
+    CGROUP_SORT_MEMORY,
+    CGROUP_SORT_IO,
+    CGROUP_SORT_PRESSURE,               //The resource stalled on the most, some
+    NUM_CGROUP_SORTS
+};
+
+/*
+* One cgroup. Its files are opened when it is found and kept open while the
+* descriptor budget allows, so a sample of it is a pread per file. A file
+* its controllers do not provide is marked missing and not tried again
+* until its parent's cgroup.subtree_control is written or the tree walked.
+*/
+struct cgroup_entry
+{
+    int in_use;                         //0 for a free slot of the array
+    char *path;                         //Relative to the root, "" for the root itself
+    const char *name;                   //The last component of path
+    int parent;                         //Index of the parent, -1 for the root
+    int first_child;                    //-1 when it has none
+    int next_sibling;
+    int depth;
+    int watch;                          //Inotify watch descriptor, -1 when not watched
+    int fd[NUM_CGROUP_FILES];           //-1 when closed
+    unsigned int missing;               //Bit per cgroup_file that does not exist
+    uint32_t seen_walk;                 //Walk of the tree that last listed it
+
+    int have_previous;
+    uint64_t sample_ns;
+    uint64_t usage_usec;                //cpu.stat
+    uint64_t throttled_usec;
+    uint64_t memory_bytes;              //memory.current
+    uint64_t anon_bytes;                //memory.stat
+    uint64_t file_bytes;
+    uint64_t read_bytes;                //io.stat, every device
+    uint64_t write_bytes;
+    uint64_t ios;
+    uint32_t some_avg10[NUM_PRESSURE_RESOURCES]; //Hundredths of a percent
+    uint64_t some_total_us[NUM_PRESSURE_RESOURCES];
+
+    float cpu_pct;                      //Of one cpu
+    float throttled_pct;
+    float read_rate;
+    float write_rate;
+    float io_rate;
+    float stall_pct[NUM_PRESSURE_RESOURCES];
+};
+
+/*
+* The cgroups under the root in an array whose slots are reused as cgroups
+* come and go, so a cgroup keeps its index, which its children refer to.
+* The tree is walked once; after that one inotify descriptor reports the
+* directories created and removed and the controllers enabled, and only
+* those are looked at. The tree is walked again only when
+* the inotify queue overflowed, or every CGROUP_RESCAN_SAMPLES samples
+* while some directory could not be watched.
+*/
+struct cgroup_tree
+{
+    char root[CGROUP_PATH_LENGTH];
+    int root_fd;                        //Cgroup files are opened relative to it
+    int inotify_fd;
+    char *events;                       //CGROUP_INOTIFY_BUFFER bytes
+
+    struct cgroup_entry *entries;
+    int num_slots;                      //Slots in use or freed, the end of the array in use
+    int capacity;
+    int num_cgroups;
+    int free_slot;                      //Lowest slot that may be free
+
+    char *buffer;                       //The file being parsed, nul terminated and padded
+    size_t buffer_capacity;
+
+    int fd_budget;
+    int fds_open;
+    int unwatched;                      //Directories inotify_add_watch failed on
+    int rescan;                         //Walk the tree on the next sample
+    uint32_t walk;
+    int samples_since_walk;
+
+    int top_n;
+    int sort;
+    int *top;                           //Entry indexes of the top_n, highest first
+    double *top_ranks;                  //What each of them is ranked by
+    int num_top;
+
+    uint64_t sample_ns;
+    uint64_t sample_duration_ns;        //What the last sample took
+    uint64_t walk_ns;                   //What the last walk took
+    uint64_t added;                     //Since the first walk
+    uint64_t removed;
+    uint64_t events_read;
+    uint64_t walks;
+};
+
+extern struct cgroup_tree cgroup_tree;
+extern const char *cgroup_sort_names[NUM_CGROUP_SORTS];
+extern const char *cgroup_file_names[NUM_CGROUP_FILES];
+
+const char *find_cgroup_root();
+void init_cgroups(const char *root, int top_n, int sort);
+int serve_cgroup_events(int fd);
+void sample_cgroups(uint64_t sample_ns);
+void select_top_cgroups(int by_rate);
+void close_cgroups();
+
+#endif
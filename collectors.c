@@ -0,0 +1,814 @@
+/*
+ * File: collectors.c
+ * Description: The cpu, memory and network collectors. Each keeps its proc
+ *              file open, parses it into a numeric snapshot and works out
+ *              rates against the previous one.
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "sys_mon.h"
+#include "scan.h"
+#include "selfstats.h"
+#include "netlink.h"
+#include "meminfo.h"
+
+char proc_root[PROC_PATH_LENGTH] = PROC_ROOT;
+
+struct proc_source cpu_source = {CPU_STATS_FILE, "", -1, NULL, 0, 0, 0};
+struct proc_source mem_source = {MEM_INFO_FILE, "", -1, NULL, 0, 0, 0};
+struct proc_source network_source = {NETWORK_ACTIVITY_FILE, "", -1, NULL, 0, 0, 0};
+struct sampler_stats sampler_stats;
+
+/*
+* Key of each mem_field as it appears in /proc/meminfo.
+*/
+const char *mem_field_keys[NUM_MEM_FIELDS] =
+{
+    "MemTotal:",
+    "MemFree:",
+    "MemAvailable:",
+    "Buffers:",
+    "Cached:",
+    "Active:",
+    "Inactive:",
+    "Dirty:",
+    "PageTables:",
+    "Percpu:",
+    "HardwareCorrupted:"
+};
+
+/*
+* The meminfo_key each mem_field is taken from.
+*/
+const int mem_field_meminfo_keys[NUM_MEM_FIELDS] =
+{
+    MEMINFO_MEMTOTAL,
+    MEMINFO_MEMFREE,
+    MEMINFO_MEMAVAILABLE,
+    MEMINFO_BUFFERS,
+    MEMINFO_CACHED,
+    MEMINFO_ACTIVE,
+    MEMINFO_INACTIVE,
+    MEMINFO_DIRTY,
+    MEMINFO_PAGETABLES,
+    MEMINFO_PERCPU,
+    MEMINFO_HARDWARECORRUPTED
+};
+
+struct cpu_stats cpu_stats;
+struct mem_info mem_info;
+struct network_info network_info;
+struct cpu_rates cpu_rates;
+struct network_rates network_rates;
+
+/*
+* @brief Prints error message from caller and exits program with exit failure.
+*/
+int fatal_error(const char * error_msg, const char * additional_text)
+{
+    printf("ERROR: ");
+    printf("%s", error_msg);
+    printf("%s.\n", additional_text);
+    exit(EXIT_FAILED);
+}
+
+/*
+* @brief Current CLOCK_MONOTONIC time in nanoseconds.
+*/
+uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/*
+* @brief Current CLOCK_REALTIME time in nanoseconds.
+*/
+uint64_t realtime_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/*
+* @brief malloc that is counted in sampler_stats.allocations, with an
+*        atomic add as the analysis threads allocate too.
+*/
+void *counted_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if(ptr == NULL) fatal_error("out of memory allocating ", "sampler storage");
+    __atomic_fetch_add(&sampler_stats.allocations, 1, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+/*
+* @brief realloc that is counted in sampler_stats.allocations.
+*/
+void *counted_realloc(void *ptr, size_t size)
+{
+    void *new_ptr = realloc(ptr, size);
+    if(new_ptr == NULL) fatal_error("out of memory allocating ", "sampler storage");
+    __atomic_fetch_add(&sampler_stats.allocations, 1, __ATOMIC_RELAXED);
+    return new_ptr;
+}
+
+/*
+* @brief Points the collectors at another directory laid out like /proc,
+*        closing any sources that were opened under the old one.
+*/
+void set_proc_root(const char *root)
+{
+    snprintf(proc_root, sizeof(proc_root), "%s", root);
+    close_proc_source(&cpu_source);
+    close_proc_source(&mem_source);
+    close_proc_source(&network_source);
+    close_netlink_source();
+    close_node_meminfo();
+}
+
+/*
+* @brief Opens a proc source if it is not already open.
+*/
+void open_proc_source(struct proc_source *source)
+{
+    if(source->fd >= 0) return;
+
+    int length = snprintf(source->path, sizeof(source->path), "%s/%s", proc_root, source->name);
+    if(length < 0 || (size_t)length >= sizeof(source->path)) fatal_error("proc path too long for ", source->name);
+    source->fd = open(source->path, O_RDONLY | O_CLOEXEC);
+    if(source->fd < 0) fatal_error("failed to open ", source->path);
+
+    if(source->buffer == NULL)
+    {
+        source->capacity = PROC_SOURCE_INITIAL_SIZE;
+        source->buffer = (char*)counted_malloc(source->capacity);
+    }
+}
+
+/*
+* @brief Reads the whole of a proc source into its buffer with pread from
+*        offset 0. The buffer is nul terminated and padded, and only grows
+*        if the file no longer fits.
+*
+* @returns the number of bytes read
+*/
+size_t read_proc_source(struct proc_source *source)
+{
+    open_proc_source(source);
+
+    size_t length = 0;
+    while(1)
+    {
+        if(source->capacity - length < SCAN_PADDING + 2)
+        {
+            source->capacity *= 2;
+            source->buffer = (char*)counted_realloc(source->buffer, source->capacity);
+        }
+
+        ssize_t bytes = pread(source->fd, source->buffer + length,
+                              source->capacity - length - SCAN_PADDING - 1, (off_t)length);
+        sampler_stats.read_syscalls++;
+        if(bytes < 0)
+        {
+            if(errno == EINTR) continue;
+            fatal_error("failed to read ", source->path);
+        }
+        if(bytes == 0) break;
+        length += (size_t)bytes;
+    }
+
+    memset(source->buffer + length, 0, SCAN_PADDING + 1);
+    source->length = length;
+    source->read_ns = monotonic_ns();
+    sampler_stats.bytes_read += length;
+    return length;
+}
+
+/*
+* @brief Closes a proc source and releases its buffer.
+*/
+void close_proc_source(struct proc_source *source)
+{
+    if(source->fd >= 0) close(source->fd);
+    source->fd = -1;
+
+    free(source->buffer);
+    source->buffer = NULL;
+    source->capacity = 0;
+    source->length = 0;
+}
+
+/*
+* @brief Finds the highest cpuN line in the stat file. Used when the proc
+*        root is not the running kernel's, whose possible mask would not
+*        describe it.
+*/
+int highest_cpu_in_stat()
+{
+    read_proc_source(&cpu_source);
+
+    int highest = -1;
+    const char *cursor = cpu_source.buffer;
+    while(*cursor != '\0')
+    {
+        const char *token;
+        size_t length = scan_token(&cursor, &token);
+        int cpu_index = cpu_index_from_token(token, length);
+        if(cpu_index > highest) highest = cpu_index;
+        cursor = skip_line(cursor);
+    }
+    return highest;
+}
+
+/*
+* @brief Works out how many cpus the machine can have from the kernel's
+*        possible mask, e.g. "0-383", falling back to sysconf.
+*/
+int discover_num_cpus()
+{
+    if(strcmp(proc_root, PROC_ROOT) != 0) return highest_cpu_in_stat() + 1;
+
+    int max_cpu = -1;
+    FILE *possible_file = fopen(CPU_POSSIBLE_FILEPATH, "r");
+    if(possible_file != NULL)
+    {
+        char mask[256];
+        if(fgets(mask, sizeof(mask), possible_file) != NULL)
+        {
+            //The mask is a list of ranges, the last number is the highest cpu
+            for(char *range = strtok(mask, ",\n"); range != NULL; range = strtok(NULL, ",\n"))
+            {
+                char *last = strchr(range, '-');
+                int cpu = atoi(last != NULL ? last + 1 : range);
+                if(cpu > max_cpu) max_cpu = cpu;
+            }
+        }
+        fclose(possible_file);
+    }
+    if(max_cpu >= 0) return max_cpu + 1;
+
+    long configured = sysconf(_SC_NPROCESSORS_CONF);
+    return configured > 0 ? (int)configured : 1;
+}
+
+/*
+* @brief Sizes the per core arrays of cpu_rates to num_cpus. The previous
+*        sample is dropped, so the next one only sets a new baseline.
+*/
+void resize_cpu_rates(int num_cpus)
+{
+    free(cpu_rates.previous[0]);
+    free(cpu_rates.previous_online);
+    free(cpu_rates.pct[0]);
+    free(cpu_rates.valid);
+
+    uint64_t *previous = (uint64_t*)counted_malloc((size_t)num_cpus * NUM_CPU_FIELDS * sizeof(uint64_t));
+    float *pct = (float*)counted_malloc((size_t)num_cpus * NUM_CPU_RATES * sizeof(float));
+    for(int field = 0; field < NUM_CPU_FIELDS; field++) cpu_rates.previous[field] = previous + (size_t)field * num_cpus;
+    for(int rate = 0; rate < NUM_CPU_RATES; rate++) cpu_rates.pct[rate] = pct + (size_t)rate * num_cpus;
+
+    cpu_rates.previous_online = (uint8_t*)counted_malloc((size_t)num_cpus);
+    cpu_rates.valid = (uint8_t*)counted_malloc((size_t)num_cpus);
+    memset(cpu_rates.valid, 0, (size_t)num_cpus);
+    cpu_rates.have_previous = 0;
+}
+
+/*
+* @brief Sizes the per core columns of cpu_stats to hold num_cpus cores,
+*        keeping the values already collected.
+*/
+void resize_cpu_stats(int num_cpus)
+{
+    uint64_t *block = (uint64_t*)counted_malloc((size_t)num_cpus * NUM_CPU_FIELDS * sizeof(uint64_t));
+    uint8_t *online = (uint8_t*)counted_malloc((size_t)num_cpus);
+    memset(block, 0, (size_t)num_cpus * NUM_CPU_FIELDS * sizeof(uint64_t));
+    memset(online, 0, (size_t)num_cpus);
+    uint64_t *old_block = cpu_stats.time[0];
+
+    for(int field = 0; field < NUM_CPU_FIELDS; field++)
+    {
+        uint64_t *column = block + (size_t)field * num_cpus;
+        if(cpu_stats.time[field] != NULL) memcpy(column, cpu_stats.time[field], (size_t)cpu_stats.num_cpus * sizeof(uint64_t));
+        cpu_stats.time[field] = column;
+    }
+    if(cpu_stats.online != NULL) memcpy(online, cpu_stats.online, (size_t)cpu_stats.num_cpus);
+
+    free(old_block);
+    free(cpu_stats.online);
+    cpu_stats.online = online;
+    cpu_stats.num_cpus = num_cpus;
+
+    resize_cpu_rates(num_cpus);
+}
+
+/*
+* @brief Copies a cpu line's fields into the total or into core cpu_index.
+*/
+void update_cpu_index(int cpu_index, const uint64_t fields[NUM_CPU_FIELDS])
+{
+    if(cpu_index < 0)
+    {
+        memcpy(cpu_stats.total.time, fields, sizeof(cpu_stats.total.time));
+        return;
+    }
+    for(int i = 0; i < NUM_CPU_FIELDS; i++) cpu_stats.time[i][cpu_index] = fields[i];
+}
+
+/*
+* @brief Reads the core number out of a "cpuN" token.
+*
+* @returns the core number, -1 for the "cpu" total line, -2 if it is not a cpu line
+*/
+int cpu_index_from_token(const char *token, size_t length)
+{
+    if(length < 3 || token[0] != 'c' || token[1] != 'p' || token[2] != 'u') return -2;
+    if(length == 3) return -1;
+
+    int index = 0;
+    for(size_t i = 3; i < length; i++)
+    {
+        if(token[i] < '0' || token[i] > '9') return -2;
+        index = index * 10 + (token[i] - '0');
+    }
+    return index;
+}
+
+/*
+* @breif Updates cpu_stats struct with latest from proc file.
+*        Cores without a line (offline) are marked as such and keep their
+*        last values.
+*/
+void update_cpu_stats()
+{
+    const char *cursor = cpu_source.buffer;
+
+    memset(cpu_stats.online, 0, (size_t)cpu_stats.num_cpus);
+    cpu_stats.num_online = 0;
+    cpu_stats.sample_ns = cpu_source.read_ns;
+    while(*cursor != '\0')
+    {
+        const char *token;
+        size_t length = scan_token(&cursor, &token);
+
+        int cpu_index = cpu_index_from_token(token, length);
+        if(cpu_index >= -1)
+        {
+            uint64_t fields[NUM_CPU_FIELDS] = {0}; //Older kernels print fewer columns
+            scan_fields(&cursor, fields, NUM_CPU_FIELDS);
+            if(cpu_index >= 0)
+            {
+                //A cpu beyond the possible mask, only seen if it changed since startup
+                if(cpu_index >= cpu_stats.num_cpus) resize_cpu_stats(cpu_index + 1);
+                cpu_stats.online[cpu_index] = 1;
+                cpu_stats.num_online++;
+            }
+            update_cpu_index(cpu_index, fields);
+        }
+        else if(token_is(token, length, "ctxt")) scan_fields(&cursor, &cpu_stats.num_context_switches, 1);
+        else if(token_is(token, length, "intr")) scan_fields(&cursor, &cpu_stats.num_interrupts, 1);
+        else if(token_is(token, length, "softirq")) scan_fields(&cursor, &cpu_stats.num_softirqs, 1);
+        else if(token_is(token, length, "btime")) scan_fields(&cursor, &cpu_stats.boot_time, 1);
+        else if(token_is(token, length, "processes")) scan_fields(&cursor, &cpu_stats.num_proccesses_created, 1);
+        else if(token_is(token, length, "procs_running")) scan_fields(&cursor, &cpu_stats.proccesses_running, 1);
+        else if(token_is(token, length, "procs_blocked")) scan_fields(&cursor, &cpu_stats.proccesses_blocked, 1);
+
+        //The per irq counts after the intr total are left to the interrupt
+        //collector, which has them per cpu from /proc/interrupts
+        cursor = skip_line(cursor);
+    }
+
+}
+
+/*
+* @breif Updates meminfo_snapshot with newest data from file, and mem_info
+*        with the lines it keeps
+*/
+void update_meminfo()
+{
+    parse_meminfo(mem_source.buffer, &meminfo_snapshot, mem_source.read_ns);
+
+    mem_info.present = 0;
+    mem_info.sample_ns = mem_source.read_ns;
+    for(int i = 0; i < NUM_MEM_FIELDS; i++)
+    {
+        if(!meminfo_has(&meminfo_snapshot, mem_field_meminfo_keys[i])) continue;
+        mem_info.value[i] = meminfo_snapshot.value[mem_field_meminfo_keys[i]];
+        mem_info.present |= 1u << i;
+    }
+}
+
+/*
+* @brief Grows the device array of network_info to hold num_devices, and
+*        the rates with it. New devices have no interface yet.
+*/
+void reserve_network_devices(int num_devices)
+{
+    if(num_devices <= network_info.capacity) return;
+
+    int capacity = network_info.capacity > 0 ? network_info.capacity : 16;
+    while(capacity < num_devices) capacity *= 2;
+    network_info.devices = counted_realloc(network_info.devices, (size_t)capacity * sizeof(struct network_device));
+    network_rates.devices = counted_realloc(network_rates.devices, (size_t)capacity * sizeof(struct network_rate));
+    for(int i = network_info.capacity; i < capacity; i++) network_info.devices[i].id = -1;
+    network_info.capacity = capacity;
+}
+
+/*
+* @breif helper for function update_network_info
+*        scans the line at *cursor into the device struct at index device_index
+*        and moves the cursor to the next line
+*
+* @returns 0 on success, -1 if the line is not a device line
+*/
+int copy_to_network_struct(int device_index, const char **cursor)
+{
+    struct network_device *device = &network_info.devices[device_index];
+    const char *line = skip_blanks(*cursor);
+    const char *next = skip_line(line);
+
+    //The name ends at the colon, large counters can run straight into it
+    const char *colon = memchr(line, ':', (size_t)(next - line));
+    if(colon == NULL) {*cursor = next; return -1;}
+
+    size_t length = (size_t)(colon - line);
+    if(length >= sizeof(device->face)) length = sizeof(device->face) - 1;
+    memcpy(device->face, line, length);
+    device->face[length] = '\0';
+
+    const char *fields = colon + 1;
+    int num_fields = scan_fields(&fields, device->counter, NUM_NETWORK_FIELDS);
+    for(int i = num_fields; i < NUM_NETWORK_FIELDS; i++) device->counter[i] = 0;
+
+    *cursor = next;
+    return 0;
+}
+
+/*
+* @breif updates network info struct
+*/
+void update_network_info()
+{
+    const char *cursor = network_source.buffer;
+    int device_index = 0;
+
+    cursor = skip_line(skip_line(cursor)); //Two header lines
+    while(*cursor != '\0')
+    {
+        reserve_network_devices(device_index + 1);
+        if(copy_to_network_struct(device_index, &cursor) != 0) continue;
+        device_index++;
+    }
+    network_info.num_devices = device_index;
+    network_info.sample_ns = network_source.read_ns;
+}
+
+/*
+* @brief Difference between two jiffy counts. Some of them, iowait in
+*        particular, can step backwards and are treated as no change.
+*/
+uint64_t jiffies_delta(uint64_t current, uint64_t previous)
+{
+    return current > previous ? current - previous : 0;
+}
+
+/*
+* @brief Difference between two interface counters. A counter that went
+*        down either wrapped at 32 bits (some drivers) or was reset when the
+*        interface was recreated, in which case it counted up from zero.
+*        It only wrapped if it was within COUNTER_WRAP_MARGIN of 2^32 and
+*        came back round to within the margin of zero; any other drop, such
+*        as a recreated veth going from 1000000 to 500, is a reset.
+*/
+uint64_t counter_delta(uint64_t current, uint64_t previous)
+{
+    if(current >= previous) return current - previous;
+    if(previous <= UINT32_MAX)
+    {
+        uint64_t wrapped = (UINT32_MAX - previous) + current + 1;
+        if(wrapped < COUNTER_WRAP_MARGIN) return wrapped;
+    }
+    return current;
+}
+
+/*
+* @brief Works out the cpu_rate_field percentages of one cpu line from the
+*        jiffies spent since the previous sample.
+*/
+void cpu_line_rates(const uint64_t current[NUM_CPU_FIELDS], const uint64_t previous[NUM_CPU_FIELDS],
+                    float pct[NUM_CPU_RATES])
+{
+    uint64_t delta[NUM_CPU_FIELDS];
+    uint64_t total = 0;
+    //Guest time is already counted in user time, so it is left out of the total
+    for(int field = 0; field < CPU_GUEST; field++)
+    {
+        delta[field] = jiffies_delta(current[field], previous[field]);
+        total += delta[field];
+    }
+
+    if(total == 0)
+    {
+        for(int rate = 0; rate < NUM_CPU_RATES; rate++) pct[rate] = 0;
+        return;
+    }
+
+    float scale = 100.0f / (float)total;
+    pct[CPU_RATE_USER] = (float)(delta[CPU_USER] + delta[CPU_NICE]) * scale;
+    pct[CPU_RATE_SYSTEM] = (float)(delta[CPU_SYSTEM] + delta[CPU_IRQ] + delta[CPU_SOFTIRQ]) * scale;
+    pct[CPU_RATE_IOWAIT] = (float)delta[CPU_IOWAIT] * scale;
+    pct[CPU_RATE_STEAL] = (float)delta[CPU_STEAL] * scale;
+    pct[CPU_RATE_IDLE] = (float)delta[CPU_IDLE] * scale;
+    pct[CPU_RATE_BUSY] = 100.0f - pct[CPU_RATE_IDLE];
+}
+
+/*
+* @brief Updates cpu_rates from the sample just taken by update_cpu_stats
+*        and keeps that sample as the previous one.
+*/
+void update_cpu_rates()
+{
+    int num_cpus = cpu_stats.num_cpus;
+    if(cpu_rates.have_previous)
+    {
+        cpu_line_rates(cpu_stats.total.time, cpu_rates.previous_total.time, cpu_rates.total);
+
+        for(int cpu = 0; cpu < num_cpus; cpu++)
+        {
+            cpu_rates.valid[cpu] = cpu_stats.online[cpu] && cpu_rates.previous_online[cpu];
+            if(!cpu_rates.valid[cpu]) continue;
+
+            uint64_t current[NUM_CPU_FIELDS];
+            uint64_t previous[NUM_CPU_FIELDS];
+            float pct[NUM_CPU_RATES];
+            for(int field = 0; field < NUM_CPU_FIELDS; field++)
+            {
+                current[field] = cpu_stats.time[field][cpu];
+                previous[field] = cpu_rates.previous[field][cpu];
+            }
+            cpu_line_rates(current, previous, pct);
+            for(int rate = 0; rate < NUM_CPU_RATES; rate++) cpu_rates.pct[rate][cpu] = pct[rate];
+        }
+
+        double seconds = (double)(cpu_stats.sample_ns - cpu_rates.previous_ns) / 1e9;
+        uint64_t switches = jiffies_delta(cpu_stats.num_context_switches, cpu_rates.previous_context_switches);
+        cpu_rates.context_switches_per_second = seconds > 0 ? (double)switches / seconds : 0;
+        uint64_t interrupts = counter_delta(cpu_stats.num_interrupts, cpu_rates.previous_interrupts);
+        cpu_rates.interrupts_per_second = seconds > 0 ? (double)interrupts / seconds : 0;
+        uint64_t softirqs = counter_delta(cpu_stats.num_softirqs, cpu_rates.previous_softirqs);
+        cpu_rates.softirqs_per_second = seconds > 0 ? (double)softirqs / seconds : 0;
+    }
+
+    //Both sets of columns share one layout, so the whole sample copies at once
+    memcpy(cpu_rates.previous[0], cpu_stats.time[0], (size_t)num_cpus * NUM_CPU_FIELDS * sizeof(uint64_t));
+    memcpy(cpu_rates.previous_online, cpu_stats.online, (size_t)num_cpus);
+    cpu_rates.previous_total = cpu_stats.total;
+    cpu_rates.previous_context_switches = cpu_stats.num_context_switches;
+    cpu_rates.previous_interrupts = cpu_stats.num_interrupts;
+    cpu_rates.previous_softirqs = cpu_stats.num_softirqs;
+    cpu_rates.span_ns = cpu_rates.have_previous ? cpu_stats.sample_ns - cpu_rates.previous_ns : 0;
+    cpu_rates.previous_ns = cpu_stats.sample_ns;
+    cpu_rates.have_previous = 1;
+}
+
+static inline uint32_t face_slot(const char *face)
+{
+    uint32_t hash = 2166136261u;
+    for(; *face != '\0'; face++) hash = (hash ^ (uint8_t)*face) * 16777619u;
+    return hash & network_rates.slot_mask;
+}
+
+/*
+* @returns the id of the interface named face, or -1 if it is not known
+*/
+int find_network_interface(const char *face)
+{
+    if(network_rates.slots == NULL) return -1;
+    for(uint32_t slot = face_slot(face); network_rates.slots[slot] >= 0; slot = (slot + 1) & network_rates.slot_mask)
+    {
+        if(strcmp(network_rates.interfaces[network_rates.slots[slot]].face, face) == 0) return network_rates.slots[slot];
+    }
+    return -1;
+}
+
+void set_interface_slot(int id)
+{
+    uint32_t slot = face_slot(network_rates.interfaces[id].face);
+    while(network_rates.slots[slot] >= 0) slot = (slot + 1) & network_rates.slot_mask;
+    network_rates.slots[slot] = id;
+}
+
+/*
+* @brief Frees the slot of an interface, moving back the ones after it that
+*        would otherwise no longer be found.
+*/
+void remove_interface_slot(int id)
+{
+    uint32_t slot = face_slot(network_rates.interfaces[id].face);
+    while(network_rates.slots[slot] != id) slot = (slot + 1) & network_rates.slot_mask;
+
+    uint32_t hole = slot;
+    for(uint32_t next = (hole + 1) & network_rates.slot_mask; network_rates.slots[next] >= 0; next = (next + 1) & network_rates.slot_mask)
+    {
+        uint32_t home = face_slot(network_rates.interfaces[network_rates.slots[next]].face);
+        //The interface can fill the hole if its home is not between the hole and it
+        if(((next - home) & network_rates.slot_mask) >= ((next - hole) & network_rates.slot_mask))
+        {
+            network_rates.slots[hole] = network_rates.slots[next];
+            hole = next;
+        }
+    }
+    network_rates.slots[hole] = -1;
+}
+
+/*
+* @brief Doubles the interfaces and the name table, which is kept at least
+*        twice as large as the interfaces.
+*/
+void grow_network_interfaces()
+{
+    network_rates.capacity = network_rates.capacity > 0 ? network_rates.capacity * 2 : 64;
+    size_t capacity = (size_t)network_rates.capacity;
+    network_rates.interfaces = counted_realloc(network_rates.interfaces, capacity * sizeof(struct network_interface));
+    network_rates.free_ids = counted_realloc(network_rates.free_ids, capacity * sizeof(int));
+
+    uint32_t num_slots = (uint32_t)capacity * 2;
+    free(network_rates.slots);
+    network_rates.slots = counted_malloc(num_slots * sizeof(int32_t));
+    memset(network_rates.slots, 0xff, num_slots * sizeof(int32_t));
+    network_rates.slot_mask = num_slots - 1;
+    for(int id = 0; id < network_rates.num_interfaces; id++)
+    {
+        if(network_rates.interfaces[id].in_use) set_interface_slot(id);
+    }
+}
+
+/*
+* @brief Gives a new interface an id, the most recently freed one if any.
+*
+* @returns the id
+*/
+int add_network_interface(const char *face)
+{
+    int id;
+    if(network_rates.num_free > 0) id = network_rates.free_ids[--network_rates.num_free];
+    else
+    {
+        if(network_rates.num_interfaces == network_rates.capacity) grow_network_interfaces();
+        id = network_rates.num_interfaces++;
+    }
+
+    struct network_interface *interface = &network_rates.interfaces[id];
+    memset(interface, 0, sizeof(*interface));
+    memcpy(interface->face, face, sizeof(interface->face));
+    interface->in_use = 1;
+    interface->first_sample = network_rates.samples;
+    set_interface_slot(id);
+    network_rates.num_added++;
+    network_rates.generation++;
+    return id;
+}
+
+void remove_network_interface(int id)
+{
+    remove_interface_slot(id);
+    network_rates.interfaces[id].in_use = 0;
+    network_rates.free_ids[network_rates.num_free++] = id;
+    network_rates.num_removed++;
+    network_rates.generation++;
+}
+
+/*
+* @brief Updates network_rates from the sample just taken by
+*        update_network_info and keeps each interface's counters as its
+*        previous ones. An interface is matched by name, trying the id its
+*        line had in the last sample first, so interfaces that appear or
+*        disappear between samples leave the others' rates alone.
+*/
+void update_network_rates()
+{
+    double seconds = (double)(network_info.sample_ns - network_rates.previous_ns) / 1e9;
+    uint64_t sample = ++network_rates.samples;
+    network_rates.num_added = 0;
+    network_rates.num_removed = 0;
+
+    for(int i = 0; i < network_info.num_devices; i++)
+    {
+        struct network_device *device = &network_info.devices[i];
+        int id = device->id;
+        if(id < 0 || id >= network_rates.num_interfaces || !network_rates.interfaces[id].in_use ||
+           strcmp(network_rates.interfaces[id].face, device->face) != 0)
+        {
+            id = find_network_interface(device->face);
+            if(id < 0) id = add_network_interface(device->face);
+            device->id = id;
+        }
+
+        struct network_interface *interface = &network_rates.interfaces[id];
+        struct network_rate *rate = &network_rates.devices[i];
+        rate->valid = network_rates.have_previous && seconds > 0 && interface->seen_sample == sample - 1;
+        if(rate->valid)
+        {
+            const uint64_t *counter = device->counter;
+            const uint64_t *previous_counter = interface->previous;
+            rate->rate[NET_RATE_R_BYTES] = (double)counter_delta(counter[NET_R_BYTES], previous_counter[NET_R_BYTES]) / seconds;
+            rate->rate[NET_RATE_R_PACKETS] = (double)counter_delta(counter[NET_R_PACKETS], previous_counter[NET_R_PACKETS]) / seconds;
+            rate->rate[NET_RATE_R_DROP] = (double)counter_delta(counter[NET_R_DROP], previous_counter[NET_R_DROP]) / seconds;
+            rate->rate[NET_RATE_T_BYTES] = (double)counter_delta(counter[NET_T_BYTES], previous_counter[NET_T_BYTES]) / seconds;
+            rate->rate[NET_RATE_T_PACKETS] = (double)counter_delta(counter[NET_T_PACKETS], previous_counter[NET_T_PACKETS]) / seconds;
+            rate->rate[NET_RATE_T_DROP] = (double)counter_delta(counter[NET_T_DROP], previous_counter[NET_T_DROP]) / seconds;
+        }
+        memcpy(interface->previous, device->counter, sizeof(interface->previous));
+        interface->seen_sample = sample;
+    }
+
+    //Interfaces without a line this sample are gone
+    if(network_rates.num_interfaces - network_rates.num_free > network_info.num_devices)
+    {
+        for(int id = 0; id < network_rates.num_interfaces; id++)
+        {
+            struct network_interface *interface = &network_rates.interfaces[id];
+            if(interface->in_use && interface->seen_sample != sample) remove_network_interface(id);
+        }
+    }
+    network_rates.previous_ns = network_info.sample_ns;
+    network_rates.have_previous = 1;
+}
+
+/*
+* @brief Takes a memory sample, with the node files once
+*        init_node_meminfo has opened them.
+*/
+void sample_mem_info()
+{
+    uint64_t start = monotonic_ns();
+    read_proc_source(&mem_source);
+    update_meminfo();
+    sample_node_meminfo();
+    probe_end(PROBE_MEM, start);
+}
+
+/*
+* @brief Takes a cpu sample and updates the rates from it.
+*/
+void sample_cpu_stats()
+{
+    uint64_t start = monotonic_ns();
+    read_proc_source(&cpu_source);
+    update_cpu_stats();
+    update_cpu_rates();
+    probe_end(PROBE_CPU, start);
+}
+
+/*
+* @brief Takes a network sample and updates the rates from it.
+*/
+void sample_network_info()
+{
+    uint64_t start = monotonic_ns();
+    read_network_info();
+    update_network_rates();
+    probe_end(PROBE_NETWORK, start);
+}
+
+/*
+* @brief Sizes the collectors to the machine the proc root describes.
+*/
+void init_collectors()
+{
+    resize_cpu_stats(discover_num_cpus());
+    network_rates.have_previous = 0;
+}
+
+/*
+* @brief Closes the proc sources and frees everything the collectors allocated.
+*/
+void close_collectors()
+{
+    free(cpu_stats.time[0]);
+    free(cpu_stats.online);
+    free(cpu_rates.previous[0]);
+    free(cpu_rates.previous_online);
+    free(cpu_rates.pct[0]);
+    free(cpu_rates.valid);
+    memset(&cpu_stats, 0, sizeof(cpu_stats));
+    memset(&cpu_rates, 0, sizeof(cpu_rates));
+    free(network_info.devices);
+    free(network_rates.devices);
+    free(network_rates.interfaces);
+    free(network_rates.free_ids);
+    free(network_rates.slots);
+    memset(&network_info, 0, sizeof(network_info));
+    memset(&network_rates, 0, sizeof(network_rates));
+
+    close_proc_source(&cpu_source);
+    close_proc_source(&mem_source);
+    close_proc_source(&network_source);
+    close_netlink_source();
+    close_node_meminfo();
+}
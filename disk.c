@@ -0,0 +1,341 @@
+/*
+ * File: disk.c
+ * Description: The disk collector: per device I/O from /proc/diskstats and
+ *              the capacity of each mounted filesystem from statvfs.
+ *
+ * Notes:
+ *      /proc/self/mountinfo stays open and is polled without waiting each
+ *      sample; the kernel flags it with POLLPRI when a mount is added or
+ *      removed, and only then is it read and parsed again. A copy of
+ *      another host's proc files never flags, so it is parsed once.
+ */
+#include <unistd.h>
+#include <poll.h>
+#include <sys/statvfs.h>
+
+#include "sys_mon.h"
+#include "scan.h"
+#include "selfstats.h"
+#include "disk.h"
+
+struct proc_source disk_source = {DISK_STATS_FILE, "", -1, NULL, 0, 0, 0};
+struct proc_source mount_source = {MOUNT_INFO_FILE, "", -1, NULL, 0, 0, 0};
+struct disk_stats disk_stats;
+struct disk_rates disk_rates;
+struct mount_table mount_table;
+
+/*
+* Filesystems without a device behind them, whose statvfs says nothing
+* about disk space.
+*/
+const char *pseudo_filesystems[] =
+{
+    "proc", "sysfs", "devpts", "cgroup", "cgroup2", "securityfs", "debugfs",
+    "tracefs", "pstore", "bpf", "mqueue", "hugetlbfs", "configfs", "fusectl",
+    "binfmt_misc", "autofs", "rpc_pipefs", "nsfs", "efivarfs", "selinuxfs"
+};
+
+/*
+* @brief Grows the device array of a disk_stats to hold num_devices. The
+*        rates of disk_stats grow with it.
+*/
+void reserve_disk_devices(struct disk_stats *stats, int num_devices)
+{
+    if(num_devices <= stats->capacity) return;
+
+    int capacity = stats->capacity > 0 ? stats->capacity : 16;
+    while(capacity < num_devices) capacity *= 2;
+    stats->devices = counted_realloc(stats->devices, (size_t)capacity * sizeof(struct disk_device));
+    stats->capacity = capacity;
+    if(stats == &disk_stats)
+    {
+        disk_rates.devices = counted_realloc(disk_rates.devices, (size_t)capacity * sizeof(struct disk_rate));
+    }
+}
+
+/*
+* @breif Updates disk_stats with the devices in the diskstats buffer.
+*/
+void update_disk_stats()
+{
+    const char *cursor = disk_source.buffer;
+    int device_index = 0;
+
+    while(*cursor != '\0')
+    {
+        uint64_t numbers[2];
+        const char *token;
+        size_t length;
+        if(scan_fields(&cursor, numbers, 2) != 2 || (length = scan_token(&cursor, &token)) == 0)
+        {
+            cursor = skip_line(cursor);
+            continue;
+        }
+
+        reserve_disk_devices(&disk_stats, device_index + 1);
+        struct disk_device *device = &disk_stats.devices[device_index++];
+        device->major = (unsigned int)numbers[0];
+        device->minor = (unsigned int)numbers[1];
+        if(length >= sizeof(device->name)) length = sizeof(device->name) - 1;
+        memcpy(device->name, token, length);
+        device->name[length] = '\0';
+
+        int num_fields = scan_fields(&cursor, device->counter, NUM_DISK_FIELDS);
+        for(int i = num_fields; i < NUM_DISK_FIELDS; i++) device->counter[i] = 0;
+        cursor = skip_line(cursor);
+    }
+    disk_stats.num_devices = device_index;
+    disk_stats.sample_ns = disk_source.read_ns;
+}
+
+/*
+* @brief Finds a device in the previous disk sample by name, trying the
+*        same index first as devices rarely move.
+*
+* @returns the previous device, or NULL if the device is new
+*/
+const struct disk_device *find_previous_disk(int device_index, const char *name)
+{
+    const struct disk_stats *previous = &disk_rates.previous;
+    if(device_index < previous->num_devices && strcmp(previous->devices[device_index].name, name) == 0)
+    {
+        return &previous->devices[device_index];
+    }
+    for(int i = 0; i < previous->num_devices; i++)
+    {
+        if(strcmp(previous->devices[i].name, name) == 0) return &previous->devices[i];
+    }
+    return NULL;
+}
+
+/*
+* @brief Updates disk_rates from the sample just taken by update_disk_stats
+*        and keeps that sample as the previous one.
+*/
+void update_disk_rates()
+{
+    double seconds = (double)(disk_stats.sample_ns - disk_rates.previous.sample_ns) / 1e9;
+
+    for(int i = 0; i < disk_stats.num_devices; i++)
+    {
+        struct disk_rate *rate = &disk_rates.devices[i];
+        rate->valid = 0;
+        if(!disk_rates.have_previous || seconds <= 0) continue;
+
+        const struct disk_device *device = &disk_stats.devices[i];
+        const struct disk_device *previous = find_previous_disk(i, device->name);
+        if(previous == NULL) continue;
+
+        uint64_t delta[NUM_DISK_FIELDS];
+        for(int field = 0; field < NUM_DISK_FIELDS; field++)
+        {
+            delta[field] = counter_delta(device->counter[field], previous->counter[field]);
+        }
+        double milliseconds = seconds * 1000;
+        rate->rate[DISK_RATE_READS] = (double)delta[DISK_READS] / seconds;
+        rate->rate[DISK_RATE_WRITES] = (double)delta[DISK_WRITES] / seconds;
+        rate->rate[DISK_RATE_READ_BYTES] = (double)delta[DISK_SECTORS_READ] * DISK_SECTOR_SIZE / seconds;
+        rate->rate[DISK_RATE_WRITE_BYTES] = (double)delta[DISK_SECTORS_WRITTEN] * DISK_SECTOR_SIZE / seconds;
+        rate->rate[DISK_RATE_READ_LATENCY] = delta[DISK_READS] > 0 ? (double)delta[DISK_READ_MS] / delta[DISK_READS] : 0;
+        rate->rate[DISK_RATE_WRITE_LATENCY] = delta[DISK_WRITES] > 0 ? (double)delta[DISK_WRITE_MS] / delta[DISK_WRITES] : 0;
+        rate->rate[DISK_RATE_QUEUE] = (double)delta[DISK_WEIGHTED_IO_MS] / milliseconds;
+        //io_ms is counted in jiffies, so a sample can see slightly more than its length
+        double utilization = (double)delta[DISK_IO_MS] * 100 / milliseconds;
+        rate->rate[DISK_RATE_UTILIZATION] = utilization < 100 ? utilization : 100;
+        rate->valid = 1;
+    }
+
+    reserve_disk_devices(&disk_rates.previous, disk_stats.num_devices);
+    memcpy(disk_rates.previous.devices, disk_stats.devices, (size_t)disk_stats.num_devices * sizeof(struct disk_device));
+    disk_rates.previous.num_devices = disk_stats.num_devices;
+    disk_rates.previous.sample_ns = disk_stats.sample_ns;
+    disk_rates.have_previous = 1;
+}
+
+/*
+* @brief Cuts the next space separated field off a mountinfo line, nul
+*        terminating it in place.
+*
+* @returns the field, empty at the end of the line
+*/
+char *next_mount_field(char **cursor, char *end)
+{
+    char *p = *cursor;
+    while(p < end && *p == ' ') p++;
+    char *field = p;
+    while(p < end && *p != ' ') p++;
+    *p = '\0';
+    *cursor = p < end ? p + 1 : end;
+    return field;
+}
+
+/*
+* @brief Undoes the octal escapes mountinfo uses for spaces, tabs, newlines
+*        and backslashes in paths, in place.
+*/
+void unescape_mount_path(char *path)
+{
+    char *out = path;
+    for(char *in = path; *in != '\0'; in++)
+    {
+        if(in[0] == '\\' && in[1] >= '0' && in[1] <= '3' && in[2] >= '0' && in[2] <= '7' && in[3] >= '0' && in[3] <= '7')
+        {
+            *out++ = (char)((in[1] - '0') * 64 + (in[2] - '0') * 8 + (in[3] - '0'));
+            in += 3;
+        }
+        else *out++ = *in;
+    }
+    *out = '\0';
+}
+
+/*
+* @returns 1 if the filesystem type is one of pseudo_filesystems
+*/
+int is_pseudo_filesystem(const char *type)
+{
+    for(int i = 0; i < (int)(sizeof(pseudo_filesystems) / sizeof(pseudo_filesystems[0])); i++)
+    {
+        if(strcmp(type, pseudo_filesystems[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/*
+* @brief Parses the mountinfo buffer into mount_table. The buffer is cut
+*        into nul terminated names that the filesystems point at.
+*/
+void parse_mount_table()
+{
+    char *cursor = mount_source.buffer;
+    mount_table.num_filesystems = 0;
+    mount_table.num_skipped = 0;
+
+    while(*cursor != '\0')
+    {
+        char *end = strchr(cursor, '\n');
+        if(end == NULL) end = cursor + strlen(cursor);
+        char *next = *end == '\n' ? end + 1 : end;
+
+        //id parent major:minor root mount_point options [optional...] - type source super_options
+        next_mount_field(&cursor, end);
+        next_mount_field(&cursor, end);
+        char *device = next_mount_field(&cursor, end);
+        next_mount_field(&cursor, end);
+        char *mount_point = next_mount_field(&cursor, end);
+        next_mount_field(&cursor, end);
+        char *field;
+        do field = next_mount_field(&cursor, end); while(*field != '\0' && strcmp(field, "-") != 0);
+        char *type = next_mount_field(&cursor, end);
+        char *source = next_mount_field(&cursor, end);
+        cursor = next;
+
+        unsigned int major, minor;
+        if(*type == '\0' || sscanf(device, "%u:%u", &major, &minor) != 2) continue;
+        unescape_mount_path(mount_point);
+        unescape_mount_path(source);
+        for(int i = 0; i < mount_table.num_filesystems; i++)
+        {
+            //Mounted over: statvfs of the path only sees the later mount
+            if(strcmp(mount_table.filesystems[i].mount_point, mount_point) != 0) continue;
+            memmove(&mount_table.filesystems[i], &mount_table.filesystems[i + 1],
+                    (size_t)(mount_table.num_filesystems - i - 1) * sizeof(struct filesystem));
+            mount_table.num_filesystems--;
+            mount_table.num_skipped++;
+            break;
+        }
+        int skip = is_pseudo_filesystem(type);
+        for(int i = 0; i < mount_table.num_filesystems && !skip; i++)
+        {
+            //A bind mount or another subvolume of a device already listed
+            skip = mount_table.filesystems[i].major == major && mount_table.filesystems[i].minor == minor;
+        }
+        if(skip)
+        {
+            mount_table.num_skipped++;
+            continue;
+        }
+
+        if(mount_table.num_filesystems == mount_table.capacity)
+        {
+            mount_table.capacity = mount_table.capacity > 0 ? mount_table.capacity * 2 : 32;
+            mount_table.filesystems = counted_realloc(mount_table.filesystems, (size_t)mount_table.capacity * sizeof(struct filesystem));
+        }
+        struct filesystem *filesystem = &mount_table.filesystems[mount_table.num_filesystems++];
+        memset(filesystem, 0, sizeof(*filesystem));
+        filesystem->mount_point = mount_point;
+        filesystem->source = source;
+        filesystem->type = type;
+        filesystem->major = major;
+        filesystem->minor = minor;
+    }
+}
+
+/*
+* @brief Reads the mount table again if the kernel flagged a change since
+*        it was last read.
+*/
+void update_mount_table()
+{
+    if(mount_table.loaded)
+    {
+        struct pollfd changed = {mount_source.fd, POLLPRI, 0};
+        if(poll(&changed, 1, 0) <= 0 || (changed.revents & (POLLPRI | POLLERR)) == 0) return;
+    }
+    read_proc_source(&mount_source);
+    parse_mount_table();
+    mount_table.loaded = 1;
+    mount_table.parses++;
+}
+
+/*
+* @brief Takes the capacity and inode counts of every filesystem in the
+*        mount table.
+*/
+void update_filesystems()
+{
+    for(int i = 0; i < mount_table.num_filesystems; i++)
+    {
+        struct filesystem *filesystem = &mount_table.filesystems[i];
+        struct statvfs stats;
+        filesystem->have_stats = statvfs(filesystem->mount_point, &stats) == 0;
+        if(!filesystem->have_stats) continue;
+
+        filesystem->total_bytes = (uint64_t)stats.f_blocks * stats.f_frsize;
+        filesystem->free_bytes = (uint64_t)stats.f_bfree * stats.f_frsize;
+        filesystem->available_bytes = (uint64_t)stats.f_bavail * stats.f_frsize;
+        filesystem->total_inodes = stats.f_files;
+        filesystem->free_inodes = stats.f_ffree;
+    }
+}
+
+/*
+* @brief Takes a disk sample, updates the rates from it and refreshes the
+*        filesystem capacities.
+*/
+void sample_disk_info()
+{
+    uint64_t start = monotonic_ns();
+    read_proc_source(&disk_source);
+    update_disk_stats();
+    update_disk_rates();
+    update_mount_table();
+    update_filesystems();
+    probe_end(PROBE_DISK, start);
+}
+
+/*
+* @brief Closes the disk sources and frees everything the collector allocated.
+*/
+void close_disk_info()
+{
+    free(disk_stats.devices);
+    free(disk_rates.previous.devices);
+    free(disk_rates.devices);
+    free(mount_table.filesystems);
+    memset(&disk_stats, 0, sizeof(disk_stats));
+    memset(&disk_rates, 0, sizeof(disk_rates));
+    memset(&mount_table, 0, sizeof(mount_table));
+
+    close_proc_source(&disk_source);
+    close_proc_source(&mount_source);
+}
@@ -0,0 +1,140 @@
+/*
+ * File: disk.h
+ * Description: The disk collector: per device I/O from /proc/diskstats and
+ *              the capacity of each mounted filesystem from statvfs.
+ */
+#ifndef DISK_H
+#define DISK_H
+
+#include <stdint.h>
+
+#include "sys_mon.h"
+
+#define DISK_STATS_FILE             "diskstats"
+#define MOUNT_INFO_FILE             "self/mountinfo"
+#define DISK_NAME_LENGTH            32
+#define DISK_SECTOR_SIZE            512 //diskstats counts 512 byte sectors whatever the device's own size
+
+/*
+* Columns of a device line in /proc/diskstats after the name, in the order
+* the kernel prints them. Newer kernels add discard and flush columns, which
+* are not read.
+*/
+enum disk_field
+{
+    DISK_READS,
+    DISK_READS_MERGED,
+    DISK_SECTORS_READ,
+    DISK_READ_MS,
+    DISK_WRITES,
+    DISK_WRITES_MERGED,
+    DISK_SECTORS_WRITTEN,
+    DISK_WRITE_MS,
+    DISK_IN_FLIGHT,                     //A gauge, not a counter
+    DISK_IO_MS,                         //Time with at least one request in flight
+    DISK_WEIGHTED_IO_MS,                //Request time summed over the requests in flight
+    NUM_DISK_FIELDS
+};
+
+/*
+* What a device did between two samples.
+*/
+enum disk_rate_field
+{
+    DISK_RATE_READS,                    //Completed per second
+    DISK_RATE_WRITES,
+    DISK_RATE_READ_BYTES,
+    DISK_RATE_WRITE_BYTES,
+    DISK_RATE_READ_LATENCY,             //Average ms a read took
+    DISK_RATE_WRITE_LATENCY,
+    DISK_RATE_QUEUE,                    //Average requests in flight
+    DISK_RATE_UTILIZATION,              //% of the time busy
+    NUM_DISK_RATES
+};
+
+struct disk_device
+{
+    char name[DISK_NAME_LENGTH];
+    unsigned int major;
+    unsigned int minor;
+    uint64_t counter[NUM_DISK_FIELDS];
+};
+
+struct disk_rate
+{
+    int valid;                          //Not set for a device that is new this sample
+    double rate[NUM_DISK_RATES];
+};
+
+/*
+* One sample of /proc/diskstats. The device array grows with the file and
+* is never shrunk, so a steady state sample allocates nothing.
+*/
+struct disk_stats
+{
+    struct disk_device *devices;
+    int num_devices;
+    int capacity;
+    uint64_t sample_ns;
+};
+
+/*
+* The previous disk sample and the rates of each device in disk_stats,
+* index for index.
+*/
+struct disk_rates
+{
+    int have_previous;
+    struct disk_stats previous;
+    struct disk_rate *devices;
+};
+
+/*
+* A mounted filesystem. The names point into the mountinfo buffer, which
+* holds them unescaped and nul terminated until the table is parsed again.
+*/
+struct filesystem
+{
+    const char *mount_point;
+    const char *source;
+    const char *type;
+    unsigned int major;
+    unsigned int minor;
+    int have_stats;                     //statvfs succeeded in the last sample
+    uint64_t total_bytes;
+    uint64_t free_bytes;
+    uint64_t available_bytes;           //Free to unprivileged users
+    uint64_t total_inodes;
+    uint64_t free_inodes;
+};
+
+/*
+* The mount table, parsed from /proc/self/mountinfo only when the kernel
+* reports it changed. Pseudo filesystems, further mounts of a device
+* already in the table and mounts hidden by a later one on the same mount
+* point are left out.
+*/
+struct mount_table
+{
+    int loaded;
+    struct filesystem *filesystems;
+    int num_filesystems;
+    int capacity;
+    int num_skipped;
+    uint64_t parses;                    //Times the table was read and parsed
+};
+
+extern struct proc_source disk_source;
+extern struct proc_source mount_source;
+extern struct disk_stats disk_stats;
+extern struct disk_rates disk_rates;
+extern struct mount_table mount_table;
+
+void update_disk_stats();
+void update_disk_rates();
+void update_mount_table();
+void update_filesystems();
+void sample_disk_info();
+void close_disk_info();
+
+#endif
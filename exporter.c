@@ -0,0 +1,1006 @@
+/*
+ * File: exporter.c
+ * Description: Serves the latest snapshot of the collectors over HTTP on a
+ *              TCP or Unix socket, as Prometheus text and as JSON.
+ *
+ * Notes:
+ *      Each format is written once per sample, header and all, and every
+ *      request until the next sample is sent that same response, so a
+ *      scrape is one send() with nothing formatted on the request path
+ *      however many scrapers there are. The connections are non-blocking
+ *      and served from one level triggered epoll set, which the scheduler
+ *      waits on next to its timers. HTTP/1.1 connections are kept alive and
+ *      pipelined requests answered in order. Only GET and HEAD are served.
+ */
+#define _GNU_SOURCE //accept4, memmem and strcasestr
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "sys_mon.h"
+#include "selfstats.h"
+#include "disk.h"
+#include "meminfo.h"
+#include "exporter.h"
+
+#define EXPORT_LISTENER             UINT32_MAX //epoll data of the listening socket, clients have their slot
+
+struct exporter exporter = {.listen_fd = -1, .epoll_fd = -1};
+const char *export_format_names[NUM_EXPORT_FORMATS] = {"prometheus", "json"};
+const char *export_content_types[NUM_EXPORT_FORMATS] = {"text/plain; version=0.0.4; charset=utf-8", "application/json"};
+
+/*
+* Mode label of each cpu_field.
+*/
+const char *export_cpu_modes[NUM_CPU_FIELDS] =
+{
+    "user", "nice", "system", "idle", "iowait", "irq", "softirq", "steal", "guest", "guest_nice"
+};
+
+/*
+* Name of each network_field, the metric is sys_mon_network_<name>_total.
+*/
+const char *export_network_fields[NUM_NETWORK_FIELDS] =
+{
+    "receive_bytes", "receive_packets", "receive_errs", "receive_drop", "receive_fifo", "receive_frame",
+    "receive_compressed", "receive_multicast", "transmit_bytes", "transmit_packets", "transmit_errs",
+    "transmit_drop", "transmit_fifo", "transmit_colls", "transmit_carrier", "transmit_compressed"
+};
+
+enum export_unit
+{
+    EXPORT_UNIT_COUNT,
+    EXPORT_UNIT_SECTORS,                //Exported as bytes
+    EXPORT_UNIT_MS                      //Exported as seconds
+};
+
+/*
+* How each disk_field is exported: its Prometheus name, in the base units
+* Prometheus expects, and its JSON name, as the counter diskstats has.
+*/
+struct export_disk_field
+{
+    const char *name;
+    const char *json_name;
+    const char *type;
+    int unit;
+    const char *help;
+};
+
+const struct export_disk_field export_disk_fields[NUM_DISK_FIELDS] =
+{
+    {"reads_completed_total", "reads", "counter", EXPORT_UNIT_COUNT, "Reads completed"},
+    {"reads_merged_total", "reads_merged", "counter", EXPORT_UNIT_COUNT, "Reads merged with a neighbour"},
+    {"read_bytes_total", "sectors_read", "counter", EXPORT_UNIT_SECTORS, "Bytes read"},
+    {"read_time_seconds_total", "read_ms", "counter", EXPORT_UNIT_MS, "Time spent on reads"},
+    {"writes_completed_total", "writes", "counter", EXPORT_UNIT_COUNT, "Writes completed"},
+    {"writes_merged_total", "writes_merged", "counter", EXPORT_UNIT_COUNT, "Writes merged with a neighbour"},
+    {"written_bytes_total", "sectors_written", "counter", EXPORT_UNIT_SECTORS, "Bytes written"},
+    {"write_time_seconds_total", "write_ms", "counter", EXPORT_UNIT_MS, "Time spent on writes"},
+    {"io_now", "in_flight", "gauge", EXPORT_UNIT_COUNT, "Requests in flight"},
+    {"io_time_seconds_total", "io_ms", "counter", EXPORT_UNIT_MS, "Time with at least one request in flight"},
+    {"io_time_weighted_seconds_total", "weighted_io_ms", "counter", EXPORT_UNIT_MS, "Request time summed over the requests in flight"}
+};
+
+int cpu_decimals = 2;                   //Digits the cpu seconds need to be exact at USER_HZ
+
+/*
+* @brief Gives a response its first buffer.
+*/
+void init_response(struct export_response *response, size_t capacity)
+{
+    memset(response, 0, sizeof(*response));
+    response->capacity = capacity;
+    response->data = counted_malloc(capacity);
+    response->end = EXPORT_HEADER_SPACE;
+}
+
+/*
+* @brief Makes room for length more bytes and a nul after the body.
+*/
+static inline void grow_response(struct export_response *response, size_t length)
+{
+    if(__builtin_expect(response->end + length + 1 <= response->capacity, 1)) return;
+    size_t capacity = response->capacity;
+    while(capacity < response->end + length + 1) capacity *= 2;
+    response->data = counted_realloc(response->data, capacity);
+    response->capacity = capacity;
+}
+
+/*
+* @brief printf onto the end of a response body, growing it when the text
+*        does not fit.
+*/
+__attribute__((format(printf, 2, 3)))
+void export_printf(struct export_response *response, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(response->data + response->end, response->capacity - response->end, format, args);
+    va_end(args);
+    if(length < 0) return;
+    if((size_t)length >= response->capacity - response->end)
+    {
+        grow_response(response, (size_t)length);
+        va_start(args, format);
+        vsnprintf(response->data + response->end, response->capacity - response->end, format, args);
+        va_end(args);
+    }
+    response->end += (size_t)length;
+}
+
+/*
+* @brief Appends text as the inside of a Prometheus label value or a JSON
+*        string, escaping what either would read as syntax.
+*/
+void export_string(struct export_response *response, const char *text, size_t length, int json)
+{
+    grow_response(response, length * 6);
+    char *out = response->data + response->end;
+    for(size_t i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+        if(c == '"' || c == '\\') {*out++ = '\\'; *out++ = (char)c;}
+        else if(c == '\n') {*out++ = '\\'; *out++ = 'n';}
+        else if(c < 0x20 && json) out += sprintf(out, "\\u%04x", c);
+        else *out++ = (char)c;
+    }
+    response->end = (size_t)(out - response->data);
+}
+
+/*
+* @brief Appends text that needs no formatting.
+*/
+static inline void export_text(struct export_response *response, const char *text)
+{
+    size_t length = strlen(text);
+    grow_response(response, length);
+    memcpy(response->data + response->end, text, length);
+    response->end += length;
+}
+
+/*
+* @brief Appends a number in decimal. With export_text it writes the per
+*        cpu and per device lines, most of a snapshot, several times faster
+*        than a printf for each.
+*/
+static inline void export_u64(struct export_response *response, uint64_t value)
+{
+    char digits[20];
+    int length = 0;
+    do
+    {
+        digits[length++] = (char)('0' + value % 10);
+        value /= 10;
+    } while(value > 0);
+    grow_response(response, (size_t)length);
+    char *out = response->data + response->end;
+    while(length > 0) *out++ = digits[--length];
+    response->end = (size_t)(out - response->data);
+}
+
+/*
+* @brief Appends value / divisor with decimals digits after the point,
+*        exact when divisor divides 10^decimals, such as jiffies as seconds.
+*/
+void export_decimal(struct export_response *response, uint64_t value, uint64_t divisor, int decimals)
+{
+    export_u64(response, value / divisor);
+    if(decimals == 0) return;
+    uint64_t scale = 1;
+    for(int i = 0; i < decimals; i++) scale *= 10;
+    uint64_t fraction = value % divisor * scale / divisor;
+    grow_response(response, (size_t)decimals + 1);
+    char *out = response->data + response->end;
+    *out = '.';
+    for(int i = decimals; i > 0; i--)
+    {
+        out[i] = (char)('0' + fraction % 10);
+        fraction /= 10;
+    }
+    response->end += (size_t)decimals + 1;
+}
+
+/*
+* @brief Puts the HTTP header in front of a finished body.
+*/
+void finish_response(struct export_response *response, const char *status, const char *content_type)
+{
+    char header[EXPORT_HEADER_SPACE];
+    int length = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+                          status, content_type, response->end - EXPORT_HEADER_SPACE);
+    response->header_length = (size_t)length;
+    response->start = EXPORT_HEADER_SPACE - response->header_length;
+    memcpy(response->data + response->start, header, response->header_length);
+}
+
+/*
+* @brief Builds a response that never changes, held by the exporter for as
+*        long as it is open.
+*/
+void build_static_response(struct export_response *response, const char *status, const char *body)
+{
+    init_response(response, EXPORT_HEADER_SPACE + strlen(body) + 1);
+    export_printf(response, "%s", body);
+    finish_response(response, status, "text/plain; charset=utf-8");
+    response->format = -1;
+    response->references = 1;
+}
+
+/*
+* @brief A response to write a sample of a format into, from its free
+*        list when there is one. The caller holds the one reference.
+*/
+struct export_response *take_response(int format)
+{
+    struct export_response *response = exporter.free_responses[format];
+    if(response != NULL)
+    {
+        exporter.free_responses[format] = response->next_free;
+        response->end = EXPORT_HEADER_SPACE;
+    }
+    else
+    {
+        response = counted_malloc(sizeof(*response));
+        init_response(response, EXPORT_INITIAL_BODY);
+        response->format = format;
+    }
+    response->references = 1;
+    return response;
+}
+
+void release_response(struct export_response *response)
+{
+    if(--response->references > 0) return;
+    response->next_free = exporter.free_responses[response->format];
+    exporter.free_responses[response->format] = response;
+}
+
+/*
+* @brief Writes the HELP and TYPE lines of a metric family.
+*/
+void export_family(struct export_response *response, const char *name, const char *type, const char *help)
+{
+    export_printf(response, "# HELP sys_mon_%s %s\n# TYPE sys_mon_%s %s\n", name, help, name, type);
+}
+
+/*
+* @brief Writes a metric family with one sample and no labels.
+*/
+void export_scalar(struct export_response *response, const char *name, const char *type, const char *help, uint64_t value)
+{
+    export_family(response, name, type, help);
+    export_printf(response, "sys_mon_%s %" PRIu64 "\n", name, value);
+}
+
+/*
+* @brief Writes a diskstats counter in the unit it is exported in.
+*/
+void export_disk_value(struct export_response *response, uint64_t value, int unit)
+{
+    if(unit == EXPORT_UNIT_SECTORS) export_u64(response, value * DISK_SECTOR_SIZE);
+    else if(unit == EXPORT_UNIT_MS) export_decimal(response, value, 1000, 3);
+    else export_u64(response, value);
+}
+
+/*
+* @brief Writes the samples of a meminfo snapshot's lines in kB, as bytes,
+*        or of those that are counts. They are labelled with node unless it
+*        is -1.
+*/
+void export_meminfo_lines(struct export_response *response, const char *name, const struct meminfo_snapshot *snapshot,
+                          int node, int counts)
+{
+    uint64_t scale = counts ? 1 : 1024;
+    for(int key = 0; key < NUM_MEMINFO_KEYS; key++)
+    {
+        if(!meminfo_has(snapshot, key) || meminfo_key_counts[key] != counts) continue;
+        export_printf(response, "sys_mon_%s{", name);
+        if(node >= 0) export_printf(response, "node=\"%d\",", node);
+        export_printf(response, "key=\"%s\"} %" PRIu64 "\n", meminfo_key_names[key], snapshot->value[key] * scale);
+    }
+    for(int i = 0; i < snapshot->num_overflow; i++)
+    {
+        const struct meminfo_overflow *overflow = &snapshot->overflow[i];
+        if(overflow->count != counts) continue;
+        export_printf(response, "sys_mon_%s{", name);
+        if(node >= 0) export_printf(response, "node=\"%d\",", node);
+        export_text(response, "key=\"");
+        export_string(response, overflow->key, strlen(overflow->key), 0);
+        export_printf(response, "\"} %" PRIu64 "\n", overflow->value * scale);
+    }
+}
+
+/*
+* @brief Writes the members of a JSON object for a meminfo snapshot's lines
+*        in kB, or for those that are counts.
+*/
+void export_meminfo_json(struct export_response *response, const struct meminfo_snapshot *snapshot, int counts)
+{
+    int first = 1;
+    for(int key = 0; key < NUM_MEMINFO_KEYS; key++)
+    {
+        if(!meminfo_has(snapshot, key) || meminfo_key_counts[key] != counts) continue;
+        export_printf(response, "%s\"%s\":%" PRIu64, first ? "" : ",", meminfo_key_names[key], snapshot->value[key]);
+        first = 0;
+    }
+    for(int i = 0; i < snapshot->num_overflow; i++)
+    {
+        const struct meminfo_overflow *overflow = &snapshot->overflow[i];
+        if(overflow->count != counts) continue;
+        export_text(response, first ? "\"" : ",\"");
+        export_string(response, overflow->key, strlen(overflow->key), 1);
+        export_printf(response, "\":%" PRIu64, overflow->value);
+        first = 0;
+    }
+}
+
+/*
+* @brief Writes the snapshot in the Prometheus text format. Every counter
+*        is cumulative, the rates are left to the queries.
+*/
+void write_prometheus(struct export_response *response, uint64_t sample_ns)
+{
+    export_family(response, "sample_timestamp_seconds", "gauge", "Unix time of the sample");
+    export_printf(response, "sys_mon_sample_timestamp_seconds %" PRIu64 ".%03" PRIu64 "\n",
+                  sample_ns / 1000000000, sample_ns / 1000000 % 1000);
+
+    if(cpu_stats.num_online > 0)
+    {
+        export_family(response, "cpu_seconds_total", "counter", "Time each cpu spent in each mode");
+        for(int field = 0; field < NUM_CPU_FIELDS; field++)
+        {
+            for(int cpu = 0; cpu < cpu_stats.num_cpus; cpu++)
+            {
+                if(!cpu_stats.online[cpu]) continue;
+                export_text(response, "sys_mon_cpu_seconds_total{cpu=\"");
+                export_u64(response, (uint64_t)cpu);
+                export_text(response, "\",mode=\"");
+                export_text(response, export_cpu_modes[field]);
+                export_text(response, "\"} ");
+                export_decimal(response, cpu_stats.time[field][cpu], (uint64_t)exporter.ticks_per_second, cpu_decimals);
+                export_text(response, "\n");
+            }
+        }
+        export_scalar(response, "cpus_online", "gauge", "Cpus with a line in /proc/stat", (uint64_t)cpu_stats.num_online);
+        export_scalar(response, "context_switches_total", "counter", "Context switches", cpu_stats.num_context_switches);
+        export_scalar(response, "interrupts_total", "counter", "Interrupts serviced", cpu_stats.num_interrupts);
+        export_scalar(response, "softirqs_total", "counter", "Soft irqs serviced", cpu_stats.num_softirqs);
+        export_scalar(response, "forks_total", "counter", "Processes and threads created", cpu_stats.num_proccesses_created);
+        export_scalar(response, "procs_running", "gauge", "Processes runnable", cpu_stats.proccesses_running);
+        export_scalar(response, "procs_blocked", "gauge", "Processes blocked on I/O", cpu_stats.proccesses_blocked);
+        export_scalar(response, "boot_time_seconds", "gauge", "Unix time the host booted", cpu_stats.boot_time);
+    }
+
+    if(meminfo_snapshot.num_present + meminfo_snapshot.num_overflow > 0)
+    {
+        export_family(response, "memory_bytes", "gauge", "Each line of /proc/meminfo that is a size, in bytes");
+        export_meminfo_lines(response, "memory_bytes", &meminfo_snapshot, -1, 0);
+        export_family(response, "memory_pages", "gauge", "Each line of /proc/meminfo that is a count, the HugePages_ ones");
+        export_meminfo_lines(response, "memory_pages", &meminfo_snapshot, -1, 1);
+    }
+    if(node_meminfo.num_nodes > 0)
+    {
+        export_family(response, "node_memory_bytes", "gauge", "Each line of a NUMA node's meminfo that is a size, in bytes");
+        for(int i = 0; i < node_meminfo.num_nodes; i++)
+        {
+            export_meminfo_lines(response, "node_memory_bytes", &node_meminfo.nodes[i], node_meminfo.id[i], 0);
+        }
+        export_family(response, "node_memory_pages", "gauge", "Each line of a NUMA node's meminfo that is a count");
+        for(int i = 0; i < node_meminfo.num_nodes; i++)
+        {
+            export_meminfo_lines(response, "node_memory_pages", &node_meminfo.nodes[i], node_meminfo.id[i], 1);
+        }
+    }
+
+    for(int field = 0; network_info.num_devices > 0 && field < NUM_NETWORK_FIELDS; field++)
+    {
+        export_printf(response, "# TYPE sys_mon_network_%s_total counter\n", export_network_fields[field]);
+        for(int i = 0; i < network_info.num_devices; i++)
+        {
+            const struct network_device *device = &network_info.devices[i];
+            export_text(response, "sys_mon_network_");
+            export_text(response, export_network_fields[field]);
+            export_text(response, "_total{interface=\"");
+            export_string(response, device->face, strlen(device->face), 0);
+            export_text(response, "\"} ");
+            export_u64(response, device->counter[field]);
+            export_text(response, "\n");
+        }
+    }
+
+    for(int field = 0; disk_stats.num_devices > 0 && field < NUM_DISK_FIELDS; field++)
+    {
+        const struct export_disk_field *disk_field = &export_disk_fields[field];
+        export_printf(response, "# HELP sys_mon_disk_%s %s\n# TYPE sys_mon_disk_%s %s\n", disk_field->name, disk_field->help,
+                      disk_field->name, disk_field->type);
+        for(int i = 0; i < disk_stats.num_devices; i++)
+        {
+            const struct disk_device *device = &disk_stats.devices[i];
+            export_text(response, "sys_mon_disk_");
+            export_text(response, disk_field->name);
+            export_text(response, "{device=\"");
+            export_string(response, device->name, strlen(device->name), 0);
+            export_text(response, "\"} ");
+            export_disk_value(response, device->counter[field], disk_field->unit);
+            export_text(response, "\n");
+        }
+    }
+
+    const char *filesystem_metrics[] = {"size_bytes", "free_bytes", "avail_bytes", "files", "files_free"};
+    int num_filesystem_metrics = (int)(sizeof(filesystem_metrics) / sizeof(filesystem_metrics[0]));
+    for(int metric = 0; mount_table.num_filesystems > 0 && metric < num_filesystem_metrics; metric++)
+    {
+        export_printf(response, "# TYPE sys_mon_filesystem_%s gauge\n", filesystem_metrics[metric]);
+        for(int i = 0; i < mount_table.num_filesystems; i++)
+        {
+            const struct filesystem *filesystem = &mount_table.filesystems[i];
+            if(!filesystem->have_stats) continue;
+            const uint64_t values[] = {filesystem->total_bytes, filesystem->free_bytes, filesystem->available_bytes,
+                                       filesystem->total_inodes, filesystem->free_inodes};
+            export_printf(response, "sys_mon_filesystem_%s{device=\"", filesystem_metrics[metric]);
+            export_string(response, filesystem->source, strlen(filesystem->source), 0);
+            export_printf(response, "\",fstype=\"");
+            export_string(response, filesystem->type, strlen(filesystem->type), 0);
+            export_printf(response, "\",mountpoint=\"");
+            export_string(response, filesystem->mount_point, strlen(filesystem->mount_point), 0);
+            export_printf(response, "\"} %" PRIu64 "\n", values[metric]);
+        }
+    }
+
+    export_scalar(response, "export_samples_total", "counter", "Snapshots the exporter published", exporter.samples);
+    export_scalar(response, "export_requests_total", "counter", "Requests answered before this snapshot", exporter.requests);
+    export_scalar(response, "export_clients", "gauge", "Open connections", (uint64_t)exporter.num_clients);
+    export_family(response, "export_serialise_seconds", "gauge", "Time the previous snapshot took to write in every format");
+    export_printf(response, "sys_mon_export_serialise_seconds %.6f\n", (double)exporter.serialise_ns / 1e9);
+}
+
+/*
+* @brief Writes the snapshot as one JSON object, with the counters as the
+*        proc files have them: cpu time in USER_HZ jiffies, memory in kB,
+*        disk sectors and milliseconds.
+*/
+void write_json(struct export_response *response, uint64_t sample_ns)
+{
+    export_printf(response, "{\"timestamp\":%" PRIu64 ".%03" PRIu64 ",\"user_hz\":%ld,\"cpu\":{\"online\":%d,\"total\":{",
+                  sample_ns / 1000000000, sample_ns / 1000000 % 1000, exporter.ticks_per_second, cpu_stats.num_online);
+    for(int field = 0; field < NUM_CPU_FIELDS; field++)
+    {
+        export_printf(response, "%s\"%s\":%" PRIu64, field > 0 ? "," : "", export_cpu_modes[field], cpu_stats.total.time[field]);
+    }
+    export_printf(response, "},\"cpus\":[");
+    int first = 1;
+    for(int cpu = 0; cpu < cpu_stats.num_cpus; cpu++)
+    {
+        if(!cpu_stats.online[cpu]) continue;
+        export_text(response, first ? "{\"cpu\":" : ",{\"cpu\":");
+        export_u64(response, (uint64_t)cpu);
+        for(int field = 0; field < NUM_CPU_FIELDS; field++)
+        {
+            export_text(response, ",\"");
+            export_text(response, export_cpu_modes[field]);
+            export_text(response, "\":");
+            export_u64(response, cpu_stats.time[field][cpu]);
+        }
+        export_text(response, "}");
+        first = 0;
+    }
+    export_printf(response, "],\"context_switches\":%" PRIu64 ",\"interrupts\":%" PRIu64 ",\"softirqs\":%" PRIu64
+                  ",\"processes_created\":%" PRIu64 ",\"processes_running\":%" PRIu64 ",\"processes_blocked\":%" PRIu64
+                  ",\"boot_time\":%" PRIu64 "},\"memory_kb\":{", cpu_stats.num_context_switches, cpu_stats.num_interrupts,
+                  cpu_stats.num_softirqs, cpu_stats.num_proccesses_created, cpu_stats.proccesses_running,
+                  cpu_stats.proccesses_blocked, cpu_stats.boot_time);
+
+    export_meminfo_json(response, &meminfo_snapshot, 0);
+    export_text(response, "},\"memory_counts\":{");
+    export_meminfo_json(response, &meminfo_snapshot, 1);
+    export_text(response, "},\"numa\":[");
+    for(int i = 0; i < node_meminfo.num_nodes; i++)
+    {
+        export_printf(response, "%s{\"node\":%d,\"memory_kb\":{", i > 0 ? "," : "", node_meminfo.id[i]);
+        export_meminfo_json(response, &node_meminfo.nodes[i], 0);
+        export_text(response, "},\"memory_counts\":{");
+        export_meminfo_json(response, &node_meminfo.nodes[i], 1);
+        export_text(response, "}}");
+    }
+
+    export_printf(response, "],\"network\":[");
+    for(int i = 0; i < network_info.num_devices; i++)
+    {
+        const struct network_device *device = &network_info.devices[i];
+        export_printf(response, "%s{\"interface\":\"", i > 0 ? "," : "");
+        export_string(response, device->face, strlen(device->face), 1);
+        export_text(response, "\"");
+        for(int field = 0; field < NUM_NETWORK_FIELDS; field++)
+        {
+            export_text(response, ",\"");
+            export_text(response, export_network_fields[field]);
+            export_text(response, "\":");
+            export_u64(response, device->counter[field]);
+        }
+        export_text(response, "}");
+    }
+
+    export_printf(response, "],\"disks\":[");
+    for(int i = 0; i < disk_stats.num_devices; i++)
+    {
+        const struct disk_device *device = &disk_stats.devices[i];
+        export_printf(response, "%s{\"device\":\"", i > 0 ? "," : "");
+        export_string(response, device->name, strlen(device->name), 1);
+        export_text(response, "\"");
+        for(int field = 0; field < NUM_DISK_FIELDS; field++)
+        {
+            export_text(response, ",\"");
+            export_text(response, export_disk_fields[field].json_name);
+            export_text(response, "\":");
+            export_u64(response, device->counter[field]);
+        }
+        export_text(response, "}");
+    }
+
+    export_printf(response, "],\"filesystems\":[");
+    first = 1;
+    for(int i = 0; i < mount_table.num_filesystems; i++)
+    {
+        const struct filesystem *filesystem = &mount_table.filesystems[i];
+        if(!filesystem->have_stats) continue;
+        export_printf(response, "%s{\"source\":\"", first ? "" : ",");
+        export_string(response, filesystem->source, strlen(filesystem->source), 1);
+        export_printf(response, "\",\"type\":\"");
+        export_string(response, filesystem->type, strlen(filesystem->type), 1);
+        export_printf(response, "\",\"mount_point\":\"");
+        export_string(response, filesystem->mount_point, strlen(filesystem->mount_point), 1);
+        export_printf(response, "\",\"total_bytes\":%" PRIu64 ",\"free_bytes\":%" PRIu64 ",\"available_bytes\":%" PRIu64
+                      ",\"total_inodes\":%" PRIu64 ",\"free_inodes\":%" PRIu64 "}", filesystem->total_bytes,
+                      filesystem->free_bytes, filesystem->available_bytes, filesystem->total_inodes, filesystem->free_inodes);
+        first = 0;
+    }
+    export_printf(response, "],\"exporter\":{\"samples\":%" PRIu64 ",\"requests\":%" PRIu64 ",\"clients\":%d}}\n",
+                  exporter.samples, exporter.requests, exporter.num_clients);
+}
+
+/*
+* @brief Closes a connection and gives its slot back.
+*/
+void close_client(int slot)
+{
+    struct export_client *client = &exporter.clients[slot];
+    close(client->fd); //Which also takes it out of the epoll set
+    client->fd = -1;
+    if(client->response != NULL) release_response(client->response);
+    client->response = NULL;
+    exporter.free_slots[exporter.num_free++] = slot;
+    exporter.num_clients--;
+}
+
+/*
+* @brief Changes what a connection waits for, reading a request or
+*        writing a response.
+*/
+void set_client_writing(int slot, int writing)
+{
+    struct export_client *client = &exporter.clients[slot];
+    if(client->writing == writing) return;
+    client->writing = writing;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = writing ? EPOLLOUT : EPOLLIN;
+    event.data.u32 = (uint32_t)slot;
+    epoll_ctl(exporter.epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+}
+
+/*
+* @brief Sends what the socket takes of a connection's response. Once it is
+*        all sent the connection is closed, or kept to read the next request.
+*/
+void send_response(int slot)
+{
+    struct export_client *client = &exporter.clients[slot];
+    const char *data = client->response->data + client->response->start;
+    while(client->sent < client->send_length)
+    {
+        ssize_t written = send(client->fd, data + client->sent, client->send_length - client->sent, MSG_NOSIGNAL);
+        if(written < 0)
+        {
+            if(errno == EINTR) continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK) set_client_writing(slot, 1);
+            else close_client(slot);
+            return;
+        }
+        client->sent += (size_t)written;
+        exporter.bytes_sent += (uint64_t)written;
+    }
+    client->active_ns = monotonic_ns();
+    release_response(client->response);
+    client->response = NULL;
+    if(!client->keep_alive) {close_client(slot); return;}
+    set_client_writing(slot, 0);
+}
+
+/*
+* @brief Starts sending a response to a connection.
+*/
+void start_response(int slot, struct export_response *response, int head_only, int keep_alive)
+{
+    struct export_client *client = &exporter.clients[slot];
+    response->references++;
+    client->response = response;
+    client->sent = 0;
+    client->send_length = head_only ? response->header_length : response->end - response->start;
+    client->keep_alive = keep_alive;
+    exporter.requests++;
+    send_response(slot);
+}
+
+/*
+* @brief Works out the response to a request head, which is nul terminated
+*        in place of its final CRLF.
+*
+* @returns the response, which may be one of the static ones
+*/
+struct export_response *route_request(char *head, int *head_only, int *keep_alive)
+{
+    char method[8];
+    char target[256];
+    char version[16];
+    *head_only = 0;
+    *keep_alive = 0;
+    if(sscanf(head, "%7s %255s %15s", method, target, version) != 3 || strncmp(version, "HTTP/1.", 7) != 0)
+    {
+        return &exporter.bad_request;
+    }
+
+    if(strcmp(version, "HTTP/1.1") == 0)
+    {
+        *keep_alive = 1;
+        for(const char *line = strchr(head, '\n'); line != NULL; line = strchr(line, '\n'))
+        {
+            line++;
+            if(strncasecmp(line, "Connection:", 11) != 0) continue;
+            const char *line_end = strchr(line, '\r');
+            const char *close_token = strcasestr(line, "close");
+            if(close_token != NULL && (line_end == NULL || close_token < line_end)) *keep_alive = 0;
+        }
+    }
+
+    if(strcmp(method, "HEAD") == 0) *head_only = 1;
+    else if(strcmp(method, "GET") != 0) return &exporter.bad_request;
+
+    char *query = strchr(target, '?');
+    if(query != NULL) *query = '\0';
+    struct export_response *response = &exporter.not_found;
+    if(strcmp(target, "/metrics") == 0) response = exporter.latest[EXPORT_PROMETHEUS];
+    else if(strcmp(target, "/metrics.json") == 0 || strcmp(target, "/json") == 0) response = exporter.latest[EXPORT_JSON];
+    else if(strcmp(target, "/") == 0) response = &exporter.index;
+    return response != NULL ? response : &exporter.not_found;
+}
+
+/*
+* @brief Answers the complete requests a connection has sent, in order,
+*        until one has to wait for the socket to take its response.
+*/
+void handle_requests(int slot)
+{
+    struct export_client *client = &exporter.clients[slot];
+    while(client->fd >= 0 && !client->writing && client->request_length > 0)
+    {
+        char *head_end = memmem(client->request, client->request_length, "\r\n\r\n", 4);
+        if(head_end == NULL)
+        {
+            //Refuse a head that does not fit, and close after
+            if(client->request_length == EXPORT_REQUEST_LENGTH - 1)
+            {
+                client->request_length = 0;
+                start_response(slot, &exporter.bad_request, 0, 0);
+            }
+            return;
+        }
+
+        *(head_end + 2) = '\0';
+        size_t head_length = (size_t)(head_end + 4 - client->request);
+        int head_only, keep_alive;
+        struct export_response *response = route_request(client->request, &head_only, &keep_alive);
+        client->request_length -= head_length;
+        memmove(client->request, client->request + head_length, client->request_length);
+        start_response(slot, response, head_only, keep_alive);
+    }
+}
+
+/*
+* @brief Reads what a connection sent and answers any requests it
+*        completed.
+*/
+void read_request(int slot)
+{
+    struct export_client *client = &exporter.clients[slot];
+    ssize_t length = recv(client->fd, client->request + client->request_length,
+                          EXPORT_REQUEST_LENGTH - 1 - client->request_length, 0);
+    if(length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if(length <= 0) {close_client(slot); return;}
+    client->request_length += (size_t)length;
+    client->active_ns = monotonic_ns();
+    handle_requests(slot);
+}
+
+/*
+* @brief A free slot in the client array, growing it when there is none.
+*/
+int take_client_slot()
+{
+    if(exporter.num_free > 0) return exporter.free_slots[--exporter.num_free];
+    if(exporter.num_slots == exporter.capacity)
+    {
+        int capacity = exporter.capacity > 0 ? exporter.capacity * 2 : 16;
+        exporter.clients = counted_realloc(exporter.clients, (size_t)capacity * sizeof(struct export_client));
+        exporter.free_slots = counted_realloc(exporter.free_slots, (size_t)capacity * sizeof(int));
+        exporter.capacity = capacity;
+    }
+    return exporter.num_slots++;
+}
+
+/*
+* @brief Takes every connection waiting on the listening socket.
+*/
+void accept_clients()
+{
+    for(;;)
+    {
+        int fd = accept4(exporter.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        if(exporter.num_clients >= exporter.max_clients)
+        {
+            close(fd);
+            exporter.refused++;
+            continue;
+        }
+
+        int slot = take_client_slot();
+        struct export_client *client = &exporter.clients[slot];
+        client->fd = fd;
+        client->writing = 0;
+        client->keep_alive = 0;
+        client->request_length = 0;
+        client->response = NULL;
+        client->active_ns = monotonic_ns();
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u32 = (uint32_t)slot;
+        if(epoll_ctl(exporter.epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            client->fd = -1;
+            exporter.free_slots[exporter.num_free++] = slot;
+            continue;
+        }
+        exporter.num_clients++;
+        exporter.accepted++;
+    }
+}
+
+/*
+* @brief Serves what is ready on the exporter's sockets without waiting.
+*        The scheduler calls it when the epoll set is readable.
+*
+* @returns 0, serving never redraws the screen
+*/
+int serve_exporter(int epoll_fd)
+{
+    struct epoll_event events[EXPORT_EVENTS];
+    int ready = epoll_wait(epoll_fd, events, EXPORT_EVENTS, 0);
+    for(int i = 0; i < ready; i++)
+    {
+        if(events[i].data.u32 == EXPORT_LISTENER)
+        {
+            accept_clients();
+            continue;
+        }
+        int slot = (int)events[i].data.u32;
+        //The slot may have been closed, or closed and handed on, by an earlier event
+        if(slot >= exporter.num_slots || exporter.clients[slot].fd < 0) continue;
+        if(exporter.clients[slot].writing) send_response(slot);
+        else if(events[i].events & EPOLLIN) read_request(slot);
+        else close_client(slot);
+        if(exporter.clients[slot].fd >= 0 && !exporter.clients[slot].writing) handle_requests(slot);
+    }
+    return 0;
+}
+
+/*
+* @brief Writes every format of the snapshot the collectors hold into new
+*        responses, which requests get from then on. Connections left idle
+*        for EXPORT_IDLE_NS are closed.
+*/
+void publish_export_snapshot(uint64_t sample_ns)
+{
+    uint64_t start = monotonic_ns();
+    for(int format = 0; format < NUM_EXPORT_FORMATS; format++)
+    {
+        struct export_response *response = take_response(format);
+        if(format == EXPORT_PROMETHEUS) write_prometheus(response, sample_ns);
+        else write_json(response, sample_ns);
+        finish_response(response, "200 OK", export_content_types[format]);
+        if(exporter.latest[format] != NULL) release_response(exporter.latest[format]);
+        exporter.latest[format] = response;
+    }
+    exporter.samples++;
+    exporter.serialise_ns = monotonic_ns() - start;
+    probe_end(PROBE_EXPORT, start);
+
+    for(int slot = 0; slot < exporter.num_slots; slot++)
+    {
+        const struct export_client *client = &exporter.clients[slot];
+        if(client->fd >= 0 && start - client->active_ns > EXPORT_IDLE_NS) close_client(slot);
+    }
+}
+
+/*
+* @brief Binds a Unix socket at path. One left behind by an earlier run is
+*        removed, one another process still listens on is not.
+*
+* @returns the socket
+*/
+int listen_unix(const char *path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path)) fatal_error("socket path too long: ", path);
+    memcpy(address.sun_path, path, strlen(path));
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0) fatal_error("failed to create a socket for ", path);
+    struct stat status;
+    if(stat(path, &status) == 0 && S_ISSOCK(status.st_mode))
+    {
+        int probe_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(probe_fd >= 0 && connect(probe_fd, (struct sockaddr*)&address, sizeof(address)) == 0)
+        {
+            fatal_error("another process is serving on ", path);
+        }
+        if(probe_fd >= 0) close(probe_fd);
+        unlink(path);
+    }
+    if(bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0) fatal_error("failed to bind ", path);
+    return fd;
+}
+
+/*
+* @brief Binds a TCP socket to HOST:PORT, [HOST]:PORT for IPv6, :PORT for
+*        every address or PORT for 127.0.0.1.
+*
+* @returns the socket
+*/
+int listen_tcp(const char *text)
+{
+    char host[EXPORT_ADDRESS_LENGTH];
+    const char *port = text;
+    snprintf(host, sizeof(host), "127.0.0.1");
+    const char *colon = strrchr(text, ':');
+    if(colon != NULL)
+    {
+        const char *host_start = text;
+        size_t length = (size_t)(colon - text);
+        if(length >= 2 && text[0] == '[' && text[length - 1] == ']') {host_start++; length -= 2;}
+        if(length >= sizeof(host)) fatal_error("host name too long in ", text);
+        memcpy(host, host_start, length);
+        host[length] = '\0';
+        port = colon + 1;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    struct addrinfo *addresses;
+    if(getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &addresses) != 0) fatal_error("could not resolve ", text);
+
+    int fd = -1;
+    for(struct addrinfo *address = addresses; address != NULL && fd < 0; address = address->ai_next)
+    {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address->ai_protocol);
+        if(fd < 0) continue;
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if(bind(fd, address->ai_addr, address->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if(fd < 0) fatal_error("failed to bind ", text);
+    return fd;
+}
+
+/*
+* @brief Starts listening on address: unix:PATH, or any path with a slash
+*        in it, for a Unix socket, a TCP address otherwise. Connections
+*        are taken once the scheduler runs.
+*/
+void open_exporter(const char *address)
+{
+    if(strlen(address) >= sizeof(exporter.address)) fatal_error("export address too long: ", address);
+    snprintf(exporter.address, sizeof(exporter.address), "%s", address);
+    if(strncmp(address, "unix:", 5) == 0) address += 5;
+    exporter.unix_socket = strchr(address, '/') != NULL;
+    if(exporter.unix_socket) exporter.listen_fd = listen_unix(address);
+    else exporter.listen_fd = listen_tcp(address);
+    if(listen(exporter.listen_fd, EXPORT_LISTEN_BACKLOG) != 0) fatal_error("failed to listen on ", exporter.address);
+
+    exporter.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(exporter.epoll_fd < 0) fatal_error("failed to create ", "the exporter's epoll set");
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = EXPORT_LISTENER;
+    if(epoll_ctl(exporter.epoll_fd, EPOLL_CTL_ADD, exporter.listen_fd, &event) != 0) fatal_error("failed to watch ", exporter.address);
+
+    //Keep descriptors for the collectors, and never take a connection accept() cannot
+    struct rlimit limit;
+    exporter.max_clients = EXPORT_MAX_CLIENTS;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && (rlim_t)exporter.max_clients + 64 > limit.rlim_cur)
+    {
+        exporter.max_clients = limit.rlim_cur > 128 ? (int)limit.rlim_cur - 64 : 64;
+    }
+
+    exporter.ticks_per_second = sysconf(_SC_CLK_TCK);
+    if(exporter.ticks_per_second < 1) exporter.ticks_per_second = 100;
+    cpu_decimals = 0;
+    for(long scale = 1; scale < exporter.ticks_per_second; scale *= 10) cpu_decimals++;
+
+    build_static_response(&exporter.not_found, "404 Not Found", "Not found, try /metrics or /metrics.json\n");
+    build_static_response(&exporter.bad_request, "400 Bad Request", "Only GET and HEAD requests are served\n");
+    build_static_response(&exporter.index, "200 OK", "sys_mon exporter\n/metrics       Prometheus text\n"
+                                                     "/metrics.json  JSON\n");
+    exporter.active = 1;
+}
+
+/*
+* @brief Closes every connection and the listening socket and frees the
+*        responses.
+*/
+void close_exporter()
+{
+    if(!exporter.active) return;
+    for(int slot = 0; slot < exporter.num_slots; slot++)
+    {
+        if(exporter.clients[slot].fd >= 0) close_client(slot);
+    }
+    for(int format = 0; format < NUM_EXPORT_FORMATS; format++)
+    {
+        if(exporter.latest[format] != NULL) release_response(exporter.latest[format]);
+        while(exporter.free_responses[format] != NULL)
+        {
+            struct export_response *response = exporter.free_responses[format];
+            exporter.free_responses[format] = response->next_free;
+            free(response->data);
+            free(response);
+        }
+    }
+    free(exporter.not_found.data);
+    free(exporter.bad_request.data);
+    free(exporter.index.data);
+
+    close(exporter.listen_fd);
+    close(exporter.epoll_fd);
+    if(exporter.unix_socket) unlink(exporter.address + (strncmp(exporter.address, "unix:", 5) == 0 ? 5 : 0));
+    free(exporter.clients);
+    free(exporter.free_slots);
+    memset(&exporter, 0, sizeof(exporter));
+    exporter.listen_fd = -1;
+    exporter.epoll_fd = -1;
+}
@@ -0,0 +1,113 @@
+/*
+ * File: exporter.h
+ * Description: Serves the latest snapshot of the collectors over HTTP on a
+ *              TCP or Unix socket, as Prometheus text and as JSON.
+ */
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sys_mon.h"
+
+#define EXPORT_ADDRESS_LENGTH       128 //Room for unix: and the longest socket path
+#define EXPORT_REQUEST_LENGTH       2048 //Longest request head, a longer one is refused
+#define EXPORT_HEADER_SPACE         256 //Kept in front of each body for its response header
+#define EXPORT_INITIAL_BODY         65536
+#define EXPORT_MAX_CLIENTS          4096 //Connections past this are closed as they are accepted
+#define EXPORT_IDLE_NS              30000000000ull //Kept alive connections idle this long are closed
+#define EXPORT_LISTEN_BACKLOG       1024
+#define EXPORT_EVENTS               64  //Events taken from the epoll set at a time
+
+enum export_format
+{
+    EXPORT_PROMETHEUS,                  //GET /metrics
+    EXPORT_JSON,                        //GET /metrics.json or /json
+    NUM_EXPORT_FORMATS
+};
+
+/*
+* A complete HTTP response, header and body, in one buffer. The body is
+* written from EXPORT_HEADER_SPACE on and the header is put right in front
+* of it, so the whole response is sent from start with one send(). Each
+* client sending a response holds a reference on it, and the exporter
+* holds one on the latest of each format, so a new sample never overwrites
+* a response still being sent. One nobody holds goes to the free list of
+* its format and is written over by a later sample, keeping its buffer.
+*/
+struct export_response
+{
+    int format;                         //-1 for the static responses
+    char *data;
+    size_t capacity;
+    size_t end;                         //End of the body
+    size_t start;                       //Where the header begins
+    size_t header_length;               //What a HEAD request is sent
+    int references;
+    struct export_response *next_free;
+};
+
+/*
+* A connection. The request head is read into request until the blank line
+* that ends it, then response is sent from sent to send_length. A kept
+* alive connection then goes back to reading the next request.
+*/
+struct export_client
+{
+    int fd;                             //-1 for a free slot
+    int writing;                        //Waiting for the socket to take more of the response
+    int keep_alive;
+    size_t request_length;
+    struct export_response *response;
+    size_t sent;
+    size_t send_length;
+    uint64_t active_ns;                 //Last time it was read from or written to
+    char request[EXPORT_REQUEST_LENGTH];
+};
+
+/*
+* The listening socket and the connections, in an epoll set of their own
+* that the scheduler waits on with its timers. The client array grows with
+* the number of connections and is never shrunk.
+*/
+struct exporter
+{
+    int active;
+    char address[EXPORT_ADDRESS_LENGTH];
+    int unix_socket;                    //address is a path, removed when the exporter closes
+    int listen_fd;
+    int epoll_fd;
+    long ticks_per_second;              //USER_HZ, the unit of the cpu counters
+
+    struct export_client *clients;
+    int num_slots;                      //Slots handed out, open or free
+    int capacity;
+    int *free_slots;
+    int num_free;
+    int num_clients;                    //Open connections
+    int max_clients;                    //EXPORT_MAX_CLIENTS, or less to stay under the descriptor limit
+
+    struct export_response *latest[NUM_EXPORT_FORMATS];
+    struct export_response *free_responses[NUM_EXPORT_FORMATS];
+    struct export_response not_found;   //Never released, sent as is
+    struct export_response bad_request;
+    struct export_response index;
+
+    uint64_t samples;                   //Snapshots published
+    uint64_t serialise_ns;              //What the last one took to write in every format
+    uint64_t accepted;
+    uint64_t refused;                   //Over EXPORT_MAX_CLIENTS
+    uint64_t requests;
+    uint64_t bytes_sent;
+};
+
+extern struct exporter exporter;
+extern const char *export_format_names[NUM_EXPORT_FORMATS];
+
+void open_exporter(const char *address);
+void publish_export_snapshot(uint64_t sample_ns);
+int serve_exporter(int epoll_fd);
+void close_exporter();
+
+#endif
@@ -0,0 +1,392 @@
+/*
+ * File: highfreq.c
+ * Description: Samples /proc/stat and /proc/net/dev every few milliseconds
+ *              for a subset of cpus and interfaces, within a cost budget
+ *              per tick.
+ *
+ * Notes:
+ *      /proc/stat counts in USER_HZ jiffies, 10 ms on most kernels, so a
+ *      single 10 ms tick only sees whole jiffies and its percentages are
+ *      coarse. The mean over a display period is exact, the maximum shows
+ *      which cores saturated a tick at all. A tick that saw no jiffy pass
+ *      on a core adds nothing to it.
+ *
+ *      Only the cpu lines up to the last selected core are parsed. The
+ *      kernel still writes every line of the file on each read, which is
+ *      most of what a tick costs on a large machine.
+ *
+ *      Both files are read into buffers of the mode's own and parsed
+ *      straight into its cores and interfaces. cpu_stats and network_info,
+ *      which the other modes and the sinks share, are left alone, and
+ *      --net-backend does not apply: a tick always reads /proc/net/dev.
+ */
+#include <time.h>
+
+#include "sys_mon.h"
+#include "highfreq.h"
+#include "scan.h"
+#include "selfstats.h"
+
+struct high_freq_sampler high_freq;
+
+const char *high_freq_level_names[HIGH_FREQ_MAX_LEVEL + 1] = {
+    "every collector every tick",
+    "network every 2nd tick",
+    "network every 4th tick",
+    "network every 8th tick",
+    "network every 8th tick, /proc/stat every 2nd tick"
+};
+
+/*
+* @brief Reads one cpu or range of cpus, such as 3 or 0-7, from a --cpus list.
+*
+* @returns 0, or -1 if the list is malformed
+*/
+int next_cpu_range(const char **cursor, long *first, long *last)
+{
+    char *end;
+    *first = strtol(*cursor, &end, 10);
+    if(end == *cursor || *first < 0) return -1;
+    *last = *first;
+    if(*end == '-')
+    {
+        const char *start = end + 1;
+        *last = strtol(start, &end, 10);
+        if(end == start || *last < *first) return -1;
+    }
+    if(*last >= 65536) return -1;
+    if(*end == ',') end++;
+    else if(*end != '\0') return -1;
+    *cursor = end;
+    return 0;
+}
+
+/*
+* @brief Turns a --cpus list such as 0-3,8 into a flag per cpu.
+*/
+void select_high_freq_cpus(const char *list)
+{
+    long first, last;
+    long highest = -1;
+    const char *cursor = list;
+    while(*cursor != '\0')
+    {
+        if(next_cpu_range(&cursor, &first, &last) != 0) fatal_error("--cpus takes a list such as 0-3,8, not ", list);
+        if(last > highest) highest = last;
+    }
+    if(highest < 0) fatal_error("--cpus takes a list such as 0-3,8, not ", list);
+
+    high_freq.selected_length = (int)highest + 1;
+    high_freq.selected = counted_malloc((size_t)high_freq.selected_length);
+    memset(high_freq.selected, 0, (size_t)high_freq.selected_length);
+    cursor = list;
+    while(*cursor != '\0')
+    {
+        next_cpu_range(&cursor, &first, &last);
+        for(long cpu = first; cpu <= last; cpu++) high_freq.selected[cpu] = 1;
+    }
+}
+
+/*
+* @brief Appends an interface to follow, growing the array as needed.
+*/
+struct high_freq_interface *add_high_freq_interface(const char *face, size_t length)
+{
+    if(high_freq.num_interfaces == high_freq.interfaces_capacity)
+    {
+        high_freq.interfaces_capacity = high_freq.interfaces_capacity > 0 ? high_freq.interfaces_capacity * 2 : 16;
+        high_freq.interfaces = counted_realloc(high_freq.interfaces,
+                                               (size_t)high_freq.interfaces_capacity * sizeof(struct high_freq_interface));
+    }
+    struct high_freq_interface *added = &high_freq.interfaces[high_freq.num_interfaces++];
+    memset(added, 0, sizeof(*added));
+    memcpy(added->face, face, length);
+    added->face[length] = '\0';
+    return added;
+}
+
+/*
+* @brief Takes the interfaces of a comma separated --interfaces list.
+*/
+void select_high_freq_interfaces(const char *list)
+{
+    const char *cursor = list;
+    while(*cursor != '\0')
+    {
+        size_t length = strcspn(cursor, ",");
+        if(length == 0 || length >= MAX_NETWORK_FACE_LENGTH) fatal_error("--interfaces takes a list such as eth0,lo, not ", list);
+        add_high_freq_interface(cursor, length);
+        cursor += length;
+        if(*cursor == ',') cursor++;
+    }
+}
+
+uint64_t process_cpu_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/*
+* @brief Sets up the high-freq-loop mode. A NULL list follows every cpu or
+*        every interface.
+*/
+void init_high_freq(uint64_t interval_ns, uint64_t budget_ns, const char *cpu_list, const char *interface_list)
+{
+    memset(&high_freq, 0, sizeof(high_freq));
+    high_freq.interval_ns = interval_ns;
+    high_freq.budget_ns = budget_ns;
+    high_freq.stat_source.name = CPU_STATS_FILE;
+    high_freq.stat_source.fd = -1;
+    high_freq.network_source.name = NETWORK_ACTIVITY_FILE;
+    high_freq.network_source.fd = -1;
+
+    if(cpu_list != NULL) select_high_freq_cpus(cpu_list);
+    int num_cpus = 0;
+    int highest = high_freq.selected != NULL ? high_freq.selected_length : cpu_stats.num_cpus;
+    for(int cpu = 0; cpu < highest; cpu++)
+    {
+        if(high_freq.selected == NULL || high_freq.selected[cpu]) num_cpus++;
+    }
+    high_freq.cpus = counted_malloc((size_t)num_cpus * sizeof(struct high_freq_cpu));
+    memset(high_freq.cpus, 0, (size_t)num_cpus * sizeof(struct high_freq_cpu));
+    for(int cpu = 0; cpu < highest; cpu++)
+    {
+        if(high_freq.selected == NULL || high_freq.selected[cpu]) high_freq.cpus[high_freq.num_cpus++].cpu = cpu;
+    }
+
+    if(interface_list != NULL) select_high_freq_interfaces(interface_list);
+    else high_freq.all_interfaces = 1;
+
+    high_freq.period_start_ns = monotonic_ns();
+    high_freq.period_start_cpu_ns = process_cpu_ns();
+}
+
+void add_high_freq_stat(struct high_freq_stat *stat, float value)
+{
+    stat->sum += value;
+    if(stat->samples == 0 || value > stat->max) stat->max = value;
+    stat->samples++;
+}
+
+/*
+* @brief Adds the busy, iowait and softirq percentages of a core since its
+*        previous tick.
+*/
+void add_high_freq_cpu_rates(struct high_freq_cpu *cpu, const uint64_t current[NUM_CPU_FIELDS])
+{
+    uint64_t delta[NUM_CPU_FIELDS];
+    uint64_t total = 0;
+    //Guest time is already counted in user time, so it is left out of the total
+    for(int field = 0; field < CPU_GUEST; field++)
+    {
+        delta[field] = current[field] > cpu->previous[field] ? current[field] - cpu->previous[field] : 0;
+        total += delta[field];
+    }
+    if(total == 0) return; //Not a jiffy passed
+
+    float scale = 100.0f / (float)total;
+    add_high_freq_stat(&cpu->rate[HIGH_FREQ_BUSY], 100.0f - (float)delta[CPU_IDLE] * scale);
+    add_high_freq_stat(&cpu->rate[HIGH_FREQ_IOWAIT], (float)delta[CPU_IOWAIT] * scale);
+    add_high_freq_stat(&cpu->rate[HIGH_FREQ_SOFTIRQ], (float)delta[CPU_SOFTIRQ] * scale);
+}
+
+/*
+* @brief Reads /proc/stat and adds the rates of the selected cores. The cpu
+*        lines come first and in cpu order, so parsing stops after the last
+*        selected core, and a selected core without a line is offline.
+*/
+void sample_high_freq_cpus()
+{
+    uint64_t start = monotonic_ns();
+    read_proc_source(&high_freq.stat_source);
+
+    const char *cursor = high_freq.stat_source.buffer;
+    int next = 0;
+    while(*cursor != '\0' && next < high_freq.num_cpus)
+    {
+        const char *token;
+        size_t length = scan_token(&cursor, &token);
+        int cpu_index = cpu_index_from_token(token, length);
+        if(cpu_index < -1) break;
+
+        for(; next < high_freq.num_cpus && high_freq.cpus[next].cpu < cpu_index; next++) high_freq.cpus[next].have_previous = 0;
+        if(next < high_freq.num_cpus && high_freq.cpus[next].cpu == cpu_index)
+        {
+            struct high_freq_cpu *cpu = &high_freq.cpus[next++];
+            uint64_t current[NUM_CPU_FIELDS] = {0}; //Older kernels print fewer columns
+            scan_fields(&cursor, current, NUM_CPU_FIELDS);
+            if(cpu->have_previous) add_high_freq_cpu_rates(cpu, current);
+            memcpy(cpu->previous, current, sizeof(current));
+            cpu->have_previous = 1;
+        }
+        cursor = skip_line(cursor);
+    }
+    for(; next < high_freq.num_cpus; next++) high_freq.cpus[next].have_previous = 0;
+    probe_end(PROBE_HIGH_FREQ_CPU, start);
+}
+
+/*
+* @brief Finds the interface of a /proc/net/dev line, trying the same index
+*        first: following every interface they are kept in the file's order.
+*
+* @returns the interface, or NULL if it is not followed
+*/
+struct high_freq_interface *find_high_freq_interface(int device_index, const char *face)
+{
+    if(device_index < high_freq.num_interfaces && strcmp(high_freq.interfaces[device_index].face, face) == 0)
+    {
+        return &high_freq.interfaces[device_index];
+    }
+    for(int i = 0; i < high_freq.num_interfaces; i++)
+    {
+        if(strcmp(high_freq.interfaces[i].face, face) == 0) return &high_freq.interfaces[i];
+    }
+    if(!high_freq.all_interfaces) return NULL;
+    return add_high_freq_interface(face, strlen(face));
+}
+
+/*
+* @brief Reads /proc/net/dev and adds the byte rates of the selected
+*        interfaces since their previous sample.
+*/
+void sample_high_freq_interfaces()
+{
+    uint64_t start = monotonic_ns();
+    read_proc_source(&high_freq.network_source);
+    uint64_t sample_ns = high_freq.network_source.read_ns;
+
+    for(int i = 0; i < high_freq.num_interfaces; i++) high_freq.interfaces[i].present = 0;
+    const char *cursor = skip_line(skip_line(high_freq.network_source.buffer)); //Two header lines
+    for(int line = 0; *cursor != '\0'; line++)
+    {
+        const char *name = skip_blanks(cursor);
+        cursor = skip_line(name);
+        //The name ends at the colon, large counters can run straight into it
+        const char *colon = memchr(name, ':', (size_t)(cursor - name));
+        if(colon == NULL) continue;
+        char face_name[MAX_NETWORK_FACE_LENGTH];
+        size_t length = (size_t)(colon - name);
+        if(length >= sizeof(face_name)) length = sizeof(face_name) - 1;
+        memcpy(face_name, name, length);
+        face_name[length] = '\0';
+        struct high_freq_interface *face = find_high_freq_interface(line, face_name);
+        if(face == NULL) continue;
+        face->present = 1;
+
+        //Only the two byte counters are wanted, the transmit one is the ninth
+        uint64_t counter[NET_T_BYTES + 1] = {0};
+        const char *fields = colon + 1;
+        scan_fields(&fields, counter, NET_T_BYTES + 1);
+        uint64_t current[NUM_HIGH_FREQ_NETWORK_RATES] = {counter[NET_R_BYTES], counter[NET_T_BYTES]};
+        if(face->have_previous && sample_ns > face->previous_ns)
+        {
+            double seconds = (double)(sample_ns - face->previous_ns) / 1e9;
+            for(int rate = 0; rate < NUM_HIGH_FREQ_NETWORK_RATES; rate++)
+            {
+                uint64_t bytes = current[rate] > face->previous[rate] ? current[rate] - face->previous[rate] : 0;
+                add_high_freq_stat(&face->rate[rate], (float)((double)bytes / seconds));
+            }
+        }
+        memcpy(face->previous, current, sizeof(current));
+        face->previous_ns = sample_ns;
+        face->have_previous = 1;
+    }
+    int kept = 0;
+    for(int i = 0; i < high_freq.num_interfaces; i++)
+    {
+        struct high_freq_interface *face = &high_freq.interfaces[i];
+        if(!face->present) face->have_previous = 0;
+        //Following every interface, one that is gone is dropped rather than kept for good
+        if(face->present || !high_freq.all_interfaces) high_freq.interfaces[kept++] = *face;
+    }
+    high_freq.num_interfaces = kept;
+    probe_end(PROBE_HIGH_FREQ_NETWORK, start);
+}
+
+/*
+* @brief Runs the collectors the current level allows, then moves the level
+*        by what the tick cost.
+*/
+void high_freq_tick()
+{
+    uint64_t start = monotonic_ns();
+    int level = high_freq.level;
+    uint64_t network_every = 1ull << (level < 3 ? level : 3);
+    int run_stat = level < HIGH_FREQ_MAX_LEVEL || high_freq.ticks % 2 == 0;
+    int run_network = high_freq.ticks % network_every == 0;
+    high_freq.ticks++;
+
+    if(run_stat) sample_high_freq_cpus();
+    else high_freq.period.stat_skipped++;
+    if(run_network) sample_high_freq_interfaces();
+    else high_freq.period.network_skipped++;
+
+    uint64_t cost = monotonic_ns() - start;
+    struct high_freq_period *period = &high_freq.period;
+    period->ticks++;
+    period->cost_sum_ns += cost;
+    if(cost > period->cost_max_ns) period->cost_max_ns = cost;
+
+    if(cost > high_freq.budget_ns)
+    {
+        period->over_budget++;
+        if(high_freq.level < HIGH_FREQ_MAX_LEVEL) high_freq.level++;
+        high_freq.cheap_ticks = 0;
+    }
+    else if(run_stat && run_network)
+    {
+        //Only a tick that ran everything its level runs tells if a lower level would fit
+        if(cost >= high_freq.budget_ns / 2) high_freq.cheap_ticks = 0;
+        else if(++high_freq.cheap_ticks >= HIGH_FREQ_RECOVER_TICKS && high_freq.level > 0)
+        {
+            high_freq.level--;
+            high_freq.cheap_ticks = 0;
+        }
+    }
+}
+
+/*
+* @brief Closes a display period: what it measured moves to the shown
+*        copies and the next period starts from zero.
+*/
+void end_high_freq_period()
+{
+    uint64_t now = monotonic_ns();
+    uint64_t cpu_now = process_cpu_ns();
+    high_freq.period.wall_ns = now - high_freq.period_start_ns;
+    high_freq.period.cpu_ns = cpu_now - high_freq.period_start_cpu_ns;
+    high_freq.shown = high_freq.period;
+    memset(&high_freq.period, 0, sizeof(high_freq.period));
+    high_freq.period_start_ns = now;
+    high_freq.period_start_cpu_ns = cpu_now;
+
+    for(int i = 0; i < high_freq.num_cpus; i++)
+    {
+        struct high_freq_cpu *cpu = &high_freq.cpus[i];
+        memcpy(cpu->shown, cpu->rate, sizeof(cpu->rate));
+        memset(cpu->rate, 0, sizeof(cpu->rate));
+    }
+    for(int i = 0; i < high_freq.num_interfaces; i++)
+    {
+        struct high_freq_interface *face = &high_freq.interfaces[i];
+        memcpy(face->shown, face->rate, sizeof(face->rate));
+        memset(face->rate, 0, sizeof(face->rate));
+    }
+}
+
+void free_high_freq()
+{
+    close_proc_source(&high_freq.stat_source);
+    close_proc_source(&high_freq.network_source);
+    free(high_freq.selected);
+    free(high_freq.cpus);
+    free(high_freq.interfaces);
+    high_freq.selected = NULL;
+    high_freq.cpus = NULL;
+    high_freq.interfaces = NULL;
+    high_freq.num_interfaces = 0;
+    high_freq.interfaces_capacity = 0;
+    high_freq.num_cpus = 0;
+}
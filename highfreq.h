@@ -0,0 +1,123 @@
+/*
+ * File: highfreq.h
+ * Description: Samples /proc/stat and /proc/net/dev every few milliseconds
+ *              for a subset of cpus and interfaces, within a cost budget
+ *              per tick.
+ */
+#ifndef HIGHFREQ_H
+#define HIGHFREQ_H
+
+#include <stdint.h>
+
+#include "sys_mon.h"
+
+#define DEFAULT_HIGH_FREQ_INTERVAL_NS   10000000ull //10 ms
+#define HIGH_FREQ_MAX_LEVEL             4
+#define HIGH_FREQ_RECOVER_TICKS         100 //Cheap full ticks in a row before a level is given back
+
+enum high_freq_cpu_rate
+{
+    HIGH_FREQ_BUSY,
+    HIGH_FREQ_IOWAIT,
+    HIGH_FREQ_SOFTIRQ,
+    NUM_HIGH_FREQ_CPU_RATES
+};
+
+enum high_freq_network_rate
+{
+    HIGH_FREQ_R_BYTES,
+    HIGH_FREQ_T_BYTES,
+    NUM_HIGH_FREQ_NETWORK_RATES
+};
+
+/*
+* Mean and maximum of a value over the ticks of one display period.
+*/
+struct high_freq_stat
+{
+    double sum;
+    float max;
+    uint32_t samples;
+};
+
+struct high_freq_cpu
+{
+    int cpu;
+    int have_previous;
+    uint64_t previous[NUM_CPU_FIELDS];
+    struct high_freq_stat rate[NUM_HIGH_FREQ_CPU_RATES];
+    struct high_freq_stat shown[NUM_HIGH_FREQ_CPU_RATES]; //The last period that ended
+};
+
+struct high_freq_interface
+{
+    char face[MAX_NETWORK_FACE_LENGTH];
+    int present;                        //Had a line in the last network sample
+    int have_previous;
+    uint64_t previous[NUM_HIGH_FREQ_NETWORK_RATES];
+    uint64_t previous_ns;
+    struct high_freq_stat rate[NUM_HIGH_FREQ_NETWORK_RATES];
+    struct high_freq_stat shown[NUM_HIGH_FREQ_NETWORK_RATES];
+};
+
+/*
+* What the ticks of one display period cost.
+*/
+struct high_freq_period
+{
+    uint64_t ticks;
+    uint64_t cost_sum_ns;
+    uint64_t cost_max_ns;
+    uint64_t over_budget;               //Ticks that took longer than the budget
+    uint64_t stat_skipped;              //Ticks that left out a collector to stay in budget
+    uint64_t network_skipped;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;                    //Cpu time of the whole process
+};
+
+/*
+* State of the high-freq-loop mode. A tick that runs over budget_ns raises
+* level by one, and each level leaves out more of the next ticks instead
+* of letting them run into the next deadline. A level is given back after
+* HIGH_FREQ_RECOVER_TICKS ticks in a row that ran every collector of their
+* level in under half the budget. Everything is allocated by
+* init_high_freq. The files are read into buffers of its own and parsed
+* straight into cpus and interfaces, so the snapshots the other modes and
+* sinks work from are never touched by a tick.
+*/
+struct high_freq_sampler
+{
+    uint64_t interval_ns;
+    uint64_t budget_ns;
+    struct proc_source stat_source;
+    struct proc_source network_source;
+
+    uint8_t *selected;                  //Flag per cpu given to --cpus, NULL for every cpu
+    int selected_length;
+    struct high_freq_cpu *cpus;         //In cpu order, as the lines of /proc/stat are
+    int num_cpus;
+
+    int all_interfaces;                 //No --interfaces, follow every interface
+    struct high_freq_interface *interfaces;
+    int num_interfaces;
+    int interfaces_capacity;
+
+    int level;
+    int cheap_ticks;
+    uint64_t ticks;
+    struct high_freq_period period;
+    struct high_freq_period shown;
+    uint64_t period_start_ns;
+    uint64_t period_start_cpu_ns;
+};
+
+extern struct high_freq_sampler high_freq;
+extern const char *high_freq_level_names[HIGH_FREQ_MAX_LEVEL + 1];
+
+int next_cpu_range(const char **cursor, long *first, long *last);
+void init_high_freq(uint64_t interval_ns, uint64_t budget_ns, const char *cpu_list, const char *interface_list);
+void high_freq_tick();
+void end_high_freq_period();
+void free_high_freq();
+
+#endif
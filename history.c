@@ -0,0 +1,409 @@
+/*
+ * File: history.c
+ * Description: Fixed size history of the numbers the collectors produce,
+ *              with min, max, mean and p95 over the last 10s, 1m and 5m.
+ */
+#include <math.h>
+
+#include "sys_mon.h"
+#include "history.h"
+
+const uint64_t history_window_ns[NUM_WINDOWS] = {10000000000ull, 60000000000ull, 300000000000ull};
+const char *history_window_names[NUM_WINDOWS] = {"10s", "1m", "5m"};
+
+struct history cpu_history;
+struct history mem_history;
+struct history network_history;
+int network_history_overflow = 0;      //Interfaces of the last sample with an id past network_history's room
+
+/*
+* @brief Value of metric in a sample that is still in the ring.
+*/
+static inline float sample_value(const struct history *history, uint32_t sample, int metric)
+{
+    return history->values[(size_t)(sample % history->capacity) * history->num_metrics + metric];
+}
+
+/*
+* @brief Allocates a deque able to hold every sample in the ring.
+*/
+void extreme_deque_init(struct extreme_deque *deque, uint32_t capacity)
+{
+    deque->entries = (uint32_t*)counted_malloc(capacity * sizeof(uint32_t));
+    deque->front = 0;
+    deque->back = 0;
+    for(int window = 0; window < NUM_WINDOWS; window++) deque->start[window] = 0;
+}
+
+/*
+* @brief Adds a sample to a deque, dropping the entries it makes irrelevant.
+*        keep_below is set for the minimum deque.
+*/
+void extreme_deque_push(struct history *history, struct extreme_deque *deque, int metric,
+                        uint32_t sample, float value, int keep_below)
+{
+    while(deque->back != deque->front)
+    {
+        uint32_t last = deque->entries[(deque->back - 1) % history->capacity];
+        float last_value = sample_value(history, last, metric);
+        if(keep_below ? last_value < value : last_value > value) break;
+        deque->back--;
+    }
+    deque->entries[deque->back % history->capacity] = sample;
+    deque->back++;
+
+    for(int window = 0; window < NUM_WINDOWS; window++)
+    {
+        if(deque->start[window] > deque->back - 1) deque->start[window] = deque->back - 1;
+    }
+}
+
+/*
+* @brief Moves the deque's window pointers past samples older than each
+*        window and drops entries that left the largest one.
+*/
+void extreme_deque_trim(struct history *history, struct extreme_deque *deque)
+{
+    for(int window = 0; window < NUM_WINDOWS; window++)
+    {
+        if(deque->start[window] < deque->front) deque->start[window] = deque->front;
+        while(deque->start[window] != deque->back &&
+              deque->entries[deque->start[window] % history->capacity] < history->window_start[window])
+        {
+            deque->start[window]++;
+        }
+    }
+    deque->front = deque->start[NUM_WINDOWS - 1];
+}
+
+/*
+* @brief Allocates a history of capacity samples of num_metrics values.
+*/
+void history_init(struct history *history, int num_metrics, uint32_t capacity)
+{
+    memset(history, 0, sizeof(*history));
+    if(capacity < 2) capacity = 2;
+    history->num_metrics = num_metrics;
+    history->capacity = capacity;
+
+    size_t size = capacity * sizeof(uint64_t) + (size_t)capacity * num_metrics * sizeof(float);
+    history->time_ns = (uint64_t*)counted_malloc(capacity * sizeof(uint64_t));
+    history->values = (float*)counted_malloc((size_t)capacity * num_metrics * sizeof(float));
+
+    for(int window = 0; window < NUM_WINDOWS; window++)
+    {
+        history->sum[window] = (double*)counted_malloc((size_t)num_metrics * sizeof(double));
+        history->count[window] = (uint32_t*)counted_malloc((size_t)num_metrics * sizeof(uint32_t));
+        memset(history->sum[window], 0, (size_t)num_metrics * sizeof(double));
+        memset(history->count[window], 0, (size_t)num_metrics * sizeof(uint32_t));
+        size += (size_t)num_metrics * (sizeof(double) + sizeof(uint32_t));
+    }
+
+    history->minimum = (struct extreme_deque*)counted_malloc((size_t)num_metrics * sizeof(struct extreme_deque));
+    history->maximum = (struct extreme_deque*)counted_malloc((size_t)num_metrics * sizeof(struct extreme_deque));
+    for(int metric = 0; metric < num_metrics; metric++)
+    {
+        extreme_deque_init(&history->minimum[metric], capacity);
+        extreme_deque_init(&history->maximum[metric], capacity);
+    }
+    size += 2 * (size_t)num_metrics * (sizeof(struct extreme_deque) + capacity * sizeof(uint32_t));
+
+    history->staging = (float*)counted_malloc((size_t)num_metrics * sizeof(float));
+    history->scratch = (float*)counted_malloc(capacity * sizeof(float));
+    size += (size_t)num_metrics * sizeof(float) + capacity * sizeof(float);
+
+    history->memory = size;
+}
+
+/*
+* @brief Frees everything history_init allocated.
+*/
+void history_free(struct history *history)
+{
+    if(history->values == NULL) return;
+    for(int metric = 0; metric < history->num_metrics; metric++)
+    {
+        free(history->minimum[metric].entries);
+        free(history->maximum[metric].entries);
+    }
+    for(int window = 0; window < NUM_WINDOWS; window++)
+    {
+        free(history->sum[window]);
+        free(history->count[window]);
+    }
+    free(history->minimum);
+    free(history->maximum);
+    free(history->time_ns);
+    free(history->values);
+    free(history->staging);
+    free(history->scratch);
+    memset(history, 0, sizeof(*history));
+}
+
+/*
+* @brief Forgets every value of one metric, for a metric that is about to
+*        be reused for something else.
+*/
+void history_clear_metric(struct history *history, int metric)
+{
+    for(uint32_t slot = 0; slot < history->capacity; slot++) history->values[(size_t)slot * history->num_metrics + metric] = NAN;
+    for(int window = 0; window < NUM_WINDOWS; window++)
+    {
+        history->sum[window][metric] = 0;
+        history->count[window][metric] = 0;
+    }
+
+    struct extreme_deque *deques[2] = {&history->minimum[metric], &history->maximum[metric]};
+    for(int i = 0; i < 2; i++)
+    {
+        deques[i]->front = deques[i]->back;
+        for(int window = 0; window < NUM_WINDOWS; window++) deques[i]->start[window] = deques[i]->back;
+    }
+}
+
+/*
+* @brief Takes a sample out of a window's running sums.
+*/
+void window_remove_sample(struct history *history, int window, uint32_t sample)
+{
+    for(int metric = 0; metric < history->num_metrics; metric++)
+    {
+        float value = sample_value(history, sample, metric);
+        if(isnan(value)) continue;
+        history->sum[window][metric] -= value;
+        history->count[window][metric]--;
+    }
+}
+
+/*
+* @brief Adds a sample of num_metrics values taken at time_ns. The oldest
+*        sample is overwritten once the ring is full.
+*/
+void history_push(struct history *history, uint64_t time_ns, const float *values)
+{
+    uint32_t sample = history->next_sample;
+
+    //Anything still in a window when its slot is reused leaves it now
+    if(sample >= history->capacity)
+    {
+        uint32_t oldest = sample - history->capacity;
+        for(int window = 0; window < NUM_WINDOWS; window++)
+        {
+            if(history->window_start[window] != oldest) continue;
+            window_remove_sample(history, window, oldest);
+            history->window_start[window]++;
+        }
+    }
+
+    size_t slot = sample % history->capacity;
+    history->time_ns[slot] = time_ns;
+    memcpy(&history->values[slot * history->num_metrics], values, (size_t)history->num_metrics * sizeof(float));
+    history->next_sample = sample + 1;
+
+    for(int window = 0; window < NUM_WINDOWS; window++)
+    {
+        for(int metric = 0; metric < history->num_metrics; metric++)
+        {
+            if(isnan(values[metric])) continue;
+            history->sum[window][metric] += values[metric];
+            history->count[window][metric]++;
+        }
+
+        uint64_t oldest_time = time_ns > history_window_ns[window] ? time_ns - history_window_ns[window] : 0;
+        while(history->window_start[window] < sample &&
+              history->time_ns[history->window_start[window] % history->capacity] <= oldest_time)
+        {
+            window_remove_sample(history, window, history->window_start[window]);
+            history->window_start[window]++;
+        }
+    }
+
+    for(int metric = 0; metric < history->num_metrics; metric++)
+    {
+        extreme_deque_trim(history, &history->minimum[metric]);
+        extreme_deque_trim(history, &history->maximum[metric]);
+        if(isnan(values[metric])) continue;
+        extreme_deque_push(history, &history->minimum[metric], metric, sample, values[metric], 1);
+        extreme_deque_push(history, &history->maximum[metric], metric, sample, values[metric], 0);
+    }
+}
+
+/*
+* @brief Selects the k-th smallest of values[0..count) in place.
+*/
+float select_kth(float *values, int count, int k)
+{
+    int left = 0;
+    int right = count - 1;
+    while(left < right)
+    {
+        float pivot = values[left + (right - left) / 2];
+        int i = left;
+        int j = right;
+        while(i <= j)
+        {
+            while(values[i] < pivot) i++;
+            while(values[j] > pivot) j--;
+            if(i <= j)
+            {
+                float swap = values[i];
+                values[i] = values[j];
+                values[j] = swap;
+                i++;
+                j--;
+            }
+        }
+        if(k <= j) right = j;
+        else if(k >= i) left = i;
+        else break;
+    }
+    return values[k];
+}
+
+/*
+* @brief Works out the aggregates of one metric over a window. Min, max and
+*        mean come straight from the deques and sums, the p95 is selected
+*        from the window's samples, of which there are at most capacity.
+*/
+void history_query(struct history *history, int metric, int window, struct window_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    uint32_t count = history->count[window][metric];
+    if(count == 0) return;
+
+    const struct extreme_deque *minimum = &history->minimum[metric];
+    const struct extreme_deque *maximum = &history->maximum[metric];
+    stats->samples = (int)count;
+    stats->min = sample_value(history, minimum->entries[minimum->start[window] % history->capacity], metric);
+    stats->max = sample_value(history, maximum->entries[maximum->start[window] % history->capacity], metric);
+    stats->mean = (float)(history->sum[window][metric] / count);
+
+    int num_values = 0;
+    for(uint32_t sample = history->window_start[window]; sample < history->next_sample; sample++)
+    {
+        float value = sample_value(history, sample, metric);
+        if(!isnan(value)) history->scratch[num_values++] = value;
+    }
+    int rank = (int)ceilf(0.95f * (float)num_values);
+    stats->p95 = select_kth(history->scratch, num_values, rank > 0 ? rank - 1 : 0);
+}
+
+/*
+* @brief Sizes the cpu, memory and network histories to hold seconds worth
+*        of samples of everything the collectors produce, taken every
+*        interval_ns of each. The network history has room for the rates
+*        of max_interfaces interfaces and never grows.
+*
+* @returns the bytes allocated for them
+*/
+size_t init_histories(int seconds, uint64_t cpu_interval_ns, uint64_t mem_interval_ns, uint64_t network_interval_ns,
+                      int max_interfaces)
+{
+    uint64_t span_ns = (uint64_t)seconds * 1000000000ull;
+    history_free(&cpu_history);
+    history_free(&mem_history);
+    history_free(&network_history);
+
+    history_init(&cpu_history, cpu_history_metric(cpu_stats.num_cpus, 0), (uint32_t)(span_ns / cpu_interval_ns + 1));
+    history_init(&mem_history, NUM_MEM_FIELDS, (uint32_t)(span_ns / mem_interval_ns + 1));
+    history_init(&network_history, network_history_metric(max_interfaces, 0), (uint32_t)(span_ns / network_interval_ns + 1));
+    network_history_overflow = 0;
+    return cpu_history.memory + mem_history.memory + network_history.memory;
+}
+
+/*
+* @brief Frees the cpu, memory and network histories.
+*/
+void free_histories()
+{
+    history_free(&cpu_history);
+    history_free(&mem_history);
+    history_free(&network_history);
+}
+
+/*
+* @brief Index of a cpu rate in cpu_history. cpu -1 is the total line.
+*/
+int cpu_history_metric(int cpu, int rate)
+{
+    return (cpu + 1) * NUM_CPU_RATES + rate;
+}
+
+/*
+* @brief Index of an interface's NET_RATE_R_BYTES or NET_RATE_T_BYTES in
+*        network_history.
+*/
+int network_history_metric(int interface_id, int rate)
+{
+    return interface_id * NETWORK_HISTORY_RATES + (rate == NET_RATE_T_BYTES);
+}
+
+/*
+* @brief Pushes the latest cpu_rates into cpu_history.
+*/
+void record_cpu_history()
+{
+    //The history was sized for the cpus seen at startup
+    if(cpu_history_metric(cpu_stats.num_cpus, 0) != cpu_history.num_metrics) return;
+
+    float *values = cpu_history.staging;
+    for(int rate = 0; rate < NUM_CPU_RATES; rate++)
+    {
+        values[cpu_history_metric(-1, rate)] = cpu_rates.have_previous ? cpu_rates.total[rate] : NAN;
+    }
+    for(int cpu = 0; cpu < cpu_stats.num_cpus; cpu++)
+    {
+        for(int rate = 0; rate < NUM_CPU_RATES; rate++)
+        {
+            values[cpu_history_metric(cpu, rate)] = cpu_rates.valid[cpu] ? cpu_rates.pct[rate][cpu] : NAN;
+        }
+    }
+    history_push(&cpu_history, cpu_stats.sample_ns, values);
+}
+
+/*
+* @brief Pushes the latest mem_info into mem_history.
+*/
+void record_mem_history()
+{
+    float *values = mem_history.staging;
+    for(int field = 0; field < NUM_MEM_FIELDS; field++)
+    {
+        values[field] = (mem_info.present & (1u << field)) ? (float)mem_info.value[field] : NAN;
+    }
+    history_push(&mem_history, mem_info.sample_ns, values);
+}
+
+/*
+* @brief Pushes the latest network_rates into network_history. Interfaces
+*        whose id is past the room it was given are left out and counted in
+*        network_history_overflow, so a sample never reallocates it.
+*/
+void record_network_history()
+{
+    float *values = network_history.staging;
+    for(int metric = 0; metric < network_history.num_metrics; metric++) values[metric] = NAN;
+    network_history_overflow = 0;
+    for(int i = 0; i < network_info.num_devices; i++)
+    {
+        const struct network_device *device = &network_info.devices[i];
+        const struct network_rate *rate = &network_rates.devices[i];
+        if(network_history_metric(device->id, 0) >= network_history.num_metrics)
+        {
+            network_history_overflow++;
+            continue;
+        }
+        int r_bytes = network_history_metric(device->id, NET_RATE_R_BYTES);
+        int t_bytes = network_history_metric(device->id, NET_RATE_T_BYTES);
+        if(network_rates.interfaces[device->id].first_sample == network_rates.samples)
+        {
+            //New this sample, perhaps on the id of an interface that is gone
+            history_clear_metric(&network_history, r_bytes);
+            history_clear_metric(&network_history, t_bytes);
+        }
+        if(!rate->valid) continue;
+        values[r_bytes] = (float)rate->rate[NET_RATE_R_BYTES];
+        values[t_bytes] = (float)rate->rate[NET_RATE_T_BYTES];
+    }
+    history_push(&network_history, network_info.sample_ns, values);
+}
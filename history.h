@@ -0,0 +1,97 @@
+/*
+ * File: history.h
+ * Description: Fixed size history of the numbers the collectors produce,
+ *              with min, max, mean and p95 over the last 10s, 1m and 5m.
+ */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFAULT_HISTORY_SECONDS     300
+#define NETWORK_HISTORY_RATES       2   //Only the byte rates of each interface are kept
+#define DEFAULT_HISTORY_INTERFACES  128 //Interfaces network_history has room for, --history-interfaces
+
+enum history_window
+{
+    WINDOW_10S,
+    WINDOW_1M,
+    WINDOW_5M,
+    NUM_WINDOWS
+};
+
+struct window_stats
+{
+    int samples;                        //Samples in the window that had a value
+    float min;
+    float max;
+    float mean;
+    float p95;
+};
+
+/*
+* Monotonic deque of sample numbers over the largest window, whose values
+* only increase (for the minimum) or decrease (for the maximum) from front
+* to back. As the windows all end at the newest sample, the extreme of a
+* smaller window is the first entry that is still inside it, which
+* start[window] points at.
+*/
+struct extreme_deque
+{
+    uint32_t *entries;                  //Ring of capacity sample numbers
+    uint32_t front;
+    uint32_t back;
+    uint32_t start[NUM_WINDOWS];
+};
+
+/*
+* The last capacity samples of num_metrics values, all taken at the same
+* times. Everything is allocated by history_init, a push only updates the
+* running sums and deques of each window, and a query costs the same
+* however many samples have been pushed. A value of NAN means the metric had
+* no value in that sample and is left out of the aggregates.
+*/
+struct history
+{
+    int num_metrics;
+    uint32_t capacity;
+    uint32_t next_sample;               //Number of the next sample pushed
+    uint64_t *time_ns;                  //time_ns[sample % capacity]
+    float *values;                      //values[(sample % capacity) * num_metrics + metric]
+
+    uint32_t window_start[NUM_WINDOWS]; //Oldest sample still inside each window
+    double *sum[NUM_WINDOWS];           //sum[window][metric]
+    uint32_t *count[NUM_WINDOWS];
+    struct extreme_deque *minimum;      //One per metric
+    struct extreme_deque *maximum;
+
+    float *staging;                     //num_metrics values filled in before a push
+    float *scratch;                     //Used by history_query to select the p95
+    size_t memory;                      //Bytes allocated by history_init
+};
+
+extern const uint64_t history_window_ns[NUM_WINDOWS];
+extern const char *history_window_names[NUM_WINDOWS];
+
+void history_init(struct history *history, int num_metrics, uint32_t capacity);
+void history_free(struct history *history);
+void history_clear_metric(struct history *history, int metric);
+void history_push(struct history *history, uint64_t time_ns, const float *values);
+void history_query(struct history *history, int metric, int window, struct window_stats *stats);
+
+extern struct history cpu_history;
+extern struct history mem_history;
+extern struct history network_history;
+extern int network_history_overflow;
+
+size_t init_histories(int seconds, uint64_t cpu_interval_ns, uint64_t mem_interval_ns, uint64_t network_interval_ns,
+                      int max_interfaces);
+void free_histories();
+int cpu_history_metric(int cpu, int rate);
+int network_history_metric(int interface_id, int rate);
+void record_cpu_history();
+void record_mem_history();
+void record_network_history();
+
+#endif
@@ -0,0 +1,371 @@
+/*
+ * File: interrupts.c
+ * Description: The interrupt collector: the count of every irq on every cpu
+ *              from /proc/interrupts, their rates, and the busiest sources
+ *              with the cpus that serve them.
+ *
+ * Notes:
+ *      On a 256 cpu host with thousands of irqs the file is several
+ *      megabytes, nearly all of it counts padded to ten columns. It is
+ *      parsed in one pass, each count in a single vector load without
+ *      looking for its digits, straight into a flat array, and the
+ *      previous sample trades buffers with the new one instead of being
+ *      copied. The cpus an irq went to are only worked out for the top N.
+ */
+#include "sys_mon.h"
+#include "scan.h"
+#include "selfstats.h"
+#include "interrupts.h"
+
+struct proc_source interrupts_source = {INTERRUPTS_FILE, "", -1, NULL, 0, 0, 0};
+struct interrupt_stats interrupt_stats;
+struct interrupt_rates interrupt_rates;
+
+/*
+* @brief Sets how many irqs select_top_interrupts picks.
+*/
+void init_interrupts(int top_n)
+{
+    if(top_n < 1) top_n = DEFAULT_IRQ_TOP_N;
+    interrupt_rates.top = counted_realloc(interrupt_rates.top, (size_t)top_n * sizeof(struct irq_top));
+    interrupt_rates.top_n = top_n;
+    interrupt_rates.num_top = 0;
+}
+
+/*
+* @brief Grows the column arrays of a sample to hold num_columns.
+*/
+void reserve_irq_columns(struct interrupt_stats *stats, int num_columns)
+{
+    if(num_columns <= stats->columns_capacity) return;
+
+    int capacity = stats->columns_capacity > 0 ? stats->columns_capacity : 16;
+    while(capacity < num_columns) capacity *= 2;
+    stats->column_cpu = counted_realloc(stats->column_cpu, (size_t)capacity * sizeof(int));
+    stats->column_total = counted_realloc(stats->column_total, (size_t)capacity * sizeof(uint64_t));
+    stats->columns_capacity = capacity;
+}
+
+/*
+* @brief Grows the lines of a sample to hold num_lines, and the counts to
+*        hold that many lines of its columns.
+*/
+void reserve_irq_lines(struct interrupt_stats *stats, int num_lines)
+{
+    if(num_lines > stats->capacity)
+    {
+        int capacity = stats->capacity > 0 ? stats->capacity : 64;
+        while(capacity < num_lines) capacity *= 2;
+        stats->lines = counted_realloc(stats->lines, (size_t)capacity * sizeof(struct irq_line));
+        stats->capacity = capacity;
+    }
+
+    size_t num_counts = (size_t)stats->capacity * (size_t)stats->num_columns;
+    if(num_counts > stats->counts_capacity)
+    {
+        stats->counts = counted_realloc(stats->counts, num_counts * sizeof(uint64_t));
+        stats->counts_capacity = num_counts;
+    }
+}
+
+/*
+* @breif helper for function update_interrupt_stats
+*        reads the header line, one CPUn token per column
+*
+* @returns the start of the next line
+*/
+const char *scan_irq_columns(const char *cursor)
+{
+    int num_columns = 0;
+    while(1)
+    {
+        const char *token;
+        size_t length = scan_token(&cursor, &token);
+        if(length == 0) break;
+        if(length < 4 || memcmp(token, "CPU", 3) != 0) continue;
+
+        int cpu = 0;
+        for(size_t i = 3; i < length && (unsigned char)(token[i] - '0') < 10; i++) cpu = cpu * 10 + (token[i] - '0');
+        reserve_irq_columns(&interrupt_stats, num_columns + 1);
+        interrupt_stats.column_cpu[num_columns++] = cpu;
+    }
+    interrupt_stats.num_columns = num_columns;
+    memset(interrupt_stats.column_total, 0, (size_t)interrupt_stats.columns_capacity * sizeof(uint64_t));
+    return skip_line(cursor);
+}
+
+/*
+* @breif helper for function update_interrupt_stats
+*        copies the rest of the line at p into description with the runs of
+*        blanks the kernel pads its columns with squeezed to one
+*
+* @returns the end of the line
+*/
+const char *copy_irq_description(const char *p, char *description)
+{
+    size_t length = 0;
+    p = skip_blanks(p);
+    while(*p != '\n' && *p != '\0')
+    {
+        if(*p == ' ' || *p == '\t')
+        {
+            p = skip_blanks(p);
+            if(*p == '\n' || *p == '\0') break;
+            if(length < IRQ_DESCRIPTION_LENGTH - 1) description[length++] = ' ';
+            continue;
+        }
+        if(length < IRQ_DESCRIPTION_LENGTH - 1) description[length++] = *p;
+        p++;
+    }
+    description[length] = '\0';
+    return p;
+}
+
+/*
+* @breif Updates interrupt_stats with the lines in the interrupts buffer.
+*        The last sample is handed to interrupt_rates.previous first.
+*/
+void update_interrupt_stats()
+{
+    struct interrupt_stats last = interrupt_rates.previous;
+    interrupt_rates.previous = interrupt_stats;
+    interrupt_stats = last;
+
+    const char *cursor = scan_irq_columns(interrupts_source.buffer);
+    int num_columns = interrupt_stats.num_columns;
+    int line_index = 0;
+    while(*cursor != '\0')
+    {
+        const char *p = skip_blanks(cursor);
+        const char *name = p;
+        while(*p != ':' && *p != '\n' && *p != '\0') p++;
+        if(*p != ':') {cursor = skip_line(p); continue;}
+
+        reserve_irq_lines(&interrupt_stats, line_index + 1);
+        struct irq_line *line = &interrupt_stats.lines[line_index];
+        size_t length = (size_t)(p - name);
+        if(length >= sizeof(line->name)) length = sizeof(line->name) - 1;
+        memcpy(line->name, name, length);
+        line->name[length] = '\0';
+
+        //ERR and MIS have a single count, not one per cpu
+        p++;
+        uint64_t *row = &interrupt_stats.counts[(size_t)line_index * num_columns];
+        int num_counts = scan_aligned_fields(&p, row, num_columns);
+        for(int i = num_counts; i < num_columns; i++) row[i] = 0;
+
+        uint64_t total = 0;
+        for(int i = 0; i < num_columns; i++)
+        {
+            total += row[i];
+            interrupt_stats.column_total[i] += row[i];
+        }
+        line->total = total;
+
+        cursor = skip_line(copy_irq_description(p, line->description));
+        line_index++;
+    }
+    interrupt_stats.num_lines = line_index;
+    interrupt_stats.sample_ns = interrupts_source.read_ns;
+}
+
+/*
+* @brief Finds an irq in the previous sample by name, trying the same index
+*        first and then the ones after it, as lines only move when an irq
+*        is added or removed before them.
+*
+* @returns the index of the line in the previous sample, or -1 if it is new
+*/
+int find_previous_irq(int line_index, const char *name)
+{
+    const struct interrupt_stats *previous = &interrupt_rates.previous;
+    for(int i = 0; i < previous->num_lines; i++)
+    {
+        int candidate = (line_index + i) % previous->num_lines;
+        if(strcmp(previous->lines[candidate].name, name) == 0) return candidate;
+    }
+    return -1;
+}
+
+/*
+* @brief Updates interrupt_rates from the sample just taken by
+*        update_interrupt_stats. Rates need the same cpus in the same
+*        columns in both samples, so there are none for the sample after a
+*        cpu went on or offline.
+*/
+void update_interrupt_rates()
+{
+    const struct interrupt_stats *previous = &interrupt_rates.previous;
+    int num_columns = interrupt_stats.num_columns;
+    double seconds = (double)(interrupt_stats.sample_ns - previous->sample_ns) / 1e9;
+
+    if(interrupt_stats.num_lines > interrupt_rates.lines_capacity)
+    {
+        interrupt_rates.lines_capacity = interrupt_stats.capacity;
+        interrupt_rates.lines = counted_realloc(interrupt_rates.lines, (size_t)interrupt_rates.lines_capacity * sizeof(struct irq_rate));
+    }
+    if(num_columns > interrupt_rates.cpu_rate_capacity)
+    {
+        interrupt_rates.cpu_rate_capacity = interrupt_stats.columns_capacity;
+        interrupt_rates.cpu_rate = counted_realloc(interrupt_rates.cpu_rate, (size_t)interrupt_rates.cpu_rate_capacity * sizeof(double));
+    }
+
+    interrupt_rates.columns_match = interrupt_rates.have_previous && seconds > 0 && previous->num_columns == num_columns &&
+                                    memcmp(previous->column_cpu, interrupt_stats.column_cpu, (size_t)num_columns * sizeof(int)) == 0;
+    memset(interrupt_rates.cpu_rate, 0, (size_t)num_columns * sizeof(double));
+    interrupt_rates.total_rate = 0;
+
+    for(int i = 0; i < interrupt_stats.num_lines; i++)
+    {
+        struct irq_rate *rate = &interrupt_rates.lines[i];
+        rate->valid = 0;
+        rate->previous_line = -1;
+        if(!interrupt_rates.columns_match) continue;
+
+        rate->previous_line = find_previous_irq(i, interrupt_stats.lines[i].name);
+        if(rate->previous_line < 0) continue;
+
+        //Each count is an unsigned int in the kernel, so it wraps at 2^32
+        const uint64_t *row = &interrupt_stats.counts[(size_t)i * num_columns];
+        const uint64_t *previous_row = &previous->counts[(size_t)rate->previous_line * num_columns];
+        uint64_t sum = 0;
+        for(int column = 0; column < num_columns; column++)
+        {
+            uint64_t delta = counter_delta(row[column], previous_row[column]);
+            interrupt_rates.cpu_rate[column] += (double)delta;
+            sum += delta;
+        }
+        rate->rate = (double)sum / seconds;
+        rate->valid = 1;
+        interrupt_rates.total_rate += rate->rate;
+    }
+    if(interrupt_rates.columns_match)
+    {
+        for(int column = 0; column < num_columns; column++) interrupt_rates.cpu_rate[column] /= seconds;
+    }
+    interrupt_rates.have_previous = 1;
+}
+
+/*
+* @brief What the top irqs are ranked by: the rate, or the count since boot.
+*
+* @returns a negative value for a line without one
+*/
+static inline double irq_key(int line_index, int by_rate)
+{
+    if(!by_rate) return (double)interrupt_stats.lines[line_index].total;
+    return interrupt_rates.lines[line_index].valid ? interrupt_rates.lines[line_index].rate : -1;
+}
+
+/*
+* @brief Works out which cpus took the interrupts of a top irq, from its
+*        counts since the previous sample or since boot.
+*/
+void spread_irq_over_cpus(struct irq_top *top, int by_rate)
+{
+    int num_columns = interrupt_stats.num_columns;
+    const uint64_t *row = &interrupt_stats.counts[(size_t)top->line * num_columns];
+    const uint64_t *previous_row = NULL;
+    if(by_rate) previous_row = &interrupt_rates.previous.counts[(size_t)interrupt_rates.lines[top->line].previous_line * num_columns];
+
+    uint64_t value[IRQ_SHOWN_CPUS] = {0};
+    uint64_t sum = 0;
+    top->num_cpus = 0;
+    for(int i = 0; i < IRQ_SHOWN_CPUS; i++) top->cpu[i] = -1;
+    for(int column = 0; column < num_columns; column++)
+    {
+        uint64_t count = by_rate ? counter_delta(row[column], previous_row[column]) : row[column];
+        if(count == 0) continue;
+        sum += count;
+        top->num_cpus++;
+
+        //Insertion into the few kept, highest first
+        int slot = IRQ_SHOWN_CPUS;
+        while(slot > 0 && (top->cpu[slot - 1] < 0 || value[slot - 1] < count)) slot--;
+        if(slot == IRQ_SHOWN_CPUS) continue;
+        for(int i = IRQ_SHOWN_CPUS - 1; i > slot; i--) {value[i] = value[i - 1]; top->cpu[i] = top->cpu[i - 1];}
+        value[slot] = count;
+        top->cpu[slot] = interrupt_stats.column_cpu[column];
+    }
+    for(int i = 0; i < IRQ_SHOWN_CPUS; i++) top->share[i] = sum > 0 ? (float)(100.0 * value[i] / sum) : 0;
+}
+
+/*
+* @brief Picks the top_n irqs by rate, or by count since boot, into
+*        interrupt_rates.top, highest first, and the busiest cpus.
+*/
+void select_top_interrupts(int by_rate)
+{
+    int num_top = 0;
+    for(int i = 0; i < interrupt_stats.num_lines; i++)
+    {
+        double key = irq_key(i, by_rate);
+        if(key <= 0) continue;
+
+        int slot = num_top < interrupt_rates.top_n ? num_top++ : interrupt_rates.top_n;
+        while(slot > 0 && irq_key(interrupt_rates.top[slot - 1].line, by_rate) < key)
+        {
+            if(slot < interrupt_rates.top_n) interrupt_rates.top[slot] = interrupt_rates.top[slot - 1];
+            slot--;
+        }
+        if(slot < interrupt_rates.top_n) interrupt_rates.top[slot].line = i;
+    }
+    interrupt_rates.num_top = num_top;
+    for(int i = 0; i < num_top; i++) spread_irq_over_cpus(&interrupt_rates.top[i], by_rate);
+
+    for(int i = 0; i < IRQ_SHOWN_BUSIEST_CPUS; i++) interrupt_rates.busiest[i] = -1;
+    if(by_rate && !interrupt_rates.columns_match) return;
+    for(int column = 0; column < interrupt_stats.num_columns; column++)
+    {
+        double value = by_rate ? interrupt_rates.cpu_rate[column] : (double)interrupt_stats.column_total[column];
+        if(value <= 0) continue;
+
+        int slot = IRQ_SHOWN_BUSIEST_CPUS;
+        while(slot > 0 && (interrupt_rates.busiest[slot - 1] < 0 ||
+              (by_rate ? interrupt_rates.cpu_rate[interrupt_rates.busiest[slot - 1]]
+                       : (double)interrupt_stats.column_total[interrupt_rates.busiest[slot - 1]]) < value)) slot--;
+        if(slot == IRQ_SHOWN_BUSIEST_CPUS) continue;
+        for(int i = IRQ_SHOWN_BUSIEST_CPUS - 1; i > slot; i--) interrupt_rates.busiest[i] = interrupt_rates.busiest[i - 1];
+        interrupt_rates.busiest[slot] = column;
+    }
+}
+
+/*
+* @brief Takes an interrupt sample and updates the rates from it.
+*/
+void sample_interrupts()
+{
+    uint64_t start = monotonic_ns();
+    read_proc_source(&interrupts_source);
+    update_interrupt_stats();
+    update_interrupt_rates();
+    probe_end(PROBE_INTERRUPTS, start);
+}
+
+/*
+* @brief Frees the arrays of one sample.
+*/
+void free_interrupt_stats(struct interrupt_stats *stats)
+{
+    free(stats->column_cpu);
+    free(stats->column_total);
+    free(stats->lines);
+    free(stats->counts);
+    memset(stats, 0, sizeof(*stats));
+}
+
+/*
+* @brief Closes the interrupts source and frees everything the collector
+*        allocated.
+*/
+void close_interrupts()
+{
+    free_interrupt_stats(&interrupt_stats);
+    free_interrupt_stats(&interrupt_rates.previous);
+    free(interrupt_rates.lines);
+    free(interrupt_rates.cpu_rate);
+    free(interrupt_rates.top);
+    memset(&interrupt_rates, 0, sizeof(interrupt_rates));
+
+    close_proc_source(&interrupts_source);
+}
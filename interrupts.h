@@ -0,0 +1,106 @@
+/*
+ * File: interrupts.h
+ * Description: The interrupt collector: the count of every irq on every cpu
+ *              from /proc/interrupts, their rates, and the busiest sources
+ *              with the cpus that serve them.
+ */
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include <stdint.h>
+
+#include "sys_mon.h"
+
+#define INTERRUPTS_FILE             "interrupts"
+#define IRQ_NAME_LENGTH             16
+#define IRQ_DESCRIPTION_LENGTH      48
+#define DEFAULT_IRQ_TOP_N           10
+#define IRQ_SHOWN_CPUS              3 //Cpus listed for each of the top irqs
+#define IRQ_SHOWN_BUSIEST_CPUS      4
+
+/*
+* A line of /proc/interrupts: a numbered irq, or one the architecture
+* counts itself such as NMI or LOC.
+*/
+struct irq_line
+{
+    char name[IRQ_NAME_LENGTH];
+    char description[IRQ_DESCRIPTION_LENGTH]; //Chip, hwirq, trigger and handlers, blank runs squeezed
+    uint64_t total;                     //Over every cpu
+};
+
+/*
+* One sample of /proc/interrupts. The file only has a column for each
+* online cpu, so the counts are kept per column, num_columns for each line
+* one line after the other, with the cpu of each column on the side. The
+* arrays grow with the file and are never shrunk.
+*/
+struct interrupt_stats
+{
+    int num_columns;
+    int *column_cpu;
+    int columns_capacity;
+    int num_lines;
+    int capacity;
+    struct irq_line *lines;
+    uint64_t *counts;
+    size_t counts_capacity;
+    uint64_t *column_total;             //Every irq on the cpu of each column
+    uint64_t sample_ns;
+};
+
+/*
+* Rate of one line between two samples.
+*/
+struct irq_rate
+{
+    int valid;                          //Not set for a line that is new this sample
+    int previous_line;                  //The same irq in the previous sample
+    double rate;                        //Interrupts per second on every cpu
+};
+
+/*
+* One of the top irqs, with the cpus that took the most of it.
+*/
+struct irq_top
+{
+    int line;
+    int num_cpus;                       //Cpus that took any
+    int cpu[IRQ_SHOWN_CPUS];            //-1 past the last of them
+    float share[IRQ_SHOWN_CPUS];        //% of the irq's interrupts
+};
+
+/*
+* The previous sample, and the rates of each line and each column of
+* interrupt_stats. The previous sample trades buffers with interrupt_stats
+* before each parse instead of being copied.
+*/
+struct interrupt_rates
+{
+    int have_previous;
+    int columns_match;                  //The previous sample had the same cpus in the same columns
+    struct interrupt_stats previous;
+    struct irq_rate *lines;
+    int lines_capacity;
+    double *cpu_rate;                   //Per column
+    int cpu_rate_capacity;
+    double total_rate;
+
+    int top_n;
+    struct irq_top *top;
+    int num_top;
+    int busiest[IRQ_SHOWN_BUSIEST_CPUS]; //Columns with the highest cpu_rate, -1 past the last
+};
+
+extern struct proc_source interrupts_source;
+extern struct interrupt_stats interrupt_stats;
+extern struct interrupt_rates interrupt_rates;
+
+void init_interrupts(int top_n);
+void update_interrupt_stats();
+void update_interrupt_rates();
+void select_top_interrupts(int by_rate);
+void sample_interrupts();
+void close_interrupts();
+
+#endif
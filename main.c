@@ -5,7 +5,7 @@
  * Date: [Date of creation or last update]
  * Version: 1.0
  *
- * Compilation: gcc -o sys_mon main.c
+ * Compilation: ./build.sh
  * Usage: ./sys_mon usage
  *
  *
@@ -16,562 +16,961 @@
  *      None.
  *
  */
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <fnmatch.h>
+#include <regex.h>
+
+#include "sys_mon.h"
+#include "history.h"
+#include "record.h"
+#include "scheduler.h"
+#include "highfreq.h"
+#include "selfstats.h"
+#include "screen.h"
+#include "proctop.h"
+#include "disk.h"
+#include "netlink.h"
+#include "interrupts.h"
+#include "exporter.h"
+#include "shm.h"
+#include "pipeline.h"
+#include "meminfo.h"
+#include "pressure.h"
+#include "rules.h"
+#include "cgroup.h"
+#include "analyze.h"
 
-#define EXIT_FAILED                 1
-#define EXIT_SUCCESS                0
-
-#define CPU_STATS_FILEPATH          "/proc/stat"
-#define MEM_INFO_FILEPATH           "/proc/meminfo"
-#define NETWORK_ACTIVITY_FILEPATH   "/proc/net/dev"
-
-#define MAX_PROCFILE_LINE_LENGTH    8192
-#define MAX_PROCFILE_TOKEN_AMOUNT   12
-#define NUM_CPU_LINES               17 //This may change depending on number of cores CPU has
-#define MAX_CPU_DATA_SIZE           34
-#define MAX_MEM_DATA_SIZE           42
-#define MAX_NETWORK_DATA_SIZE       42
-#define MAX_NETWORK_DEVICES         8
-
-typedef char* string_t;
-
-FILE *proc_stats_file;
-FILE *mem_info_file;
-FILE *network_activity_file;
-
-struct cpu_line
-{
-    string_t name;
-    string_t user_mode;
-    string_t nice_time;
-    string_t system_mode_time;
-    string_t idle_time;
-    string_t I_O_wait_time;
-    string_t IRQ_time;
-    string_t soft_IRQ_time;
-    string_t steal_time;
-    string_t guest_time;
-    string_t guest_nice_time;
-};
-
-struct cpu_stats
+/*
+* What the network tables show first.
+*/
+enum network_sort
 {
-    struct cpu_line cpu[NUM_CPU_LINES]; //There are 16 lines for each cpu core and 1 line for entire cpu
-    string_t num_context_switches;
-    string_t boot_time;
-    string_t num_proccesses_created;
-    string_t proccesses_running;
-    string_t proccesses_blocked;
+    NETWORK_SORT_TOTAL,                 //Bytes received and sent
+    NETWORK_SORT_RX,
+    NETWORK_SORT_TX,
+    NETWORK_SORT_NAME,
+    NETWORK_SORT_NONE,                  //The order of /proc/net/dev
+    NUM_NETWORK_SORTS
 };
 
-struct mem_info
-{
-    string_t mem_total;
-    string_t mem_free;
-    string_t mem_available;
-    string_t buffers;
-    string_t cached;
-    string_t active;
-    string_t inactive;
-    string_t dirty;
-    string_t page_tables;
-    string_t percpu;
-    string_t hardware_corrupted;
-};
+int show_raw_counters = 0;              //--raw, loop modes print counters instead of rates
+int show_self_stats = 0;                //--self-stats, print what sys_mon itself costs
+int history_seconds = DEFAULT_HISTORY_SECONDS; //--history, how far back the loop modes keep samples
+int history_interfaces = DEFAULT_HISTORY_INTERFACES; //--history-interfaces, the network history's room
+int history_window = WINDOW_1M;         //--window, aggregates shown next to the current values
+double replay_speed = 1.0;              //--speed, 0 replays as fast as it can print
+const char *replay_from = NULL;         //--from, where replay starts
+uint64_t cpu_interval_ns = DEFAULT_INTERVAL_NS;     //--cpu-interval
+uint64_t mem_interval_ns = DEFAULT_INTERVAL_NS;     //--mem-interval
+uint64_t network_interval_ns = DEFAULT_INTERVAL_NS; //--network-interval
+uint64_t disk_interval_ns = DEFAULT_INTERVAL_NS;    //--disk-interval
+uint64_t irq_interval_ns = DEFAULT_INTERVAL_NS;     //--irq-interval
+uint64_t pressure_interval_ns = DEFAULT_INTERVAL_NS; //--pressure-interval
+uint64_t record_interval_ns = DEFAULT_INTERVAL_NS;  //--record-interval
+uint64_t export_interval_ns = DEFAULT_INTERVAL_NS;  //--export-interval
+uint64_t shm_interval_ns = DEFAULT_INTERVAL_NS;     //--shm-interval
+uint64_t rules_interval_ns = DEFAULT_INTERVAL_NS;   //--rule-interval
+const char *shm_name = SHM_DEFAULT_NAME;            //--shm-name
+uint64_t high_freq_interval_ns = DEFAULT_HIGH_FREQ_INTERVAL_NS; //--hf-interval
+uint64_t high_freq_budget_ns = 0;       //--budget-us, 1% of the interval when not given
+const char *high_freq_cpus = NULL;      //--cpus, every cpu when not given
+const char *high_freq_interfaces = NULL; //--interfaces, every interface when not given
+uint64_t proc_top_interval_ns = DEFAULT_INTERVAL_NS; //--proc-top-interval
+int proc_top_n = DEFAULT_PROC_TOP_N;    //--top
+int proc_top_sort = PROC_SORT_CPU;      //--sort
+int proc_top_threads = 0;               //--threads, one per online cpu up to 8 when not given
+uint64_t cgroup_interval_ns = DEFAULT_INTERVAL_NS; //--cgroup-interval
+const char *cgroup_root = NULL;         //--cgroup-root, where cgroup v2 is mounted when not given
+int cgroup_top_n = DEFAULT_CGROUP_TOP_N; //--cgroup-top
+int cgroup_sort = CGROUP_SORT_CPU;      //--cgroup-sort
+const char *network_match = NULL;       //--net-match, a glob the interfaces shown must match
+regex_t network_regex;                  //--net-regex, compiled
+int have_network_regex = 0;
+int network_sort = NETWORK_SORT_TOTAL;  //--net-sort
+int network_top = 0;                    //--net-top, 0 shows every interface
+int irq_top_n = DEFAULT_IRQ_TOP_N;      //--irq-top
+int use_pipeline = 0;                   //--pipeline, the collectors read on threads of their own
+const char *pin_list = NULL;            //--pin, cpus the collector threads are pinned to in turn
+
+struct scheduled_job *cpu_job = NULL;   //Set for each loop mode given
+struct scheduled_job *mem_job = NULL;
+struct scheduled_job *network_job = NULL;
+struct scheduled_job *disk_job = NULL;
+struct scheduled_job *irq_job = NULL;
+struct scheduled_job *record_job = NULL;
+struct scheduled_job *high_freq_job = NULL;
+struct scheduled_job *proc_top_job = NULL;
+struct scheduled_job *export_job = NULL;
+struct scheduled_job *shm_job = NULL;
+struct scheduled_job *pressure_job = NULL;
+struct scheduled_job *rules_job = NULL;
+struct scheduled_job *cgroup_job = NULL;
+int drawing_frames = 0;                 //The loop modes draw the screen rather than run as daemons
+struct recorder recorder;
+size_t history_memory = 0;
+int *network_order = NULL;              //Devices the network tables show, in the order shown
+int network_order_capacity = 0;
+int network_order_rates = 0;            //network_order is sorted by rates rather than counters
+const char *network_sort_names[NUM_NETWORK_SORTS] = {"total", "rx", "tx", "name", "none"};
 
-struct network_device
-{
-    string_t face;
-    string_t r_bytes;
-    string_t r_packets;
-    string_t r_errs;
-    string_t r_drop;
-    string_t r_fifo;
-    string_t r_frame;
-    string_t r_compressed;
-    string_t r_multicast;
-    string_t t_bytes;
-    string_t t_packets;
-    string_t t_errs;
-    string_t t_drop;
-    string_t t_fifo;
-    string_t t_frame;
-    string_t t_compressed;
-};
+/*
+* @brief Prints every line of meminfo_snapshot, the keys the table does not
+*        know after the rest, then the lines of each NUMA node side by side.
+*/
+void display_meminfo_snapshot()
+{
+    for(int key = 0; key < NUM_MEMINFO_KEYS; key++)
+    {
+        if(!meminfo_has(&meminfo_snapshot, key)) continue;
+        screen_printf("%s: %" PRIu64 "%s\n", meminfo_key_names[key], meminfo_snapshot.value[key],
+                      meminfo_key_counts[key] ? "" : " kB");
+    }
+    for(int i = 0; i < meminfo_snapshot.num_overflow; i++)
+    {
+        const struct meminfo_overflow *overflow = &meminfo_snapshot.overflow[i];
+        screen_printf("%s: %" PRIu64 "%s (not in the key table)\n", overflow->key, overflow->value, overflow->count ? "" : " kB");
+    }
+    if(meminfo_snapshot.dropped > 0) screen_printf("%d more lines of unknown keys not kept\n", meminfo_snapshot.dropped);
+    screen_printf("\n");
+    if(node_meminfo.num_nodes == 0) return;
+
+    screen_printf("%-18s", "NUMA node, kB");
+    for(int node = 0; node < node_meminfo.num_nodes; node++) screen_printf(" %13d", node_meminfo.id[node]);
+    screen_printf("\n");
+    for(int key = 0; key < NUM_MEMINFO_KEYS; key++)
+    {
+        int shown = 0;
+        for(int node = 0; node < node_meminfo.num_nodes; node++) shown |= meminfo_has(&node_meminfo.nodes[node], key);
+        if(!shown) continue;
+        screen_printf("%-18s", meminfo_key_names[key]);
+        for(int node = 0; node < node_meminfo.num_nodes; node++)
+        {
+            if(meminfo_has(&node_meminfo.nodes[node], key)) screen_printf(" %13" PRIu64, node_meminfo.nodes[node].value[key]);
+            else screen_printf(" %13s", "n/a");
+        }
+        screen_printf("\n");
+    }
+    screen_printf("\n");
+}
 
-struct network_info
+/*
+* @breif prints mem_info struct
+*/
+void display_mem_info()
 {
-    struct network_device devices[MAX_NETWORK_DEVICES];
-    int num_devices;
-};
+    for(int i = 0; i < NUM_MEM_FIELDS; i++)
+    {
+        if(mem_info.present & (1u << i))
+        {
+            screen_printf("%s %" PRIu64 " kB\n", mem_field_keys[i], mem_info.value[i]);
+        }
+        else
+        {
+            screen_printf("%s n/a\n", mem_field_keys[i]);
+        }
+    }
+    screen_printf("\n");
+}
+
+/*
+* @brief Prints the average, maximum and p95 of a metric over the chosen
+*        window as table columns, dashes if it has no samples yet.
+*/
+void display_window_columns(struct history *history, int metric, const char *format)
+{
+    struct window_stats stats;
+    if(metric < history->num_metrics) history_query(history, metric, history_window, &stats);
+    else stats.samples = 0;
+    if(stats.samples == 0)
+    {
+        screen_printf(" %13s | %13s | %13s |", "-", "-", "-");
+        return;
+    }
+    screen_printf(" ");
+    screen_printf(format, stats.mean);
+    screen_printf(" | ");
+    screen_printf(format, stats.max);
+    screen_printf(" | ");
+    screen_printf(format, stats.p95);
+    screen_printf(" |");
+}
 
-struct cpu_stats cpu_stats;
-struct mem_info mem_info;
-struct network_info network_info;
+/*
+* @brief Prints the header of the columns display_window_columns prints.
+*/
+void display_window_header(const char *name)
+{
+    char title[32];
+    snprintf(title, sizeof(title), "%s %s avg", name, history_window_names[history_window]);
+    screen_printf(" %13s | %13s | %13s |", title, "max", "p95");
+}
 
 /*
-* @brief Prints error message from caller and exits program with exit failure.
+* @brief Prints one row of the cpu table.
 */
-int fatal_error(char * error_msg, char * additional_text)
+void display_cpu_row(const char *name, const uint64_t time[NUM_CPU_FIELDS])
 {
-    printf("ERROR: ");
-    printf("%s", error_msg);
-    printf("%s.\n", additional_text);
-    exit(EXIT_FAILED);
+    screen_printf("%6s | ", name);
+    screen_printf(" %8" PRIu64 " | ", time[CPU_USER]);
+    screen_printf(" %8" PRIu64 " | ", time[CPU_NICE]);
+    screen_printf(" %15" PRIu64 " | ", time[CPU_SYSTEM]);
+    screen_printf(" %12" PRIu64 " | ", time[CPU_IDLE]);
+    screen_printf(" %12" PRIu64 " | ", time[CPU_IOWAIT]);
+    screen_printf(" %7" PRIu64 " | ", time[CPU_IRQ]);
+    screen_printf(" %12" PRIu64 " | ", time[CPU_SOFTIRQ]);
+    screen_printf(" %9" PRIu64 " | ", time[CPU_STEAL]);
+    screen_printf(" %9" PRIu64 " | ", time[CPU_GUEST]);
+    screen_printf(" %15" PRIu64 "\n", time[CPU_GUEST_NICE]);
 }
 
 /*
-* @brief Opens main files for system monitoring.
+* @breif Prints cpu_stats struct
 */
-void open_proc_files()
+void display_cpu_proc()
 {
-    proc_stats_file = fopen(CPU_STATS_FILEPATH, "r");
-    if(proc_stats_file == NULL) fatal_error("proc stats failed to open at", CPU_STATS_FILEPATH);
+    //Table Header
+    screen_printf("  Name | ");
+    screen_printf("User mode | ");
+    screen_printf("Nice Time | ");
+    screen_printf("System Mode time | ");
+    screen_printf("Idle Time     | ");
+    screen_printf("I/O Wait Time | ");
+    screen_printf("IRQ Time | ");
+    screen_printf("Soft IRQ Time | ");
+    screen_printf("Steal Time | ");
+    screen_printf("Guest Time | ");
+    screen_printf("Guest Nice Time\n");
+    //CPU lines
+    display_cpu_row("cpu", cpu_stats.total.time);
+    for(int cpu = 0; cpu < cpu_stats.num_cpus; cpu++) {
+        if(!cpu_stats.online[cpu]) continue;
 
-    mem_info_file = fopen(MEM_INFO_FILEPATH, "r");
-    if(mem_info_file == NULL) fatal_error("mem info failed to open at", MEM_INFO_FILEPATH);
+        uint64_t time[NUM_CPU_FIELDS];
+        for(int field = 0; field < NUM_CPU_FIELDS; field++) time[field] = cpu_stats.time[field][cpu];
 
-    network_activity_file = fopen(NETWORK_ACTIVITY_FILEPATH, "r");
-    if(network_activity_file == NULL) fatal_error("net dev failed to open at", NETWORK_ACTIVITY_FILEPATH);
+        char name[16];
+        snprintf(name, sizeof(name), "cpu%d", cpu);
+        display_cpu_row(name, time);
+    }
+    screen_printf("Online CPUs: %d of %d\n", cpu_stats.num_online, cpu_stats.num_cpus);
+    screen_printf("Context Switches: %" PRIu64 "\n", cpu_stats.num_context_switches);
+    screen_printf("Interrupts: %" PRIu64 "\n", cpu_stats.num_interrupts);
+    screen_printf("Soft IRQs: %" PRIu64 "\n", cpu_stats.num_softirqs);
+    screen_printf("Boot Time: %" PRIu64 "\n", cpu_stats.boot_time);
+    screen_printf("Total processes Created: %" PRIu64 "\n", cpu_stats.num_proccesses_created);
+    screen_printf("Processes Running: %" PRIu64 "\n", cpu_stats.proccesses_running);
+    screen_printf("Processes Blocked: %" PRIu64 "\n\n", cpu_stats.proccesses_blocked);
 }
 
 /*
-* @breif Closes main files for system monitoring.
+* @brief Prints one row of the cpu rates table, dashes if there is no rate yet.
 */
-void close_proc_files()
+void display_cpu_rates_row(const char *name, const float pct[NUM_CPU_RATES], int valid, int cpu)
 {
-    if(proc_stats_file != NULL) fclose(proc_stats_file);
-    if(mem_info_file != NULL) fclose(mem_info_file);
-    if(network_activity_file != NULL) fclose(network_activity_file);
+    screen_printf("%6s |", name);
+    for(int rate = 0; rate < NUM_CPU_RATES; rate++)
+    {
+        if(valid) screen_printf(" %8.1f |", pct[rate]);
+        else screen_printf(" %8s |", "-");
+    }
+    display_window_columns(&cpu_history, cpu_history_metric(cpu, CPU_RATE_BUSY), "%13.1f");
+    screen_printf("\n");
 }
 
 /*
-* @brief Gets list of tokens from line
-*
-* @returns the first token from the line
+* @brief Prints cpu_rates, the loop mode's default view of cpu_stats.
+*/
+void display_cpu_rates()
+{
+    screen_printf("  Name |   User %% | System %% | IOWait %% |  Steal %% |   Idle %% |   Busy %% |");
+    display_window_header("Busy");
+    screen_printf("\n");
+    display_cpu_rates_row("cpu", cpu_rates.total, cpu_rates.have_previous, -1);
+    for(int cpu = 0; cpu < cpu_stats.num_cpus; cpu++) {
+        if(!cpu_stats.online[cpu]) continue;
+
+        float pct[NUM_CPU_RATES];
+        for(int rate = 0; rate < NUM_CPU_RATES; rate++) pct[rate] = cpu_rates.pct[rate][cpu];
+
+        char name[16];
+        snprintf(name, sizeof(name), "cpu%d", cpu);
+        display_cpu_rates_row(name, pct, cpu_rates.valid[cpu], cpu);
+    }
+    screen_printf("Online CPUs: %d of %d\n", cpu_stats.num_online, cpu_stats.num_cpus);
+    screen_printf("Context Switches/s: %.0f\n", cpu_rates.context_switches_per_second);
+    //Recordings do not carry the interrupt counts
+    if(cpu_stats.num_interrupts > 0)
+    {
+        screen_printf("Interrupts/s: %.0f, Soft IRQs/s: %.0f\n", cpu_rates.interrupts_per_second, cpu_rates.softirqs_per_second);
+    }
+    screen_printf("Processes Running: %" PRIu64 "\n", cpu_stats.proccesses_running);
+    screen_printf("Processes Blocked: %" PRIu64 "\n\n", cpu_stats.proccesses_blocked);
+}
+
+/*
+* @brief What the network tables sort an interface by: its byte rate, or its
+*        byte counter for the raw tables. An interface without a rate sorts
+*        last.
 */
-char* tokens_from_line(char *token_list[], char * line, int *num_tokens)
+double network_sort_key(int device_index)
 {
-    if (line == NULL) return NULL;
+    const struct network_device *device = &network_info.devices[device_index];
+    const struct network_rate *rate = &network_rates.devices[device_index];
+    double received, sent;
+    if(network_order_rates)
+    {
+        if(!rate->valid) return -1;
+        received = rate->rate[NET_RATE_R_BYTES];
+        sent = rate->rate[NET_RATE_T_BYTES];
+    }
+    else
+    {
+        received = (double)device->counter[NET_R_BYTES];
+        sent = (double)device->counter[NET_T_BYTES];
+    }
+    if(network_sort == NETWORK_SORT_RX) return received;
+    if(network_sort == NETWORK_SORT_TX) return sent;
+    return received + sent;
+}
 
-    char *first_token = strtok(line, " ");
-    if(strcmp(first_token, "intr") == 0) return NULL; //We skip this one
-                                           //as it is 4000 tokens
+int compare_network_devices(const void *a, const void *b)
+{
+    int left = *(const int*)a;
+    int right = *(const int*)b;
+    if(network_sort == NETWORK_SORT_NAME)
+    {
+        int order = strcmp(network_info.devices[left].face, network_info.devices[right].face);
+        if(order != 0) return order;
+    }
+    else
+    {
+        double left_key = network_sort_key(left);
+        double right_key = network_sort_key(right);
+        if(left_key != right_key) return left_key > right_key ? -1 : 1;
+    }
+    return left - right;
+}
 
-    int index = 0;
-    token_list[index] = first_token;
-    char *token;
-    while((token = strtok(NULL, " ")) != NULL)
+/*
+* @brief Fills network_order with the devices that match --net-match and
+*        --net-regex, sorted by --net-sort and cut to --net-top.
+*
+* @returns the number of devices to show
+*/
+int select_network_devices(int by_rates)
+{
+    if(network_info.capacity > network_order_capacity)
     {
-        token_list[index] = token;
-        index++;
+        network_order_capacity = network_info.capacity;
+        network_order = counted_realloc(network_order, (size_t)network_order_capacity * sizeof(int));
     }
 
-    *num_tokens = index + 1;
-    return first_token;
+    int num_shown = 0;
+    for(int i = 0; i < network_info.num_devices; i++)
+    {
+        const char *face = network_info.devices[i].face;
+        if(network_match != NULL && fnmatch(network_match, face, 0) != 0) continue;
+        if(have_network_regex && regexec(&network_regex, face, 0, NULL, 0) != 0) continue;
+        network_order[num_shown++] = i;
+    }
+    network_order_rates = by_rates;
+    if(network_sort != NETWORK_SORT_NONE) qsort(network_order, (size_t)num_shown, sizeof(int), compare_network_devices);
+    if(network_top > 0 && num_shown > network_top) num_shown = network_top;
+    return num_shown;
 }
 
 /*
-* @breif Update the cpu line indicated by cpu_index with the list of tokens
+* @brief Prints how many interfaces the network table shows and why.
 */
-void update_cpu_index(int cpu_index, char * first_token, char *token_list[])
+void display_network_selection(int num_shown)
 {
-    strcpy(cpu_stats.cpu[cpu_index].name, first_token);
-    strcpy(cpu_stats.cpu[cpu_index].user_mode, token_list[0]);
-    strcpy(cpu_stats.cpu[cpu_index].nice_time, token_list[1]);
-    strcpy(cpu_stats.cpu[cpu_index].system_mode_time, token_list[2]);
-    strcpy(cpu_stats.cpu[cpu_index].idle_time, token_list[3]);
-    strcpy(cpu_stats.cpu[cpu_index].I_O_wait_time, token_list[4]);
-    strcpy(cpu_stats.cpu[cpu_index].IRQ_time, token_list[5]);
-    strcpy(cpu_stats.cpu[cpu_index].soft_IRQ_time, token_list[6]);
-    strcpy(cpu_stats.cpu[cpu_index].steal_time, token_list[7]);
-    strcpy(cpu_stats.cpu[cpu_index].guest_time, token_list[8]);
-    strcpy(cpu_stats.cpu[cpu_index].guest_nice_time, token_list[9]);
+    screen_printf("Interfaces: %d of %d shown", num_shown, network_info.num_devices);
+    if(network_match != NULL) screen_printf(", matching %s", network_match);
+    if(have_network_regex) screen_printf(", matching the --net-regex");
+    if(network_sort == NETWORK_SORT_NAME) screen_printf(", by name");
+    else if(network_sort != NETWORK_SORT_NONE) screen_printf(", busiest first by %s", network_sort_names[network_sort]);
+    if(network_rates.samples > 1) screen_printf("; %d appeared and %d gone since the last sample", network_rates.num_added, network_rates.num_removed);
+    if(network_backend == NETWORK_BACKEND_NETLINK) screen_printf("; read over netlink");
+    else if(netlink_source.error != 0) screen_printf("; read from /proc/net/dev, netlink failed: %s", strerror(netlink_source.error));
+    screen_printf("\n");
 }
 
 /*
-* @breif Updates cpu_stats struct with latest from proc file.
+* @breif display network info struct
 */
-void update_cpu_stats()
+void display_network_info()
 {
-    char proc_line_buffer[MAX_PROCFILE_LINE_LENGTH];
+    screen_printf("-------------------------------------------------------------------");
+    screen_printf("-------------------------------------------------------------------\n");
+    int num_shown = select_network_devices(0);
+    display_network_selection(num_shown);
+    screen_printf("Face            | ");
+    screen_printf("R Bytes      | ");
+    screen_printf("R Packets    | ");
+    screen_printf("R errs       | ");
+    screen_printf("R drop       | ");
+    screen_printf("R fifo       | ");
+    screen_printf("R frame      | ");
+    screen_printf("R compressed | ");
+    screen_printf("R multicast  |");
+    screen_printf("\n                ");
+    screen_printf("| T Bytes      | ");
+    screen_printf("T Packets    | ");
+    screen_printf("T errs       | ");
+    screen_printf("T drop       | ");
+    screen_printf("T fifo       | ");
+    screen_printf("T colls      | ");
+    screen_printf("T carrier    | ");
+    screen_printf("T compressed |\n");
+    screen_printf("-------------------------------------------------------------------");
+    screen_printf("-------------------------------------------------------------------\n");
+    for(int shown = 0; shown < num_shown; shown++)
+    {
+        int i = network_order[shown];
+        const uint64_t *counter = network_info.devices[i].counter;
+        screen_printf("%15s |", network_info.devices[i].face);
+        for(int field = NET_R_BYTES; field <= NET_R_MULTICAST; field++)
+        {
+            screen_printf("%13" PRIu64 " |", counter[field]);
+        }
+        screen_printf("\n                |");
+        for(int field = NET_T_BYTES; field <= NET_T_COMPRESSED; field++)
+        {
+            screen_printf("%13" PRIu64 " |", counter[field]);
+        }
+        screen_printf("\n");
+        screen_printf("-------------------------------------------------------------------");
+        screen_printf("-------------------------------------------------------------------\n\n");
+    }
+}
 
-    while(fgets(proc_line_buffer, sizeof(proc_line_buffer), proc_stats_file) != NULL)
+/*
+* @brief Prints network_rates, the loop mode's default view of network_info.
+*/
+void display_network_rates()
+{
+    screen_printf("------------------------------------------------------------------------------------------------------------");
+    screen_printf("------------------------------------------------------------------------------------------\n");
+    int num_shown = select_network_devices(1);
+    display_network_selection(num_shown);
+    screen_printf("Face            |    R Bytes/s |  R Packets/s |     R Drop/s |    T Bytes/s |  T Packets/s |     T Drop/s |");
+    display_window_header("R B/s");
+    display_window_header("T B/s");
+    screen_printf("\n");
+    screen_printf("------------------------------------------------------------------------------------------------------------");
+    screen_printf("------------------------------------------------------------------------------------------\n");
+    for(int shown = 0; shown < num_shown; shown++)
     {
-        char * token_list[MAX_PROCFILE_TOKEN_AMOUNT];
-        int num_tokens;
-        char *first_token = tokens_from_line(token_list, proc_line_buffer, &num_tokens);
-        if(first_token == NULL) continue;
-        if(num_tokens < 1) continue;
+        int i = network_order[shown];
+        const struct network_device *device = &network_info.devices[i];
+        const struct network_rate *rate = &network_rates.devices[i];
+        screen_printf("%15s |", device->face);
+        for(int field = 0; field < NUM_NETWORK_RATES; field++)
+        {
+            if(rate->valid) screen_printf("%13.1f |", rate->rate[field]);
+            else screen_printf("%13s |", "-");
+        }
+        display_window_columns(&network_history, network_history_metric(device->id, NET_RATE_R_BYTES), "%13.0f");
+        display_window_columns(&network_history, network_history_metric(device->id, NET_RATE_T_BYTES), "%13.0f");
+        screen_printf("\n");
+    }
+    screen_printf("------------------------------------------------------------------------------------------------------------");
+    screen_printf("------------------------------------------------------------------------------------------\n\n");
+}
 
-        if(strcmp(first_token, "cpu") == 0) update_cpu_index(0, first_token, token_list);
-        if(strcmp(first_token, "cpu0") == 0) update_cpu_index(1, first_token, token_list);
-        if(strcmp(first_token, "cpu1") == 0) update_cpu_index(2, first_token, token_list);
-        if(strcmp(first_token, "cpu2") == 0) update_cpu_index(3, first_token, token_list);
-        if(strcmp(first_token, "cpu3") == 0) update_cpu_index(4, first_token, token_list);
-        if(strcmp(first_token, "cpu4") == 0) update_cpu_index(5, first_token, token_list);
-        if(strcmp(first_token, "cpu5") == 0) update_cpu_index(6, first_token, token_list);
-        if(strcmp(first_token, "cpu6") == 0) update_cpu_index(7, first_token, token_list);
-        if(strcmp(first_token, "cpu7") == 0) update_cpu_index(8, first_token, token_list);
-        if(strcmp(first_token, "cpu8") == 0) update_cpu_index(9, first_token, token_list);
-        if(strcmp(first_token, "cpu9") == 0) update_cpu_index(10, first_token, token_list);
-        if(strcmp(first_token, "cpu10") == 0) update_cpu_index(11, first_token, token_list);
-        if(strcmp(first_token, "cpu11") == 0) update_cpu_index(12, first_token, token_list);
-        if(strcmp(first_token, "cpu12") == 0) update_cpu_index(13, first_token, token_list);
-        if(strcmp(first_token, "cpu13") == 0) update_cpu_index(14, first_token, token_list);
-        if(strcmp(first_token, "cpu14") == 0) update_cpu_index(15, first_token, token_list);
-        if(strcmp(first_token, "cpu15") == 0) update_cpu_index(16, first_token, token_list);
-        if(strcmp(first_token, "ctxt") == 0) strcpy(cpu_stats.num_context_switches, token_list[0]);
-        if(strcmp(first_token, "btime") == 0) strcpy(cpu_stats.boot_time, token_list[0]);
-        if(strcmp(first_token, "processes") == 0) strcpy(cpu_stats.num_proccesses_created, token_list[0]);
-        if(strcmp(first_token, "procs_running") == 0) strcpy(cpu_stats.proccesses_running, token_list[0]);
-        if(strcmp(first_token, "procs_blocked") == 0) strcpy(cpu_stats.proccesses_blocked, token_list[0]);
+/*
+* @brief Prints the disk_stats counters of the devices that have done any
+*        I/O since boot.
+*/
+void display_disk_info()
+{
+    screen_printf("Device           |        Reads |     R merged |    R sectors |         R ms |       Writes |     W merged |"
+                  "    W sectors |         W ms |    In flight |        IO ms |  Weighted ms |\n");
+    int idle = 0;
+    for(int i = 0; i < disk_stats.num_devices; i++)
+    {
+        const struct disk_device *device = &disk_stats.devices[i];
+        if(device->counter[DISK_READS] == 0 && device->counter[DISK_WRITES] == 0) {idle++; continue;}
+        screen_printf("%-16s |", device->name);
+        for(int field = 0; field < NUM_DISK_FIELDS; field++) screen_printf("%13" PRIu64 " |", device->counter[field]);
+        screen_printf("\n");
     }
+    if(idle > 0) screen_printf("%d devices without I/O not shown\n", idle);
+    screen_printf("\n");
+}
 
+/*
+* @brief Prints disk_rates, the loop mode's default view of disk_stats.
+*/
+void display_disk_rates()
+{
+    screen_printf("Device           |     R IO/s |     W IO/s |      R B/s |      W B/s |  R wait ms |  W wait ms |"
+                  "    Queue |   Util %% |\n");
+    int idle = 0;
+    for(int i = 0; i < disk_stats.num_devices; i++)
+    {
+        const struct disk_device *device = &disk_stats.devices[i];
+        const struct disk_rate *rate = &disk_rates.devices[i];
+        if(device->counter[DISK_READS] == 0 && device->counter[DISK_WRITES] == 0) {idle++; continue;}
+        screen_printf("%-16s |", device->name);
+        if(!rate->valid)
+        {
+            screen_printf(" %10s | %10s | %10s | %10s | %10s | %10s | %8s | %8s |\n", "-", "-", "-", "-", "-", "-", "-", "-");
+            continue;
+        }
+        screen_printf(" %10.1f | %10.1f | %10.0f | %10.0f | %10.2f | %10.2f | %8.2f | %8.1f |\n",
+                      rate->rate[DISK_RATE_READS], rate->rate[DISK_RATE_WRITES], rate->rate[DISK_RATE_READ_BYTES],
+                      rate->rate[DISK_RATE_WRITE_BYTES], rate->rate[DISK_RATE_READ_LATENCY], rate->rate[DISK_RATE_WRITE_LATENCY],
+                      rate->rate[DISK_RATE_QUEUE], rate->rate[DISK_RATE_UTILIZATION]);
+    }
+    if(idle > 0) screen_printf("%d devices without I/O not shown\n", idle);
+    screen_printf("\n");
 }
 
 /*
-* @breif Updates mem_info struct with newest data from file
+* @brief Prints the capacity and inode use of each filesystem in the mount
+*        table.
 */
-void update_meminfo()
+void display_filesystems()
 {
-    char proc_line_buffer[MAX_PROCFILE_LINE_LENGTH];
-    while(fgets(proc_line_buffer, sizeof(proc_line_buffer), mem_info_file) != NULL)
+    screen_printf("%-16s | %-10s |    Size GB |    Used GB |   Avail GB |  Use %% |       Inodes | IUse %% | Mounted on\n",
+                  "Source", "Type");
+    for(int i = 0; i < mount_table.num_filesystems; i++)
     {
-        char * token_list[MAX_PROCFILE_TOKEN_AMOUNT];
-        int num_tokens;
-        char *first_token = tokens_from_line(token_list, proc_line_buffer, &num_tokens);
-        //printf("TOKEN %s\n", first_token);
-        if(strcmp(first_token, "MemTotal:") == 0) strcpy(mem_info.mem_total, token_list[0]);
-        if(strcmp(first_token, "MemFree:") == 0) strcpy(mem_info.mem_free, token_list[0]);
-        if(strcmp(first_token, "MemAvailable:") == 0) strcpy(mem_info.mem_available, token_list[0]);
-        if(strcmp(first_token, "Buffers:") == 0) strcpy(mem_info.buffers, token_list[0]);
-        if(strcmp(first_token, "Cached:") == 0) strcpy(mem_info.cached, token_list[0]);
-        if(strcmp(first_token, "Active:") == 0) strcpy(mem_info.active, token_list[0]);
-        if(strcmp(first_token, "Inactive:") == 0) strcpy(mem_info.inactive, token_list[0]);
-        if(strcmp(first_token, "Dirty:") == 0) strcpy(mem_info.dirty, token_list[0]);
-        if(strcmp(first_token, "PageTables:") == 0) strcpy(mem_info.page_tables, token_list[0]);
-        if(strcmp(first_token, "Percpu:") == 0) strcpy(mem_info.percpu, token_list[0]);
-        if(strcmp(first_token, "HardwareCorrupted:") == 0) strcpy(mem_info.hardware_corrupted, token_list[0]);
+        const struct filesystem *filesystem = &mount_table.filesystems[i];
+        screen_printf("%-16s | %-10s |", filesystem->source, filesystem->type);
+        if(!filesystem->have_stats)
+        {
+            screen_printf(" %10s | %10s | %10s | %6s | %12s | %6s | %s\n", "n/a", "n/a", "n/a", "n/a", "n/a", "n/a",
+                          filesystem->mount_point);
+            continue;
+        }
+        //Used against what users can have, as df does, so root's reserve shows as full
+        uint64_t used = filesystem->total_bytes - filesystem->free_bytes;
+        uint64_t usable = used + filesystem->available_bytes;
+        uint64_t used_inodes = filesystem->total_inodes - filesystem->free_inodes;
+        screen_printf(" %10.1f | %10.1f | %10.1f |", (double)filesystem->total_bytes / 1073741824, (double)used / 1073741824,
+                      (double)filesystem->available_bytes / 1073741824);
+        if(usable > 0) screen_printf(" %6.1f |", (double)used * 100 / usable);
+        else screen_printf(" %6s |", "-");
+        screen_printf(" %12" PRIu64 " |", filesystem->total_inodes);
+        if(filesystem->total_inodes > 0) screen_printf(" %6.1f |", (double)used_inodes * 100 / filesystem->total_inodes);
+        else screen_printf(" %6s |", "-");
+        screen_printf(" %s\n", filesystem->mount_point);
     }
+    screen_printf("%d filesystems, %d pseudo or repeated mounts not shown, mount table read %" PRIu64 " times\n\n",
+                  mount_table.num_filesystems, mount_table.num_skipped, mount_table.parses);
 }
 
 /*
-* @breif helper for function update_network_info
-*        copies line_buffer to device struct in netwwork struct at index device_index
+* @brief Prints mem_info next to its minimum, average, maximum and p95 over
+*        the chosen window, the loop mode's view of mem_info.
 */
-void copy_to_network_struct(int device_index, char * line_buffer)
+void display_mem_history()
 {
-    strcpy(network_info.devices[device_index].face, strtok(line_buffer, " "));
-    strcpy(network_info.devices[device_index].r_bytes, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].r_packets, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].r_errs, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].r_drop, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].r_fifo, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].r_frame, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].r_compressed, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].r_multicast, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].t_bytes, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].t_packets, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].t_errs, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].t_drop, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].t_fifo, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].t_frame, strtok(NULL, " "));
-    strcpy(network_info.devices[device_index].t_compressed, strtok(NULL, " "));
+    screen_printf("%-19s | %12s | %10s |", "Key", "Now kB", "min");
+    display_window_header("");
+    screen_printf("\n");
+    for(int i = 0; i < NUM_MEM_FIELDS; i++)
+    {
+        struct window_stats stats;
+        history_query(&mem_history, i, history_window, &stats);
+
+        screen_printf("%-19s |", mem_field_keys[i]);
+        if(mem_info.present & (1u << i)) screen_printf(" %12" PRIu64 " |", mem_info.value[i]);
+        else screen_printf(" %12s |", "n/a");
+        if(stats.samples > 0) screen_printf(" %10.0f |", stats.min);
+        else screen_printf(" %10s |", "-");
+        display_window_columns(&mem_history, i, "%13.0f");
+        screen_printf("\n");
+    }
+    screen_printf("\n");
 }
 
 /*
-* @breif updates network info struct
+* @brief Prints the mean and maximum of a high-freq-loop value over the last
+*        display period, dashes if no tick measured it.
 */
-void update_network_info()
+void display_high_freq_columns(const struct high_freq_stat *stat, const char *format)
 {
-    char proc_line_buffer[MAX_PROCFILE_LINE_LENGTH];
-    int line_index = 0;
-    int device_index = 0;
-    while(fgets(proc_line_buffer, sizeof(proc_line_buffer), network_activity_file) != NULL)
+    if(stat->samples == 0)
     {
-        if(line_index < 2) {line_index++; continue;}
+        screen_printf(" %11s | %11s |", "-", "-");
+        return;
+    }
+    screen_printf(" ");
+    screen_printf(format, stat->sum / stat->samples);
+    screen_printf(" | ");
+    screen_printf(format, (double)stat->max);
+    screen_printf(" |");
+}
 
-        copy_to_network_struct(device_index, proc_line_buffer);
+/*
+* @brief Prints what the high-freq-loop ticks of the last display period
+*        measured and what they cost.
+*/
+void display_high_freq()
+{
+    const struct high_freq_period *shown = &high_freq.shown;
+    screen_printf("High frequency: every %.1f ms, budget %" PRIu64 " us per tick, level %d (%s)\n",
+                  (double)high_freq.interval_ns / 1e6, high_freq.budget_ns / 1000, high_freq.level, high_freq_level_names[high_freq.level]);
+    screen_printf("Last %.2f s: %" PRIu64 " ticks, cost avg %.0f us max %.0f us, %" PRIu64 " over budget, "
+                  "%" PRIu64 " /proc/stat and %" PRIu64 " network reads skipped\n",
+                  (double)shown->wall_ns / 1e9, shown->ticks,
+                  shown->ticks > 0 ? (double)shown->cost_sum_ns / shown->ticks / 1000 : 0, (double)shown->cost_max_ns / 1000,
+                  shown->over_budget, shown->stat_skipped, shown->network_skipped);
+    screen_printf("Own cpu: %.2f%% of one core\n", shown->wall_ns > 0 ? (double)shown->cpu_ns * 100 / shown->wall_ns : 0);
+
+    screen_printf("  Name |  Busy %% avg |         max | IOWait %% avg |        max | SoftIRQ %% avg |       max |\n");
+    for(int i = 0; i < high_freq.num_cpus; i++)
+    {
+        const struct high_freq_cpu *cpu = &high_freq.cpus[i];
+        char name[16];
+        snprintf(name, sizeof(name), "cpu%d", cpu->cpu);
+        screen_printf("%6s |", name);
+        for(int rate = 0; rate < NUM_HIGH_FREQ_CPU_RATES; rate++) display_high_freq_columns(&cpu->shown[rate], "%11.1f");
+        screen_printf("\n");
+    }
+    screen_printf("\n");
 
-        device_index++;
-        if(device_index >= MAX_NETWORK_DEVICES) break; //This application only supports 8 network devices
+    screen_printf("Face         | R B/s avg   |         max | T B/s avg   |         max |\n");
+    for(int i = 0; i < high_freq.num_interfaces; i++)
+    {
+        const struct high_freq_interface *face = &high_freq.interfaces[i];
+        screen_printf("%12s |", face->face);
+        for(int rate = 0; rate < NUM_HIGH_FREQ_NETWORK_RATES; rate++) display_high_freq_columns(&face->shown[rate], "%11.0f");
+        screen_printf("\n");
     }
-    network_info.num_devices = device_index;
+    screen_printf("\n");
 }
 
 /*
-* @breif prints mem_info struct
+* @brief Prints the some and full averages of each resource, with the
+*        share of time stalled since the previous sample when there is one.
 */
-void display_mem_info()
+void display_pressure()
 {
-    printf("MemTotal: %s\n", mem_info.mem_total);
-    printf("MemFree: %s\n", mem_info.mem_free);
-    printf("MemAvailable: %s\n", mem_info.mem_available);
-    printf("Buffers: %s\n", mem_info.buffers);
-    printf("Cached: %s\n", mem_info.cached);
-    printf("Active: %s\n", mem_info.active);
-    printf("Inactive: %s\n", mem_info.inactive);
-    printf("Dirty: %s\n", mem_info.dirty);
-    printf("PageTables: %s\n", mem_info.page_tables);
-    printf("percpu: %s\n", mem_info.percpu);
-    printf("HardwareCorrupted: %s\n\n", mem_info.hardware_corrupted);
+    screen_printf("Pressure |  Some avg10 |  avg60 | avg300 | Stalled %% |  Full avg10 |  avg60 | avg300 | Stalled %%\n");
+    for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+    {
+        screen_printf("%8s |", pressure_resource_names[resource]);
+        for(int kind = 0; kind < NUM_PRESSURE_KINDS; kind++)
+        {
+            const struct pressure_line *line = &pressure_stats.line[resource][kind];
+            if(!pressure_stats.available[resource] || !line->present)
+            {
+                screen_printf(" %11s | %6s | %6s | %9s |", "n/a", "", "", "");
+                continue;
+            }
+            screen_printf(" %10.2f%% | %5.2f%% | %5.2f%% |", line->average[PRESSURE_AVG10] / 100.0,
+                          line->average[PRESSURE_AVG60] / 100.0, line->average[PRESSURE_AVG300] / 100.0);
+            if(pressure_rates.valid[resource][kind]) screen_printf(" %9.2f |", pressure_rates.stall_pct[resource][kind]);
+            else screen_printf(" %9s |", "-");
+        }
+        screen_printf("\n");
+    }
+    screen_printf("\n");
 }
 
 /*
-* @breif Prints cpu_stats struct
+* @brief Prints the PSI triggers with how often each fired, and the latest
+*        alerts.
 */
-void display_cpu_proc()
+void display_pressure_alerts()
 {
-    //Table Header
-    printf("Name | ");
-    printf("User mode | ");
-    printf("Nice Time | ");
-    printf("System Mode time | ");
-    printf("Idle Time     | ");
-    printf("I/O Wait Time | ");
-    printf("IRQ Time | ");
-    printf("Soft IRQ Time | ");
-    printf("Steal Time | ");
-    printf("Guest Time | ");
-    printf("Guest Nice Time\n");
-    //CPU lines
-    for(int i = 0; i < NUM_CPU_LINES; i++) {
-        printf("%4s | ", cpu_stats.cpu[i].name);
-        printf(" %8s | ", cpu_stats.cpu[i].user_mode);
-        printf(" %8s | ", cpu_stats.cpu[i].nice_time);
-        printf(" %15s | ", cpu_stats.cpu[i].system_mode_time);
-        printf(" %12s | ", cpu_stats.cpu[i].idle_time);
-        printf(" %12s | ", cpu_stats.cpu[i].I_O_wait_time);
-        printf(" %7s | ", cpu_stats.cpu[i].IRQ_time);
-        printf(" %12s | ", cpu_stats.cpu[i].soft_IRQ_time);
-        printf(" %9s | ", cpu_stats.cpu[i].steal_time);
-        printf(" %9s | ", cpu_stats.cpu[i].guest_time);
-        printf(" %15s", cpu_stats.cpu[i].guest_nice_time);
-    }
-    printf("Context Switches: %s", cpu_stats.num_context_switches);
-    printf("Boot Time: %s", cpu_stats.boot_time);
-    printf("Total processes Created: %s", cpu_stats.num_proccesses_created);
-    printf("Processes Running: %s", cpu_stats.proccesses_running);
-    printf("Processes Blocked: %s\n\n", cpu_stats.proccesses_blocked);
+    screen_printf("PSI triggers: %" PRIu64 " alerts\n", pressure_alerts.alerts);
+    for(int i = 0; i < pressure_alerts.num_triggers; i++)
+    {
+        const struct pressure_trigger *trigger = &pressure_alerts.triggers[i];
+        screen_printf("  %-24s fired %" PRIu64 " times\n", trigger->spec, trigger->fired);
+    }
+    for(int i = pressure_alerts.num_recent; i > 0; i--)
+    {
+        screen_printf("  %s\n", pressure_alerts.recent[(pressure_alerts.alerts - (uint64_t)i) % PRESSURE_RECENT_ALERTS]);
+    }
+    screen_printf("\n");
 }
 
 /*
-* @breif display network info struct
+* @brief Prints how many rules there are and fire, the ones firing, and
+*        the latest alerts.
 */
-void display_network_info()
-{
-    printf("-------------------------------------------------------------------");
-    printf("-------------------------------------------------------------------\n");
-    printf("Face         | ");
-    printf("R Bytes      | ");
-    printf("R Packets    | ");
-    printf("R errs       | ");
-    printf("R drop       | ");
-    printf("R fifo       | ");
-    printf("R frame      | ");
-    printf("R compressed | ");
-    printf("R multicast  |");
-    printf("\n             ");
-    printf("| T Bytes      | ");
-    printf("T Packets    | ");
-    printf("T errs       | ");
-    printf("T drop       | ");
-    printf("T fifo       | ");
-    printf("T frame      | ");
-    printf("T compressed | \n");
-    printf("-------------------------------------------------------------------");
-    printf("-------------------------------------------------------------------\n");
-    for(int i = 0; i < network_info.num_devices;i++)
-    {
-        printf("%12s |", network_info.devices[i].face);
-        printf("%13s |", network_info.devices[i].r_bytes);
-        printf("%13s |", network_info.devices[i].r_packets);
-        printf("%13s |", network_info.devices[i].r_errs);
-        printf("%13s |", network_info.devices[i].r_drop);
-        printf("%13s |", network_info.devices[i].r_fifo);
-        printf("%13s |", network_info.devices[i].r_frame);
-        printf("%13s |", network_info.devices[i].r_compressed);
-        printf("%13s |", network_info.devices[i].r_multicast);
-        printf("\n             |");
-        printf("%13s |", network_info.devices[i].t_bytes);
-        printf("%13s |", network_info.devices[i].t_packets);
-        printf("%13s |", network_info.devices[i].t_errs);
-        printf("%13s |", network_info.devices[i].t_drop);
-        printf("%13s |", network_info.devices[i].t_fifo);
-        printf("%13s |", network_info.devices[i].t_frame);
-        printf("%13s |\n", network_info.devices[i].t_compressed);
-        printf("-------------------------------------------------------------------");
-        printf("-------------------------------------------------------------------\n\n");
-    }
-}
-
-/*
-* @breif allocates space for cpu_struct dynamically
-*/
-void alloc_cpu_struct()
-{
-    for(int i = 0; i < NUM_CPU_LINES; i++) {
-        cpu_stats.cpu[i].name = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-        cpu_stats.cpu[i].user_mode = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-        cpu_stats.cpu[i].nice_time = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-        cpu_stats.cpu[i].system_mode_time = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-        cpu_stats.cpu[i].idle_time = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-        cpu_stats.cpu[i].I_O_wait_time = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-        cpu_stats.cpu[i].IRQ_time = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-        cpu_stats.cpu[i].soft_IRQ_time = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-        cpu_stats.cpu[i].steal_time = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-        cpu_stats.cpu[i].guest_time = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-        cpu_stats.cpu[i].guest_nice_time = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-    }
-    cpu_stats.num_context_switches = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-    cpu_stats.boot_time = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-    cpu_stats.num_proccesses_created = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-    cpu_stats.proccesses_running = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-    cpu_stats.proccesses_blocked = (char*)malloc(MAX_CPU_DATA_SIZE * sizeof(char));
-}
-
-/*
-* @breif Frees space allocated to cpu_struct
-*/
-void free_cpu_struct()
-{
-    for(int i = 0; i < NUM_CPU_LINES; i++) {
-        if(cpu_stats.cpu[i].name != NULL) free(cpu_stats.cpu[i].name);
-        if(cpu_stats.cpu[i].user_mode != NULL) free(cpu_stats.cpu[i].user_mode);
-        if(cpu_stats.cpu[i].nice_time != NULL) free(cpu_stats.cpu[i].nice_time);
-        if(cpu_stats.cpu[i].system_mode_time != NULL) free(cpu_stats.cpu[i].system_mode_time);
-        if(cpu_stats.cpu[i].idle_time != NULL) free(cpu_stats.cpu[i].idle_time);
-        if(cpu_stats.cpu[i].I_O_wait_time != NULL) free(cpu_stats.cpu[i].I_O_wait_time);
-        if(cpu_stats.cpu[i].IRQ_time != NULL) free(cpu_stats.cpu[i].IRQ_time);
-        if(cpu_stats.cpu[i].soft_IRQ_time != NULL) free(cpu_stats.cpu[i].soft_IRQ_time);
-        if(cpu_stats.cpu[i].steal_time != NULL) free(cpu_stats.cpu[i].steal_time);
-        if(cpu_stats.cpu[i].guest_time != NULL) free(cpu_stats.cpu[i].guest_time);
-        if(cpu_stats.cpu[i].guest_nice_time != NULL) free(cpu_stats.cpu[i].guest_nice_time);
-    }
-    if(cpu_stats.num_context_switches != NULL) free(cpu_stats.num_context_switches);
-    if(cpu_stats.boot_time != NULL) free(cpu_stats.boot_time);
-    if(cpu_stats.num_proccesses_created != NULL) free(cpu_stats.num_proccesses_created);
-    if(cpu_stats.proccesses_running != NULL) free(cpu_stats.proccesses_running);
-    if(cpu_stats.proccesses_blocked != NULL) free(cpu_stats.proccesses_blocked);
-}
-
-/*
-* @breif allocates space for mem_info struct
-*/
-void alloc_mem_info_struct()
-{
-    mem_info.active = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-    mem_info.buffers = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-    mem_info.cached = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-    mem_info.dirty = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-    mem_info.hardware_corrupted = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-    mem_info.inactive = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-    mem_info.mem_available = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-    mem_info.mem_free = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-    mem_info.mem_total = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-    mem_info.page_tables = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-    mem_info.percpu = (char *)malloc(MAX_MEM_DATA_SIZE * sizeof(char));
-}
-
-/*
-* @breif Frees the mem_info struct
-*/
-void free_mem_info_struct()
+void display_rules()
 {
-    if(mem_info.active != NULL) free(mem_info.active);
-    if(mem_info.buffers != NULL) free(mem_info.buffers);
-    if(mem_info.cached != NULL) free(mem_info.cached);
-    if(mem_info.dirty != NULL) free(mem_info.dirty);
-    if(mem_info.hardware_corrupted != NULL) free(mem_info.hardware_corrupted);
-    if(mem_info.inactive != NULL) free(mem_info.inactive);
-    if(mem_info.mem_available != NULL) free(mem_info.mem_available);
-    if(mem_info.mem_free != NULL) free(mem_info.mem_free);
-    if(mem_info.mem_total != NULL) free(mem_info.mem_total);
-    if(mem_info.page_tables != NULL) free(mem_info.page_tables);
-    if(mem_info.percpu != NULL) free(mem_info.percpu);
+    screen_printf("Rules: %d rules, %d firing, %" PRIu64 " alerts, evaluated in %.1f us\n", rule_set.num_rules,
+                  rule_set.num_firing, rule_set.alerts, (double)rule_set.evaluate_ns / 1000);
+    int shown = 0;
+    for(int i = 0; i < rule_set.num_rules && shown < RULES_SHOWN_FIRING; i++)
+    {
+        const struct rule *rule = &rule_set.rules[i];
+        if(!rule->firing) continue;
+        screen_printf("  firing: %s, value %.6g\n", rule->text, rule->value);
+        shown++;
+    }
+    if(rule_set.num_firing > shown) screen_printf("  and %d more firing\n", rule_set.num_firing - shown);
+    for(int i = rule_set.num_recent; i > 0; i--)
+    {
+        screen_printf("  %s\n", rule_set.recent[(rule_set.alerts - (uint64_t)i) % RULE_RECENT_ALERTS]);
+    }
+    if(rule_set.hooks_skipped > 0) screen_printf("  %" PRIu64 " hooks not run, %d were running\n", rule_set.hooks_skipped, RULE_MAX_HOOKS);
+    screen_printf("\n");
 }
 
 /*
-* @breif allocate network info struct
+* @brief Prints the top irqs by rate, or by count since boot, with the cpus
+*        that took them, and the busiest cpus.
 */
-void alloc_network_info_struct()
+void display_interrupts(int by_rate)
 {
-    for(int i = 0; i < MAX_NETWORK_DEVICES; i++)
+    select_top_interrupts(by_rate);
+    screen_printf("Interrupts: %d irqs on %d cpus", interrupt_stats.num_lines, interrupt_stats.num_columns);
+    if(by_rate && interrupt_rates.columns_match) screen_printf(", %.0f/s in total", interrupt_rates.total_rate);
+    else if(by_rate) screen_printf(", no rates until the next sample");
+    screen_printf("\nBusiest cpus:");
+    for(int i = 0; i < IRQ_SHOWN_BUSIEST_CPUS && interrupt_rates.busiest[i] >= 0; i++)
+    {
+        int column = interrupt_rates.busiest[i];
+        if(by_rate) screen_printf(" cpu%d %.0f/s", interrupt_stats.column_cpu[column], interrupt_rates.cpu_rate[column]);
+        else screen_printf(" cpu%d %" PRIu64, interrupt_stats.column_cpu[column], interrupt_stats.column_total[column]);
+    }
+    screen_printf("\n");
+
+    screen_printf("%-10s | %14s |  Cpus | %-38s | Description\n", "IRQ", by_rate ? "Per s" : "Since boot", "Taken by");
+    for(int i = 0; i < interrupt_rates.num_top; i++)
     {
-        network_info.devices[i].face = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].r_bytes = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].r_packets = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].r_errs = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].r_drop = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].r_fifo = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].r_frame = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].r_compressed = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].r_multicast = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].t_bytes = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].t_packets = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].t_errs = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].t_drop = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].t_fifo = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].t_frame = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
-        network_info.devices[i].t_compressed = (char*)malloc(MAX_NETWORK_DATA_SIZE * sizeof(char));
+        const struct irq_top *top = &interrupt_rates.top[i];
+        const struct irq_line *line = &interrupt_stats.lines[top->line];
+        char taken_by[64];
+        int length = 0;
+        for(int cpu = 0; cpu < IRQ_SHOWN_CPUS && top->cpu[cpu] >= 0; cpu++)
+        {
+            length += snprintf(taken_by + length, sizeof(taken_by) - (size_t)length, "%scpu%d %.0f%%",
+                               cpu > 0 ? ", " : "", top->cpu[cpu], top->share[cpu]);
+        }
+        if(by_rate) screen_printf("%-10s | %14.1f |", line->name, interrupt_rates.lines[top->line].rate);
+        else screen_printf("%-10s | %14" PRIu64 " |", line->name, line->total);
+        screen_printf(" %5d | %-38s | %s\n", top->num_cpus, taken_by, line->description);
     }
+    screen_printf("\n");
 }
 
 /*
-* @breif free network info struct
+* @brief Prints the top processes of the last proc-top refresh and what the
+*        refresh cost.
 */
-void free_network_info_struct()
+void display_proc_top()
 {
-    for(int i = 0; i < MAX_NETWORK_DEVICES; i++)
+    screen_printf("Processes: %d tracked, %d descriptors kept open, %d new, %d exited; refresh %.1f ms on %d threads",
+                  proc_top.num_entries, proc_top.fds_open, proc_top.num_new, proc_top.num_exited,
+                  (double)proc_top.refresh_ns / 1e6, proc_top.num_threads);
+    if(proc_top.scanned) screen_printf(", directory listed in %.1f ms\n", (double)proc_top.scan_ns / 1e6);
+    else screen_printf(", no new pids\n");
+
+    screen_printf("    PID | %-15s |  CPU %% |     RSS MB |    Read B/s |   Write B/s | Switches/s |  (by %s)\n", "Name",
+                  proc_sort_names[proc_top.sort]);
+    for(int i = 0; i < proc_top.num_top; i++)
     {
-        if(network_info.devices[i].face != NULL) free(network_info.devices[i].face);
-        if(network_info.devices[i].r_bytes != NULL) free(network_info.devices[i].r_bytes);
-        if(network_info.devices[i].r_packets != NULL) free(network_info.devices[i].r_packets);
-        if(network_info.devices[i].r_errs != NULL) free(network_info.devices[i].r_errs);
-        if(network_info.devices[i].r_drop != NULL) free(network_info.devices[i].r_drop);
-        if(network_info.devices[i].r_fifo != NULL) free(network_info.devices[i].r_fifo);
-        if(network_info.devices[i].r_frame != NULL) free(network_info.devices[i].r_frame);
-        if(network_info.devices[i].r_compressed != NULL) free(network_info.devices[i].r_compressed);
-        if(network_info.devices[i].r_multicast != NULL) free(network_info.devices[i].r_multicast);
-        if(network_info.devices[i].t_bytes != NULL) free(network_info.devices[i].t_bytes);
-        if(network_info.devices[i].t_packets != NULL) free(network_info.devices[i].t_packets);
-        if(network_info.devices[i].t_errs != NULL) free(network_info.devices[i].t_errs);
-        if(network_info.devices[i].t_drop != NULL) free(network_info.devices[i].t_drop);
-        if(network_info.devices[i].t_fifo != NULL) free(network_info.devices[i].t_fifo);
-        if(network_info.devices[i].t_frame != NULL) free(network_info.devices[i].t_frame);
-        if(network_info.devices[i].t_compressed != NULL) free(network_info.devices[i].t_compressed);
+        const struct proc_entry *entry = &proc_top.entries[proc_top.top[i]];
+        screen_printf("%7d | %-15s | %6.1f | %10.1f | %11.0f | %11.0f | %10.0f |\n", entry->pid, entry->comm,
+                      entry->cpu_pct, (double)entry->rss_pages * proc_top.page_size / 1048576,
+                      entry->read_rate, entry->write_rate, entry->switch_rate);
     }
+    screen_printf("\n");
 }
 
 /*
-* @breif Inits globals and allocates space for structs
+* @brief Prints a column of a cgroup, a dash when the file it comes from
+*        is missing.
 */
-void init_progam()
+void display_cgroup_column(const struct cgroup_entry *entry, int file, int width, int precision, double value)
 {
+    if(entry->missing & (1u << file)) screen_printf(" %*s |", width, "-");
+    else screen_printf(" %*.*f |", width, precision, value);
+}
 
-    open_proc_files();
+/*
+* @brief Prints the top cgroups by rate, or by what they used since they
+*        were created, with how the tree is kept up to date.
+*/
+void display_cgroups(int by_rate)
+{
+    select_top_cgroups(by_rate);
+    screen_printf("Cgroups: %d under %s, %d descriptors kept open, %" PRIu64 " added, %" PRIu64 " removed, %" PRIu64
+                  " inotify events; sampled in %.1f ms, walked %" PRIu64 " times, last in %.1f ms",
+                  cgroup_tree.num_cgroups, cgroup_tree.root, cgroup_tree.fds_open, cgroup_tree.added, cgroup_tree.removed,
+                  cgroup_tree.events_read, (double)cgroup_tree.sample_duration_ns / 1e6, cgroup_tree.walks,
+                  (double)cgroup_tree.walk_ns / 1e6);
+    if(cgroup_tree.unwatched > 0) screen_printf(", %d directories not watched", cgroup_tree.unwatched);
+    screen_printf("\n");
+
+    if(by_rate)
+    {
+        screen_printf("%-32s |  CPU %% | Thrott %% |  Memory MB |  Anon MB |  File MB |  Read B/s | Write B/s |   IO/s |"
+                      " Stalled cpu %% | mem %% |  io %% |  (by %s)\n", "Cgroup", cgroup_sort_names[cgroup_tree.sort]);
+    }
+    else
+    {
+        screen_printf("%-32s |  CPU s | Thrott s |  Memory MB |  Anon MB |  File MB |   Read MB | Written MB |    IOs |"
+                      " Some avg10 cpu | mem %% |  io %% |  (by %s)\n", "Cgroup", cgroup_sort_names[cgroup_tree.sort]);
+    }
+    for(int i = 0; i < cgroup_tree.num_top; i++)
+    {
+        const struct cgroup_entry *entry = &cgroup_tree.entries[cgroup_tree.top[i]];
+        size_t length = strlen(entry->path);
+        if(length > 32) screen_printf("...%-29s |", entry->path + length - 29);
+        else screen_printf("%-32s |", entry->path);
+        if(by_rate)
+        {
+            display_cgroup_column(entry, CGROUP_CPU_STAT, 6, 1, entry->cpu_pct);
+            display_cgroup_column(entry, CGROUP_CPU_STAT, 8, 1, entry->throttled_pct);
+        }
+        else
+        {
+            display_cgroup_column(entry, CGROUP_CPU_STAT, 6, 0, (double)entry->usage_usec / 1e6);
+            display_cgroup_column(entry, CGROUP_CPU_STAT, 8, 0, (double)entry->throttled_usec / 1e6);
+        }
+        display_cgroup_column(entry, CGROUP_MEMORY_CURRENT, 10, 1, (double)entry->memory_bytes / 1048576);
+        display_cgroup_column(entry, CGROUP_MEMORY_STAT, 8, 1, (double)entry->anon_bytes / 1048576);
+        display_cgroup_column(entry, CGROUP_MEMORY_STAT, 8, 1, (double)entry->file_bytes / 1048576);
+        if(by_rate)
+        {
+            display_cgroup_column(entry, CGROUP_IO_STAT, 9, 0, entry->read_rate);
+            display_cgroup_column(entry, CGROUP_IO_STAT, 9, 0, entry->write_rate);
+            display_cgroup_column(entry, CGROUP_IO_STAT, 6, 0, entry->io_rate);
+        }
+        else
+        {
+            display_cgroup_column(entry, CGROUP_IO_STAT, 9, 1, (double)entry->read_bytes / 1048576);
+            display_cgroup_column(entry, CGROUP_IO_STAT, 10, 1, (double)entry->write_bytes / 1048576);
+            display_cgroup_column(entry, CGROUP_IO_STAT, 6, 0, (double)entry->ios);
+        }
+        for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+        {
+            double stall = by_rate ? entry->stall_pct[resource] : entry->some_avg10[resource] / 100.0;
+            display_cgroup_column(entry, CGROUP_CPU_PRESSURE + resource, resource == 0 ? 13 : 5, 2, stall);
+        }
+        screen_printf("\n");
+    }
+    screen_printf("\n");
+}
+
+/*
+* @brief Writes a value of an analysed metric, in exponent form once it
+*        would not fit a column.
+*/
+void format_analysis_value(char *text, size_t size, double value)
+{
+    snprintf(text, size, value < 1e7 ? "%.2f" : "%.3e", value);
+}
 
-    alloc_cpu_struct();
-    alloc_mem_info_struct();
-    alloc_network_info_struct();
+/*
+* @brief Writes a span of time in seconds, minutes or hours.
+*/
+void format_span(char *text, size_t size, uint64_t ns)
+{
+    double seconds = (double)ns / 1e9;
+    if(seconds < 120) snprintf(text, size, "%.0fs", seconds);
+    else if(seconds < 7200) snprintf(text, size, "%.1fm", seconds / 60);
+    else snprintf(text, size, "%.1fh", seconds / 3600);
 }
 
 /*
-* @breif Closes open files and frees space from structs
+* @brief Prints the summary analyze_recording made of each metric.
 */
-void cleanup_program()
+void display_analysis(const char *path)
 {
+    if(analysis.rebuilt_index) screen_printf("%s was not closed, rebuilt its index\n", path);
+    if(analysis.samples == 0)
+    {
+        screen_printf("%s has no two samples in a row to take rates from\n\n", path);
+        return;
+    }
 
-    free_cpu_struct();
-    free_mem_info_struct();
-    free_network_info_struct();
+    char first[32], last[32], span[16];
+    struct tm local;
+    time_t seconds = (time_t)(analysis.first_ns / 1000000000ull);
+    strftime(first, sizeof(first), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &local));
+    seconds = (time_t)(analysis.last_ns / 1000000000ull);
+    strftime(last, sizeof(last), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &local));
+    format_span(span, sizeof(span), analysis.last_ns - analysis.first_ns);
+    screen_printf("Analysis of %s: %" PRIu64 " samples from %s to %s (%s), %d metrics; %.2f s on %d threads, %.1f MB of metrics\n",
+                  path, analysis.samples, first, last, span, analysis.table.num_metrics, (double)analysis.duration_ns / 1e9,
+                  analysis.num_threads, (double)analysis.memory / 1048576);
+
+    char peak_title[32];
+    snprintf(peak_title, sizeof(peak_title), "Peak %s mean at", history_window_names[history_window]);
+    screen_printf("%-32s |    Samples |       Mean |        p50 |        p90 |        p99 |      p99.9 |        Max |"
+                  " %-28s | Threshold |  Above | Longest\n", "Metric", peak_title);
+    for(int i = 0; i < analysis.table.num_metrics; i++)
+    {
+        const struct analysis_metric *metric = &analysis.table.metrics[i];
+        double values[] = {metric->sum / (double)metric->count, analysis_percentile(metric, 0.5), analysis_percentile(metric, 0.9),
+                           analysis_percentile(metric, 0.99), analysis_percentile(metric, 0.999), metric->max,
+                           metric->peak.sum / (double)metric->peak.count};
+        char text[16];
+        screen_printf("%-32s | %10" PRIu64 " |", metric->name, metric->count);
+        for(size_t v = 0; v < sizeof(values) / sizeof(values[0]); v++)
+        {
+            format_analysis_value(text, sizeof(text), values[v]);
+            screen_printf(" %10s %s", text, v + 1 < sizeof(values) / sizeof(values[0]) ? "|" : "at");
+        }
+        char when[32];
+        seconds = (time_t)(metric->peak.start_ns / 1000000000ull);
+        strftime(when, sizeof(when), "%m-%d %H:%M:%S", localtime_r(&seconds, &local));
+        screen_printf(" %-14s |", when);
+
+        if(isnan(metric->threshold))
+        {
+            screen_printf(" %9s | %6s | -\n", "-", "-");
+            continue;
+        }
+        format_span(span, sizeof(span), metric->longest_above_ns);
+        screen_printf(" %9g | %5.1f%% | %s\n", metric->threshold,
+                      metric->covered_ns > 0 ? 100.0 * (double)metric->above_ns / (double)metric->covered_ns : 0, span);
+    }
+    screen_printf("\n");
+}
 
-    close_proc_files();
+/*
+* @breif Inits globals and allocates space for structs
+*/
+void init_progam()
+{
+    init_self_stats();
+    if(network_backend == NETWORK_BACKEND_NETLINK && strcmp(proc_root, PROC_ROOT) != 0)
+    {
+        fatal_error("--net-backend netlink reads the running kernel and cannot be used with --proc-root ", proc_root);
+    }
+    if(network_backend == NETWORK_BACKEND_NETLINK && use_pipeline)
+    {
+        fatal_error("--pipeline reads /proc/net/dev on the network thread and cannot be used with --net-backend ", "netlink");
+    }
+    init_collectors();
+}
 
+/*
+* @breif Closes open proc files and frees their buffers
+*/
+void cleanup_program()
+{
+    free_histories();
+    free_high_freq();
+    free_proc_top();
+    close_cgroups();
+    free_analysis();
+    close_disk_info();
+    close_interrupts();
+    close_pressure_alerts();
+    close_pressure();
+    close_rules();
+    close_exporter();
+    close_shm_publisher();
+    free_pipeline();
+    close_collectors();
+    free(network_order);
+    if(have_network_regex) regfree(&network_regex);
 }
 
 /*
@@ -583,94 +982,1184 @@ void print_usage()
     printf("Run with one or more of the following arguments:\n");
     printf("cpu-stats            Displays cpu stats\n");
     printf("mem-info             Displays information on memory usage\n");
-    printf("network-info         Display information on network info\n\n");
-    printf("Run with only one of these arguments\n");
+    printf("network-info         Display information on network info\n");
+    printf("disk-info            Displays disk I/O counters and filesystem capacity\n");
+    printf("interrupts           Displays the irqs with the most interrupts since boot\n");
+    printf("pressure             Displays the cpu, memory and io stall averages of /proc/pressure\n");
+    printf("cgroup-info          Displays the cgroups that used the most cpu, or --cgroup-sort, since\n");
+    printf("                     they were created\n");
+    printf("replay FILE          Replays a recording through the loop mode displays\n");
+    printf("analyze FILE         Prints the mean, percentiles, peak --window and time above\n");
+    printf("                     --threshold of each metric of a recording, read on --threads\n");
+    printf("read-shm             Displays the sample publish-shm last put in shared memory\n\n");
+    printf("Run with any of these arguments together, until Ctrl-C\n");
     printf("cpu-status-loop      Displays cpu stats on loop\n");
     printf("mem-info-loop        Displays information on memory usage on loop\n");
     printf("network-info-loop    Display information on network info on loop\n");
+    printf("disk-info-loop       Displays disk I/O rates and filesystem capacity on loop\n");
+    printf("interrupts-loop      Displays the busiest irqs and the cpus taking them on loop\n");
+    printf("pressure-loop        Displays the stall averages and the time stalled on loop\n");
+    printf("pressure-alert       Registers --psi-trigger with the kernel and, only when one fires,\n");
+    printf("                     samples the other collectors and prints an alert line\n");
+    printf("high-freq-loop       Samples cpu and network every --hf-interval within --budget-us\n");
+    printf("proc-top             Displays the processes using the most cpu, or --sort\n");
+    printf("cgroup-info-loop     Displays the cgroups using the most cpu, or --cgroup-sort, on loop\n");
+    printf("record FILE          Records cpu, memory and network samples to FILE\n");
+    printf("export ADDRESS       Serves the latest cpu, memory, network and disk sample over HTTP\n");
+    printf("                     as Prometheus text on /metrics and JSON on /metrics.json. ADDRESS\n");
+    printf("                     is PORT for 127.0.0.1, HOST:PORT, or unix:PATH for a Unix socket\n");
+    printf("publish-shm          Publishes the latest cpu, memory and network sample to shared\n");
+    printf("                     memory, --shm-name, for readers linking libsysmonshm.a\n\n");
+    printf("Options\n");
+    printf("--raw                Loop modes show cumulative counters instead of rates\n");
+    printf("--proc-root DIR      Read the proc files from DIR instead of /proc\n");
+    printf("--self-stats         Print the latency of each collector and renderer and what\n");
+    printf("                     sys_mon itself uses, on every frame and when it exits\n");
+    printf("--history SECONDS    How many seconds of samples the loop modes keep, 300 by default\n");
+    printf("--history-interfaces N How many interfaces the network history keeps, allocated at\n");
+    printf("                     startup, 128 by default\n");
+    printf("--window 10s|1m|5m   Window of the avg/max/p95 columns in the loop modes and of the\n");
+    printf("                     peaks of analyze, 1m by default\n");
+    printf("--speed X            Replay X times faster than recorded, 0 for no waiting, 1 by default\n");
+    printf("--from TIME          Start the replay at unix time TIME, or +SECONDS into the recording\n");
+    printf("--threshold GLOB=VALUE What analyze counts the time above for the metrics matching\n");
+    printf("                     GLOB; may be given up to 16 times, '" DEFAULT_ANALYZE_THRESHOLD "' and\n");
+    printf("                     '" DEFAULT_ANALYZE_MEM_THRESHOLD "' by default\n");
+    printf("--metrics GLOB       Metrics analyze summarises, such as 'cpu.*' or 'net.eth0.*'\n");
+    printf("--interval SECONDS   Interval of every loop mode, 1 by default\n");
+    printf("--cpu-interval, --mem-interval, --network-interval, --disk-interval,\n");
+    printf("--irq-interval, --pressure-interval, --record-interval, --export-interval,\n");
+    printf("--shm-interval, --rule-interval SECONDS\n");
+    printf("                     Interval of one loop mode. Samples are taken on multiples of\n");
+    printf("                     the interval since the epoch, the same instants on every host\n");
+    printf("--hf-interval SECONDS Interval of high-freq-loop, 0.01 by default\n");
+    printf("--budget-us N        Time a high-freq-loop tick may take before it leaves collectors\n");
+    printf("                     out of the next ticks, 1%% of --hf-interval by default\n");
+    printf("--cpus LIST          Cpus high-freq-loop samples, such as 0-3,8\n");
+    printf("--interfaces LIST    Interfaces high-freq-loop samples, such as eth0,lo\n");
+    printf("--net-match GLOB     Network tables only show interfaces matching GLOB, such as 'eth*'\n");
+    printf("--net-regex REGEX    Network tables only show interfaces matching an extended REGEX\n");
+    printf("--net-sort total|rx|tx|name|none Order of the network tables, busiest by total bytes first by default\n");
+    printf("--net-top N          Network tables show only the first N interfaces\n");
+    printf("--net-backend proc|netlink Where the interface counters are read from, /proc/net/dev\n");
+    printf("                     or one RTM_GETLINK dump; proc by default\n");
+    printf("--irq-top N          Irqs the interrupt tables show, 10 by default\n");
+    printf("--psi-trigger RESOURCE:some|full:STALL:WINDOW A pressure-alert trigger, such as\n");
+    printf("                     io:full:100ms:1s; may be given up to 8 times, " DEFAULT_PRESSURE_TRIGGER " by default\n");
+    printf("--rule EXPRESSION    Prints an alert when EXPRESSION starts and stops holding, such as\n");
+    printf("                     'cpu.iowait_pct > 20 for 5s' or 'net.eth0.rx_drop_rate > 100'; may be\n");
+    printf("                     given many times, and runs with the other modes or alone\n");
+    printf("--rule-hook COMMAND  Runs COMMAND with sh on every rule alert, with SYS_MON_RULE,\n");
+    printf("                     SYS_MON_STATE, SYS_MON_VALUE and SYS_MON_ALERT set\n");
+    printf("--proc-top-interval SECONDS Interval of proc-top\n");
+    printf("--top N              Processes proc-top shows, 20 by default\n");
+    printf("--sort cpu|rss|io|switches What proc-top ranks processes by, cpu by default\n");
+    printf("--threads N          Threads proc-top reads processes on and analyze splits a recording\n");
+    printf("                     across, one per cpu up to 8 by default\n");
+    printf("--cgroup-root DIR    Where the cgroup v2 hierarchy is, " CGROUP_ROOT " or " CGROUP_HYBRID_ROOT " by default\n");
+    printf("--cgroup-interval SECONDS Interval of cgroup-info-loop\n");
+    printf("--cgroup-top N       Cgroups the cgroup tables show, 20 by default\n");
+    printf("--cgroup-sort cpu|memory|io|pressure What the cgroup tables rank cgroups by, cpu by default\n");
+    printf("--shm-name NAME      Shared memory object of publish-shm and read-shm, /sys_mon by default\n");
+    printf("--pipeline           Read each collector's proc file on a thread of its own, so slow\n");
+    printf("                     frames or sinks never delay a sample\n");
+    printf("--pin LIST           Pin the --pipeline threads to the cpus in LIST in turn, such as 2-3\n");
 }
 
-void cpu_status()
+/*
+* @brief Prints what the sampler cost since the previous tick. Used by the
+*        loop modes, where the allocation count should stay at zero.
+*/
+void display_sampler_stats(struct sampler_stats *previous)
 {
-    open_proc_files();
-    alloc_cpu_struct();
+    screen_printf("Sampler: %lu allocations, %lu read syscalls, %lu bytes read this tick\n",
+                  sampler_stats.allocations - previous->allocations,
+                  sampler_stats.read_syscalls - previous->read_syscalls,
+                  sampler_stats.bytes_read - previous->bytes_read);
+    *previous = sampler_stats;
+}
 
-    update_cpu_stats();
-    display_cpu_proc();
+/*
+* @brief Prints the latencies of each collector and renderer that ran, and
+*        what sys_mon has used of the machine since it started.
+*/
+void display_self_stats()
+{
+    struct self_usage usage;
+    read_self_usage(&usage);
+    screen_printf("Self: %.1f s, cpu %.2f s (%.2f%% of one core), RSS %.1f MB, max RSS %.1f MB\n",
+                  (double)usage.wall_ns / 1e9, (double)usage.cpu_ns / 1e9,
+                  usage.wall_ns > 0 ? (double)usage.cpu_ns * 100 / usage.wall_ns : 0,
+                  (double)usage.rss_bytes / 1048576, (double)usage.max_rss_bytes / 1048576);
+    screen_printf("Self: %lu proc reads, %lu bytes read, %lu allocations; the kernel counts %" PRIu64 " read and %" PRIu64
+                  " write syscalls, %" PRIu64 " bytes read\n", sampler_stats.read_syscalls, sampler_stats.bytes_read,
+                  sampler_stats.allocations, usage.read_syscalls, usage.write_syscalls, usage.bytes_read);
+    screen_printf("            Probe |      Count |    Mean us |     p50 us |     p99 us |     Max us\n");
+    for(int i = 0; i < NUM_PROBES; i++)
+    {
+        const struct probe *probe = &probes[i];
+        if(probe->count == 0) continue;
+        screen_printf("%17s | %10" PRIu64 " | %10.1f | %10.1f | %10.1f | %10.1f\n", probe_names[i], probe->count,
+                      (double)probe->sum_ns / probe->count / 1000, (double)probe_percentile(probe, 0.5) / 1000,
+                      (double)probe_percentile(probe, 0.99) / 1000, (double)probe->max_ns / 1000);
+    }
+}
 
-    free_cpu_struct();
-    close_proc_files();
+/*
+* @brief Sizes the histories for the loop modes to hold --history seconds
+*        at each collector's interval.
+*
+* @returns the bytes they take
+*/
+size_t start_histories()
+{
+    return init_histories(history_seconds, cpu_interval_ns, mem_interval_ns, network_interval_ns, history_interfaces);
+}
+
+void cpu_status()
+{
+    sample_cpu_stats();
+    display_cpu_proc();
 }
 
 void mem_status()
 {
-    open_proc_files();
-    alloc_mem_info_struct();
+    //The node files of a live system do not go with another proc root
+    if(strcmp(proc_root, PROC_ROOT) == 0) init_node_meminfo(NODE_ROOT);
+    sample_mem_info();
+    display_meminfo_snapshot();
+}
 
-    update_meminfo();
-    display_mem_info();
+void network_status()
+{
+    sample_network_info();
+    display_network_info();
+}
 
-    free_mem_info_struct();
-    close_proc_files();
+void disk_status()
+{
+    sample_disk_info();
+    display_disk_info();
+    display_filesystems();
 }
 
-void network_status()
+void cpu_tick()
+{
+    sample_cpu_stats();
+    record_cpu_history();
+}
+
+void mem_tick()
+{
+    sample_mem_info();
+    record_mem_history();
+}
+
+void network_tick()
+{
+    sample_network_info();
+    record_network_history();
+}
+
+void disk_tick()
 {
-    open_proc_files();
-    alloc_network_info_struct();
+    sample_disk_info();
+}
 
+/*
+* The ticks of the collectors with --pipeline, run on the sinks' thread for
+* a sample their own thread read into the proc source.
+*/
+void cpu_apply()
+{
+    uint64_t start = monotonic_ns();
+    update_cpu_stats();
+    update_cpu_rates();
+    probe_end(PROBE_CPU, start);
+    if(cpu_job != NULL) record_cpu_history();
+}
+
+void mem_apply()
+{
+    uint64_t start = monotonic_ns();
+    update_meminfo();
+    sample_node_meminfo(); //The node files have no thread, read here when opened
+    probe_end(PROBE_MEM, start);
+    if(mem_job != NULL) record_mem_history();
+}
+
+void network_apply()
+{
+    uint64_t start = monotonic_ns();
     update_network_info();
+    update_network_rates();
+    probe_end(PROBE_NETWORK, start);
+    if(network_job != NULL) record_network_history();
+}
+
+void disk_apply()
+{
+    uint64_t start = monotonic_ns();
+    update_disk_stats();
+    update_disk_rates();
+    update_mount_table();
+    update_filesystems();
+    probe_end(PROBE_DISK, start);
+}
+
+void irq_apply()
+{
+    uint64_t start = monotonic_ns();
+    update_interrupt_stats();
+    update_interrupt_rates();
+    probe_end(PROBE_INTERRUPTS, start);
+}
+
+void irq_status()
+{
+    init_interrupts(irq_top_n);
+    sample_interrupts();
+    display_interrupts(0);
+}
+
+/*
+* @brief Displays the sample publish-shm last put in the shared memory
+*        segment name, through the same tables as cpu-stats, mem-info and
+*        network-info.
+*/
+void read_shm(const char *name)
+{
+    struct shm_reader reader;
+    struct shm_snapshot snapshot;
+    if(shm_open_reader(&reader, &snapshot, name) != SHM_OK) fatal_error("no sample published in shared memory as ", name);
+    uint64_t start = monotonic_ns();
+    int result;
+    int backoffs = 0;
+    while((result = shm_read(&reader, &snapshot, SHM_READ_ALL)) != SHM_OK)
+    {
+        if(result == SHM_DEAD) fatal_error("the writer died while updating the shared memory segment ", name);
+        if(result == SHM_BUSY)
+        {
+            //A stopped writer holds the sequence odd until it is continued
+            if(++backoffs > SHM_READ_BACKOFFS) fatal_error("the writer is stuck updating the shared memory segment ", name);
+            usleep(SHM_READ_BACKOFF_US);
+        }
+        else if(shm_reopen(&reader, &snapshot) != SHM_OK) fatal_error("the shared memory segment went away: ", name);
+    }
+    uint64_t read_ns = monotonic_ns() - start;
+
+    const struct shm_summary *summary = &snapshot.summary;
+    if((int)summary->num_cpus != cpu_stats.num_cpus) resize_cpu_stats((int)summary->num_cpus);
+    memcpy(cpu_stats.total.time, summary->cpu_total, sizeof(cpu_stats.total.time));
+    for(uint32_t cpu = 0; cpu < summary->num_cpus; cpu++)
+    {
+        for(int field = 0; field < NUM_CPU_FIELDS; field++) cpu_stats.time[field][cpu] = snapshot.cpus[cpu].time[field];
+        cpu_stats.online[cpu] = (uint8_t)snapshot.cpus[cpu].online;
+    }
+    cpu_stats.num_online = (int)summary->num_online;
+    cpu_stats.num_context_switches = summary->context_switches;
+    cpu_stats.num_interrupts = summary->interrupts;
+    cpu_stats.num_softirqs = summary->softirqs;
+    cpu_stats.boot_time = summary->boot_time;
+    cpu_stats.num_proccesses_created = summary->processes_created;
+    cpu_stats.proccesses_running = summary->processes_running;
+    cpu_stats.proccesses_blocked = summary->processes_blocked;
+
+    //Matched by name, so a writer with other fields still lines up
+    mem_info.present = 0;
+    for(int field = 0; field < NUM_MEM_FIELDS; field++)
+    {
+        size_t length = strlen(mem_field_keys[field]) - 1;
+        for(uint32_t i = 0; i < summary->num_mem && i < reader.mem_capacity; i++)
+        {
+            if(strncmp(reader.names[i], mem_field_keys[field], length) != 0 || reader.names[i][length] != '\0') continue;
+            if(snapshot.mem[i] == SHM_ABSENT) break;
+            mem_info.value[field] = snapshot.mem[i];
+            mem_info.present |= 1u << field;
+            break;
+        }
+    }
+
+    reserve_network_devices((int)summary->num_interfaces);
+    for(uint32_t i = 0; i < summary->num_interfaces; i++)
+    {
+        struct network_device *device = &network_info.devices[i];
+        memcpy(device->face, snapshot.interfaces[i].face, SHM_FACE_LENGTH);
+        device->face[MAX_NETWORK_FACE_LENGTH - 1] = '\0';
+        device->id = -1;
+        memcpy(device->counter, snapshot.interfaces[i].counter, sizeof(device->counter));
+    }
+    network_info.num_devices = (int)summary->num_interfaces;
+
+    char when[32];
+    time_t seconds = (time_t)(summary->sample_ns / 1000000000ull);
+    struct tm local;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &local));
+    printf("Sample at %s from pid %" PRIu64 ", publication %" PRIu64 ", read in %" PRIu64 " ns with %" PRIu64 " retries\n",
+           when, reader.header->writer_pid, summary->publications, read_ns, snapshot.retries);
+    display_cpu_proc();
+    display_mem_info();
     display_network_info();
+    shm_close_reader(&reader, &snapshot);
+}
 
-    free_network_info_struct();
-    close_proc_files();
+void irq_tick()
+{
+    sample_interrupts();
+}
+
+void pressure_tick()
+{
+    sample_pressure();
+}
+
+/*
+* @brief Finds the pressure files, exiting if the kernel has none.
+*/
+void open_pressure()
+{
+    if(init_pressure() == 0) fatal_error("no pressure files in ", "the proc root, the kernel was built without PSI");
+}
+
+void pressure_status()
+{
+    open_pressure();
+    sample_pressure();
+    display_pressure();
+}
+
+/*
+* @brief Handles a PSI trigger that fired: samples what the other
+*        collectors see at that moment, those a loop mode samples already
+*        aside, and writes an alert line of it, printed when sys_mon runs
+*        as a daemon and otherwise shown on the next frame.
+*
+* @returns 1 to redraw the screen
+*/
+int pressure_alert(const struct pressure_trigger *trigger)
+{
+    uint64_t start = monotonic_ns();
+    if(cpu_job == NULL) sample_cpu_stats();
+    if(mem_job == NULL) sample_mem_info();
+    if(pressure_job == NULL) sample_pressure();
+
+    char when[32];
+    time_t seconds = (time_t)(trigger->last_fired_ns / 1000000000ull);
+    struct tm local;
+    strftime(when, sizeof(when), "%H:%M:%S", localtime_r(&seconds, &local));
+    const uint64_t *memory = meminfo_snapshot.value;
+    char *line = next_pressure_alert();
+    int length = snprintf(line, PRESSURE_ALERT_LENGTH, "%s.%03" PRIu64 " %s: some avg10 cpu %.2f%% memory %.2f%% io %.2f%%, "
+                          "%" PRIu64 " running %" PRIu64 " blocked", when, trigger->last_fired_ns / 1000000 % 1000, trigger->spec,
+                          pressure_stats.line[PRESSURE_CPU][PRESSURE_SOME].average[PRESSURE_AVG10] / 100.0,
+                          pressure_stats.line[PRESSURE_MEMORY][PRESSURE_SOME].average[PRESSURE_AVG10] / 100.0,
+                          pressure_stats.line[PRESSURE_IO][PRESSURE_SOME].average[PRESSURE_AVG10] / 100.0,
+                          cpu_stats.proccesses_running, cpu_stats.proccesses_blocked);
+    if(cpu_rates.have_previous && length < PRESSURE_ALERT_LENGTH)
+    {
+        //Over the two latest cpu samples, the loop mode's or this alert's and the previous alert's
+        length += snprintf(line + length, PRESSURE_ALERT_LENGTH - (size_t)length, ", cpu %.0f%% busy %.0f%% iowait over %.1f s",
+                           cpu_rates.total[CPU_RATE_BUSY], cpu_rates.total[CPU_RATE_IOWAIT], (double)cpu_rates.span_ns / 1e9);
+    }
+    if(length < PRESSURE_ALERT_LENGTH)
+    {
+        snprintf(line + length, PRESSURE_ALERT_LENGTH - (size_t)length, ", available %" PRIu64 " MB dirty %" PRIu64
+                 " MB writeback %" PRIu64 " MB, taken in %.0f us", memory[MEMINFO_MEMAVAILABLE] / 1024,
+                 memory[MEMINFO_DIRTY] / 1024, memory[MEMINFO_WRITEBACK] / 1024, (double)(monotonic_ns() - start) / 1000);
+    }
+    if(!drawing_frames)
+    {
+        printf("%s\n", line);
+        fflush(stdout);
+    }
+    return drawing_frames;
+}
+
+void cgroup_tick()
+{
+    uint64_t start = monotonic_ns();
+    sample_cgroups(start);
+    probe_end(PROBE_CGROUP, start);
+}
+
+/*
+* @brief Walks the cgroup hierarchy at --cgroup-root, or where cgroup v2 is
+*        mounted.
+*/
+void open_cgroups()
+{
+    init_cgroups(cgroup_root != NULL ? cgroup_root : find_cgroup_root(), cgroup_top_n, cgroup_sort);
+}
+
+void cgroup_status()
+{
+    if(cgroup_tree.root_fd < 0) open_cgroups();
+    sample_cgroups(monotonic_ns());
+    display_cgroups(0);
+}
+
+void proc_top_tick()
+{
+    uint64_t start = monotonic_ns();
+    refresh_proc_top();
+    probe_end(PROBE_PROC_TOP, start);
+}
+
+/*
+* @brief Appends a sample of every collector to the recording, stamped
+*        with the deadline it was taken for.
+*/
+void record_tick()
+{
+    if(!pipeline.active)
+    {
+        sample_cpu_stats();
+        sample_mem_info();
+        sample_network_info();
+    }
+    uint64_t start = monotonic_ns();
+    record_sample(&recorder, scheduler_tick_ns);
+    probe_end(PROBE_RECORD, start);
+}
+
+/*
+* @brief Samples the collectors for the exporter and shared memory, once
+*        per deadline however many of them run at it. A collector a loop
+*        mode also runs is left to it, as sampling it twice at the same
+*        deadline would leave its rates over no time at all; the sinks take
+*        its latest sample. With --pipeline every collector they need has a
+*        thread, and they take its latest sample too.
+*/
+void sample_for_sinks(int with_disk)
+{
+    static uint64_t sampled_ns = UINT64_MAX;
+    static uint64_t disk_sampled_ns = UINT64_MAX;
+    if(pipeline.active) return;
+    if(sampled_ns != scheduler_tick_ns)
+    {
+        sampled_ns = scheduler_tick_ns;
+        if(cpu_job == NULL) sample_cpu_stats();
+        if(mem_job == NULL) sample_mem_info();
+        if(network_job == NULL) sample_network_info();
+    }
+    if(with_disk && disk_sampled_ns != scheduler_tick_ns)
+    {
+        disk_sampled_ns = scheduler_tick_ns;
+        if(disk_job == NULL) sample_disk_info();
+    }
+}
+
+/*
+* @brief Prints an alert line of a rule when sys_mon runs as a daemon, the
+*        screen shows it otherwise.
+*/
+void rule_alert(const char *line)
+{
+    if(drawing_frames) return;
+    printf("%s\n", line);
+    fflush(stdout);
+}
+
+/*
+* @brief Samples what the rules read, the collectors the sinks sample and
+*        pressure when a rule reads it, unless a loop mode samples them.
+*/
+void sample_for_rules()
+{
+    sample_for_sinks((rule_set.sources & RULE_SOURCE_DISK) != 0);
+    if((rule_set.sources & RULE_SOURCE_PRESSURE) && pressure_job == NULL) sample_pressure();
+}
+
+void rules_tick()
+{
+    sample_for_rules();
+    evaluate_rules(scheduler_tick_ns > 0 ? scheduler_tick_ns : realtime_ns());
+}
+
+/*
+* @brief Evaluates the --rule given on every sample from the next deadline on.
+*/
+void start_rules()
+{
+    if(rule_set.sources & RULE_SOURCE_PRESSURE) open_pressure();
+    open_rules(rule_alert);
+    rules_job = schedule_job("rules", rules_interval_ns, rules_tick);
+    rules_job->quiet = 1;
+}
+
+void export_tick()
+{
+    sample_for_sinks(1);
+    publish_export_snapshot(scheduler_tick_ns > 0 ? scheduler_tick_ns : realtime_ns());
+}
+
+void shm_tick()
+{
+    sample_for_sinks(0);
+    publish_shm_snapshot(scheduler_tick_ns > 0 ? scheduler_tick_ns : realtime_ns());
+}
+
+/*
+* @brief Prints the interval, missed deadlines and jitter of each collector
+*        the scheduler runs.
+*/
+void display_scheduler_stats()
+{
+    screen_printf("Collector |   Interval |      Ticks |     Missed | Jitter avg | Jitter max\n");
+    for(int i = 0; i < num_scheduled_jobs; i++)
+    {
+        struct scheduled_job *job = &scheduled_jobs[i];
+        uint64_t ticks = __atomic_load_n(&job->ticks, __ATOMIC_RELAXED);
+        uint64_t jitter_sum_ns = __atomic_load_n(&job->jitter_sum_ns, __ATOMIC_RELAXED);
+        double average_us = ticks > 0 ? (double)jitter_sum_ns / ticks / 1000 : 0;
+        screen_printf("%9s | %8.3f s | %10" PRIu64 " | %10" PRIu64 " | %7.0f us | %7.0f us\n", job->name,
+                      (double)job->interval_ns / 1e9, ticks, __atomic_load_n(&job->missed, __ATOMIC_RELAXED), average_us,
+                      (double)__atomic_load_n(&job->jitter_max_ns, __ATOMIC_RELAXED) / 1000);
+    }
+}
+
+/*
+* @brief Prints the queue of each collector thread: samples read, those
+*        dropped as a newer one was published before the sinks took them,
+*        and the time from a read to its sample being applied.
+*/
+void display_pipeline_stats()
+{
+    screen_printf("Thread    |  Cpu |       Read |    Dropped |    Read | Latency avg | Latency max\n");
+    for(int i = 0; i < pipeline.num_stages; i++)
+    {
+        const struct pipeline_stage *stage = &pipeline.stages[i];
+        const struct pipeline_queue *queue = &stage->queue;
+        char cpu[16];
+        if(stage->cpu >= 0) snprintf(cpu, sizeof(cpu), "%d", stage->cpu);
+        else snprintf(cpu, sizeof(cpu), "-");
+        double average_us = stage->applied > 0 ? (double)stage->latency_sum_ns / stage->applied / 1000 : 0;
+        screen_printf("%9s | %4s | %10" PRIu64 " | %10" PRIu64 " | %4.0f us | %8.0f us | %8.0f us\n",
+                      stage->job->name, cpu, __atomic_load_n(&queue->published, __ATOMIC_RELAXED),
+                      __atomic_load_n(&queue->dropped, __ATOMIC_RELAXED),
+                      (double)__atomic_load_n(&stage->read_ns, __ATOMIC_RELAXED) / 1000, average_us,
+                      (double)stage->latency_max_ns / 1000);
+    }
+}
+
+/*
+* @brief Draws a frame of the loop modes, so any mix of them shares the
+*        screen without knowing each other's height.
+*/
+void render_loop_modes()
+{
+    static struct sampler_stats previous;
+    uint64_t frame_start = monotonic_ns();
+    uint64_t start;
+    char when[32];
+    time_t seconds = (time_t)(scheduler_tick_ns / 1000000000ull);
+    struct tm local;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &local));
+
+    screen_begin_frame();
+    screen_printf("Sample at %s.%03" PRIu64 "\n", when, scheduler_tick_ns / 1000000 % 1000);
+    if(cpu_job != NULL)
+    {
+        start = monotonic_ns();
+        if(show_raw_counters) display_cpu_proc();
+        else display_cpu_rates();
+        probe_end(PROBE_RENDER_CPU, start);
+    }
+    if(mem_job != NULL)
+    {
+        start = monotonic_ns();
+        if(show_raw_counters) display_mem_info();
+        else display_mem_history();
+        probe_end(PROBE_RENDER_MEM, start);
+    }
+    if(network_job != NULL)
+    {
+        start = monotonic_ns();
+        if(show_raw_counters) display_network_info();
+        else display_network_rates();
+        probe_end(PROBE_RENDER_NETWORK, start);
+    }
+    if(disk_job != NULL)
+    {
+        start = monotonic_ns();
+        if(show_raw_counters) display_disk_info();
+        else display_disk_rates();
+        display_filesystems();
+        probe_end(PROBE_RENDER_DISK, start);
+    }
+    if(irq_job != NULL)
+    {
+        start = monotonic_ns();
+        display_interrupts(!show_raw_counters);
+        probe_end(PROBE_RENDER_INTERRUPTS, start);
+    }
+    if(pressure_job != NULL)
+    {
+        start = monotonic_ns();
+        display_pressure();
+        probe_end(PROBE_RENDER_PRESSURE, start);
+    }
+    if(pressure_alerts.active) display_pressure_alerts();
+    if(rules_job != NULL) display_rules();
+    if(high_freq_job != NULL)
+    {
+        start = monotonic_ns();
+        display_high_freq();
+        probe_end(PROBE_RENDER_HIGH_FREQ, start);
+    }
+    if(proc_top_job != NULL)
+    {
+        start = monotonic_ns();
+        display_proc_top();
+        probe_end(PROBE_RENDER_PROC_TOP, start);
+    }
+    if(cgroup_job != NULL)
+    {
+        start = monotonic_ns();
+        display_cgroups(!show_raw_counters);
+        probe_end(PROBE_RENDER_CGROUP, start);
+    }
+    if(record_job != NULL)
+    {
+        screen_printf("Recording to %s: %" PRIu64 " samples, %" PRIu64 " bytes, %.1f bytes/sample\n\n", recorder.path,
+                      recorder.num_samples, recorder.offset,
+                      recorder.num_samples > 0 ? (double)(recorder.offset - RECORD_MAGIC_LENGTH) / recorder.num_samples : 0);
+    }
+    if(export_job != NULL)
+    {
+        screen_printf("Exporting on %s: %d clients, %" PRIu64 " requests, %" PRIu64 " bytes sent, "
+                      "last sample written in %.0f us\n\n", exporter.address, exporter.num_clients, exporter.requests,
+                      exporter.bytes_sent, (double)exporter.serialise_ns / 1000);
+    }
+    if(shm_job != NULL)
+    {
+        screen_printf("Publishing to shared memory %s: %" PRIu64 " samples, %zu KB, last written in %.1f us\n\n",
+                      shm_publisher.name, shm_publisher.publications, shm_publisher.size / 1024,
+                      (double)shm_publisher.publish_ns / 1000);
+    }
+    display_scheduler_stats();
+    if(pipeline.active) display_pipeline_stats();
+    history_memory = cpu_history.memory + mem_history.memory + network_history.memory;
+    screen_printf("History: last %d s of every metric, %zu KB", history_seconds, history_memory / 1024);
+    if(network_history_overflow > 0) screen_printf(", %d interfaces past --history-interfaces not kept", network_history_overflow);
+    screen_printf("\n");
+    display_sampler_stats(&previous);
+    if(show_self_stats) display_self_stats();
+    screen_printf("Terminal: %zu bytes written for the last frame, %zu without diffing\n", screen.last_bytes,
+                  screen.last_frame_bytes);
+    screen_end_frame();
+    probe_end(PROBE_RENDER_FRAME, frame_start);
+}
+
+/*
+* @brief Gives a collector a thread with --pipeline: the one of its loop
+*        mode, job, or if there is none but a sink needs it, a quiet one.
+*/
+void add_collector_thread(struct scheduled_job *job, int for_sinks, const char *name, uint64_t interval_ns,
+                          struct proc_source *source, void (*apply)(), int *num_threads)
+{
+    static int pin_cpus[MAX_PIPELINE_STAGES];
+    static int num_pin_cpus = -1;
+    if(num_pin_cpus < 0)
+    {
+        //The cpus of --pin, handed to the threads in turn
+        num_pin_cpus = 0;
+        long first, last;
+        const char *cursor = pin_list != NULL ? pin_list : "";
+        while(*cursor != '\0' && num_pin_cpus < MAX_PIPELINE_STAGES)
+        {
+            if(next_cpu_range(&cursor, &first, &last) != 0) fatal_error("--pin takes a list such as 0-3,8, not ", pin_list);
+            for(long cpu = first; cpu <= last && num_pin_cpus < MAX_PIPELINE_STAGES; cpu++) pin_cpus[num_pin_cpus++] = (int)cpu;
+        }
+    }
+
+    if(job == NULL && !for_sinks) return;
+    if(job == NULL)
+    {
+        job = schedule_job(name, interval_ns, NULL);
+        job->quiet = 1;
+    }
+    int cpu = num_pin_cpus > 0 ? pin_cpus[*num_threads % num_pin_cpus] : -1;
+    add_pipeline_stage(job, source, apply, cpu);
+    (*num_threads)++;
+}
+
+/*
+* @brief With --pipeline, moves the collectors of the loop modes, and those
+*        the recorder, exporter and shared memory sample, onto threads of
+*        their own. The sinks' thread is woken to apply what they read.
+*/
+void start_collector_threads()
+{
+    int sinks = record_job != NULL || export_job != NULL || shm_job != NULL || rules_job != NULL;
+    int disk_sinks = export_job != NULL || (rules_job != NULL && (rule_set.sources & RULE_SOURCE_DISK));
+    int num_threads = 0;
+    add_collector_thread(cpu_job, sinks, "cpu", cpu_interval_ns, &cpu_source, cpu_apply, &num_threads);
+    add_collector_thread(mem_job, sinks, "memory", mem_interval_ns, &mem_source, mem_apply, &num_threads);
+    add_collector_thread(network_job, sinks, "network", network_interval_ns, &network_source, network_apply, &num_threads);
+    add_collector_thread(disk_job, disk_sinks, "disk", disk_interval_ns, &disk_source, disk_apply, &num_threads);
+    add_collector_thread(irq_job, 0, "irq", irq_interval_ns, &interrupts_source, irq_apply, &num_threads);
+    start_pipeline();
+    if(pipeline.active) watch_descriptor(pipeline.wake_fd, EPOLLIN, drain_pipeline);
 }
 
-void cpu_status_loop()
+/*
+* @brief Runs the loop modes given on the command line together until
+*        Ctrl-C. Each collector takes a baseline sample first, so the first
+*        frame already has rates.
+*/
+void run_loop_modes()
+{
+    history_memory = start_histories();
+    printf("History: %zu KB preallocated for %d s, room for %d interfaces\n", history_memory / 1024, history_seconds,
+           history_interfaces);
+    if(cpu_job != NULL) sample_cpu_stats();
+    if(mem_job != NULL) sample_mem_info();
+    if(network_job != NULL) sample_network_info();
+    if(disk_job != NULL) sample_disk_info();
+    if(irq_job != NULL) sample_interrupts();
+    if(pressure_job != NULL || pressure_alerts.active) sample_pressure();
+    if(pressure_alerts.active)
+    {
+        //The baseline the first alert's cpu rates are worked out from
+        if(cpu_job == NULL) sample_cpu_stats();
+        if(mem_job == NULL) sample_mem_info();
+    }
+    if(proc_top_job != NULL) refresh_proc_top();
+    if(cgroup_job != NULL) sample_cgroups(monotonic_ns());
+    if(export_job != NULL) export_tick();
+    if(shm_job != NULL) shm_tick();
+    if(rules_job != NULL) sample_for_rules(); //Evaluated from the first deadline, once there are rates
+    if(use_pipeline) start_collector_threads();
+
+    //The exporter and shared memory alone draw nothing, they run as daemons
+    int draw_frames = 0;
+    for(int i = 0; i < num_scheduled_jobs; i++) draw_frames |= !scheduled_jobs[i].quiet;
+    drawing_frames = draw_frames;
+    if(!draw_frames && export_job != NULL) printf("Serving on %s until Ctrl-C\n", exporter.address);
+    if(!draw_frames && shm_job != NULL) printf("Publishing to shared memory %s until Ctrl-C\n", shm_publisher.name);
+    if(!draw_frames && pressure_alerts.active) printf("Waiting for %d PSI triggers until Ctrl-C\n", pressure_alerts.num_triggers);
+    if(!draw_frames && rules_job != NULL) printf("Evaluating %d rules every %.3g s until Ctrl-C\n", rule_set.num_rules, (double)rules_interval_ns / 1e9);
+    if(draw_frames) open_screen();
+    run_scheduler(render_loop_modes);
+    stop_pipeline();
+    if(draw_frames) close_screen();
+    if(!draw_frames && export_job != NULL)
+    {
+        printf("Served %" PRIu64 " requests on %" PRIu64 " connections, %" PRIu64 " bytes\n", exporter.requests,
+               exporter.accepted, exporter.bytes_sent);
+    }
+    if(!draw_frames && shm_job != NULL) printf("Published %" PRIu64 " samples\n", shm_publisher.publications);
+    if(!draw_frames && pressure_alerts.active) printf("%" PRIu64 " alerts\n", pressure_alerts.alerts);
+    if(!draw_frames && rules_job != NULL)
+    {
+        printf("%" PRIu64 " rule alerts over %" PRIu64 " evaluations, %d rules firing\n", rule_set.alerts, rule_set.evaluations,
+               rule_set.num_firing);
+    }
+    if(record_job != NULL) close_recorder(&recorder);
+}
+
+/*
+* @brief The threads of mode, which can use up to max_threads, and exits if
+*        --threads asked for more.
+*
+* @returns --threads, or one thread per online cpu up to 8
+*/
+int worker_threads(const char *mode, int max_threads)
 {
-    while(1)
+    if(proc_top_threads > max_threads)
     {
-        cpu_status();
-        sleep(1);
-        for(int i = 0; i < 25; i++) {printf("\033[A");} //Moves the cursor up
+        char message[96];
+        snprintf(message, sizeof(message), "--threads of %s needs a number from 1 to %d, not ", mode, max_threads);
+        char value[16];
+        snprintf(value, sizeof(value), "%d", proc_top_threads);
+        fatal_error(message, value);
     }
+    if(proc_top_threads > 0) return proc_top_threads;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return (int)(online < 1 ? 1 : online > 8 ? 8 : online);
 }
 
-void mem_info_loop()
+/*
+* @brief Reads a --from value, either unix seconds or +SECONDS after first_ns.
+*
+* @returns the time in CLOCK_REALTIME nanoseconds
+*/
+uint64_t parse_replay_time(const char *text, uint64_t first_ns)
 {
-    while(1)
+    char *end;
+    double seconds = strtod(text[0] == '+' ? text + 1 : text, &end);
+    if(end == text || *end != '\0' || seconds < 0) fatal_error("--from takes unix seconds or +SECONDS, not ", text);
+    if(text[0] == '+') return first_ns + (uint64_t)(seconds * 1e9);
+    return (uint64_t)(seconds * 1e9);
+}
+
+/*
+* @brief Prints the replayed sample with the same displays as the loop modes.
+*/
+void display_replay_sample()
+{
+    char when[32];
+    time_t seconds = (time_t)(cpu_stats.sample_ns / 1000000000ull);
+    struct tm local;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &local));
+    screen_printf("Sample at %s\n", when);
+
+    if(show_raw_counters)
+    {
+        display_cpu_proc();
+        display_mem_info();
+        display_network_info();
+    }
+    else
     {
-        mem_status();
-        sleep(1);
-        for(int i = 0; i < 12; i++) {printf("\033[A");} //Moves the cursor up
+        display_cpu_rates();
+        display_mem_history();
+        display_network_rates();
     }
 }
 
-void network_info_loop()
+/*
+* @brief Replays a recording through the displays, --speed times faster
+*        than it was recorded, from --from if given.
+*/
+void replay_recording(const char *path)
 {
-    while(1)
+    struct replay replay;
+    open_replay(&replay, path);
+    if(replay.index_copy != NULL) screen_printf("%s was not closed, rebuilt its index of %zu keyframes\n", path, replay.num_keyframes);
+    if(replay_from != NULL) replay_seek(&replay, parse_replay_time(replay_from, replay_first_time(&replay)));
+
+    //Rates and histories start over from the first sample replayed
+    cpu_rates.have_previous = 0;
+    network_rates.have_previous = 0;
+    int draw_frames = replay_speed > 0 && isatty(STDOUT_FILENO);
+    if(draw_frames) open_screen();
+    uint64_t start_ns = 0;
+    uint64_t start_sample_ns = 0;
+    while(replay_next(&replay))
     {
-        network_status();
-        sleep(1);
-        for(int i = 0; i < (4* network_info.num_devices + 4); i++) {printf("\033[A");}
-        //Moves the cursor up by number of devices + header
+        update_cpu_rates();
+        update_network_rates();
+        if(cpu_history_metric(cpu_stats.num_cpus, 0) != cpu_history.num_metrics) init_histories(history_seconds, DEFAULT_INTERVAL_NS, DEFAULT_INTERVAL_NS, DEFAULT_INTERVAL_NS, history_interfaces);
+        record_cpu_history();
+        record_mem_history();
+        record_network_history();
+
+        if(replay_speed > 0)
+        {
+            if(start_ns == 0 || cpu_stats.sample_ns < start_sample_ns)
+            {
+                start_ns = monotonic_ns();
+                start_sample_ns = cpu_stats.sample_ns;
+            }
+            uint64_t due_ns = start_ns + (uint64_t)((double)(cpu_stats.sample_ns - start_sample_ns) / replay_speed);
+            struct timespec due = {(time_t)(due_ns / 1000000000ull), (long)(due_ns % 1000000000ull)};
+            while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) != 0);
+        }
+        if(draw_frames) screen_begin_frame();
+        display_replay_sample();
+        if(draw_frames) screen_end_frame();
     }
+    if(draw_frames) close_screen();
+    close_replay(&replay);
+}
+
+/*
+* @brief Analyses a recording on --threads threads and prints a summary of
+*        each metric, with peak windows of --window.
+*/
+void analyze_status(const char *path)
+{
+    analyze_recording(path, worker_threads("analyze", ANALYZE_MAX_THREADS), history_window_ns[history_window]);
+    display_analysis(path);
 }
 
 /*
-* @breif execute argument
+* @breif execute argument. The loop modes and record are only scheduled
+*        here, main runs them together once every argument is executed.
+*
+* @returns the number of arguments the mode used
 */
-void execute_arg(char * arg)
+int execute_arg(int num_args, char **args, int index)
 {
+    char *arg = args[index];
     if(strcmp(arg, "cpu-stats") == 0) {cpu_status();}
-    else if(strcmp(arg, "mem-info") == 0) {update_meminfo(); display_mem_info();}
-    else if(strcmp(arg, "network-info") == 0) {update_network_info(); display_network_info();}
-    else if(strcmp(arg, "cpu-status-loop") == 0) {cpu_status_loop();}
-    else if(strcmp(arg, "mem-info-loop") == 0) {mem_info_loop();}
-    else if(strcmp(arg, "network-info-loop") == 0) {network_info_loop();}
+    else if(strcmp(arg, "mem-info") == 0) {mem_status();}
+    else if(strcmp(arg, "network-info") == 0) {network_status();}
+    else if(strcmp(arg, "disk-info") == 0) {disk_status();}
+    else if(strcmp(arg, "interrupts") == 0) {irq_status();}
+    else if(strcmp(arg, "pressure") == 0) {pressure_status();}
+    else if(strcmp(arg, "pressure-loop") == 0)
+    {
+        if(pressure_job != NULL) return 1;
+        open_pressure();
+        pressure_job = schedule_job("pressure", pressure_interval_ns, pressure_tick);
+    }
+    else if(strcmp(arg, "pressure-alert") == 0)
+    {
+        if(pressure_alerts.active) return 1;
+        open_pressure();
+        open_pressure_alerts(pressure_alert);
+        for(int i = 0; i < pressure_alerts.num_triggers; i++)
+        {
+            watch_descriptor(pressure_alerts.triggers[i].fd, EPOLLPRI, serve_pressure_trigger);
+        }
+    }
+    else if(strcmp(arg, "cpu-status-loop") == 0) {if(cpu_job == NULL) cpu_job = schedule_job("cpu", cpu_interval_ns, cpu_tick);}
+    else if(strcmp(arg, "mem-info-loop") == 0) {if(mem_job == NULL) mem_job = schedule_job("memory", mem_interval_ns, mem_tick);}
+    else if(strcmp(arg, "network-info-loop") == 0) {if(network_job == NULL) network_job = schedule_job("network", network_interval_ns, network_tick);}
+    else if(strcmp(arg, "disk-info-loop") == 0) {if(disk_job == NULL) disk_job = schedule_job("disk", disk_interval_ns, disk_tick);}
+    else if(strcmp(arg, "interrupts-loop") == 0)
+    {
+        if(irq_job != NULL) return 1;
+        init_interrupts(irq_top_n);
+        irq_job = schedule_job("irq", irq_interval_ns, irq_tick);
+    }
+    else if(strcmp(arg, "high-freq-loop") == 0)
+    {
+        if(high_freq_job != NULL) return 1;
+        init_high_freq(high_freq_interval_ns, high_freq_budget_ns > 0 ? high_freq_budget_ns : high_freq_interval_ns / 100,
+                       high_freq_cpus, high_freq_interfaces);
+        high_freq_job = schedule_job("high-freq", high_freq_interval_ns, high_freq_tick);
+        high_freq_job->quiet = 1;
+        //The screen is redrawn once a second with what the ticks measured since
+        schedule_job("hf-period", DEFAULT_INTERVAL_NS, end_high_freq_period);
+    }
+    else if(strcmp(arg, "proc-top") == 0)
+    {
+        if(proc_top_job != NULL) return 1;
+        init_proc_top(proc_top_n, proc_top_sort, worker_threads("proc-top", PROC_TOP_MAX_THREADS));
+        proc_top_job = schedule_job("proc-top", proc_top_interval_ns, proc_top_tick);
+    }
+    else if(strcmp(arg, "cgroup-info") == 0) {cgroup_status();}
+    else if(strcmp(arg, "cgroup-info-loop") == 0)
+    {
+        if(cgroup_job != NULL) return 1;
+        if(cgroup_tree.root_fd < 0) open_cgroups();
+        cgroup_job = schedule_job("cgroup", cgroup_interval_ns, cgroup_tick);
+        watch_descriptor(cgroup_tree.inotify_fd, EPOLLIN, serve_cgroup_events);
+    }
+    else if(strcmp(arg, "export") == 0)
+    {
+        if(index + 1 >= num_args) fatal_error("missing address for ", arg);
+        if(export_job == NULL)
+        {
+            open_exporter(args[index + 1]);
+            if(strcmp(proc_root, PROC_ROOT) == 0) init_node_meminfo(NODE_ROOT);
+            export_job = schedule_job("export", export_interval_ns, export_tick);
+            export_job->quiet = 1;
+            watch_descriptor(exporter.epoll_fd, EPOLLIN, serve_exporter);
+        }
+        return 2;
+    }
+    else if(strcmp(arg, "publish-shm") == 0)
+    {
+        if(shm_job != NULL) return 1;
+        open_shm_publisher(shm_name);
+        shm_job = schedule_job("shm", shm_interval_ns, shm_tick);
+        shm_job->quiet = 1;
+    }
+    else if(strcmp(arg, "read-shm") == 0) {read_shm(shm_name);}
+    else if(strcmp(arg, "analyze") == 0)
+    {
+        if(index + 1 >= num_args) fatal_error("missing file for ", arg);
+        analyze_status(args[index + 1]);
+        return 2;
+    }
+    else if(strcmp(arg, "record") == 0 || strcmp(arg, "replay") == 0)
+    {
+        if(index + 1 >= num_args) fatal_error("missing file for ", arg);
+        if(strcmp(arg, "replay") == 0) replay_recording(args[index + 1]);
+        else if(record_job == NULL)
+        {
+            open_recorder(&recorder, args[index + 1]);
+            record_job = schedule_job("record", record_interval_ns, record_tick);
+        }
+        return 2;
+    }
     else {
         printf("Argument '%s' not recognized.\n", arg);
     }
+    return 1;
+}
+
+/*
+* @brief Reads an interval in seconds, such as 1, 0.5 or 10.
+*
+* @returns the interval in nanoseconds
+*/
+uint64_t parse_interval(const char *text)
+{
+    char *end;
+    double seconds = strtod(text, &end);
+    if(end == text || *end != '\0' || seconds < 0.001 || seconds > 86400) fatal_error("an interval needs seconds between 0.001 and 86400, not ", text);
+    return (uint64_t)(seconds * 1e9 + 0.5);
+}
+
+/*
+* @brief Applies the option at argv[index].
+*
+* @returns the number of arguments the option used
+*/
+int parse_option(int argc, char **argv, int index)
+{
+    char *option = argv[index];
+    if(strcmp(option, "--raw") == 0) {show_raw_counters = 1; return 1;}
+    if(strcmp(option, "--self-stats") == 0) {show_self_stats = 1; return 1;}
+    if(strcmp(option, "--pipeline") == 0) {use_pipeline = 1; return 1;}
+
+    if(index + 1 >= argc) fatal_error("missing value for option ", option);
+    if(strcmp(option, "--proc-root") == 0) {set_proc_root(argv[index + 1]); return 2;}
+    if(strcmp(option, "--history") == 0)
+    {
+        history_seconds = atoi(argv[index + 1]);
+        if(history_seconds < 1) fatal_error("--history needs a number of seconds, not ", argv[index + 1]);
+        return 2;
+    }
+    if(strcmp(option, "--history-interfaces") == 0)
+    {
+        history_interfaces = atoi(argv[index + 1]);
+        if(history_interfaces < 1) fatal_error("--history-interfaces needs a number of interfaces, not ", argv[index + 1]);
+        return 2;
+    }
+    if(strcmp(option, "--window") == 0)
+    {
+        for(int window = 0; window < NUM_WINDOWS; window++)
+        {
+            if(strcmp(argv[index + 1], history_window_names[window]) == 0) {history_window = window; return 2;}
+        }
+        fatal_error("--window takes 10s, 1m or 5m, not ", argv[index + 1]);
+    }
+    if(strcmp(option, "--speed") == 0)
+    {
+        char *end;
+        replay_speed = strtod(argv[index + 1], &end);
+        if(end == argv[index + 1] || *end != '\0' || replay_speed < 0) fatal_error("--speed needs a number, not ", argv[index + 1]);
+        return 2;
+    }
+    if(strcmp(option, "--from") == 0) {replay_from = argv[index + 1]; return 2;}
+    if(strcmp(option, "--threshold") == 0) {add_analysis_threshold(argv[index + 1]); return 2;}
+    if(strcmp(option, "--metrics") == 0) {analysis.metrics_glob = argv[index + 1]; return 2;}
+    if(strcmp(option, "--interval") == 0)
+    {
+        cpu_interval_ns = parse_interval(argv[index + 1]);
+        mem_interval_ns = cpu_interval_ns;
+        network_interval_ns = cpu_interval_ns;
+        disk_interval_ns = cpu_interval_ns;
+        irq_interval_ns = cpu_interval_ns;
+        pressure_interval_ns = cpu_interval_ns;
+        record_interval_ns = cpu_interval_ns;
+        export_interval_ns = cpu_interval_ns;
+        shm_interval_ns = cpu_interval_ns;
+        rules_interval_ns = cpu_interval_ns;
+        proc_top_interval_ns = cpu_interval_ns;
+        cgroup_interval_ns = cpu_interval_ns;
+        return 2;
+    }
+    if(strcmp(option, "--cpu-interval") == 0) {cpu_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--mem-interval") == 0) {mem_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--network-interval") == 0) {network_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--disk-interval") == 0) {disk_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--irq-interval") == 0) {irq_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--pressure-interval") == 0) {pressure_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--psi-trigger") == 0) {add_pressure_trigger(argv[index + 1]); return 2;}
+    if(strcmp(option, "--rule") == 0) {add_rule(argv[index + 1]); return 2;}
+    if(strcmp(option, "--rule-hook") == 0) {rule_set.hook = argv[index + 1]; return 2;}
+    if(strcmp(option, "--rule-interval") == 0) {rules_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--irq-top") == 0)
+    {
+        irq_top_n = atoi(argv[index + 1]);
+        if(irq_top_n < 1) fatal_error("--irq-top needs a number of irqs, not ", argv[index + 1]);
+        return 2;
+    }
+    if(strcmp(option, "--record-interval") == 0) {record_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--export-interval") == 0) {export_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--shm-interval") == 0) {shm_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--shm-name") == 0) {shm_name = argv[index + 1]; return 2;}
+    if(strcmp(option, "--hf-interval") == 0) {high_freq_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--budget-us") == 0)
+    {
+        char *end;
+        double budget_us = strtod(argv[index + 1], &end);
+        if(end == argv[index + 1] || *end != '\0' || budget_us <= 0) fatal_error("--budget-us needs a number of microseconds, not ", argv[index + 1]);
+        high_freq_budget_ns = (uint64_t)(budget_us * 1000);
+        return 2;
+    }
+    if(strcmp(option, "--proc-top-interval") == 0) {proc_top_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--top") == 0)
+    {
+        proc_top_n = atoi(argv[index + 1]);
+        if(proc_top_n < 1) fatal_error("--top needs a number of processes, not ", argv[index + 1]);
+        return 2;
+    }
+    if(strcmp(option, "--sort") == 0)
+    {
+        for(int sort = 0; sort < NUM_PROC_SORTS; sort++)
+        {
+            if(strcmp(argv[index + 1], proc_sort_names[sort]) == 0) {proc_top_sort = sort; return 2;}
+        }
+        fatal_error("--sort takes cpu, rss, io or switches, not ", argv[index + 1]);
+    }
+    if(strcmp(option, "--threads") == 0)
+    {
+        //Each mode checks it against its own limit when it starts
+        proc_top_threads = atoi(argv[index + 1]);
+        if(proc_top_threads < 1) fatal_error("--threads needs a number of threads, not ", argv[index + 1]);
+        return 2;
+    }
+    if(strcmp(option, "--cgroup-root") == 0) {cgroup_root = argv[index + 1]; return 2;}
+    if(strcmp(option, "--cgroup-interval") == 0) {cgroup_interval_ns = parse_interval(argv[index + 1]); return 2;}
+    if(strcmp(option, "--cgroup-top") == 0)
+    {
+        cgroup_top_n = atoi(argv[index + 1]);
+        if(cgroup_top_n < 1) fatal_error("--cgroup-top needs a number of cgroups, not ", argv[index + 1]);
+        return 2;
+    }
+    if(strcmp(option, "--cgroup-sort") == 0)
+    {
+        for(int sort = 0; sort < NUM_CGROUP_SORTS; sort++)
+        {
+            if(strcmp(argv[index + 1], cgroup_sort_names[sort]) == 0) {cgroup_sort = sort; return 2;}
+        }
+        fatal_error("--cgroup-sort takes cpu, memory, io or pressure, not ", argv[index + 1]);
+    }
+    if(strcmp(option, "--net-match") == 0) {network_match = argv[index + 1]; return 2;}
+    if(strcmp(option, "--net-regex") == 0)
+    {
+        if(have_network_regex) regfree(&network_regex);
+        if(regcomp(&network_regex, argv[index + 1], REG_EXTENDED | REG_NOSUB) != 0) fatal_error("--net-regex could not compile ", argv[index + 1]);
+        have_network_regex = 1;
+        return 2;
+    }
+    if(strcmp(option, "--net-sort") == 0)
+    {
+        for(int sort = 0; sort < NUM_NETWORK_SORTS; sort++)
+        {
+            if(strcmp(argv[index + 1], network_sort_names[sort]) == 0) {network_sort = sort; return 2;}
+        }
+        fatal_error("--net-sort takes total, rx, tx, name or none, not ", argv[index + 1]);
+    }
+    if(strcmp(option, "--net-top") == 0)
+    {
+        network_top = atoi(argv[index + 1]);
+        if(network_top < 1) fatal_error("--net-top needs a number of interfaces, not ", argv[index + 1]);
+        return 2;
+    }
+    if(strcmp(option, "--net-backend") == 0)
+    {
+        for(int backend = 0; backend < NUM_NETWORK_BACKENDS; backend++)
+        {
+            if(strcmp(argv[index + 1], network_backend_names[backend]) == 0) {network_backend = backend; return 2;}
+        }
+        fatal_error("--net-backend takes proc or netlink, not ", argv[index + 1]);
+    }
+    if(strcmp(option, "--cpus") == 0) {high_freq_cpus = argv[index + 1]; return 2;}
+    if(strcmp(option, "--pin") == 0) {pin_list = argv[index + 1]; return 2;}
+    if(strcmp(option, "--interfaces") == 0) {high_freq_interfaces = argv[index + 1]; return 2;}
+
+    printf("Option '%s' not recognized.\n", option);
+    return 1;
 }
 
 /*
@@ -680,12 +2169,25 @@ int main(int argc, char **argv)
 {
     if(argc <= 1) {print_usage(); exit(EXIT_SUCCESS);}
 
+    //Options first, as the modes use them. The modes are packed to the
+    //front of argv as the options are taken out.
+    int num_modes = 0;
+    for(int i = 1; i < argc;)
+    {
+        if(strncmp(argv[i], "--", 2) == 0) i += parse_option(argc, argv, i);
+        else argv[num_modes++] = argv[i++];
+    }
+
     init_progam();
 
-    for(int i = 1; i < argc;i++)
+    for(int i = 0; i < num_modes;)
     {
-        execute_arg(argv[i]);
+        i += execute_arg(num_modes, argv, i);
     }
+    if(rule_set.num_rules > 0) start_rules();
+    if(num_scheduled_jobs > 0 || num_watched_descriptors > 0) run_loop_modes();
+    if(show_self_stats) display_self_stats();
 
+    cleanup_program();
     exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+}
@@ -0,0 +1,178 @@
+/*
+ * File: meminfo.c
+ * Description: Every line of /proc/meminfo and of the per NUMA node
+ *              meminfo files, found through a perfect hash generated at
+ *              build time, with lines of keys it does not know kept aside.
+ *
+ * Notes:
+ *      meminfo_gen picks a seed under which every known key hashes to a
+ *      slot of its own, so a line's key is found with one hash of its
+ *      characters and one compare with the key in that slot, instead of a
+ *      compare with each key in turn. A key that misses is one a newer
+ *      kernel added; it goes to the overflow with its unit read off the
+ *      line, and is shown and exported all the same.
+ *
+ *      The node files print each line as "Node N Key: value kB", so the
+ *      first two tokens are passed over when the line starts with Node.
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include "sys_mon.h"
+#include "scan.h"
+#include "meminfo.h"
+
+struct meminfo_snapshot meminfo_snapshot;
+struct node_meminfo node_meminfo;
+
+/*
+* @brief Looks a key, without its colon, up in the generated table.
+*
+* @returns its meminfo_key, or -1 for a key not in the table
+*/
+int meminfo_key_of(const char *key, size_t length)
+{
+    int index = meminfo_slots[meminfo_hash(MEMINFO_HASH_SEED, key, length)];
+    if(index == MEMINFO_NO_KEY || meminfo_key_lengths[index] != length) return -1;
+    return memcmp(meminfo_key_names[index], key, length) == 0 ? index : -1;
+}
+
+/*
+* @brief Keeps a line of an unknown key in the snapshot's overflow.
+*/
+void add_meminfo_overflow(struct meminfo_snapshot *snapshot, const char *key, size_t length, const char **cursor)
+{
+    if(snapshot->num_overflow == MEMINFO_MAX_OVERFLOW || length >= MEMINFO_KEY_LENGTH)
+    {
+        snapshot->dropped++;
+        return;
+    }
+    struct meminfo_overflow *overflow = &snapshot->overflow[snapshot->num_overflow];
+    if(scan_fields(cursor, &overflow->value, 1) != 1) return;
+
+    const char *unit;
+    size_t unit_length = scan_token(cursor, &unit);
+    overflow->count = !token_is(unit, unit_length, "kB");
+    memcpy(overflow->key, key, length);
+    overflow->key[length] = '\0';
+    snapshot->num_overflow++;
+}
+
+/*
+* @brief Parses the text of a meminfo file, /proc/meminfo or a node's,
+*        into snapshot.
+*/
+void parse_meminfo(const char *text, struct meminfo_snapshot *snapshot, uint64_t sample_ns)
+{
+    const char *cursor = text;
+
+    memset(snapshot->present, 0, sizeof(snapshot->present));
+    snapshot->num_present = 0;
+    snapshot->num_overflow = 0;
+    snapshot->dropped = 0;
+    snapshot->sample_ns = sample_ns;
+    while(*cursor != '\0')
+    {
+        const char *token;
+        size_t length = scan_token(&cursor, &token);
+        if(token_is(token, length, "Node"))
+        {
+            scan_token(&cursor, &token);
+            length = scan_token(&cursor, &token);
+        }
+
+        if(length > 1 && token[length - 1] == ':')
+        {
+            int key = meminfo_key_of(token, length - 1);
+            if(key < 0) add_meminfo_overflow(snapshot, token, length - 1, &cursor);
+            else if(scan_fields(&cursor, &snapshot->value[key], 1) == 1 && !meminfo_has(snapshot, key))
+            {
+                snapshot->present[key / 64] |= 1ull << (key % 64);
+                snapshot->num_present++;
+            }
+        }
+        cursor = skip_line(cursor);
+    }
+}
+
+/*
+* @brief Opens the meminfo file of every nodeN directory in node_dir,
+*        NODE_ROOT on a live system. A kernel without NUMA has none.
+*
+* @returns the number of nodes
+*/
+int init_node_meminfo(const char *node_dir)
+{
+    close_node_meminfo();
+    DIR *dir = opendir(node_dir);
+    if(dir == NULL) return 0;
+
+    int capacity = 0;
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(strncmp(entry->d_name, "node", 4) != 0 || (unsigned char)(entry->d_name[4] - '0') >= 10) continue;
+
+        char path[PROC_PATH_LENGTH];
+        int length = snprintf(path, sizeof(path), "%s/%s/%s", node_dir, entry->d_name, MEM_INFO_FILE);
+        if(length < 0 || (size_t)length >= sizeof(path)) continue;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if(fd < 0) continue;
+
+        if(node_meminfo.num_nodes == capacity)
+        {
+            capacity = capacity > 0 ? capacity * 2 : 4;
+            node_meminfo.id = counted_realloc(node_meminfo.id, (size_t)capacity * sizeof(int));
+            node_meminfo.sources = counted_realloc(node_meminfo.sources, (size_t)capacity * sizeof(struct proc_source));
+            node_meminfo.nodes = counted_realloc(node_meminfo.nodes, (size_t)capacity * sizeof(struct meminfo_snapshot));
+        }
+
+        //Kept in the order of the ids, which readdir does not give
+        int id = atoi(entry->d_name + 4);
+        int index = node_meminfo.num_nodes++;
+        while(index > 0 && node_meminfo.id[index - 1] > id)
+        {
+            node_meminfo.id[index] = node_meminfo.id[index - 1];
+            node_meminfo.sources[index] = node_meminfo.sources[index - 1];
+            index--;
+        }
+        struct proc_source *source = &node_meminfo.sources[index];
+        memset(source, 0, sizeof(*source));
+        source->name = MEM_INFO_FILE;
+        memcpy(source->path, path, (size_t)length + 1);
+        source->fd = fd;
+        source->capacity = PROC_SOURCE_INITIAL_SIZE;
+        source->buffer = counted_malloc(source->capacity);
+        node_meminfo.id[index] = id;
+    }
+    closedir(dir);
+
+    memset(node_meminfo.nodes, 0, (size_t)node_meminfo.num_nodes * sizeof(struct meminfo_snapshot));
+    return node_meminfo.num_nodes;
+}
+
+/*
+* @brief Reads and parses the meminfo file of every node.
+*/
+void sample_node_meminfo()
+{
+    for(int i = 0; i < node_meminfo.num_nodes; i++)
+    {
+        struct proc_source *source = &node_meminfo.sources[i];
+        read_proc_source(source);
+        parse_meminfo(source->buffer, &node_meminfo.nodes[i], source->read_ns);
+    }
+}
+
+/*
+* @brief Closes the node files and frees their snapshots.
+*/
+void close_node_meminfo()
+{
+    for(int i = 0; i < node_meminfo.num_nodes; i++) close_proc_source(&node_meminfo.sources[i]);
+    free(node_meminfo.id);
+    free(node_meminfo.sources);
+    free(node_meminfo.nodes);
+    memset(&node_meminfo, 0, sizeof(node_meminfo));
+}
@@ -0,0 +1,78 @@
+/*
+ * File: meminfo.h
+ * Description: Every line of /proc/meminfo and of the per NUMA node
+ *              meminfo files, found through a perfect hash generated at
+ *              build time, with lines of keys it does not know kept aside.
+ */
+#ifndef MEMINFO_H
+#define MEMINFO_H
+
+#include <stdint.h>
+
+#include "sys_mon.h"
+#include "meminfo_hash.h"
+#include "meminfo_keys.h"
+
+#define NODE_ROOT                   "/sys/devices/system/node"
+#define MEMINFO_MAX_OVERFLOW        16
+#define MEMINFO_KEY_LENGTH          32
+#define MEMINFO_PRESENT_WORDS       ((NUM_MEMINFO_KEYS + 63) / 64)
+
+/*
+* A line whose key is not in the generated table.
+*/
+struct meminfo_overflow
+{
+    char key[MEMINFO_KEY_LENGTH];
+    uint64_t value;
+    int count;                          //Not followed by kB
+};
+
+/*
+* One meminfo file. Values are in kB but for the keys meminfo_key_counts
+* marks, the HugePages_ ones. Lines past MEMINFO_MAX_OVERFLOW unknown
+* ones are only counted in dropped.
+*/
+struct meminfo_snapshot
+{
+    uint64_t value[NUM_MEMINFO_KEYS];
+    uint64_t present[MEMINFO_PRESENT_WORDS]; //Bit per meminfo_key
+    int num_present;
+    int num_overflow;
+    int dropped;
+    struct meminfo_overflow overflow[MEMINFO_MAX_OVERFLOW];
+    uint64_t sample_ns;
+};
+
+/*
+* The meminfo file of each NUMA node, open from init_node_meminfo on. The
+* nodes are in the order of their ids.
+*/
+struct node_meminfo
+{
+    int num_nodes;
+    int *id;
+    struct proc_source *sources;
+    struct meminfo_snapshot *nodes;
+};
+
+extern const char *const meminfo_key_names[NUM_MEMINFO_KEYS];
+extern const uint8_t meminfo_key_lengths[NUM_MEMINFO_KEYS];
+extern const uint8_t meminfo_key_counts[NUM_MEMINFO_KEYS];
+extern const uint8_t meminfo_slots[MEMINFO_HASH_SLOTS];
+
+extern struct meminfo_snapshot meminfo_snapshot;
+extern struct node_meminfo node_meminfo;
+
+static inline int meminfo_has(const struct meminfo_snapshot *snapshot, int key)
+{
+    return (snapshot->present[key / 64] >> (key % 64)) & 1;
+}
+
+int meminfo_key_of(const char *key, size_t length);
+void parse_meminfo(const char *text, struct meminfo_snapshot *snapshot, uint64_t sample_ns);
+int init_node_meminfo(const char *node_dir);
+void sample_node_meminfo();
+void close_node_meminfo();
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Program Name: meminfo_gen
+ * Description: Generates the table of every /proc/meminfo key sys_mon knows
+ *              and a perfect hash over them, so update_meminfo finds a
+ *              line's key with one hash and one compare.
+ *
+ * Compilation: ./build.sh
+ * Usage: ./meminfo_gen meminfo_keys.h meminfo_keys.c
+ *
+ * Notes:
+ *      The keys are those of current and older kernels, in the order they
+ *      print them, plus MemUsed and FilePages that only the per node files
+ *      under /sys/devices/system/node have. Seeds of meminfo_hash are
+ *      tried from 1 up until every key lands in a slot of its own. A key
+ *      missing here still gets parsed, into the overflow of the snapshot;
+ *      adding it here gives it an enum and a fixed place.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "meminfo_hash.h"
+
+/*
+* A meminfo key and whether its value is in kB or a count.
+*/
+struct generated_key
+{
+    const char *name;
+    int count;
+};
+
+const struct generated_key generated_keys[] =
+{
+    {"MemTotal", 0}, {"MemFree", 0}, {"MemUsed", 0}, {"MemAvailable", 0},
+    {"Buffers", 0}, {"Cached", 0}, {"SwapCached", 0},
+    {"Active", 0}, {"Inactive", 0}, {"Active(anon)", 0}, {"Inactive(anon)", 0},
+    {"Active(file)", 0}, {"Inactive(file)", 0}, {"Unevictable", 0}, {"Mlocked", 0},
+    {"HighTotal", 0}, {"HighFree", 0}, {"LowTotal", 0}, {"LowFree", 0}, {"MmapCopy", 0},
+    {"SwapTotal", 0}, {"SwapFree", 0}, {"Zswap", 0}, {"Zswapped", 0},
+    {"Dirty", 0}, {"Writeback", 0}, {"FilePages", 0}, {"AnonPages", 0}, {"Mapped", 0}, {"Shmem", 0},
+    {"KReclaimable", 0}, {"Slab", 0}, {"SReclaimable", 0}, {"SUnreclaim", 0},
+    {"KernelStack", 0}, {"ShadowCallStack", 0}, {"PageTables", 0}, {"SecPageTables", 0},
+    {"Quicklists", 0}, {"NFS_Unstable", 0}, {"Bounce", 0}, {"WritebackTmp", 0},
+    {"CommitLimit", 0}, {"Committed_AS", 0},
+    {"VmallocTotal", 0}, {"VmallocUsed", 0}, {"VmallocChunk", 0}, {"Percpu", 0},
+    {"HardwareCorrupted", 0},
+    {"AnonHugePages", 0}, {"ShmemHugePages", 0}, {"ShmemPmdMapped", 0},
+    {"FileHugePages", 0}, {"FilePmdMapped", 0}, {"CmaTotal", 0}, {"CmaFree", 0},
+    {"Unaccepted", 0}, {"Balloon", 0},
+    {"HugePages_Total", 1}, {"HugePages_Free", 1}, {"HugePages_Rsvd", 1}, {"HugePages_Surp", 1},
+    {"Hugepagesize", 0}, {"Hugetlb", 0},
+    {"DirectMap4k", 0}, {"DirectMap2M", 0}, {"DirectMap4M", 0}, {"DirectMap1G", 0}
+};
+
+#define NUM_GENERATED_KEYS (int)(sizeof(generated_keys) / sizeof(generated_keys[0]))
+
+/*
+* @brief Finds the first seed that puts every key in a slot of its own.
+*
+* @returns the seed, with the slot of each key in slots
+*/
+unsigned int find_seed(unsigned char *slots)
+{
+    for(unsigned int seed = 1; seed != 0; seed++)
+    {
+        memset(slots, MEMINFO_NO_KEY, MEMINFO_HASH_SLOTS);
+        int i;
+        for(i = 0; i < NUM_GENERATED_KEYS; i++)
+        {
+            const char *name = generated_keys[i].name;
+            uint32_t slot = meminfo_hash(seed, name, strlen(name));
+            if(slots[slot] != MEMINFO_NO_KEY) break;
+            slots[slot] = (unsigned char)i;
+        }
+        if(i == NUM_GENERATED_KEYS) return seed;
+    }
+    fprintf(stderr, "meminfo_gen: no seed hashes the keys without a collision\n");
+    exit(1);
+}
+
+/*
+* @brief Writes MEMINFO_ and the key upper cased, with each run of other
+*        characters made one underscore and none at the end:
+*        Active(anon) is MEMINFO_ACTIVE_ANON.
+*/
+void write_enum_name(FILE *file, const char *name)
+{
+    fprintf(file, "MEMINFO_");
+    int underscore = 0;
+    for(const char *c = name; *c != '\0'; c++)
+    {
+        if(isalnum((unsigned char)*c))
+        {
+            if(underscore) fputc('_', file);
+            underscore = 0;
+            fputc(toupper((unsigned char)*c), file);
+        }
+        else underscore = 1;
+    }
+}
+
+FILE *open_output(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if(file == NULL)
+    {
+        fprintf(stderr, "meminfo_gen: failed to create %s\n", path);
+        exit(1);
+    }
+    return file;
+}
+
+/*
+* @breif Main entry point
+*/
+int main(int argc, char **argv)
+{
+    if(argc != 3 || NUM_GENERATED_KEYS >= MEMINFO_NO_KEY)
+    {
+        fprintf(stderr, "usage: meminfo_gen HEADER SOURCE\n");
+        return 1;
+    }
+
+    unsigned char slots[MEMINFO_HASH_SLOTS];
+    unsigned int seed = find_seed(slots);
+
+    FILE *header = open_output(argv[1]);
+    fprintf(header, "/*\n * File: %s\n * Description: Every /proc/meminfo key sys_mon knows. Generated by\n"
+                    " *              meminfo_gen, do not edit.\n */\n", argv[1]);
+    fprintf(header, "#ifndef MEMINFO_KEYS_H\n#define MEMINFO_KEYS_H\n\n");
+    fprintf(header, "#define MEMINFO_HASH_SEED           0x%08xu\n\n", seed);
+    fprintf(header, "enum meminfo_key\n{\n");
+    for(int i = 0; i < NUM_GENERATED_KEYS; i++)
+    {
+        fprintf(header, "    ");
+        write_enum_name(header, generated_keys[i].name);
+        fprintf(header, ",\n");
+    }
+    fprintf(header, "    NUM_MEMINFO_KEYS\n};\n\n#endif\n");
+    fclose(header);
+
+    FILE *source = open_output(argv[2]);
+    fprintf(source, "/*\n * File: %s\n * Description: Names, units and hash slots of the meminfo keys.\n"
+                    " *              Generated by meminfo_gen, do not edit.\n */\n", argv[2]);
+    fprintf(source, "#include \"meminfo.h\"\n\n");
+    fprintf(source, "const char *const meminfo_key_names[NUM_MEMINFO_KEYS] =\n{\n");
+    for(int i = 0; i < NUM_GENERATED_KEYS; i++) fprintf(source, "    \"%s\",\n", generated_keys[i].name);
+    fprintf(source, "};\n\nconst uint8_t meminfo_key_lengths[NUM_MEMINFO_KEYS] =\n{\n");
+    for(int i = 0; i < NUM_GENERATED_KEYS; i++) fprintf(source, "    %d,\n", (int)strlen(generated_keys[i].name));
+    fprintf(source, "};\n\nconst uint8_t meminfo_key_counts[NUM_MEMINFO_KEYS] =\n{\n");
+    for(int i = 0; i < NUM_GENERATED_KEYS; i++) fprintf(source, "    %d,\n", generated_keys[i].count);
+    fprintf(source, "};\n\nconst uint8_t meminfo_slots[MEMINFO_HASH_SLOTS] =\n{");
+    for(int i = 0; i < MEMINFO_HASH_SLOTS; i++) fprintf(source, "%s%3d,", i % 16 == 0 ? "\n    " : " ", slots[i]);
+    fprintf(source, "\n};\n");
+    fclose(source);
+    return 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * File: meminfo_hash.h
+ * Description: The seeded hash of /proc/meminfo keys that meminfo_gen
+ *              searches a collision free seed for and update_meminfo
+ *              looks the keys up with.
+ */
+#ifndef MEMINFO_HASH_H
+#define MEMINFO_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMINFO_HASH_SLOTS          256 //Power of two
+#define MEMINFO_NO_KEY              0xFF //An empty slot
+
+/*
+* @brief FNV-1a of a key without its colon, started from seed, with the
+*        high bits folded into the ones that pick the slot.
+*/
+static inline uint32_t meminfo_hash(uint32_t seed, const char *key, size_t length)
+{
+    uint32_t hash = seed;
+    for(size_t i = 0; i < length; i++) hash = (hash ^ (uint8_t)key[i]) * 0x01000193u;
+    return (hash ^ (hash >> 16)) & (MEMINFO_HASH_SLOTS - 1);
+}
+
+#endif
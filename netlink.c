@@ -0,0 +1,423 @@
+/*
+ * File: netlink.c
+ * Description: Reads the counters of every interface over NETLINK_ROUTE into
+ *              network_info, as an alternative to parsing /proc/net/dev.
+ * Notes: The kernel formats /proc/net/dev from the same rtnl_link_stats64
+ *        the dumps carry in binary, so both give the same counters. The
+ *        columns /proc/net/dev folds together are summed the same way here.
+ */
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#include "netlink.h"
+
+struct netlink_source netlink_source = {.fd = -1};
+int network_backend = NETWORK_BACKEND_PROC;
+
+const char *network_backend_names[NUM_NETWORK_BACKENDS] = {"proc", "netlink"};
+
+/*
+* @brief Opens the netlink socket, joined to the link multicast group, and
+*        its receive buffer if they are not already open.
+*
+* @returns 0 on success, -1 with errno set if the socket could not be opened
+*/
+int open_netlink_source()
+{
+    if(netlink_source.fd >= 0) return 0;
+
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if(fd < 0) return -1;
+
+    struct sockaddr_nl address = {0};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = RTMGRP_LINK;
+    if(bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    netlink_source.fd = fd;
+    netlink_source.names_stale = 1;
+    if(netlink_source.buffer == NULL)
+    {
+        netlink_source.capacity = NETLINK_RECEIVE_BUFFER;
+        netlink_source.buffer = (char*)counted_malloc(netlink_source.capacity);
+    }
+    return 0;
+}
+
+/*
+* @brief Closes the netlink socket and releases its buffer and the names.
+*/
+void close_netlink_source()
+{
+    if(netlink_source.fd >= 0) close(netlink_source.fd);
+    free(netlink_source.buffer);
+    free(netlink_source.links);
+    free(netlink_source.slots);
+
+    int error = netlink_source.error;
+    memset(&netlink_source, 0, sizeof(netlink_source));
+    netlink_source.fd = -1;
+    netlink_source.error = error;
+}
+
+static inline uint32_t link_slot(int index)
+{
+    return ((uint32_t)index * 2654435761u) & netlink_source.slot_mask;
+}
+
+/*
+* @returns the position in netlink_source.links of the interface with
+*          ifindex index, or -1 if its name is not known
+*/
+int find_link_name(int index)
+{
+    if(netlink_source.slots == NULL) return -1;
+    for(uint32_t slot = link_slot(index); netlink_source.slots[slot] >= 0; slot = (slot + 1) & netlink_source.slot_mask)
+    {
+        if(netlink_source.links[netlink_source.slots[slot]].index == index) return netlink_source.slots[slot];
+    }
+    return -1;
+}
+
+/*
+* @brief Forgets every name, keeping the arrays for the link dump that
+*        follows.
+*/
+void clear_link_names()
+{
+    netlink_source.num_links = 0;
+    if(netlink_source.slots != NULL) memset(netlink_source.slots, 0xff, (netlink_source.slot_mask + 1) * sizeof(int32_t));
+}
+
+/*
+* @brief Adds the name of the interface with ifindex index. The slot table
+*        is kept at most half full.
+*/
+void add_link_name(int index, const char *face)
+{
+    if(find_link_name(index) >= 0) return;
+    if(netlink_source.num_links == netlink_source.links_capacity)
+    {
+        int capacity = netlink_source.links_capacity > 0 ? netlink_source.links_capacity * 2 : NETLINK_INITIAL_LINKS;
+        netlink_source.links = counted_realloc(netlink_source.links, (size_t)capacity * sizeof(struct netlink_link));
+        netlink_source.links_capacity = capacity;
+
+        free(netlink_source.slots);
+        netlink_source.slots = counted_malloc((size_t)capacity * 2 * sizeof(int32_t));
+        netlink_source.slot_mask = (uint32_t)capacity * 2 - 1;
+        memset(netlink_source.slots, 0xff, (size_t)capacity * 2 * sizeof(int32_t));
+        for(int i = 0; i < netlink_source.num_links; i++)
+        {
+            uint32_t slot = link_slot(netlink_source.links[i].index);
+            while(netlink_source.slots[slot] >= 0) slot = (slot + 1) & netlink_source.slot_mask;
+            netlink_source.slots[slot] = i;
+        }
+    }
+
+    int position = netlink_source.num_links++;
+    struct netlink_link *link = &netlink_source.links[position];
+    link->index = index;
+    snprintf(link->face, sizeof(link->face), "%s", face);
+
+    uint32_t slot = link_slot(index);
+    while(netlink_source.slots[slot] >= 0) slot = (slot + 1) & netlink_source.slot_mask;
+    netlink_source.slots[slot] = position;
+}
+
+/*
+* @brief Sends the request for a dump of type, whose header is the size
+*        bytes at body.
+*
+* @returns 0 on success, -1 with errno set on failure
+*/
+int request_dump(int type, const void *body, size_t size)
+{
+    uint64_t request[(NLMSG_HDRLEN + 16) / sizeof(uint64_t)];
+    struct nlmsghdr *header = (struct nlmsghdr*)request;
+
+    memset(request, 0, sizeof(request));
+    header->nlmsg_len = NLMSG_LENGTH(size);
+    header->nlmsg_type = (uint16_t)type;
+    header->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    header->nlmsg_seq = ++netlink_source.seq;
+    memcpy(NLMSG_DATA(header), body, size);
+
+    while(send(netlink_source.fd, request, header->nlmsg_len, 0) < 0)
+    {
+        if(errno != EINTR) return -1;
+    }
+    netlink_source.num_devices = 0;
+    return 0;
+}
+
+/*
+* @brief Receives one datagram into the buffer. Multicast messages lost to
+*        a full socket mark the names stale, as one of them may have been
+*        a link change.
+*
+* @returns its length, or -1 with errno set
+*/
+ssize_t receive_datagram(int flags)
+{
+    ssize_t length;
+    while(1)
+    {
+        length = recv(netlink_source.fd, netlink_source.buffer, netlink_source.capacity, flags | MSG_TRUNC);
+        sampler_stats.read_syscalls++;
+        if(length >= 0) break;
+        if(errno == EINTR) continue;
+        if(errno == ENOBUFS) {netlink_source.names_stale = 1; continue;}
+        return -1;
+    }
+    if((size_t)length > netlink_source.capacity) {errno = EMSGSIZE; return -1;}
+    sampler_stats.bytes_read += (size_t)length;
+    netlink_source.datagrams++;
+    return length;
+}
+
+/*
+* @returns 1 if message is a link notification rather than part of a dump
+*/
+static inline int is_link_notification(const struct nlmsghdr *message)
+{
+    return message->nlmsg_seq == 0 && (message->nlmsg_type == RTM_NEWLINK || message->nlmsg_type == RTM_DELLINK);
+}
+
+/*
+* @brief Reads the link notifications queued since the last sample, without
+*        waiting, so a change is seen before the dump is chosen.
+*
+* @returns 0 on success, -1 with errno set on failure
+*/
+int drain_link_notifications()
+{
+    while(1)
+    {
+        ssize_t length = receive_datagram(MSG_DONTWAIT);
+        if(length < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+        int remaining = (int)length;
+        for(const struct nlmsghdr *message = (const struct nlmsghdr*)netlink_source.buffer;
+            NLMSG_OK(message, remaining); message = NLMSG_NEXT(message, remaining))
+        {
+            if(is_link_notification(message)) netlink_source.names_stale = 1;
+        }
+    }
+}
+
+/*
+* @brief Receives the dump last requested, passing each of its messages to
+*        handle. Messages left from an earlier dump that failed part way are
+*        told apart by their sequence number and dropped.
+*
+* @returns 0 on success, -1 with errno set on failure
+*/
+int receive_dump(void (*handle)(const struct nlmsghdr *message))
+{
+    while(1)
+    {
+        ssize_t length = receive_datagram(0);
+        if(length < 0) return -1;
+
+        int remaining = (int)length;
+        for(const struct nlmsghdr *message = (const struct nlmsghdr*)netlink_source.buffer;
+            NLMSG_OK(message, remaining); message = NLMSG_NEXT(message, remaining))
+        {
+            if(is_link_notification(message)) {netlink_source.names_stale = 1; continue;}
+            if(message->nlmsg_seq != netlink_source.seq) continue;
+            if(message->nlmsg_type == NLMSG_DONE) return 0;
+            if(message->nlmsg_type == NLMSG_ERROR)
+            {
+                const struct nlmsgerr *error = (const struct nlmsgerr*)NLMSG_DATA(message);
+                errno = error->error < 0 ? -error->error : EPROTO;
+                return -1;
+            }
+            handle(message);
+        }
+    }
+}
+
+/*
+* @breif helper for functions dump_links and dump_link_stats
+*        copies an rtnl_link_stats64 of size bytes, which is shorter on
+*        older kernels and may be longer on newer ones, into the counters of
+*        device in the columns of /proc/net/dev
+*/
+void copy_link_stats(struct network_device *device, const void *data, size_t size)
+{
+    struct rtnl_link_stats64 stats;
+    memset(&stats, 0, sizeof(stats));
+    memcpy(&stats, data, size < sizeof(stats) ? size : sizeof(stats));
+
+    uint64_t *counter = device->counter;
+    counter[NET_R_BYTES] = stats.rx_bytes;
+    counter[NET_R_PACKETS] = stats.rx_packets;
+    counter[NET_R_ERRS] = stats.rx_errors;
+    counter[NET_R_DROP] = stats.rx_dropped + stats.rx_missed_errors;
+    counter[NET_R_FIFO] = stats.rx_fifo_errors;
+    counter[NET_R_FRAME] = stats.rx_length_errors + stats.rx_over_errors + stats.rx_crc_errors + stats.rx_frame_errors;
+    counter[NET_R_COMPRESSED] = stats.rx_compressed;
+    counter[NET_R_MULTICAST] = stats.multicast;
+    counter[NET_T_BYTES] = stats.tx_bytes;
+    counter[NET_T_PACKETS] = stats.tx_packets;
+    counter[NET_T_ERRS] = stats.tx_errors;
+    counter[NET_T_DROP] = stats.tx_dropped;
+    counter[NET_T_FIFO] = stats.tx_fifo_errors;
+    counter[NET_T_COLLS] = stats.collisions;
+    counter[NET_T_CARRIER] = stats.tx_carrier_errors + stats.tx_aborted_errors + stats.tx_window_errors + stats.tx_heartbeat_errors;
+    counter[NET_T_COMPRESSED] = stats.tx_compressed;
+}
+
+/*
+* @brief Takes the name and counters of one RTM_NEWLINK message into the
+*        next device of network_info, and keeps the name by ifindex.
+*/
+void handle_link(const struct nlmsghdr *message)
+{
+    if(message->nlmsg_type != RTM_NEWLINK) return;
+
+    reserve_network_devices(netlink_source.num_devices + 1);
+    struct network_device *device = &network_info.devices[netlink_source.num_devices];
+    const struct ifinfomsg *link = (const struct ifinfomsg*)NLMSG_DATA(message);
+    int have_name = 0;
+
+    memset(device->counter, 0, sizeof(device->counter));
+    int length = (int)IFLA_PAYLOAD(message);
+    for(const struct rtattr *attribute = IFLA_RTA(link); RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length))
+    {
+        size_t payload = RTA_PAYLOAD(attribute);
+        if(attribute->rta_type == IFLA_IFNAME)
+        {
+            if(payload >= sizeof(device->face)) payload = sizeof(device->face) - 1;
+            memcpy(device->face, RTA_DATA(attribute), payload);
+            device->face[payload] = '\0';
+            have_name = 1;
+        }
+        else if(attribute->rta_type == IFLA_STATS64) copy_link_stats(device, RTA_DATA(attribute), payload);
+    }
+    if(!have_name) return;
+
+    add_link_name(link->ifi_index, device->face);
+    netlink_source.num_devices++;
+}
+
+/*
+* @brief Takes the counters of one RTM_NEWSTATS message into the next
+*        device of network_info, under the name kept for its ifindex. An
+*        ifindex with no name is a new link, and marks the names stale.
+*/
+void handle_link_stats(const struct nlmsghdr *message)
+{
+    if(message->nlmsg_type != RTM_NEWSTATS) return;
+
+    const struct if_stats_msg *header = (const struct if_stats_msg*)NLMSG_DATA(message);
+    int position = find_link_name((int)header->ifindex);
+    if(position < 0) {netlink_source.names_stale = 1; return;}
+
+    reserve_network_devices(netlink_source.num_devices + 1);
+    struct network_device *device = &network_info.devices[netlink_source.num_devices++];
+    memcpy(device->face, netlink_source.links[position].face, sizeof(device->face));
+    memset(device->counter, 0, sizeof(device->counter));
+
+    const struct rtattr *attribute = (const struct rtattr*)((const char*)header + NLMSG_ALIGN(sizeof(*header)));
+    int length = (int)NLMSG_PAYLOAD(message, sizeof(*header));
+    for(; RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length))
+    {
+        if(attribute->rta_type == IFLA_STATS_LINK_64) copy_link_stats(device, RTA_DATA(attribute), RTA_PAYLOAD(attribute));
+    }
+}
+
+/*
+* @brief Takes the snapshot from an RTM_GETLINK dump, and the names with it.
+*
+* @returns 0 on success, -1 with errno set on failure
+*/
+int dump_links()
+{
+    struct ifinfomsg link;
+    memset(&link, 0, sizeof(link));
+    link.ifi_family = AF_UNSPEC;
+
+    //Changes from here on may not be in the dump, so they mark the new names stale
+    clear_link_names();
+    netlink_source.names_stale = 0;
+    if(request_dump(RTM_GETLINK, &link, sizeof(link)) != 0) return -1;
+    netlink_source.link_dumps++;
+    if(receive_dump(handle_link) != 0) {netlink_source.names_stale = 1; return -1;}
+    return 0;
+}
+
+/*
+* @brief Takes the snapshot from an RTM_GETSTATS dump of the 64 bit link
+*        counters alone.
+*
+* @returns 0 on success, -1 with errno set on failure
+*/
+int dump_link_stats()
+{
+    struct if_stats_msg stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.family = AF_UNSPEC;
+    stats.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+
+    if(request_dump(RTM_GETSTATS, &stats, sizeof(stats)) != 0) return -1;
+    netlink_source.stats_dumps++;
+    return receive_dump(handle_link_stats);
+}
+
+/*
+* @brief Reads the counters of every interface over the netlink socket into
+*        network_info, the same snapshot update_network_info makes from
+*        /proc/net/dev: a stats dump while the names are current, a link
+*        dump when they are not or the kernel has no stats dump.
+*
+* @returns 0 on success, -1 with errno set on failure
+*/
+int update_network_links()
+{
+    if(open_netlink_source() != 0) return -1;
+    if(drain_link_notifications() != 0) return -1;
+
+    int result = -1;
+    if(!netlink_source.names_stale && !netlink_source.no_stats_dump)
+    {
+        result = dump_link_stats();
+        if(result != 0 && (errno == EOPNOTSUPP || errno == EINVAL)) netlink_source.no_stats_dump = 1;
+        //A link seen that was not in the last link dump
+        if(result == 0 && netlink_source.names_stale) result = -1;
+    }
+    if(result != 0 && (netlink_source.names_stale || netlink_source.no_stats_dump)) result = dump_links();
+    if(result != 0) return -1;
+
+    network_info.num_devices = netlink_source.num_devices;
+    network_info.sample_ns = monotonic_ns();
+    return 0;
+}
+
+/*
+* @brief Takes the network snapshot from the selected backend. If netlink
+*        fails the socket is closed and every later sample is read from
+*        /proc/net/dev, with the reason kept in netlink_source.error.
+*/
+void read_network_info()
+{
+    if(network_backend == NETWORK_BACKEND_NETLINK)
+    {
+        if(update_network_links() == 0) return;
+        netlink_source.error = errno;
+        close_netlink_source();
+        network_backend = NETWORK_BACKEND_PROC;
+    }
+    read_proc_source(&network_source);
+    update_network_info();
+}
@@ -0,0 +1,75 @@
+/*
+ * File: netlink.h
+ * Description: A second source for the network collector: the counters of
+ *              every interface read in binary over a netlink socket,
+ *              instead of the text of /proc/net/dev.
+ */
+#ifndef NETLINK_H
+#define NETLINK_H
+
+#include <stdint.h>
+
+#include "sys_mon.h"
+
+#define NETLINK_RECEIVE_BUFFER      32768 //The kernel never puts more than 32 KB of a dump in one datagram
+#define NETLINK_INITIAL_LINKS       64
+
+enum network_backend
+{
+    NETWORK_BACKEND_PROC,               //Parse /proc/net/dev
+    NETWORK_BACKEND_NETLINK,            //Read rtnl_link_stats64 from link and stats dumps
+    NUM_NETWORK_BACKENDS
+};
+
+/*
+* The name of an interface by its ifindex, from the last link dump.
+*/
+struct netlink_link
+{
+    int index;
+    char face[MAX_NETWORK_FACE_LENGTH];
+};
+
+/*
+* A NETLINK_ROUTE socket that stays open for the life of the program, the
+* buffer each datagram is received into, and the interface names.
+*
+* An RTM_GETLINK dump carries a name and the counters, but also everything
+* else about the link, over a kilobyte each. So the names are kept from
+* one, and while they are current a sample is an RTM_GETSTATS dump of just
+* the counters by ifindex. The socket is in the link multicast group, so a
+* link being added, removed or renamed marks the names stale and the next
+* sample is a link dump again.
+*/
+struct netlink_source
+{
+    int fd;
+    uint32_t seq;                       //Sequence number of the last dump requested
+    char *buffer;
+    size_t capacity;
+    int error;                          //errno of the failure that made the collector fall back to proc, 0 if none
+
+    int names_stale;
+    int no_stats_dump;                  //The kernel has no RTM_GETSTATS, every sample is a link dump
+    struct netlink_link *links;
+    int num_links;
+    int links_capacity;
+    int32_t *slots;                     //Index in links of each ifindex, -1 for a free slot
+    uint32_t slot_mask;
+    int num_devices;                    //Devices the dump in progress has filled in
+
+    uint64_t link_dumps;
+    uint64_t stats_dumps;
+    uint64_t datagrams;
+};
+
+extern struct netlink_source netlink_source;
+extern int network_backend;
+extern const char *network_backend_names[NUM_NETWORK_BACKENDS];
+
+int open_netlink_source();
+int update_network_links();
+void close_netlink_source();
+void read_network_info();
+
+#endif
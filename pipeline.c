@@ -0,0 +1,285 @@
+/*
+ * File: pipeline.c
+ * Description: Reads the proc files of the collectors on threads of their
+ *              own and hands the samples to the sinks' thread through
+ *              lock-free single producer, single consumer queues of the
+ *              latest sample.
+ *
+ * Notes:
+ *      Each stage's thread waits on its job's timer, so it samples on the
+ *      same aligned deadlines as run_scheduler would, pread()s its file
+ *      into the buffer it holds and publishes it by exchanging it with the
+ *      queue's latest one. The sinks' thread, the one running
+ *      run_scheduler, is woken through an eventfd, takes the latest buffer
+ *      in exchange for the one it took before, swaps it with the
+ *      collector's proc_source and parses it into the snapshot the
+ *      renderer, recorder and exporter read as before. Every read is
+ *      published, so slow frames or slow clients only make the sinks drop
+ *      the samples that were overtaken: the reads keep their deadlines and
+ *      what the sinks apply after a stall is the newest read, never one
+ *      from before it.
+ *
+ *      The threads touch nothing but their stage and queue. What they count
+ *      is added to sampler_stats by the sinks' thread, and their buffers are
+ *      not counted_malloc'd, so the allocations of a tick are the sinks'.
+ */
+#define _GNU_SOURCE //pthread_setaffinity_np and the cpu_set_t macros
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+#include "sys_mon.h"
+#include "pipeline.h"
+
+struct pipeline pipeline = {.wake_fd = -1, .stop_fd = -1};
+
+/*
+* @brief Makes a collector's job run on a thread of its own, pinned to cpu
+*        unless it is -1, reading source's file into a queue for apply.
+*/
+void add_pipeline_stage(struct scheduled_job *job, struct proc_source *source, void (*apply)(), int cpu)
+{
+    if(pipeline.num_stages == MAX_PIPELINE_STAGES) fatal_error("too many collector threads, could not add ", job->name);
+    struct pipeline_stage *stage = &pipeline.stages[pipeline.num_stages++];
+    memset(stage, 0, sizeof(*stage));
+    stage->job = job;
+    stage->source = source;
+    stage->apply = apply;
+    stage->cpu = cpu;
+    stage->queue.filling = 0;
+    stage->queue.latest = 1;
+    stage->queue.taken = 2;
+
+    char path[PROC_PATH_LENGTH];
+    int length = snprintf(path, sizeof(path), "%s/%s", proc_root, source->name);
+    if(length < 0 || (size_t)length >= sizeof(path)) fatal_error("proc path too long for ", source->name);
+    stage->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(stage->fd < 0) fatal_error("failed to open ", path);
+    job->threaded = 1;
+}
+
+/*
+* @brief Reads the stage's file into slot, growing its buffer if the file
+*        no longer fits. The same as read_proc_source, counted in the stage.
+*/
+void read_stage_file(struct pipeline_stage *stage, struct pipeline_buffer *slot)
+{
+    size_t length = 0;
+    uint64_t syscalls = 0;
+    while(1)
+    {
+        if(slot->capacity - length < SCAN_PADDING + 2)
+        {
+            slot->capacity = slot->capacity > 0 ? slot->capacity * 2 : PROC_SOURCE_INITIAL_SIZE;
+            slot->data = realloc(slot->data, slot->capacity);
+            if(slot->data == NULL) fatal_error("out of memory reading ", stage->source->name);
+            __atomic_store_n(&stage->allocations, stage->allocations + 1, __ATOMIC_RELAXED);
+        }
+
+        ssize_t bytes = pread(stage->fd, slot->data + length, slot->capacity - length - SCAN_PADDING - 1, (off_t)length);
+        syscalls++;
+        if(bytes < 0)
+        {
+            if(errno == EINTR) continue;
+            fatal_error("failed to read ", stage->source->name);
+        }
+        if(bytes == 0) break;
+        length += (size_t)bytes;
+    }
+
+    memset(slot->data + length, 0, SCAN_PADDING + 1);
+    slot->length = length;
+    slot->read_ns = monotonic_ns();
+    __atomic_store_n(&stage->read_syscalls, stage->read_syscalls + syscalls, __ATOMIC_RELAXED);
+    __atomic_store_n(&stage->bytes_read, stage->bytes_read + length, __ATOMIC_RELAXED);
+}
+
+/*
+* @brief Takes a sample for deadline into the buffer being filled and
+*        publishes it as the latest, dropping the one it replaces if the
+*        sinks had not taken it.
+*/
+void queue_stage_sample(struct pipeline_stage *stage, uint64_t deadline)
+{
+    struct pipeline_queue *queue = &stage->queue;
+    struct pipeline_buffer *slot = &queue->buffers[queue->filling];
+    uint64_t start = monotonic_ns();
+    read_stage_file(stage, slot);
+    slot->deadline_ns = deadline;
+    __atomic_store_n(&stage->read_ns, slot->read_ns - start, __ATOMIC_RELAXED);
+
+    //Release hands the sample over, acquire takes back the buffer the sinks were done with
+    uint32_t replaced = __atomic_exchange_n(&queue->latest, queue->filling | PIPELINE_FRESH, __ATOMIC_ACQ_REL);
+    queue->filling = replaced & ~PIPELINE_FRESH;
+    if(replaced & PIPELINE_FRESH) __atomic_store_n(&queue->dropped, queue->dropped + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&queue->published, queue->published + 1, __ATOMIC_RELAXED);
+
+    uint64_t one = 1;
+    if(write(pipeline.wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) fatal_error("failed to wake ", "the sinks");
+}
+
+/*
+* @brief A collector's thread: samples on its job's deadlines until
+*        stop_pipeline.
+*/
+void *pipeline_stage_main(void *arg)
+{
+    struct pipeline_stage *stage = arg;
+    struct pollfd fds[2] = {{stage->job->fd, POLLIN, 0}, {pipeline.stop_fd, POLLIN, 0}};
+    while(1)
+    {
+        if(poll(fds, 2, -1) < 0)
+        {
+            if(errno == EINTR) continue;
+            fatal_error("failed to wait for the timer of ", stage->job->name);
+        }
+        if(fds[1].revents != 0) break;
+        uint64_t deadline = expire_job(stage->job);
+        if(deadline != 0) queue_stage_sample(stage, deadline);
+    }
+    return NULL;
+}
+
+/*
+* @brief Arms the stages' timers and starts their threads.
+*/
+void start_pipeline()
+{
+    if(pipeline.num_stages == 0) return;
+    pipeline.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pipeline.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(pipeline.wake_fd < 0 || pipeline.stop_fd < 0) fatal_error("failed to create ", "the pipeline's eventfds");
+
+    //The threads leave the signals to the scheduler's thread
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    for(int i = 0; i < pipeline.num_stages; i++)
+    {
+        struct pipeline_stage *stage = &pipeline.stages[i];
+        open_job_timer(stage->job);
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+        if(stage->cpu >= 0)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(stage->cpu, &cpus);
+            pthread_attr_setaffinity_np(&attributes, sizeof(cpus), &cpus);
+        }
+        int error = pthread_create(&stage->thread, &attributes, pipeline_stage_main, stage);
+        if(error != 0 && stage->cpu >= 0)
+        {
+            //A cpu that is offline or outside the cpuset just leaves it unpinned
+            stage->cpu = -1;
+            error = pthread_create(&stage->thread, NULL, pipeline_stage_main, stage);
+        }
+        pthread_attr_destroy(&attributes);
+        if(error != 0) fatal_error("failed to start the thread of ", stage->job->name);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    pipeline.active = 1;
+}
+
+/*
+* @brief Adds what a stage's thread counted since the last call to
+*        sampler_stats.
+*/
+void count_stage(struct pipeline_stage *stage)
+{
+    uint64_t syscalls = __atomic_load_n(&stage->read_syscalls, __ATOMIC_RELAXED);
+    uint64_t bytes = __atomic_load_n(&stage->bytes_read, __ATOMIC_RELAXED);
+    uint64_t allocations = __atomic_load_n(&stage->allocations, __ATOMIC_RELAXED);
+    sampler_stats.read_syscalls += syscalls - stage->counted_syscalls;
+    sampler_stats.bytes_read += bytes - stage->counted_bytes;
+    sampler_stats.allocations += allocations - stage->counted_allocations;
+    stage->counted_syscalls = syscalls;
+    stage->counted_bytes = bytes;
+    stage->counted_allocations = allocations;
+}
+
+/*
+* @brief Applies the latest sample of each stage that has published one
+*        since the last call. scheduler_tick_ns is set to the latest
+*        deadline applied. The scheduler calls it when the threads signal
+*        wake_fd.
+*
+* @returns 1 if a sample of a collector that is shown was applied
+*/
+int drain_pipeline(int wake_fd)
+{
+    uint64_t count;
+    if(read(wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) fatal_error("failed to read ", "the pipeline's eventfd");
+
+    int redraw = 0;
+    for(int i = 0; i < pipeline.num_stages; i++)
+    {
+        struct pipeline_stage *stage = &pipeline.stages[i];
+        struct pipeline_queue *queue = &stage->queue;
+        if(!(__atomic_load_n(&queue->latest, __ATOMIC_RELAXED) & PIPELINE_FRESH)) continue;
+        //Only the collector changes latest meanwhile, and only to a fresher sample
+        uint32_t latest = __atomic_exchange_n(&queue->latest, queue->taken, __ATOMIC_ACQ_REL);
+        queue->taken = latest & ~PIPELINE_FRESH;
+
+        struct pipeline_buffer *slot = &queue->buffers[queue->taken];
+        struct proc_source *source = stage->source;
+        char *buffer = source->buffer;
+        size_t capacity = source->capacity;
+        source->buffer = slot->data;
+        source->capacity = slot->capacity;
+        source->length = slot->length;
+        source->read_ns = slot->read_ns;
+        slot->data = buffer;
+        slot->capacity = capacity;
+        uint64_t deadline = slot->deadline_ns;
+
+        if(deadline > scheduler_tick_ns) scheduler_tick_ns = deadline;
+        stage->apply();
+        uint64_t latency = monotonic_ns() - source->read_ns;
+        stage->latency_sum_ns += latency;
+        if(latency > stage->latency_max_ns) stage->latency_max_ns = latency;
+        stage->applied++;
+        count_stage(stage);
+        redraw |= !stage->job->quiet;
+    }
+    return redraw;
+}
+
+/*
+* @brief Stops the threads. The statistics of the stages stay until
+*        free_pipeline.
+*/
+void stop_pipeline()
+{
+    if(!pipeline.active) return;
+    uint64_t one = 1;
+    if(write(pipeline.stop_fd, &one, sizeof(one)) < 0) fatal_error("failed to stop ", "the collector threads");
+    for(int i = 0; i < pipeline.num_stages; i++) pthread_join(pipeline.stages[i].thread, NULL);
+    pipeline.active = 0;
+}
+
+/*
+* @brief Stops the threads if they run and frees the queues.
+*/
+void free_pipeline()
+{
+    stop_pipeline();
+    for(int i = 0; i < pipeline.num_stages; i++)
+    {
+        struct pipeline_stage *stage = &pipeline.stages[i];
+        if(stage->job->fd >= 0) close(stage->job->fd);
+        stage->job->fd = -1;
+        stage->job->threaded = 0;
+        close(stage->fd);
+        for(int slot = 0; slot < PIPELINE_BUFFERS; slot++) free(stage->queue.buffers[slot].data);
+    }
+    if(pipeline.wake_fd >= 0) close(pipeline.wake_fd);
+    if(pipeline.stop_fd >= 0) close(pipeline.stop_fd);
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.wake_fd = -1;
+    pipeline.stop_fd = -1;
+}
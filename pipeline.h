@@ -0,0 +1,98 @@
+/*
+ * File: pipeline.h
+ * Description: Reads the proc files of the collectors on threads of their
+ *              own and hands the samples to the sinks' thread through
+ *              lock-free single producer, single consumer queues of the
+ *              latest sample.
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "sys_mon.h"
+#include "scheduler.h"
+
+#define PIPELINE_BUFFERS            3 //The one being read into, the one published and the one taken
+#define PIPELINE_FRESH              4u //Set in latest until the sinks take it
+#define MAX_PIPELINE_STAGES         8
+
+/*
+* One sample of a proc file, padded like a proc_source buffer. The sinks'
+* thread swaps the buffer with its proc_source's rather than copying it.
+*/
+struct pipeline_buffer
+{
+    char *data;
+    size_t capacity;
+    size_t length;
+    uint64_t read_ns;                   //CLOCK_MONOTONIC when it was read
+    uint64_t deadline_ns;               //Deadline it was read for
+};
+
+/*
+* The latest sample of a collector's thread for the sinks' thread, in three
+* buffers. The collector reads into the one it is filling and exchanges it
+* with latest, so it always publishes its newest read and never waits; the
+* sinks exchange the one they took last with latest when it is fresh. Each
+* side owns the buffer it holds, so neither takes a lock. A sample the
+* sinks had not taken when a newer one was published is dropped, so a slow
+* sink falls forward to the newest sample rather than delaying collection
+* or applying an old one.
+*/
+struct pipeline_queue
+{
+    uint64_t published __attribute__((aligned(64))); //Samples read, written by the collector
+    uint64_t dropped;                   //Samples replaced by a newer one before the sinks took them
+    uint32_t filling;                   //Buffer the collector reads into
+    uint32_t latest __attribute__((aligned(64))); //Buffer published last, with PIPELINE_FRESH until it is taken
+    uint32_t taken;                     //Buffer the sinks took last
+    struct pipeline_buffer buffers[PIPELINE_BUFFERS];
+};
+
+/*
+* A collector run on a thread. The job keeps its name, interval and tick
+* statistics, and its timer is waited on by the thread instead of
+* run_scheduler.
+*/
+struct pipeline_stage
+{
+    struct scheduled_job *job;
+    struct proc_source *source;         //Parsed by the sinks' thread, the thread reads its file into the queue
+    void (*apply)();                    //Parses source into the collector's snapshot, on the sinks' thread
+    int fd;                             //The thread's own descriptor of the file
+    int cpu;                            //Cpu the thread is pinned to, -1 for none
+    pthread_t thread;
+    struct pipeline_queue queue;
+
+    uint64_t read_ns;                   //What the last read took, written by the thread
+    uint64_t read_syscalls;             //Written by the thread and added to sampler_stats by the sinks
+    uint64_t bytes_read;
+    uint64_t allocations;
+    uint64_t counted_syscalls;          //How much of them is in sampler_stats
+    uint64_t counted_bytes;
+    uint64_t counted_allocations;
+    uint64_t applied;
+    uint64_t latency_sum_ns;            //From each sample read to it being applied
+    uint64_t latency_max_ns;
+};
+
+struct pipeline
+{
+    int active;
+    int num_stages;
+    struct pipeline_stage stages[MAX_PIPELINE_STAGES];
+    int wake_fd;                        //eventfd the threads signal after publishing a sample
+    int stop_fd;                        //eventfd that stops them
+};
+
+extern struct pipeline pipeline;
+
+void add_pipeline_stage(struct scheduled_job *job, struct proc_source *source, void (*apply)(), int cpu);
+void start_pipeline();
+int drain_pipeline(int wake_fd);
+void stop_pipeline();
+void free_pipeline();
+
+#endif
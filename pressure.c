@@ -0,0 +1,323 @@
+/*
+ * File: pressure.c
+ * Description: The pressure stall collector: the some and full averages
+ *              and stall time of cpu, memory and io from /proc/pressure,
+ *              and PSI triggers that wake sys_mon when a stall threshold
+ *              is crossed.
+ *
+ * Notes:
+ *      A trigger is a line such as "some 150000 1000000" written to a
+ *      pressure file opened for writing: the kernel then signals POLLPRI
+ *      on that descriptor when tasks stalled on the resource for 150 ms
+ *      within any 1 s window, at most once a window, and is otherwise
+ *      silent. The descriptors are watched by the scheduler next to its
+ *      timers, so an alert is handled the moment the kernel raises it and
+ *      an idle system costs nothing between alerts. They go straight into
+ *      the scheduler's epoll set rather than a set of their own nested in
+ *      it: the kernel clears the event when the descriptor is polled, so
+ *      the outer set would wake and the inner one find nothing.
+ */
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "sys_mon.h"
+#include "scan.h"
+#include "selfstats.h"
+#include "pressure.h"
+
+const char *pressure_resource_names[NUM_PRESSURE_RESOURCES] = {"cpu", "memory", "io"};
+const char *pressure_kind_names[NUM_PRESSURE_KINDS] = {"some", "full"};
+
+struct proc_source pressure_sources[NUM_PRESSURE_RESOURCES] =
+{
+    {PRESSURE_DIR "/cpu", "", -1, NULL, 0, 0, 0},
+    {PRESSURE_DIR "/memory", "", -1, NULL, 0, 0, 0},
+    {PRESSURE_DIR "/io", "", -1, NULL, 0, 0, 0},
+};
+struct pressure_stats pressure_stats;
+struct pressure_rates pressure_rates;
+struct pressure_alerts pressure_alerts;
+
+/*
+* @brief Finds which resources the kernel reports pressure for under the
+*        proc root. A kernel built without PSI has no pressure directory.
+*
+* @returns the number of resources found
+*/
+int init_pressure()
+{
+    int available = 0;
+    for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+    {
+        char path[PROC_PATH_LENGTH];
+        int length = snprintf(path, sizeof(path), "%s/%s", proc_root, pressure_sources[resource].name);
+        if(length < 0 || (size_t)length >= sizeof(path)) fatal_error("proc path too long for ", pressure_sources[resource].name);
+        pressure_stats.available[resource] = access(path, R_OK) == 0;
+        available += pressure_stats.available[resource];
+    }
+    pressure_rates.have_previous = 0;
+    return available;
+}
+
+/*
+* @brief Converts the value of a name=value token, such as avg10=4.43, in
+*        hundredths when decimal.
+*/
+uint64_t scan_pressure_value(const char *token, size_t length, int decimal)
+{
+    const char *p = memchr(token, '=', length);
+    const char *end = token + length;
+    uint64_t value = 0;
+    if(p == NULL) return 0;
+    for(p++; p < end && *p != '.'; p++) value = value * 10 + (uint64_t)(*p - '0');
+    if(!decimal) return value;
+
+    int decimals = 0;
+    if(p < end) p++;
+    for(; p < end && decimals < 2; p++, decimals++) value = value * 10 + (uint64_t)(*p - '0');
+    for(; decimals < 2; decimals++) value *= 10;
+    return value;
+}
+
+/*
+* @brief Parses the some and full lines of a pressure file, the proc
+*        root's or a cgroup's, into lines.
+*/
+void parse_pressure_lines(const char *text, struct pressure_line lines[NUM_PRESSURE_KINDS])
+{
+    const char *cursor = text;
+    lines[PRESSURE_SOME].present = 0;
+    lines[PRESSURE_FULL].present = 0;
+    while(*cursor != '\0')
+    {
+        const char *token;
+        size_t length = scan_token(&cursor, &token);
+        int kind = token_is(token, length, "some") ? PRESSURE_SOME : token_is(token, length, "full") ? PRESSURE_FULL : -1;
+        if(kind >= 0)
+        {
+            struct pressure_line *line = &lines[kind];
+            for(int average = 0; average < NUM_PRESSURE_AVERAGES; average++)
+            {
+                length = scan_token(&cursor, &token);
+                line->average[average] = (uint32_t)scan_pressure_value(token, length, 1);
+            }
+            length = scan_token(&cursor, &token);
+            line->total_us = scan_pressure_value(token, length, 0);
+            line->present = 1;
+        }
+        cursor = skip_line(cursor);
+    }
+}
+
+/*
+* @brief Parses a resource's pressure file, already read into its source.
+*/
+void update_pressure_stats(int resource)
+{
+    parse_pressure_lines(pressure_sources[resource].buffer, pressure_stats.line[resource]);
+}
+
+/*
+* @brief Works out the share of time stalled since the previous sample.
+*/
+void update_pressure_rates()
+{
+    uint64_t elapsed = pressure_stats.sample_ns - pressure_rates.previous_ns;
+    for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+    {
+        for(int kind = 0; kind < NUM_PRESSURE_KINDS; kind++)
+        {
+            const struct pressure_line *line = &pressure_stats.line[resource][kind];
+            int valid = pressure_rates.have_previous && line->present && elapsed > 0 &&
+                        line->total_us >= pressure_rates.previous_total_us[resource][kind];
+            pressure_rates.valid[resource][kind] = valid;
+            if(valid)
+            {
+                uint64_t stalled = line->total_us - pressure_rates.previous_total_us[resource][kind];
+                pressure_rates.stall_pct[resource][kind] = (double)stalled * 1000 * 100 / (double)elapsed;
+            }
+            pressure_rates.previous_total_us[resource][kind] = line->total_us;
+        }
+    }
+    pressure_rates.previous_ns = pressure_stats.sample_ns;
+    pressure_rates.have_previous = 1;
+}
+
+/*
+* @brief Takes a pressure sample of every resource the kernel reports.
+*/
+void sample_pressure()
+{
+    uint64_t start = monotonic_ns();
+    for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+    {
+        if(!pressure_stats.available[resource]) continue;
+        read_proc_source(&pressure_sources[resource]);
+        update_pressure_stats(resource);
+    }
+    pressure_stats.sample_ns = monotonic_ns();
+    update_pressure_rates();
+    probe_end(PROBE_PRESSURE, start);
+}
+
+/*
+* @brief Closes the pressure files.
+*/
+void close_pressure()
+{
+    for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++) close_proc_source(&pressure_sources[resource]);
+    memset(&pressure_stats, 0, sizeof(pressure_stats));
+    memset(&pressure_rates, 0, sizeof(pressure_rates));
+}
+
+/*
+* @brief Reads a duration such as 150ms, 500us or 1s, or 2 for seconds,
+*        from the text up to end.
+*
+* @returns microseconds, 0 if it is not one
+*/
+uint64_t parse_pressure_duration(const char *text, const char *end)
+{
+    char number[32];
+    if(end - text <= 0 || end - text >= (long)sizeof(number)) return 0;
+    memcpy(number, text, (size_t)(end - text));
+    number[end - text] = '\0';
+
+    char *unit;
+    double value = strtod(number, &unit);
+    if(unit == number || value <= 0) return 0;
+    if(strcmp(unit, "us") == 0) return (uint64_t)(value + 0.5);
+    if(strcmp(unit, "ms") == 0) return (uint64_t)(value * 1e3 + 0.5);
+    if(strcmp(unit, "s") == 0 || *unit == '\0') return (uint64_t)(value * 1e6 + 0.5);
+    return 0;
+}
+
+/*
+* @brief Adds a trigger given as RESOURCE:some|full:STALL:WINDOW, such as
+*        memory:some:150ms:1s. It is armed by open_pressure_alerts.
+*/
+void add_pressure_trigger(const char *spec)
+{
+    if(pressure_alerts.num_triggers == MAX_PRESSURE_TRIGGERS) fatal_error("too many --psi-trigger, could not add ", spec);
+    if(strlen(spec) >= PRESSURE_TRIGGER_LENGTH) fatal_error("--psi-trigger too long: ", spec);
+
+    const char *fields[4];
+    const char *ends[4];
+    const char *p = spec;
+    for(int i = 0; i < 4; i++)
+    {
+        fields[i] = p;
+        const char *colon = strchr(p, ':');
+        ends[i] = colon != NULL ? colon : p + strlen(p);
+        if((colon == NULL) != (i == 3)) fatal_error("a --psi-trigger is RESOURCE:some|full:STALL:WINDOW, not ", spec);
+        p = ends[i] + 1;
+    }
+
+    struct pressure_trigger *trigger = &pressure_alerts.triggers[pressure_alerts.num_triggers];
+    memset(trigger, 0, sizeof(*trigger));
+    trigger->resource = -1;
+    trigger->kind = -1;
+    for(int resource = 0; resource < NUM_PRESSURE_RESOURCES; resource++)
+    {
+        if(token_is(fields[0], (size_t)(ends[0] - fields[0]), pressure_resource_names[resource])) trigger->resource = resource;
+    }
+    for(int kind = 0; kind < NUM_PRESSURE_KINDS; kind++)
+    {
+        if(token_is(fields[1], (size_t)(ends[1] - fields[1]), pressure_kind_names[kind])) trigger->kind = kind;
+    }
+    if(trigger->resource < 0) fatal_error("a --psi-trigger resource is cpu, memory or io, not in ", spec);
+    if(trigger->kind < 0) fatal_error("a --psi-trigger stall is some or full, not in ", spec);
+
+    trigger->stall_us = parse_pressure_duration(fields[2], ends[2]);
+    trigger->window_us = parse_pressure_duration(fields[3], ends[3]);
+    if(trigger->window_us < 500000 || trigger->window_us > 10000000)
+    {
+        fatal_error("a --psi-trigger window is 500ms to 10s, not in ", spec);
+    }
+    if(trigger->stall_us == 0 || trigger->stall_us > trigger->window_us)
+    {
+        fatal_error("a --psi-trigger stall is more than 0 and no longer than its window, not in ", spec);
+    }
+    snprintf(trigger->spec, sizeof(trigger->spec), "%s", spec);
+    trigger->fd = -1;
+    pressure_alerts.num_triggers++;
+}
+
+/*
+* @brief Arms the triggers, DEFAULT_PRESSURE_TRIGGER if none were added,
+*        for the scheduler to watch for POLLPRI and hand to
+*        serve_pressure_trigger. alert is called for each firing.
+*/
+void open_pressure_alerts(int (*alert)(const struct pressure_trigger *trigger))
+{
+    if(pressure_alerts.num_triggers == 0) add_pressure_trigger(DEFAULT_PRESSURE_TRIGGER);
+    pressure_alerts.alert = alert;
+    pressure_alerts.active = 1;
+
+    for(int i = 0; i < pressure_alerts.num_triggers; i++)
+    {
+        struct pressure_trigger *trigger = &pressure_alerts.triggers[i];
+        const char *name = pressure_sources[trigger->resource].name;
+        char path[PROC_PATH_LENGTH];
+        int length = snprintf(path, sizeof(path), "%s/%s", proc_root, name);
+        if(length < 0 || (size_t)length >= sizeof(path)) fatal_error("proc path too long for ", name);
+        trigger->fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if(trigger->fd < 0) fatal_error("failed to open for a PSI trigger ", path);
+
+        //The kernel takes the line with its terminating nul
+        char line[64];
+        length = snprintf(line, sizeof(line), "%s %" PRIu64 " %" PRIu64, pressure_kind_names[trigger->kind],
+                              trigger->stall_us, trigger->window_us);
+        if(write(trigger->fd, line, (size_t)length + 1) < 0)
+        {
+            //Without CAP_SYS_RESOURCE the kernel only takes windows that are whole multiples of 2s
+            int unprivileged = errno == EPERM || errno == EACCES || (errno == EINVAL && trigger->window_us % 2000000 != 0);
+            fatal_error(unprivileged ? "the kernel refused, as without CAP_SYS_RESOURCE a window must be a multiple of 2s, "
+                        "the PSI trigger " : "the kernel refused the PSI trigger ", trigger->spec);
+        }
+    }
+}
+
+/*
+* @brief Handles a firing of the trigger on fd, calling alert. The
+*        scheduler calls it when fd signals POLLPRI.
+*
+* @returns 1 if the alert asked for the screen to be redrawn
+*/
+int serve_pressure_trigger(int fd)
+{
+    int index = 0;
+    while(index < pressure_alerts.num_triggers && pressure_alerts.triggers[index].fd != fd) index++;
+    if(index == pressure_alerts.num_triggers) return 0;
+    struct pressure_trigger *trigger = &pressure_alerts.triggers[index];
+
+    //Polling again would clear a firing that came in meanwhile, so nothing is read here
+    trigger->fired++;
+    trigger->last_fired_ns = realtime_ns();
+    return pressure_alerts.alert(trigger);
+}
+
+/*
+* @brief Takes the next line of the ring of recent alerts, for an alert
+*        to write itself into.
+*/
+char *next_pressure_alert()
+{
+    char *line = pressure_alerts.recent[pressure_alerts.alerts % PRESSURE_RECENT_ALERTS];
+    pressure_alerts.alerts++;
+    if(pressure_alerts.num_recent < PRESSURE_RECENT_ALERTS) pressure_alerts.num_recent++;
+    return line;
+}
+
+/*
+* @brief Removes the triggers.
+*/
+void close_pressure_alerts()
+{
+    for(int i = 0; i < pressure_alerts.num_triggers; i++)
+    {
+        if(pressure_alerts.triggers[i].fd >= 0) close(pressure_alerts.triggers[i].fd);
+    }
+    memset(&pressure_alerts, 0, sizeof(pressure_alerts));
+}
@@ -0,0 +1,136 @@
+/*
+ * File: pressure.h
+ * Description: The pressure stall collector: the some and full averages
+ *              and stall time of cpu, memory and io from /proc/pressure,
+ *              and PSI triggers that wake sys_mon when a stall threshold
+ *              is crossed.
+ */
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sys_mon.h"
+
+#define PRESSURE_DIR                "pressure"
+#define MAX_PRESSURE_TRIGGERS       8
+#define PRESSURE_TRIGGER_LENGTH     48
+#define PRESSURE_RECENT_ALERTS      8 //Alerts the loop modes' screen keeps
+#define PRESSURE_ALERT_LENGTH       320
+#define DEFAULT_PRESSURE_TRIGGER    "memory:some:150ms:1s"
+
+enum pressure_resource
+{
+    PRESSURE_CPU,
+    PRESSURE_MEMORY,
+    PRESSURE_IO,
+    NUM_PRESSURE_RESOURCES
+};
+
+/*
+* some is time at least one task stalled on the resource, full time all
+* non-idle tasks did at once.
+*/
+enum pressure_kind
+{
+    PRESSURE_SOME,
+    PRESSURE_FULL,
+    NUM_PRESSURE_KINDS
+};
+
+enum pressure_average
+{
+    PRESSURE_AVG10,
+    PRESSURE_AVG60,
+    PRESSURE_AVG300,
+    NUM_PRESSURE_AVERAGES
+};
+
+/*
+* A some or full line. The kernel prints the averages as percentages with
+* two decimals, they are kept in hundredths of a percent.
+*/
+struct pressure_line
+{
+    int present;                        //Kernels before 5.13 have no full line for cpu
+    uint32_t average[NUM_PRESSURE_AVERAGES];
+    uint64_t total_us;                  //Stall time since boot
+};
+
+struct pressure_stats
+{
+    int available[NUM_PRESSURE_RESOURCES]; //The file exists, the kernel has PSI
+    struct pressure_line line[NUM_PRESSURE_RESOURCES][NUM_PRESSURE_KINDS];
+    uint64_t sample_ns;
+};
+
+/*
+* Share of the time between the last two samples spent stalled, from the
+* totals, which unlike avg10 covers exactly the sampling interval.
+*/
+struct pressure_rates
+{
+    int have_previous;
+    uint64_t previous_ns;
+    uint64_t previous_total_us[NUM_PRESSURE_RESOURCES][NUM_PRESSURE_KINDS];
+    int valid[NUM_PRESSURE_RESOURCES][NUM_PRESSURE_KINDS];
+    double stall_pct[NUM_PRESSURE_RESOURCES][NUM_PRESSURE_KINDS];
+};
+
+/*
+* A PSI trigger: the kernel makes fd signal POLLPRI when the resource
+* stalled for stall_us or more within a window_us window, at most once a
+* window.
+*/
+struct pressure_trigger
+{
+    char spec[PRESSURE_TRIGGER_LENGTH]; //As given, memory:some:150ms:1s
+    int resource;
+    int kind;
+    uint64_t stall_us;
+    uint64_t window_us;
+    int fd;
+    uint64_t fired;
+    uint64_t last_fired_ns;             //CLOCK_REALTIME
+};
+
+/*
+* The triggers, each watched by the scheduler from open_pressure_alerts
+* on. Each firing is handed to alert, which snapshots the other collectors
+* and returns 1 to redraw the screen. The latest alert lines are kept for
+* the screen.
+*/
+struct pressure_alerts
+{
+    int active;
+    int num_triggers;
+    struct pressure_trigger triggers[MAX_PRESSURE_TRIGGERS];
+    int (*alert)(const struct pressure_trigger *trigger);
+    uint64_t alerts;
+    int num_recent;
+    char recent[PRESSURE_RECENT_ALERTS][PRESSURE_ALERT_LENGTH]; //Ring, the newest at (alerts - 1) % PRESSURE_RECENT_ALERTS
+};
+
+extern const char *pressure_resource_names[NUM_PRESSURE_RESOURCES];
+extern const char *pressure_kind_names[NUM_PRESSURE_KINDS];
+extern struct proc_source pressure_sources[NUM_PRESSURE_RESOURCES];
+extern struct pressure_stats pressure_stats;
+extern struct pressure_rates pressure_rates;
+extern struct pressure_alerts pressure_alerts;
+
+int init_pressure();
+uint64_t scan_pressure_value(const char *token, size_t length, int decimal);
+void parse_pressure_lines(const char *text, struct pressure_line lines[NUM_PRESSURE_KINDS]);
+void update_pressure_stats(int resource);
+void update_pressure_rates();
+void sample_pressure();
+void close_pressure();
+
+void add_pressure_trigger(const char *spec);
+void open_pressure_alerts(int (*alert)(const struct pressure_trigger *trigger));
+int serve_pressure_trigger(int fd);
+char *next_pressure_alert();
+void close_pressure_alerts();
+
+#endif
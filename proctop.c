@@ -0,0 +1,630 @@
+/*
+ * File: proctop.c
+ * Description: Per process cpu, memory, I/O and context switches from
+ *              /proc/[pid], and the top N processes by one of them.
+ *
+ * Notes:
+ *      A refresh reads /proc/loadavg, whose last field is the last pid the
+ *      kernel allocated. If it has not moved no process was created, so
+ *      the directory is not listed again and only the known processes are
+ *      read. A listing uses getdents64 into one preallocated buffer.
+ *
+ *      Switches are the third field of schedstat, the times the process
+ *      was switched to, which is voluntary_ctxt_switches plus
+ *      nonvoluntary_ctxt_switches of status give or take the current run.
+ *      schedstat is a short line where status is 1.5 kB of formatted text,
+ *      so status is only read for a process whose schedstat is missing,
+ *      without CONFIG_SCHED_INFO, or all zero, with schedstats off.
+ *
+ *      The reads are split across --threads threads, each taking a
+ *      contiguous share of the entries. The calling thread takes the
+ *      first share. Entries are only added and removed between refreshes,
+ *      on the calling thread.
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "sys_mon.h"
+#include "scan.h"
+#include "proctop.h"
+
+struct proc_top proc_top;
+const char *proc_sort_names[NUM_PROC_SORTS] = {"cpu", "rss", "io", "switches"};
+const char *proc_file_names[NUM_PROC_FILES] = {"stat", "statm", "io", "schedstat", "status"};
+
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static inline uint32_t pid_slot(int pid)
+{
+    return ((uint32_t)pid * 2654435761u) & proc_top.slot_mask;
+}
+
+/*
+* @returns the entry index of pid, or -1 if it is not tracked
+*/
+int find_proc_entry(int pid)
+{
+    for(uint32_t slot = pid_slot(pid); proc_top.slots[slot] >= 0; slot = (slot + 1) & proc_top.slot_mask)
+    {
+        if(proc_top.entries[proc_top.slots[slot]].pid == pid) return proc_top.slots[slot];
+    }
+    return -1;
+}
+
+void set_proc_slot(int pid, int index)
+{
+    uint32_t slot = pid_slot(pid);
+    while(proc_top.slots[slot] >= 0 && proc_top.entries[proc_top.slots[slot]].pid != pid) slot = (slot + 1) & proc_top.slot_mask;
+    proc_top.slots[slot] = index;
+}
+
+/*
+* @brief Frees the slot of pid, moving back the entries after it that
+*        would otherwise no longer be found.
+*/
+void remove_proc_slot(int pid)
+{
+    uint32_t slot = pid_slot(pid);
+    while(proc_top.entries[proc_top.slots[slot]].pid != pid) slot = (slot + 1) & proc_top.slot_mask;
+
+    uint32_t hole = slot;
+    for(uint32_t next = (hole + 1) & proc_top.slot_mask; proc_top.slots[next] >= 0; next = (next + 1) & proc_top.slot_mask)
+    {
+        uint32_t home = pid_slot(proc_top.entries[proc_top.slots[next]].pid);
+        //The entry can fill the hole if its home is not between the hole and it
+        if(((next - home) & proc_top.slot_mask) >= ((next - hole) & proc_top.slot_mask))
+        {
+            proc_top.slots[hole] = proc_top.slots[next];
+            hole = next;
+        }
+    }
+    proc_top.slots[hole] = -1;
+}
+
+/*
+* @brief Doubles the entries and the pid table, which is kept at least
+*        twice as large as the entries.
+*/
+void grow_proc_top()
+{
+    proc_top.capacity = proc_top.capacity > 0 ? proc_top.capacity * 2 : 1024;
+    proc_top.entries = counted_realloc(proc_top.entries, (size_t)proc_top.capacity * sizeof(struct proc_entry));
+
+    uint32_t num_slots = (uint32_t)proc_top.capacity * 2;
+    free(proc_top.slots);
+    proc_top.slots = counted_malloc(num_slots * sizeof(int32_t));
+    memset(proc_top.slots, 0xff, num_slots * sizeof(int32_t));
+    proc_top.slot_mask = num_slots - 1;
+    for(int i = 0; i < proc_top.num_entries; i++) set_proc_slot(proc_top.entries[i].pid, i);
+}
+
+int add_proc_entry(int pid)
+{
+    if(proc_top.num_entries == proc_top.capacity) grow_proc_top();
+    int index = proc_top.num_entries++;
+    struct proc_entry *entry = &proc_top.entries[index];
+    memset(entry, 0, sizeof(*entry));
+    entry->pid = pid;
+    for(int file = 0; file < NUM_PROC_FILES; file++) entry->fd[file] = -1;
+    entry->unreadable = 1u << PROC_FILE_STATUS;
+    set_proc_slot(pid, index);
+    return index;
+}
+
+/*
+* @brief Opens a file of a process, relative to the proc root.
+*
+* @returns the descriptor, also kept in the entry, or -1
+*/
+int open_proc_file(struct proc_entry *entry, int file)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "%d/%s", entry->pid, proc_file_names[file]);
+    entry->fd[file] = openat(proc_top.proc_fd, path, O_RDONLY | O_CLOEXEC);
+    return entry->fd[file];
+}
+
+void close_proc_files(struct proc_entry *entry)
+{
+    for(int file = 0; file < NUM_PROC_FILES; file++)
+    {
+        if(entry->fd[file] >= 0) close(entry->fd[file]);
+        entry->fd[file] = -1;
+    }
+}
+
+/*
+* @brief Removes an entry, moving the last entry into its place.
+*/
+void remove_proc_entry(int index)
+{
+    struct proc_entry *entry = &proc_top.entries[index];
+    close_proc_files(entry);
+    if(entry->keep_open) proc_top.fds_open -= PROC_FILES_KEPT_OPEN;
+    remove_proc_slot(entry->pid);
+
+    int last = --proc_top.num_entries;
+    if(index != last)
+    {
+        proc_top.entries[index] = proc_top.entries[last];
+        set_proc_slot(proc_top.entries[index].pid, index);
+    }
+}
+
+/*
+* @brief Lists the pid directories of the proc root, adding the new
+*        processes and marking the ones no longer listed as gone.
+*/
+void scan_proc_directory()
+{
+    proc_top.scan++;
+    if(lseek(proc_top.proc_fd, 0, SEEK_SET) < 0) fatal_error("failed to rewind ", proc_root);
+    while(1)
+    {
+        long length = syscall(SYS_getdents64, proc_top.proc_fd, proc_top.dirents, PROC_TOP_DIRENT_BUFFER);
+        sampler_stats.read_syscalls++;
+        if(length < 0 && errno == EINTR) continue;
+        if(length < 0) fatal_error("failed to list ", proc_root);
+        if(length == 0) break;
+
+        for(long offset = 0; offset < length;)
+        {
+            const struct linux_dirent64 *dirent = (const struct linux_dirent64*)(proc_top.dirents + offset);
+            offset += dirent->d_reclen;
+
+            int pid = 0;
+            const char *name = dirent->d_name;
+            while((unsigned char)(*name - '0') < 10) pid = pid * 10 + (*name++ - '0');
+            if(*name != '\0' || pid == 0) continue;
+
+            int index = find_proc_entry(pid);
+            if(index < 0)
+            {
+                index = add_proc_entry(pid);
+                proc_top.num_new++;
+            }
+            proc_top.entries[index].seen_scan = proc_top.scan;
+        }
+    }
+
+    for(int i = 0; i < proc_top.num_entries; i++)
+    {
+        if(proc_top.entries[i].seen_scan != proc_top.scan) proc_top.entries[i].dead = 1;
+    }
+    proc_top.refreshes_since_scan = 0;
+    proc_top.scanned = 1;
+}
+
+/*
+* @brief Reads a proc file of a process from the start into buffer, which
+*        is followed by SCAN_PADDING zero bytes for the scanner.
+*
+* @returns the bytes read, 0 or less if the process is gone
+*/
+ssize_t read_proc_file(struct proc_worker *worker, int fd, char *buffer, size_t size)
+{
+    ssize_t length;
+    do
+    {
+        length = pread(fd, buffer, size - SCAN_PADDING - 1, 0);
+        worker->read_syscalls++;
+    } while(length < 0 && errno == EINTR);
+    if(length < 0) return length;
+
+    memset(buffer + length, 0, SCAN_PADDING + 1);
+    worker->bytes_read += (unsigned long)length;
+    return length;
+}
+
+/*
+* @brief Reads a file other than stat, which a process can refuse: io can
+*        be opened but not read for another user's process. A file that
+*        fails is not tried again for the process.
+*
+* @returns the bytes read, 0 or less if there is nothing to use
+*/
+ssize_t read_optional_file(struct proc_worker *worker, struct proc_entry *entry, int file, char *buffer, size_t size)
+{
+    if(entry->fd[file] < 0) return -1;
+    ssize_t length = read_proc_file(worker, entry->fd[file], buffer, size);
+    if(length <= 0)
+    {
+        close(entry->fd[file]);
+        entry->fd[file] = -1;
+        entry->unreadable |= 1u << file;
+    }
+    return length;
+}
+
+/*
+* @brief Reads the name and the user plus system time from the text of
+*        /proc/[pid]/stat. The name can hold spaces and parentheses, so it
+*        ends at the last ')'.
+*
+* @returns 0, or -1 if the text is not a stat line
+*/
+int parse_proc_stat(const char *text, struct proc_entry *entry, uint64_t *cpu_ticks)
+{
+    const char *open = strchr(text, '(');
+    const char *close = strrchr(text, ')');
+    if(open == NULL || close == NULL || close < open || close[1] == '\0') return -1;
+
+    size_t length = (size_t)(close - open - 1);
+    if(length >= PROC_COMM_LENGTH) length = PROC_COMM_LENGTH - 1;
+    memcpy(entry->comm, open + 1, length);
+    entry->comm[length] = '\0';
+
+    //Field 3 is the state letter, utime and stime are fields 14 and 15
+    const char *p = close + 2;
+    if(*p != '\0') p++;
+    *cpu_ticks = 0;
+    for(int field = 4; field <= 15; field++)
+    {
+        while(*p == ' ') p++;
+        if(*p == '-') p++;
+        uint64_t value = 0;
+        while((unsigned char)(*p - '0') < 10) value = value * 10 + (uint64_t)(*p++ - '0');
+        if(field >= 14) *cpu_ticks += value;
+    }
+    return 0;
+}
+
+/*
+* @brief Finds "key: value" in the text of /proc/[pid]/io or status.
+*/
+uint64_t proc_io_value(const char *text, const char *key)
+{
+    const char *line = strstr(text, key);
+    if(line == NULL) return 0;
+    return strtoull(line + strlen(key), NULL, 10);
+}
+
+/*
+* @brief Reads the files of one process and works out its rates since the
+*        previous refresh. Runs on a worker thread and only writes to the
+*        entry and the worker.
+*/
+void refresh_proc_entry(struct proc_worker *worker, struct proc_entry *entry, double seconds)
+{
+    for(int file = 0; file < NUM_PROC_FILES; file++)
+    {
+        if(entry->fd[file] >= 0 || (entry->unreadable & (1u << file))) continue;
+        if(open_proc_file(entry, file) >= 0) continue;
+        if(file == PROC_FILE_STAT)
+        {
+            entry->dead = 1;
+            close_proc_files(entry);
+            return;
+        }
+        entry->unreadable |= 1u << file;
+    }
+
+    char text[1024 + SCAN_PADDING];
+    uint64_t cpu_ticks;
+    if(read_proc_file(worker, entry->fd[PROC_FILE_STAT], text, sizeof(text)) <= 0 ||
+       parse_proc_stat(text, entry, &cpu_ticks) != 0)
+    {
+        entry->dead = 1;
+        close_proc_files(entry);
+        return;
+    }
+
+    uint64_t fields[3] = {0, 0, 0};
+    uint64_t rss_pages = 0;
+    uint64_t read_bytes = 0;
+    uint64_t write_bytes = 0;
+    uint64_t switches = 0;
+    const char *cursor = text;
+    if(read_optional_file(worker, entry, PROC_FILE_STATM, text, sizeof(text)) > 0 && scan_fields(&cursor, fields, 2) == 2)
+    {
+        rss_pages = fields[1];
+    }
+    if(read_optional_file(worker, entry, PROC_FILE_IO, text, sizeof(text)) > 0)
+    {
+        read_bytes = proc_io_value(text, "\nread_bytes:");
+        write_bytes = proc_io_value(text, "\nwrite_bytes:");
+    }
+    cursor = text;
+    if(!entry->status_switches)
+    {
+        if(read_optional_file(worker, entry, PROC_FILE_SCHEDSTAT, text, sizeof(text)) > 0 &&
+           scan_fields(&cursor, fields, 3) == 3 && (fields[0] | fields[1] | fields[2]) != 0)
+        {
+            switches = fields[2];
+        }
+        else
+        {
+            entry->status_switches = 1;
+            if(entry->fd[PROC_FILE_SCHEDSTAT] >= 0) close(entry->fd[PROC_FILE_SCHEDSTAT]);
+            entry->fd[PROC_FILE_SCHEDSTAT] = -1;
+            entry->unreadable = (entry->unreadable | (1u << PROC_FILE_SCHEDSTAT)) & ~(1u << PROC_FILE_STATUS);
+            if(open_proc_file(entry, PROC_FILE_STATUS) < 0) entry->unreadable |= 1u << PROC_FILE_STATUS;
+        }
+    }
+    if(entry->status_switches)
+    {
+        char status[PROC_STATUS_LENGTH + SCAN_PADDING];
+        if(read_optional_file(worker, entry, PROC_FILE_STATUS, status, sizeof(status)) > 0)
+        {
+            switches = proc_io_value(status, "\nvoluntary_ctxt_switches:") + proc_io_value(status, "\nnonvoluntary_ctxt_switches:");
+        }
+    }
+
+    if(entry->have_previous && seconds > 0)
+    {
+        entry->cpu_pct = (float)((double)(cpu_ticks > entry->cpu_ticks ? cpu_ticks - entry->cpu_ticks : 0) * 100 /
+                                 ((double)proc_top.ticks_per_second * seconds));
+        entry->read_rate = (float)((double)(read_bytes > entry->read_bytes ? read_bytes - entry->read_bytes : 0) / seconds);
+        entry->write_rate = (float)((double)(write_bytes > entry->write_bytes ? write_bytes - entry->write_bytes : 0) / seconds);
+        entry->switch_rate = (float)((double)(switches > entry->switches ? switches - entry->switches : 0) / seconds);
+    }
+    entry->cpu_ticks = cpu_ticks;
+    entry->rss_pages = rss_pages;
+    entry->read_bytes = read_bytes;
+    entry->write_bytes = write_bytes;
+    entry->switches = switches;
+    entry->have_previous = 1;
+    entry->refreshes++;
+
+    if(!entry->keep_open) close_proc_files(entry);
+}
+
+/*
+* @brief Refreshes the worker's share of the entries.
+*/
+void refresh_proc_share(struct proc_worker *worker)
+{
+    int first = (int)((int64_t)proc_top.num_entries * worker->index / proc_top.num_threads);
+    int last = (int)((int64_t)proc_top.num_entries * (worker->index + 1) / proc_top.num_threads);
+    double seconds = proc_top.previous_ns > 0 ? (double)(proc_top.sample_ns - proc_top.previous_ns) / 1e9 : 0;
+    for(int i = first; i < last; i++)
+    {
+        struct proc_entry *entry = &proc_top.entries[i];
+        if(!entry->dead) refresh_proc_entry(worker, entry, seconds);
+    }
+}
+
+void *proc_worker_main(void *arg)
+{
+    struct proc_worker *worker = arg;
+    while(1)
+    {
+        pthread_barrier_wait(&proc_top.start);
+        if(proc_top.stopping) break;
+        refresh_proc_share(worker);
+        pthread_barrier_wait(&proc_top.done);
+    }
+    return NULL;
+}
+
+/*
+* @brief The value entries are ranked by.
+*/
+double proc_sort_key(const struct proc_entry *entry)
+{
+    switch(proc_top.sort)
+    {
+        case PROC_SORT_RSS: return (double)entry->rss_pages;
+        case PROC_SORT_IO: return (double)entry->read_rate + entry->write_rate;
+        case PROC_SORT_SWITCHES: return entry->switch_rate;
+        default: return entry->cpu_pct;
+    }
+}
+
+/*
+* @brief Picks the top_n entries with a min-heap of the best seen so far,
+*        then orders them highest first.
+*/
+void select_proc_top()
+{
+    int *heap = proc_top.top;
+    int size = 0;
+    for(int i = 0; i < proc_top.num_entries; i++)
+    {
+        double key = proc_sort_key(&proc_top.entries[i]);
+        int hole;
+        if(size < proc_top.top_n)
+        {
+            hole = size++;
+            while(hole > 0 && proc_sort_key(&proc_top.entries[heap[(hole - 1) / 2]]) > key)
+            {
+                heap[hole] = heap[(hole - 1) / 2];
+                hole = (hole - 1) / 2;
+            }
+        }
+        else if(size > 0 && key > proc_sort_key(&proc_top.entries[heap[0]]))
+        {
+            //Replaces the smallest of the best
+            hole = 0;
+            while(1)
+            {
+                int child = hole * 2 + 1;
+                if(child >= size) break;
+                if(child + 1 < size && proc_sort_key(&proc_top.entries[heap[child + 1]]) < proc_sort_key(&proc_top.entries[heap[child]])) child++;
+                if(proc_sort_key(&proc_top.entries[heap[child]]) >= key) break;
+                heap[hole] = heap[child];
+                hole = child;
+            }
+        }
+        else continue;
+        heap[hole] = i;
+    }
+
+    //At most top_n entries, so an insertion sort is enough
+    for(int i = 1; i < size; i++)
+    {
+        int index = heap[i];
+        double key = proc_sort_key(&proc_top.entries[index]);
+        int j = i;
+        while(j > 0 && proc_sort_key(&proc_top.entries[heap[j - 1]]) < key)
+        {
+            heap[j] = heap[j - 1];
+            j--;
+        }
+        heap[j] = index;
+    }
+    proc_top.num_top = size;
+}
+
+/*
+* @brief Finds the last pid the kernel allocated, the last field of
+*        /proc/loadavg.
+*/
+int read_last_pid()
+{
+    read_proc_source(&proc_top.loadavg);
+    const char *end = proc_top.loadavg.buffer + proc_top.loadavg.length;
+    while(end > proc_top.loadavg.buffer && (unsigned char)(end[-1] - '0') >= 10) end--;
+    const char *start = end;
+    while(start > proc_top.loadavg.buffer && (unsigned char)(start[-1] - '0') < 10) start--;
+    int pid = 0;
+    while(start < end) pid = pid * 10 + (*start++ - '0');
+    return pid;
+}
+
+/*
+* @brief Takes a sample of every process: lists the directory if a pid was
+*        allocated since the last listing, reads the processes on the
+*        worker threads, then removes the ones that are gone and picks the
+*        top_n.
+*/
+void refresh_proc_top()
+{
+    uint64_t start = monotonic_ns();
+    proc_top.scanned = 0;
+    proc_top.num_new = 0;
+    proc_top.num_exited = 0;
+
+    int last_pid = read_last_pid();
+    if(proc_top.scan == 0 || last_pid != proc_top.last_pid || ++proc_top.refreshes_since_scan >= PROC_TOP_FULL_SCAN_REFRESHES)
+    {
+        scan_proc_directory();
+    }
+    proc_top.last_pid = last_pid;
+    proc_top.scan_ns = monotonic_ns() - start;
+
+    //Processes seen before are likely to stay, they keep their descriptors open
+    for(int i = 0; i < proc_top.num_entries; i++)
+    {
+        struct proc_entry *entry = &proc_top.entries[i];
+        if(entry->keep_open || entry->refreshes == 0 || proc_top.fds_open + PROC_FILES_KEPT_OPEN > proc_top.fd_budget) continue;
+        entry->keep_open = 1;
+        proc_top.fds_open += PROC_FILES_KEPT_OPEN;
+    }
+
+    proc_top.sample_ns = monotonic_ns();
+    if(proc_top.num_threads > 1) pthread_barrier_wait(&proc_top.start);
+    refresh_proc_share(&proc_top.workers[0]);
+    if(proc_top.num_threads > 1) pthread_barrier_wait(&proc_top.done);
+    for(int i = 0; i < proc_top.num_threads; i++)
+    {
+        sampler_stats.read_syscalls += proc_top.workers[i].read_syscalls;
+        sampler_stats.bytes_read += proc_top.workers[i].bytes_read;
+        proc_top.workers[i].read_syscalls = 0;
+        proc_top.workers[i].bytes_read = 0;
+    }
+
+    //From the end, so the entry moved into a removed one's place was already checked
+    for(int i = proc_top.num_entries - 1; i >= 0; i--)
+    {
+        const struct proc_entry *entry = &proc_top.entries[i];
+        if(!entry->dead) continue;
+        //Listed by this scan but gone from its old descriptors: the pid may
+        //have been reused, which the next refresh's listing picks up
+        if(proc_top.scanned && entry->seen_scan == proc_top.scan) proc_top.refreshes_since_scan = PROC_TOP_FULL_SCAN_REFRESHES;
+        remove_proc_entry(i);
+        proc_top.num_exited++;
+    }
+    proc_top.previous_ns = proc_top.sample_ns;
+    select_proc_top();
+    proc_top.refresh_ns = monotonic_ns() - start;
+}
+
+/*
+* @brief Opens the proc root, raises the descriptor limit as far as it
+*        goes and starts the worker threads.
+*/
+void init_proc_top(int top_n, int sort, int num_threads)
+{
+    memset(&proc_top, 0, sizeof(proc_top));
+    proc_top.proc_fd = open(proc_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(proc_top.proc_fd < 0) fatal_error("failed to open ", proc_root);
+    proc_top.loadavg.name = "loadavg";
+    proc_top.loadavg.fd = -1;
+    proc_top.dirents = counted_malloc(PROC_TOP_DIRENT_BUFFER);
+    proc_top.top_n = top_n;
+    proc_top.sort = sort;
+    proc_top.top = counted_malloc((size_t)top_n * sizeof(int));
+    proc_top.ticks_per_second = sysconf(_SC_CLK_TCK);
+    proc_top.page_size = sysconf(_SC_PAGESIZE);
+    grow_proc_top();
+
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        if(limit.rlim_cur < limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+            getrlimit(RLIMIT_NOFILE, &limit);
+        }
+        rlim_t budget = limit.rlim_cur > PROC_TOP_FD_RESERVE ? limit.rlim_cur - PROC_TOP_FD_RESERVE : 0;
+        proc_top.fd_budget = budget > 0x40000000 ? 0x40000000 : (int)budget;
+    }
+
+    if(num_threads < 1) num_threads = 1;
+    if(num_threads > PROC_TOP_MAX_THREADS) num_threads = PROC_TOP_MAX_THREADS;
+    proc_top.num_threads = num_threads;
+    for(int i = 0; i < num_threads; i++) proc_top.workers[i].index = i;
+    if(num_threads == 1) return;
+
+    pthread_barrier_init(&proc_top.start, NULL, (unsigned)num_threads);
+    pthread_barrier_init(&proc_top.done, NULL, (unsigned)num_threads);
+    //The workers leave the signals to the scheduler's thread
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    for(int i = 1; i < num_threads; i++)
+    {
+        if(pthread_create(&proc_top.workers[i].thread, NULL, proc_worker_main, &proc_top.workers[i]) != 0)
+        {
+            fatal_error("failed to start ", "a proc-top thread");
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+/*
+* @brief Stops the worker threads and closes every descriptor.
+*/
+void free_proc_top()
+{
+    if(proc_top.top == NULL) return;
+    if(proc_top.num_threads > 1)
+    {
+        proc_top.stopping = 1;
+        pthread_barrier_wait(&proc_top.start);
+        for(int i = 1; i < proc_top.num_threads; i++) pthread_join(proc_top.workers[i].thread, NULL);
+        pthread_barrier_destroy(&proc_top.start);
+        pthread_barrier_destroy(&proc_top.done);
+    }
+    for(int i = 0; i < proc_top.num_entries; i++) close_proc_files(&proc_top.entries[i]);
+    close(proc_top.proc_fd);
+    close_proc_source(&proc_top.loadavg);
+    free(proc_top.entries);
+    free(proc_top.slots);
+    free(proc_top.dirents);
+    free(proc_top.top);
+    memset(&proc_top, 0, sizeof(proc_top));
+}
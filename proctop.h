@@ -0,0 +1,139 @@
+/*
+ * File: proctop.h
+ * Description: Per process cpu, memory, I/O and context switches from
+ *              /proc/[pid], and the top N processes by one of them.
+ */
+#ifndef PROCTOP_H
+#define PROCTOP_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "sys_mon.h"
+
+#define DEFAULT_PROC_TOP_N              20
+#define PROC_TOP_MAX_THREADS            16
+#define PROC_TOP_FULL_SCAN_REFRESHES    10      //Refreshes between directory scans when no pid was allocated
+#define PROC_TOP_FD_RESERVE             64      //Descriptors left for everything else
+#define PROC_TOP_DIRENT_BUFFER          65536
+#define PROC_COMM_LENGTH                16
+#define PROC_STATUS_LENGTH              4096    //Room for /proc/[pid]/status, about 1.5 kB
+
+enum proc_file
+{
+    PROC_FILE_STAT,
+    PROC_FILE_STATM,
+    PROC_FILE_IO,
+    PROC_FILE_SCHEDSTAT,
+    PROC_FILE_STATUS,                   //Only read for the switches when schedstat has none
+    NUM_PROC_FILES
+};
+
+#define PROC_FILES_KEPT_OPEN            (NUM_PROC_FILES - 1) //schedstat or status, never both
+
+enum proc_sort
+{
+    PROC_SORT_CPU,
+    PROC_SORT_RSS,
+    PROC_SORT_IO,
+    PROC_SORT_SWITCHES,
+    NUM_PROC_SORTS
+};
+
+/*
+* One process. The descriptors of a process that has been seen in more
+* than one refresh are kept open while the descriptor budget allows, so a
+* refresh of it is just a pread per file.
+*/
+struct proc_entry
+{
+    int pid;
+    int fd[NUM_PROC_FILES];             //-1 when closed
+    unsigned int unreadable;            //Bit per proc_file not to open: io of another user, status while schedstat works
+    int keep_open;
+    int status_switches;                //schedstat had no switches, they are read from status
+    int dead;                           //The process is gone, the entry is removed after the refresh
+    uint32_t seen_scan;                 //Directory scan that last listed it
+    uint32_t refreshes;
+    char comm[PROC_COMM_LENGTH];
+
+    int have_previous;
+    uint64_t cpu_ticks;                 //utime + stime, in USER_HZ ticks
+    uint64_t rss_pages;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t switches;                  //Context switches: runs from schedstat, else voluntary + nonvoluntary from status
+
+    float cpu_pct;
+    float read_rate;
+    float write_rate;
+    float switch_rate;
+};
+
+/*
+* A thread of the refresh. Each reads its share of the entries, and counts
+* its syscalls itself so that the threads share nothing they write.
+*/
+struct proc_worker
+{
+    int index;
+    pthread_t thread;
+    unsigned long read_syscalls;
+    unsigned long bytes_read;
+};
+
+/*
+* The processes of the proc root, in a dense array with an open addressing
+* table from pid to entry. The directory is only listed again when
+* /proc/loadavg shows that a pid was allocated since the last scan, or
+* every PROC_TOP_FULL_SCAN_REFRESHES refreshes; processes that exit in
+* between are found when their reads fail.
+*/
+struct proc_top
+{
+    int proc_fd;                        //The proc root, pid files are opened relative to it
+    struct proc_source loadavg;
+    int last_pid;
+    uint32_t scan;
+    int refreshes_since_scan;
+    uint8_t *dirents;
+
+    struct proc_entry *entries;
+    int num_entries;
+    int capacity;
+    int32_t *slots;                     //Entry index of each pid, -1 for a free slot
+    uint32_t slot_mask;
+
+    int fd_budget;
+    int fds_open;
+    long ticks_per_second;
+    long page_size;
+    uint64_t previous_ns;
+
+    int num_threads;
+    struct proc_worker workers[PROC_TOP_MAX_THREADS];
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+    volatile int stopping;
+    uint64_t sample_ns;
+
+    int top_n;
+    int sort;
+    int *top;                           //Entry indexes of the top_n, highest first
+    int num_top;
+
+    uint64_t refresh_ns;                //What the last refresh took
+    uint64_t scan_ns;
+    int scanned;
+    int num_new;
+    int num_exited;
+};
+
+extern struct proc_top proc_top;
+extern const char *proc_sort_names[NUM_PROC_SORTS];
+
+void init_proc_top(int top_n, int sort, int num_threads);
+void refresh_proc_top();
+void free_proc_top();
+
+#endif
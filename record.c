@@ -0,0 +1,1117 @@
+/*
+ * File: record.c
+ * Description: Binary recording of the cpu, memory and network snapshots,
+ *              and replay of a recording back into them.
+ *
+ * Format:
+ *      The file starts with RECORD_MAGIC and is followed by one frame per
+ *      sample. A frame is a type byte, the varint length of the rest and
+ *      then the sample:
+ *
+ *      keyframe    varint time, the layout (varint cpus, online bitmap,
+ *                  varint meminfo present mask, varint interfaces and
+ *                  their names) and the values against a sample of zeros.
+ *      delta       zigzag varint of how much the gap since the last sample
+ *                  changed, and the values against the last sample.
+ *
+ *      The values are a bit stream of columns: each cpu field across the
+ *      cores and then the total line, the stat scalars, meminfo, and each
+ *      net/dev field across the interfaces. A column starts with a two bit
+ *      mode saying how its values are predicted from the last sample:
+ *      unchanged, last value, last value plus last movement, or last value
+ *      plus the movement of the row before (for idle, plus the ticks the
+ *      other fields left over). Each value is then stored as the residual
+ *      from its prediction, 0 for none or 1, a sign bit and the Elias gamma
+ *      code of its magnitude. Totals are predicted as the sum of the cores.
+ *
+ *      A keyframe comes every RECORD_KEYFRAME_INTERVAL samples and whenever
+ *      the layout changes, and a frame can only be decoded after the
+ *      keyframe before it. Closing the recording appends the keyframe
+ *      index, 16 bytes of time and file offset per keyframe, its length and
+ *      RECORD_INDEX_MAGIC. All integers are little endian.
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sys_mon.h"
+#include "record.h"
+
+#define RECORD_FRAME_HEADER         11  //Type byte and the longest varint length
+#define RECORD_INDEX_ENTRY          16
+#define RECORD_MAX_CPUS             (1 << 20)
+#define RECORD_MAX_DEVICES          (1 << 20)
+#define RECORD_NUM_COLUMNS          (NUM_CPU_FIELDS + 2 + NUM_NETWORK_FIELDS)
+#define RECORD_MAX_VALUE_BYTES      17  //Mode bits aside, the longest residual is 131 bits
+
+enum record_mode
+{
+    MODE_UNCHANGED,
+    MODE_FIRST_ORDER,
+    MODE_SECOND_ORDER,
+    MODE_NEIGHBOUR
+};
+
+enum record_column_kind
+{
+    COLUMN_CPU,                         //Cores followed by the total line
+    COLUMN_IDLE,                        //The same, for the idle field
+    COLUMN_OTHER
+};
+
+struct record_column
+{
+    int start;
+    int length;
+    int kind;
+};
+
+/*
+* Order of the cpu columns. Idle comes last so it can be predicted from the
+* other fields of the same sample.
+*/
+const int record_cpu_fields[NUM_CPU_FIELDS] =
+{
+    CPU_USER, CPU_NICE, CPU_SYSTEM, CPU_IOWAIT, CPU_IRQ,
+    CPU_SOFTIRQ, CPU_STEAL, CPU_GUEST, CPU_GUEST_NICE, CPU_IDLE
+};
+
+struct bit_writer
+{
+    uint8_t *out;
+    uint64_t buffer;
+    int count;                          //Bits in buffer not written out yet
+};
+
+struct bit_reader
+{
+    const uint8_t *start;
+    const uint8_t *cursor;
+    const uint8_t *end;
+    uint64_t buffer;
+    int count;                          //Bits in buffer not consumed yet
+    uint64_t past_end;                  //Zero bytes read beyond end
+};
+
+static inline uint8_t *put_varint(uint8_t *out, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+/*
+* @brief Reads a varint, refusing to read past end.
+*
+* @returns 1 if a whole varint was read
+*/
+static inline int get_varint(const uint8_t **cursor, const uint8_t *end, uint64_t *value)
+{
+    uint64_t result = 0;
+    for(int shift = 0; shift < 64 && *cursor < end; shift += 7)
+    {
+        uint8_t byte = *(*cursor)++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+        {
+            *value = result;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline uint8_t *put_u64(uint8_t *out, uint64_t value)
+{
+    for(int i = 0; i < 8; i++) out[i] = (uint8_t)(value >> (8 * i));
+    return out + 8;
+}
+
+static inline uint64_t get_u64(const uint8_t *in)
+{
+    uint64_t value = 0;
+    for(int i = 0; i < 8; i++) value |= (uint64_t)in[i] << (8 * i);
+    return value;
+}
+
+static inline uint64_t zigzag(uint64_t value)
+{
+    return (value << 1) ^ (uint64_t)((int64_t)value >> 63);
+}
+
+static inline uint64_t unzigzag(uint64_t value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+/*
+* @brief Appends the low count bits of value, count at most 32.
+*/
+static inline void put_bits(struct bit_writer *writer, uint64_t value, int count)
+{
+    writer->buffer |= (value & (((uint64_t)1 << count) - 1)) << writer->count;
+    writer->count += count;
+    while(writer->count >= 8)
+    {
+        *writer->out++ = (uint8_t)writer->buffer;
+        writer->buffer >>= 8;
+        writer->count -= 8;
+    }
+}
+
+static inline void put_long_bits(struct bit_writer *writer, uint64_t value, int count)
+{
+    for(; count > 32; count -= 32, value >>= 32) put_bits(writer, value, 32);
+    put_bits(writer, value, count);
+}
+
+/*
+* @brief Writes out the last partial byte.
+*
+* @returns the end of what was written
+*/
+static inline uint8_t *flush_bits(struct bit_writer *writer)
+{
+    if(writer->count > 0) *writer->out++ = (uint8_t)writer->buffer;
+    writer->buffer = 0;
+    writer->count = 0;
+    return writer->out;
+}
+
+/*
+* @brief Reads count bits, count at most 32. Past the end it reads zeros,
+*        which bits_consumed lets the caller catch.
+*/
+static inline uint64_t get_bits(struct bit_reader *reader, int count)
+{
+    while(reader->count < count)
+    {
+        uint8_t byte = 0;
+        if(reader->cursor < reader->end) byte = *reader->cursor++;
+        else reader->past_end++;
+        reader->buffer |= (uint64_t)byte << reader->count;
+        reader->count += 8;
+    }
+    uint64_t value = reader->buffer & (((uint64_t)1 << count) - 1);
+    reader->buffer >>= count;
+    reader->count -= count;
+    return value;
+}
+
+static inline uint64_t get_long_bits(struct bit_reader *reader, int count)
+{
+    uint64_t value = 0;
+    int shift = 0;
+    for(; count > 32; count -= 32, shift += 32) value |= get_bits(reader, 32) << shift;
+    return value | get_bits(reader, count) << shift;
+}
+
+static inline uint64_t bits_consumed(const struct bit_reader *reader)
+{
+    return ((uint64_t)(reader->cursor - reader->start) + reader->past_end) * 8 - (uint64_t)reader->count;
+}
+
+/*
+* @brief Makes the movements of the sample just coded the last ones.
+*/
+static inline void swap_deltas(struct record_codec *codec)
+{
+    uint64_t *delta = codec->delta;
+    codec->delta = codec->next_delta;
+    codec->next_delta = delta;
+}
+
+/*
+* @brief Where column number column of the codec's layout sits among its
+*        values. The cpu columns come first, one per field in
+*        record_cpu_fields order, each holding every core and then the
+*        total line.
+*/
+static inline struct record_column codec_column(const struct record_codec *codec, int column)
+{
+    struct record_column result;
+    int cpu_column = codec->num_cpus + 1;
+    if(column < NUM_CPU_FIELDS)
+    {
+        result.start = column * cpu_column;
+        result.length = cpu_column;
+        result.kind = column == NUM_CPU_FIELDS - 1 ? COLUMN_IDLE : COLUMN_CPU;
+    }
+    else if(column == NUM_CPU_FIELDS)
+    {
+        result.start = NUM_CPU_FIELDS * cpu_column;
+        result.length = NUM_RECORD_SCALARS;
+        result.kind = COLUMN_OTHER;
+    }
+    else if(column == NUM_CPU_FIELDS + 1)
+    {
+        result.start = NUM_CPU_FIELDS * cpu_column + NUM_RECORD_SCALARS;
+        result.length = NUM_MEM_FIELDS;
+        result.kind = COLUMN_OTHER;
+    }
+    else
+    {
+        int field = column - NUM_CPU_FIELDS - 2;
+        result.start = NUM_CPU_FIELDS * cpu_column + NUM_RECORD_SCALARS + NUM_MEM_FIELDS + field * codec->num_devices;
+        result.length = codec->num_devices;
+        result.kind = COLUMN_OTHER;
+    }
+    return result;
+}
+
+/*
+* @returns where the cpu_field field of cpu, or of the total line when cpu
+*          is num_cpus, sits among the codec's values
+*/
+int record_cpu_value(const struct record_codec *codec, int field, int cpu)
+{
+    int column = 0;
+    while(record_cpu_fields[column] != field) column++;
+    return codec_column(codec, column).start + cpu;
+}
+
+/*
+* @returns where the record_scalar scalar sits among the codec's values
+*/
+int record_scalar_value(const struct record_codec *codec, int scalar)
+{
+    return codec_column(codec, NUM_CPU_FIELDS).start + scalar;
+}
+
+/*
+* @returns where the mem_field field sits among the codec's values
+*/
+int record_mem_value(const struct record_codec *codec, int field)
+{
+    return codec_column(codec, NUM_CPU_FIELDS + 1).start + field;
+}
+
+/*
+* @returns where the network_field field of interface device sits among the
+*          codec's values
+*/
+int record_network_value(const struct record_codec *codec, int field, int device)
+{
+    return codec_column(codec, NUM_CPU_FIELDS + 2 + field).start + device;
+}
+
+/*
+* @brief Sizes the codec for a sample of num_cpus cores and num_devices
+*        interfaces.
+*/
+void codec_layout(struct record_codec *codec, int num_cpus, int num_devices)
+{
+    if(num_cpus != codec->num_cpus || codec->online == NULL)
+    {
+        codec->online = (uint8_t*)counted_realloc(codec->online, (size_t)num_cpus + 1);
+        memset(codec->online, 0, (size_t)num_cpus + 1);
+    }
+    if(num_devices != codec->num_devices || codec->faces == NULL)
+    {
+        codec->faces = counted_realloc(codec->faces, ((size_t)num_devices + 1) * MAX_NETWORK_FACE_LENGTH);
+        memset(codec->faces, 0, ((size_t)num_devices + 1) * MAX_NETWORK_FACE_LENGTH);
+    }
+    codec->num_cpus = num_cpus;
+    codec->num_devices = num_devices;
+
+    int num_values = NUM_CPU_FIELDS * (num_cpus + 1) + NUM_RECORD_SCALARS + NUM_MEM_FIELDS + NUM_NETWORK_FIELDS * num_devices;
+    if(num_values > codec->capacity)
+    {
+        codec->value = (uint64_t*)counted_realloc(codec->value, (size_t)num_values * sizeof(uint64_t));
+        codec->delta = (uint64_t*)counted_realloc(codec->delta, (size_t)num_values * sizeof(uint64_t));
+        codec->next_delta = (uint64_t*)counted_realloc(codec->next_delta, (size_t)num_values * sizeof(uint64_t));
+        codec->capacity = num_values;
+    }
+    codec->num_values = num_values;
+}
+
+/*
+* @brief Frees what codec_layout allocated.
+*/
+void free_codec(struct record_codec *codec)
+{
+    free(codec->online);
+    free(codec->faces);
+    free(codec->value);
+    free(codec->delta);
+    free(codec->next_delta);
+    memset(codec, 0, sizeof(*codec));
+}
+
+/*
+* @brief Flattens the snapshots into values in the codec's order.
+*/
+void gather_sample(const struct record_codec *codec, uint64_t *values)
+{
+    int num_cpus = codec->num_cpus;
+    for(int column = 0; column < NUM_CPU_FIELDS; column++)
+    {
+        int field = record_cpu_fields[column];
+        memcpy(values, cpu_stats.time[field], (size_t)num_cpus * sizeof(uint64_t));
+        values += num_cpus;
+        *values++ = cpu_stats.total.time[field];
+    }
+    *values++ = cpu_stats.num_context_switches;
+    *values++ = cpu_stats.num_proccesses_created;
+    *values++ = cpu_stats.boot_time;
+    *values++ = cpu_stats.proccesses_running;
+    *values++ = cpu_stats.proccesses_blocked;
+    memcpy(values, mem_info.value, sizeof(mem_info.value));
+    values += NUM_MEM_FIELDS;
+    for(int field = 0; field < NUM_NETWORK_FIELDS; field++)
+    {
+        for(int i = 0; i < codec->num_devices; i++) *values++ = network_info.devices[i].counter[field];
+    }
+}
+
+/*
+* @brief Puts a decoded sample back into the snapshots, the reverse of
+*        gather_sample. Every snapshot gets the sample's time.
+*/
+void scatter_sample(const struct record_codec *codec, const uint64_t *values)
+{
+    int num_cpus = codec->num_cpus;
+    if(cpu_stats.num_cpus != num_cpus) resize_cpu_stats(num_cpus);
+    for(int column = 0; column < NUM_CPU_FIELDS; column++)
+    {
+        int field = record_cpu_fields[column];
+        memcpy(cpu_stats.time[field], values, (size_t)num_cpus * sizeof(uint64_t));
+        values += num_cpus;
+        cpu_stats.total.time[field] = *values++;
+    }
+    cpu_stats.num_context_switches = *values++;
+    cpu_stats.num_proccesses_created = *values++;
+    cpu_stats.boot_time = *values++;
+    cpu_stats.proccesses_running = *values++;
+    cpu_stats.proccesses_blocked = *values++;
+    memcpy(cpu_stats.online, codec->online, (size_t)num_cpus);
+    cpu_stats.num_online = 0;
+    for(int cpu = 0; cpu < num_cpus; cpu++) cpu_stats.num_online += cpu_stats.online[cpu];
+
+    memcpy(mem_info.value, values, sizeof(mem_info.value));
+    values += NUM_MEM_FIELDS;
+    mem_info.present = codec->mem_present;
+
+    reserve_network_devices(codec->num_devices);
+    network_info.num_devices = codec->num_devices;
+    for(int field = 0; field < NUM_NETWORK_FIELDS; field++)
+    {
+        for(int i = 0; i < codec->num_devices; i++) network_info.devices[i].counter[field] = *values++;
+    }
+    for(int i = 0; i < codec->num_devices; i++)
+    {
+        memcpy(network_info.devices[i].face, codec->faces[i], MAX_NETWORK_FACE_LENGTH);
+    }
+
+    cpu_stats.sample_ns = codec->time_ns;
+    mem_info.sample_ns = codec->time_ns;
+    network_info.sample_ns = codec->time_ns;
+}
+
+/*
+* @brief How much the value in row of column is predicted to move under
+*        mode. next_delta already holds the movement of the rows and
+*        columns before it.
+*/
+static inline uint64_t predict_delta(const struct record_codec *codec, struct record_column column, int mode, int row)
+{
+    int slot = column.start + row;
+    if(mode == MODE_FIRST_ORDER) return 0;
+    if(mode == MODE_SECOND_ORDER) return codec->delta[slot];
+    if(column.kind != COLUMN_IDLE) return row > 0 ? codec->next_delta[slot - 1] : 0;
+
+    //A core's fields add up to the same number of ticks every interval,
+    //so idle gets whatever the other fields did not use this time
+    int cpu_column = codec->num_cpus + 1;
+    uint64_t predicted = codec->delta[slot];
+    for(int other = 0; other < NUM_CPU_FIELDS - 1; other++)
+    {
+        predicted += codec->delta[other * cpu_column + row] - codec->next_delta[other * cpu_column + row];
+    }
+    return predicted;
+}
+
+static inline int gamma_bits(uint64_t number)
+{
+    return 2 * (64 - __builtin_clzll(number)) - 1;
+}
+
+/*
+* @brief Writes the Elias gamma code of number, which is at least 1: as
+*        many 0 bits as it has bits after its top one, a 1, and then those
+*        bits.
+*/
+static inline void put_gamma(struct bit_writer *writer, uint64_t number)
+{
+    int length = 64 - __builtin_clzll(number);
+    put_long_bits(writer, 0, length - 1);
+    put_bits(writer, 1, 1);
+    put_long_bits(writer, number, length - 1);
+}
+
+/*
+* @brief Reads a number written by put_gamma.
+*
+* @returns 1 if it was well formed
+*/
+static inline int get_gamma(struct bit_reader *reader, uint64_t *number)
+{
+    int length = 1;
+    while(get_bits(reader, 1) == 0)
+    {
+        if(++length > 64) return 0;
+    }
+    *number = get_long_bits(reader, length - 1) | (uint64_t)1 << (length - 1);
+    return 1;
+}
+
+static inline uint64_t magnitude_of(uint64_t residual)
+{
+    return (int64_t)residual < 0 ? 0 - residual : residual;
+}
+
+/*
+* @brief Residual of row of column under mode. The total row of a cpu
+*        column is always predicted as the sum of its cores, which the
+*        caller works out as total_residual.
+*/
+static inline uint64_t column_residual(const struct record_codec *codec, struct record_column column, int mode,
+                                       int row, uint64_t total_residual)
+{
+    if(column.kind != COLUMN_OTHER && row == column.length - 1) return total_residual;
+    return codec->next_delta[column.start + row] - predict_delta(codec, column, mode, row);
+}
+
+/*
+* @brief Bits a column takes under mode, with or without zero runs.
+*/
+long column_bits(const struct record_codec *codec, struct record_column column, int mode, int runs, uint64_t total_residual)
+{
+    long bits = 0;
+    uint64_t zeros = 0;
+    for(int row = 0; row < column.length; row++)
+    {
+        uint64_t residual = column_residual(codec, column, mode, row, total_residual);
+        if(residual == 0 && runs) {zeros++; continue;}
+        if(zeros > 0) bits += 1 + gamma_bits(zeros);
+        zeros = 0;
+        bits += residual == 0 ? 1 : 2 + gamma_bits(magnitude_of(residual));
+    }
+    if(zeros > 0) bits += 1 + gamma_bits(zeros);
+    return bits;
+}
+
+/*
+* @brief Encodes one column of values against the codec's last sample.
+*        It is stored as its mode, whether zeros are run length coded and
+*        then a residual per row: 0 for none (followed by the gamma coded
+*        length of the run with runs), or 1, a sign bit and the gamma
+*        coded magnitude. The mode and run choice is whatever takes the
+*        fewest bits.
+*/
+void encode_column(struct record_codec *codec, int column_number, const uint64_t *values, struct bit_writer *writer)
+{
+    struct record_column column = codec_column(codec, column_number);
+    int changed = 0;
+    for(int row = 0; row < column.length; row++)
+    {
+        int slot = column.start + row;
+        codec->next_delta[slot] = values[slot] - codec->value[slot];
+        changed |= codec->next_delta[slot] != 0;
+    }
+    if(!changed)
+    {
+        put_bits(writer, MODE_UNCHANGED, 2);
+        return;
+    }
+
+    uint64_t total_residual = 0;
+    if(column.kind != COLUMN_OTHER)
+    {
+        total_residual = values[column.start + column.length - 1];
+        for(int row = 0; row < column.length - 1; row++) total_residual -= values[column.start + row];
+    }
+
+    int best_mode = MODE_FIRST_ORDER;
+    int best_runs = 0;
+    long best_bits = -1;
+    for(int mode = MODE_FIRST_ORDER; mode <= MODE_NEIGHBOUR; mode++)
+    {
+        for(int runs = 0; runs <= 1; runs++)
+        {
+            long bits = column_bits(codec, column, mode, runs, total_residual);
+            if(best_bits >= 0 && bits >= best_bits) continue;
+            best_bits = bits;
+            best_mode = mode;
+            best_runs = runs;
+        }
+    }
+
+    put_bits(writer, (uint64_t)best_mode, 2);
+    put_bits(writer, (uint64_t)best_runs, 1);
+    uint64_t zeros = 0;
+    for(int row = 0; row < column.length; row++)
+    {
+        uint64_t residual = column_residual(codec, column, best_mode, row, total_residual);
+        if(residual == 0 && best_runs) {zeros++; continue;}
+        if(zeros > 0)
+        {
+            put_bits(writer, 0, 1);
+            put_gamma(writer, zeros);
+            zeros = 0;
+        }
+        if(residual == 0) put_bits(writer, 0, 1);
+        else
+        {
+            put_bits(writer, (int64_t)residual < 0 ? 3 : 1, 2);
+            put_gamma(writer, magnitude_of(residual));
+        }
+    }
+    if(zeros > 0)
+    {
+        put_bits(writer, 0, 1);
+        put_gamma(writer, zeros);
+    }
+}
+
+/*
+* @brief Decodes one column into the codec's last sample, the reverse of
+*        encode_column.
+*
+* @returns 1 if it was well formed
+*/
+int decode_column(struct record_codec *codec, int column_number, struct bit_reader *reader)
+{
+    struct record_column column = codec_column(codec, column_number);
+    int mode = (int)get_bits(reader, 2);
+    if(mode == MODE_UNCHANGED)
+    {
+        memset(&codec->next_delta[column.start], 0, (size_t)column.length * sizeof(uint64_t));
+        return 1;
+    }
+    int runs = (int)get_bits(reader, 1);
+
+    uint64_t zeros = 0;
+    uint64_t sum = 0;
+    for(int row = 0; row < column.length; row++)
+    {
+        uint64_t residual = 0;
+        if(zeros > 0) zeros--;
+        else if(get_bits(reader, 1) == 0)
+        {
+            if(runs && !get_gamma(reader, &zeros)) return 0;
+            if(zeros > 0) zeros--;
+        }
+        else
+        {
+            int negative = (int)get_bits(reader, 1);
+            if(!get_gamma(reader, &residual)) return 0;
+            if(negative) residual = 0 - residual;
+        }
+
+        int slot = column.start + row;
+        if(column.kind != COLUMN_OTHER && row == column.length - 1)
+        {
+            codec->next_delta[slot] = sum + residual - codec->value[slot];
+            codec->value[slot] = sum + residual;
+        }
+        else
+        {
+            codec->next_delta[slot] = residual + predict_delta(codec, column, mode, row);
+            codec->value[slot] += codec->next_delta[slot];
+            sum += codec->value[slot];
+        }
+    }
+    return zeros == 0;
+}
+
+/*
+* @brief Encodes values against the codec's last sample and makes them its
+*        last sample.
+*/
+uint8_t *encode_values(struct record_codec *codec, const uint64_t *values, uint8_t *out)
+{
+    struct bit_writer writer = {out, 0, 0};
+    for(int column = 0; column < RECORD_NUM_COLUMNS; column++) encode_column(codec, column, values, &writer);
+    memcpy(codec->value, values, (size_t)codec->num_values * sizeof(uint64_t));
+    swap_deltas(codec);
+    return flush_bits(&writer);
+}
+
+/*
+* @brief Decodes the bits between cursor and end into the codec's last
+*        sample, the reverse of encode_values.
+*
+* @returns 1 if they matched the layout
+*/
+int decode_values(struct record_codec *codec, const uint8_t *cursor, const uint8_t *end)
+{
+    struct bit_reader reader = {cursor, cursor, end, 0, 0, 0};
+    for(int column = 0; column < RECORD_NUM_COLUMNS; column++)
+    {
+        if(!decode_column(codec, column, &reader)) return 0;
+    }
+    swap_deltas(codec);
+    return bits_consumed(&reader) <= (uint64_t)(end - cursor) * 8;
+}
+
+/*
+* @brief Clears the codec's last sample, so a keyframe encodes its values
+*        as they are.
+*/
+void reset_codec(struct record_codec *codec)
+{
+    memset(codec->value, 0, (size_t)codec->num_values * sizeof(uint64_t));
+    memset(codec->delta, 0, (size_t)codec->num_values * sizeof(uint64_t));
+    codec->time_delta = 0;
+}
+
+/*
+* @brief Writes all of data, retrying interrupted and short writes.
+*/
+void write_all(int fd, const uint8_t *data, size_t length, const char *path)
+{
+    while(length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if(written < 0 && errno == EINTR) continue;
+        if(written <= 0) fatal_error("failed to write recording ", path);
+        data += written;
+        length -= (size_t)written;
+    }
+}
+
+/*
+* @brief Creates the recording at path, replacing any file there.
+*/
+void open_recorder(struct recorder *recorder, const char *path)
+{
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->path = path;
+    recorder->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(recorder->fd < 0) fatal_error("failed to create recording ", path);
+    write_all(recorder->fd, (const uint8_t*)RECORD_MAGIC, RECORD_MAGIC_LENGTH, path);
+    recorder->offset = RECORD_MAGIC_LENGTH;
+}
+
+/*
+* @brief Checks whether the snapshots still have the layout of the last
+*        keyframe.
+*/
+int layout_changed(const struct record_codec *codec)
+{
+    if(codec->value == NULL) return 1;
+    if(cpu_stats.num_cpus != codec->num_cpus || network_info.num_devices != codec->num_devices) return 1;
+    if(mem_info.present != codec->mem_present) return 1;
+    if(memcmp(cpu_stats.online, codec->online, (size_t)codec->num_cpus) != 0) return 1;
+    for(int i = 0; i < codec->num_devices; i++)
+    {
+        if(strcmp(network_info.devices[i].face, codec->faces[i]) != 0) return 1;
+    }
+    return 0;
+}
+
+/*
+* @brief Takes the layout of the snapshots into the codec and makes sure
+*        the recorder's buffers fit a frame of it.
+*/
+void take_layout(struct recorder *recorder)
+{
+    struct record_codec *codec = &recorder->codec;
+    codec_layout(codec, cpu_stats.num_cpus, network_info.num_devices);
+    memcpy(codec->online, cpu_stats.online, (size_t)codec->num_cpus);
+    for(int i = 0; i < codec->num_devices; i++)
+    {
+        memcpy(codec->faces[i], network_info.devices[i].face, MAX_NETWORK_FACE_LENGTH);
+    }
+    codec->mem_present = mem_info.present;
+
+    size_t frame_size = RECORD_FRAME_HEADER + 4 * 10 + (size_t)codec->num_cpus / 8 + 1 + RECORD_NUM_COLUMNS +
+                        (size_t)codec->num_devices * (1 + MAX_NETWORK_FACE_LENGTH) + (size_t)codec->num_values * RECORD_MAX_VALUE_BYTES;
+    if(frame_size > recorder->frame_capacity)
+    {
+        recorder->frame = (uint8_t*)counted_realloc(recorder->frame, frame_size);
+        recorder->frame_capacity = frame_size;
+    }
+    recorder->current = (uint64_t*)counted_realloc(recorder->current, (size_t)codec->num_values * sizeof(uint64_t));
+}
+
+/*
+* @brief Writes the layout section of a keyframe.
+*/
+uint8_t *put_layout(const struct record_codec *codec, uint8_t *out)
+{
+    out = put_varint(out, (uint64_t)codec->num_cpus);
+    for(int cpu = 0; cpu < codec->num_cpus; cpu += 8)
+    {
+        uint8_t bits = 0;
+        for(int bit = 0; bit < 8 && cpu + bit < codec->num_cpus; bit++) bits |= (uint8_t)(codec->online[cpu + bit] << bit);
+        *out++ = bits;
+    }
+    out = put_varint(out, codec->mem_present);
+    out = put_varint(out, (uint64_t)codec->num_devices);
+    for(int i = 0; i < codec->num_devices; i++)
+    {
+        size_t length = strnlen(codec->faces[i], MAX_NETWORK_FACE_LENGTH - 1);
+        *out++ = (uint8_t)length;
+        memcpy(out, codec->faces[i], length);
+        out += length;
+    }
+    return out;
+}
+
+/*
+* @brief Appends the snapshots as they are now as one frame, taken at
+*        time_ns (CLOCK_REALTIME).
+*/
+void record_sample(struct recorder *recorder, uint64_t time_ns)
+{
+    struct record_codec *codec = &recorder->codec;
+    int keyframe = recorder->num_samples % RECORD_KEYFRAME_INTERVAL == 0 || layout_changed(codec);
+    if(keyframe) take_layout(recorder);
+    gather_sample(codec, recorder->current);
+
+    uint8_t *payload = recorder->frame + RECORD_FRAME_HEADER;
+    uint8_t *out = payload;
+    if(keyframe)
+    {
+        reset_codec(codec);
+        out = put_varint(out, time_ns);
+        out = put_layout(codec, out);
+    }
+    else
+    {
+        uint64_t time_delta = time_ns - codec->time_ns;
+        out = put_varint(out, zigzag(time_delta - codec->time_delta));
+        codec->time_delta = time_delta;
+    }
+    codec->time_ns = time_ns;
+    out = encode_values(codec, recorder->current, out);
+
+    if(keyframe)
+    {
+        //Decoding starts from here, where there is no last delta to predict from
+        memset(codec->delta, 0, (size_t)codec->num_values * sizeof(uint64_t));
+        if(recorder->num_keyframes == recorder->index_capacity)
+        {
+            recorder->index_capacity = recorder->index_capacity ? recorder->index_capacity * 2 : 64;
+            recorder->index = (uint64_t*)counted_realloc(recorder->index, recorder->index_capacity * 2 * sizeof(uint64_t));
+        }
+        recorder->index[2 * recorder->num_keyframes] = time_ns;
+        recorder->index[2 * recorder->num_keyframes + 1] = recorder->offset;
+        recorder->num_keyframes++;
+    }
+
+    uint8_t header[RECORD_FRAME_HEADER];
+    header[0] = keyframe ? RECORD_KEYFRAME : RECORD_DELTA;
+    size_t header_length = (size_t)(put_varint(header + 1, (uint64_t)(out - payload)) - header);
+    uint8_t *frame = payload - header_length;
+    memcpy(frame, header, header_length);
+
+    write_all(recorder->fd, frame, (size_t)(out - frame), recorder->path);
+    recorder->offset += (uint64_t)(out - frame);
+    recorder->num_samples++;
+}
+
+/*
+* @brief Appends the keyframe index and closes the recording.
+*/
+void close_recorder(struct recorder *recorder)
+{
+    if(recorder->fd < 0) return;
+
+    uint8_t entry[RECORD_INDEX_ENTRY];
+    for(size_t i = 0; i < recorder->num_keyframes; i++)
+    {
+        put_u64(put_u64(entry, recorder->index[2 * i]), recorder->index[2 * i + 1]);
+        write_all(recorder->fd, entry, sizeof(entry), recorder->path);
+    }
+    uint8_t trailer[16];
+    put_u64(trailer, recorder->num_keyframes);
+    memcpy(trailer + 8, RECORD_INDEX_MAGIC, RECORD_MAGIC_LENGTH);
+    write_all(recorder->fd, trailer, sizeof(trailer), recorder->path);
+    close(recorder->fd);
+
+    free_codec(&recorder->codec);
+    free(recorder->current);
+    free(recorder->frame);
+    free(recorder->index);
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->fd = -1;
+}
+
+/*
+* @brief Reads the type and extent of the frame at offset.
+*
+* @returns 1 if a whole frame is there
+*/
+int frame_at(const struct replay *replay, size_t offset, int *type, const uint8_t **payload, const uint8_t **end)
+{
+    const uint8_t *frames_end = replay->data + replay->frames_end;
+    const uint8_t *cursor = replay->data + offset;
+    uint64_t length;
+    if(cursor >= frames_end) return 0;
+    *type = *cursor++;
+    if(!get_varint(&cursor, frames_end, &length) || length > (uint64_t)(frames_end - cursor)) return 0;
+    *payload = cursor;
+    *end = cursor + length;
+    return 1;
+}
+
+/*
+* @brief Walks the frames of a recording that has no index, as one that
+*        was not closed, and builds the index in index_copy. A frame cut
+*        short at the end, or a partly written index, ends the frames.
+*/
+void rebuild_index(struct replay *replay)
+{
+    size_t capacity = 0;
+    size_t offset = RECORD_MAGIC_LENGTH;
+    int type;
+    const uint8_t *payload;
+    const uint8_t *end;
+    while(frame_at(replay, offset, &type, &payload, &end) && (type == RECORD_KEYFRAME || type == RECORD_DELTA))
+    {
+        uint64_t time_ns;
+        if(type == RECORD_KEYFRAME && get_varint(&payload, end, &time_ns))
+        {
+            if(replay->num_keyframes == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 64;
+                replay->index_copy = (uint8_t*)counted_realloc(replay->index_copy, capacity * RECORD_INDEX_ENTRY);
+            }
+            uint8_t *entry = replay->index_copy + replay->num_keyframes * RECORD_INDEX_ENTRY;
+            put_u64(put_u64(entry, time_ns), offset);
+            replay->num_keyframes++;
+        }
+        offset = (size_t)(end - replay->data);
+    }
+    replay->frames_end = offset;
+    replay->index = replay->index_copy;
+}
+
+/*
+* @brief Maps the recording at path for replay and finds its index.
+*/
+void open_replay(struct replay *replay, const char *path)
+{
+    memset(replay, 0, sizeof(*replay));
+    replay->path = path;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) fatal_error("failed to open recording ", path);
+    struct stat status;
+    if(fstat(fd, &status) != 0 || status.st_size < RECORD_MAGIC_LENGTH) fatal_error("not a recording: ", path);
+    replay->size = (size_t)status.st_size;
+    void *data = mmap(NULL, replay->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) fatal_error("failed to map recording ", path);
+    replay->data = (const uint8_t*)data;
+    if(memcmp(replay->data, RECORD_MAGIC, RECORD_MAGIC_LENGTH) != 0) fatal_error("not a recording: ", path);
+
+    replay->frames_end = replay->size;
+    size_t trailer = RECORD_MAGIC_LENGTH + 16;
+    if(replay->size >= trailer && memcmp(replay->data + replay->size - RECORD_MAGIC_LENGTH, RECORD_INDEX_MAGIC, RECORD_MAGIC_LENGTH) == 0)
+    {
+        uint64_t num_keyframes = get_u64(replay->data + replay->size - 16);
+        if(num_keyframes <= (replay->size - trailer) / RECORD_INDEX_ENTRY)
+        {
+            replay->num_keyframes = (size_t)num_keyframes;
+            replay->frames_end = replay->size - 16 - replay->num_keyframes * RECORD_INDEX_ENTRY;
+            replay->index = replay->data + replay->frames_end;
+        }
+    }
+    if(replay->index == NULL) rebuild_index(replay);
+    replay->offset = RECORD_MAGIC_LENGTH;
+}
+
+/*
+* @brief Reads the layout section of a keyframe into the codec.
+*
+* @returns 1 if it was well formed
+*/
+int get_layout(struct record_codec *codec, const uint8_t **cursor, const uint8_t *end)
+{
+    uint64_t num_cpus, mem_present, num_devices;
+    if(!get_varint(cursor, end, &num_cpus) || num_cpus == 0 || num_cpus > RECORD_MAX_CPUS) return 0;
+    size_t bitmap_length = ((size_t)num_cpus + 7) / 8;
+    if((size_t)(end - *cursor) < bitmap_length) return 0;
+    const uint8_t *bitmap = *cursor;
+    *cursor += bitmap_length;
+    if(!get_varint(cursor, end, &mem_present) || !get_varint(cursor, end, &num_devices)) return 0;
+    if(num_devices > RECORD_MAX_DEVICES) return 0;
+
+    codec_layout(codec, (int)num_cpus, (int)num_devices);
+    for(int cpu = 0; cpu < codec->num_cpus; cpu++) codec->online[cpu] = (bitmap[cpu / 8] >> (cpu % 8)) & 1;
+    codec->mem_present = (unsigned int)mem_present;
+    for(int i = 0; i < codec->num_devices; i++)
+    {
+        if(*cursor >= end) return 0;
+        size_t length = *(*cursor)++;
+        if(length >= MAX_NETWORK_FACE_LENGTH || (size_t)(end - *cursor) < length) return 0;
+        memset(codec->faces[i], 0, MAX_NETWORK_FACE_LENGTH);
+        memcpy(codec->faces[i], *cursor, length);
+        *cursor += length;
+    }
+    return 1;
+}
+
+/*
+* @brief Decodes the frame at the replay's offset into the codec's values,
+*        leaving the snapshots alone.
+*
+* @returns 1 if there was a frame, 0 at the end of the recording or of the
+*          keyframes a shared replay was given
+*/
+int replay_next_values(struct replay *replay)
+{
+    struct record_codec *codec = &replay->codec;
+    int type;
+    const uint8_t *cursor;
+    const uint8_t *end;
+    if(!frame_at(replay, replay->offset, &type, &cursor, &end)) return 0;
+
+    uint64_t time = 0;
+    int ok = get_varint(&cursor, end, &time);
+    if(type == RECORD_KEYFRAME)
+    {
+        ok = ok && get_layout(codec, &cursor, end);
+        if(ok)
+        {
+            reset_codec(codec);
+            codec->time_ns = time;
+            ok = decode_values(codec, cursor, end);
+            memset(codec->delta, 0, (size_t)codec->num_values * sizeof(uint64_t));
+        }
+    }
+    else if(type == RECORD_DELTA && codec->value != NULL)
+    {
+        codec->time_delta += unzigzag(time);
+        codec->time_ns += codec->time_delta;
+        ok = ok && decode_values(codec, cursor, end);
+    }
+    else ok = 0;
+    if(!ok) fatal_error("corrupt recording ", replay->path);
+
+    replay->keyframe = type == RECORD_KEYFRAME;
+    replay->offset = (size_t)(end - replay->data);
+    return 1;
+}
+
+/*
+* @brief Decodes the frame at the replay's offset into the snapshots.
+*
+* @returns 1 if there was a frame, 0 at the end of the recording
+*/
+int decode_frame(struct replay *replay)
+{
+    if(!replay_next_values(replay)) return 0;
+    scatter_sample(&replay->codec, replay->codec.value);
+    return 1;
+}
+
+/*
+* @brief Loads the next sample of the recording into the snapshots.
+*
+* @returns 1 if there was one, 0 at the end of the recording
+*/
+int replay_next(struct replay *replay)
+{
+    if(replay->pending)
+    {
+        replay->pending = 0;
+        return 1;
+    }
+    return decode_frame(replay);
+}
+
+static inline uint64_t keyframe_time(const struct replay *replay, size_t keyframe)
+{
+    return get_u64(replay->index + keyframe * RECORD_INDEX_ENTRY);
+}
+
+/*
+* @returns the file offset of keyframe number keyframe, checked to be
+*          among the frames
+*/
+size_t replay_keyframe_offset(const struct replay *replay, size_t keyframe)
+{
+    uint64_t offset = get_u64(replay->index + keyframe * RECORD_INDEX_ENTRY + 8);
+    if(offset < RECORD_MAGIC_LENGTH || offset >= replay->frames_end) fatal_error("corrupt index in recording ", replay->path);
+    return (size_t)offset;
+}
+
+/*
+* @brief Moves the replay to the first sample taken at or after time_ns.
+*        A binary search of the index finds the keyframe before it, and at
+*        most RECORD_KEYFRAME_INTERVAL frames are decoded from there.
+*/
+void replay_seek(struct replay *replay, uint64_t time_ns)
+{
+    size_t low = 0;
+    size_t high = replay->num_keyframes;
+    while(high - low > 1)
+    {
+        size_t middle = low + (high - low) / 2;
+        if(keyframe_time(replay, middle) <= time_ns) low = middle;
+        else high = middle;
+    }
+
+    replay->pending = 0;
+    replay->offset = RECORD_MAGIC_LENGTH;
+    if(replay->num_keyframes > 0) replay->offset = replay_keyframe_offset(replay, low);
+    while(decode_frame(replay))
+    {
+        if(replay->codec.time_ns >= time_ns)
+        {
+            replay->pending = 1;
+            return;
+        }
+    }
+}
+
+/*
+* @brief Time of the first sample in the recording, 0 if it is empty.
+*/
+uint64_t replay_first_time(const struct replay *replay)
+{
+    return replay->num_keyframes > 0 ? keyframe_time(replay, 0) : 0;
+}
+
+/*
+* @brief Sets up replay to decode the frames of source's mapping from
+*        keyframe first_keyframe up to keyframe end_keyframe, or to the end
+*        when that is num_keyframes, with a decoder of its own. Replays of
+*        different keyframes of one mapping can run on different threads.
+*/
+void share_replay(struct replay *replay, const struct replay *source, size_t first_keyframe, size_t end_keyframe)
+{
+    memset(replay, 0, sizeof(*replay));
+    replay->path = source->path;
+    replay->data = source->data;
+    replay->size = source->size;
+    replay->index = source->index;
+    replay->num_keyframes = source->num_keyframes;
+    replay->frames_end = source->frames_end;
+    replay->shared = 1;
+    replay->offset = replay->frames_end;
+    if(first_keyframe < end_keyframe) replay->offset = replay_keyframe_offset(source, first_keyframe);
+    if(end_keyframe < source->num_keyframes) replay->frames_end = replay_keyframe_offset(source, end_keyframe);
+}
+
+/*
+* @brief Unmaps the recording and frees the decoder.
+*/
+void close_replay(struct replay *replay)
+{
+    if(replay->data != NULL && !replay->shared) munmap((void*)replay->data, replay->size);
+    if(!replay->shared) free(replay->index_copy);
+    free_codec(&replay->codec);
+    memset(replay, 0, sizeof(*replay));
+}
@@ -0,0 +1,121 @@
+/*
+ * File: record.h
+ * Description: Binary recording of the cpu, memory and network snapshots,
+ *              and replay of a recording back into them.
+ */
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sys_mon.h"
+
+#define RECORD_MAGIC                "SYSMONR1"
+#define RECORD_INDEX_MAGIC          "SYSMONIX"
+#define RECORD_MAGIC_LENGTH         8
+#define RECORD_KEYFRAME_INTERVAL    600 //Samples between keyframes, the most a seek decodes
+#define RECORD_KEYFRAME             'K'
+#define RECORD_DELTA                'D'
+
+/*
+* The /proc/stat numbers a sample has besides the cpu lines, in the order
+* they are flattened.
+*/
+enum record_scalar
+{
+    RECORD_CONTEXT_SWITCHES,
+    RECORD_PROCESSES_CREATED,
+    RECORD_BOOT_TIME,
+    RECORD_RUNNING,
+    RECORD_BLOCKED,
+    NUM_RECORD_SCALARS
+};
+
+/*
+* Everything the encoder and the decoder have to agree on: the layout of a
+* sample and the last sample seen. A sample is flattened into num_values
+* numbers, column by column so that cores and interfaces that behave alike
+* sit next to each other, and each is stored as its difference from a
+* prediction made from the last sample.
+*/
+struct record_codec
+{
+    int num_cpus;
+    int num_devices;
+    unsigned int mem_present;
+    uint8_t *online;                    //num_cpus flags
+    char (*faces)[MAX_NETWORK_FACE_LENGTH];
+
+    int num_values;
+    int capacity;                       //Values the arrays below have room for
+    uint64_t *value;                    //Last sample
+    uint64_t *delta;                    //How much each value moved in the last sample
+    uint64_t *next_delta;               //How much it moved in the sample being coded
+
+    uint64_t time_ns;                   //CLOCK_REALTIME of the last sample
+    uint64_t time_delta;
+};
+
+/*
+* A recording being written. Each sample is encoded into frame and written
+* with one write(), the keyframe index is kept in memory and appended when
+* the recording is closed.
+*/
+struct recorder
+{
+    const char *path;
+    int fd;
+    struct record_codec codec;
+    uint64_t *current;                  //The sample being encoded, flattened
+    uint8_t *frame;
+    size_t frame_capacity;
+
+    uint64_t offset;                    //Bytes written so far
+    uint64_t num_samples;
+    uint64_t *index;                    //Time and offset of each keyframe
+    size_t num_keyframes;
+    size_t index_capacity;
+};
+
+/*
+* A recording mapped for replay. The index is read in place from the end of
+* the file, or rebuilt into index_copy if the recording was not closed. A
+* shared replay decodes a run of the keyframes of another one's mapping,
+* which it neither unmaps nor frees.
+*/
+struct replay
+{
+    const char *path;
+    const uint8_t *data;
+    size_t size;
+    size_t frames_end;                  //Where the frames stop and the index starts
+    const uint8_t *index;               //16 bytes per keyframe: time, offset
+    uint8_t *index_copy;
+    size_t num_keyframes;
+
+    size_t offset;                      //Next frame to decode
+    int pending;                        //The sample in the snapshots has not been returned yet
+    int keyframe;                       //The last frame decoded was a keyframe
+    int shared;
+    struct record_codec codec;
+};
+
+void open_recorder(struct recorder *recorder, const char *path);
+void record_sample(struct recorder *recorder, uint64_t time_ns);
+void close_recorder(struct recorder *recorder);
+
+void open_replay(struct replay *replay, const char *path);
+int replay_next(struct replay *replay);
+void replay_seek(struct replay *replay, uint64_t time_ns);
+uint64_t replay_first_time(const struct replay *replay);
+size_t replay_keyframe_offset(const struct replay *replay, size_t keyframe);
+void share_replay(struct replay *replay, const struct replay *source, size_t first_keyframe, size_t end_keyframe);
+int replay_next_values(struct replay *replay);
+int record_cpu_value(const struct record_codec *codec, int field, int cpu);
+int record_scalar_value(const struct record_codec *codec, int scalar);
+int record_mem_value(const struct record_codec *codec, int field);
+int record_network_value(const struct record_codec *codec, int field, int device);
+void close_replay(struct replay *replay);
+
+#endif
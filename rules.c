@@ -0,0 +1,791 @@
+/*
+ * File: rules.c
+ * Description: --rule threshold rules, compiled once into bytecode that
+ *              reads the collectors' latest samples, and evaluated on every
+ *              sample, with an alert line or a hook when one starts or
+ *              stops matching.
+ *
+ * Notes:
+ *      A rule such as "cpu.iowait_pct > 20 for 5s" is parsed when --rule is
+ *      read into postfix ops for a stack machine, and every metric it names
+ *      is resolved then to what it reads: a cpu rate to its column, a
+ *      meminfo key to its index, an interface or disk to a binding. A
+ *      sample is then evaluated by running each rule's few ops, which load
+ *      straight from the collectors' arrays, with nothing allocated and no
+ *      name compared, so hundreds of rules take microseconds.
+ *
+ *      A binding keeps the index of its interface's or disk's rates and
+ *      checks on each load that the line there is still the one it found,
+ *      by interface id or device numbers. The name is looked up again only
+ *      when network_rates.generation says interfaces came or went, or the
+ *      disk lines moved, and at most once a sample while it is missing.
+ *
+ *      A hook is started with posix_spawn and not waited for; the ones
+ *      that finished are reaped on the next evaluation.
+ */
+#include <math.h>
+#include <ctype.h>
+#include <time.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "sys_mon.h"
+#include "disk.h"
+#include "meminfo.h"
+#include "pressure.h"
+#include "selfstats.h"
+#include "rules.h"
+
+extern char **environ;
+
+struct rule_set rule_set;
+
+const char *rule_cpu_rate_names[NUM_CPU_RATES] = {"user_pct", "system_pct", "iowait_pct", "steal_pct", "idle_pct", "busy_pct"};
+const char *rule_cpu_counter_names[NUM_RULE_CPU_COUNTERS] = {"context_switches_rate", "interrupts_rate", "softirqs_rate",
+                                                             "running", "blocked"};
+const char *rule_mem_pct_names[NUM_RULE_MEM_PCTS] = {"used_pct", "available_pct"};
+const char *rule_network_rate_names[NUM_NETWORK_RATES] = {"rx_bytes_rate", "rx_packets_rate", "rx_drop_rate",
+                                                          "tx_bytes_rate", "tx_packets_rate", "tx_drop_rate"};
+const char *rule_disk_rate_names[NUM_DISK_RATES] = {"reads_rate", "writes_rate", "read_bytes_rate", "write_bytes_rate",
+                                                    "read_latency_ms", "write_latency_ms", "queue", "util_pct"};
+const char *rule_pressure_average_names[NUM_PRESSURE_AVERAGES] = {"avg10", "avg60", "avg300"};
+
+/*
+* The rule being compiled and how far its text has been read.
+*/
+struct rule_parser
+{
+    const char *cursor;
+    struct rule *rule;
+    int depth;                          //Values on the stack after the ops so far
+};
+
+/*
+* @returns the index of name, length characters, in names, or -1
+*/
+int rule_name_index(const char *const *names, int num_names, const char *name, size_t length)
+{
+    for(int i = 0; i < num_names; i++)
+    {
+        if(strlen(names[i]) == length && memcmp(names[i], name, length) == 0) return i;
+    }
+    return -1;
+}
+
+/*
+* @brief Writes a meminfo key lower cased, with each run of other
+*        characters made one underscore and none at the end, so
+*        Active(anon) and active_anon compare equal.
+*/
+void normalise_meminfo_name(const char *name, size_t length, char *normal, size_t size)
+{
+    size_t written = 0;
+    int underscore = 0;
+    for(size_t i = 0; i < length && written + 2 < size; i++)
+    {
+        unsigned char c = (unsigned char)name[i];
+        if(isalnum(c))
+        {
+            if(underscore && written > 0) normal[written++] = '_';
+            underscore = 0;
+            normal[written++] = (char)tolower(c);
+        }
+        else underscore = 1;
+    }
+    normal[written] = '\0';
+}
+
+/*
+* @returns the meminfo_key of a name in any case, or -1
+*/
+int rule_meminfo_key(const char *name, size_t length)
+{
+    char wanted[64];
+    normalise_meminfo_name(name, length, wanted, sizeof(wanted));
+    for(int key = 0; key < NUM_MEMINFO_KEYS; key++)
+    {
+        char normal[64];
+        normalise_meminfo_name(meminfo_key_names[key], meminfo_key_lengths[key], normal, sizeof(normal));
+        if(strcmp(normal, wanted) == 0) return key;
+    }
+    return -1;
+}
+
+/*
+* @brief Appends an op to the rule being compiled, keeping track of how
+*        deep its stack gets.
+*/
+void emit_rule_op(struct rule_parser *parser, int code, int field, uint32_t index)
+{
+    if(rule_set.num_ops == rule_set.ops_capacity)
+    {
+        rule_set.ops_capacity = rule_set.ops_capacity > 0 ? rule_set.ops_capacity * 2 : 256;
+        rule_set.ops = counted_realloc(rule_set.ops, rule_set.ops_capacity * sizeof(struct rule_op));
+    }
+    struct rule_op *op = &rule_set.ops[rule_set.num_ops];
+    op->code = (uint8_t)code;
+    op->field = (uint8_t)field;
+    op->index = index;
+
+    //The first value the rule loads is the one its alerts show
+    if(code > RULE_PUSH && code <= RULE_PRESSURE_STALL && parser->rule->report_op == UINT32_MAX)
+    {
+        parser->rule->report_op = rule_set.num_ops;
+    }
+    rule_set.num_ops++;
+
+    parser->depth += code <= RULE_PRESSURE_STALL ? 1 : code == RULE_NEGATE ? 0 : -1;
+    if(parser->depth > RULE_STACK_DEPTH) fatal_error("--rule nests too deep to evaluate, ", parser->rule->text);
+}
+
+uint32_t add_rule_constant(double value)
+{
+    if(rule_set.num_constants == rule_set.constants_capacity)
+    {
+        rule_set.constants_capacity = rule_set.constants_capacity > 0 ? rule_set.constants_capacity * 2 : 64;
+        rule_set.constants = counted_realloc(rule_set.constants, rule_set.constants_capacity * sizeof(double));
+    }
+    rule_set.constants[rule_set.num_constants] = value;
+    return rule_set.num_constants++;
+}
+
+/*
+* @brief Finds the binding of an interface or disk, shared by every rule
+*        naming it, adding it if no rule did before.
+*
+* @returns its index in rule_set.bindings
+*/
+uint32_t add_rule_binding(struct rule_parser *parser, int source, const char *name, size_t length)
+{
+    if(length == 0 || length >= RULE_NAME_LENGTH) fatal_error("--rule names an interface or disk that cannot exist, ", parser->rule->text);
+    for(int i = 0; i < rule_set.num_bindings; i++)
+    {
+        struct rule_binding *binding = &rule_set.bindings[i];
+        if(binding->source == source && strlen(binding->name) == length && memcmp(binding->name, name, length) == 0) return (uint32_t)i;
+    }
+
+    if(rule_set.num_bindings == rule_set.bindings_capacity)
+    {
+        rule_set.bindings_capacity = rule_set.bindings_capacity > 0 ? rule_set.bindings_capacity * 2 : 16;
+        rule_set.bindings = counted_realloc(rule_set.bindings, (size_t)rule_set.bindings_capacity * sizeof(struct rule_binding));
+    }
+    struct rule_binding *binding = &rule_set.bindings[rule_set.num_bindings];
+    memset(binding, 0, sizeof(*binding));
+    memcpy(binding->name, name, length);
+    binding->source = source;
+    binding->device = -1;
+    binding->id = -1;
+    binding->generation = UINT64_MAX;
+    binding->resolved_ns = UINT64_MAX;
+    return (uint32_t)rule_set.num_bindings++;
+}
+
+/*
+* @brief Compiles the load of a metric, such as cpu.iowait_pct,
+*        cpu3.busy_pct, mem.MemAvailable, net.eth0.rx_drop_rate,
+*        disk.sda.util_pct or pressure.memory.some_avg10.
+*/
+void compile_rule_metric(struct rule_parser *parser, const char *name, size_t length)
+{
+    struct rule *rule = parser->rule;
+    const char *end = name + length;
+    const char *dot = memchr(name, '.', length);
+    const char *last_dot = dot;
+    for(const char *c = name; c < end; c++) if(*c == '.') last_dot = c;
+    if(dot == NULL) fatal_error("--rule needs metrics such as cpu.iowait_pct, not only a name, in ", rule->text);
+
+    size_t prefix = (size_t)(dot - name);
+    const char *field = dot + 1;
+    size_t field_length = (size_t)(end - field);
+    int index;
+    if(prefix == 3 && memcmp(name, "cpu", 3) == 0)
+    {
+        rule->sources |= RULE_SOURCE_CPU;
+        if((index = rule_name_index(rule_cpu_rate_names, NUM_CPU_RATES, field, field_length)) >= 0)
+        {
+            emit_rule_op(parser, RULE_CPU_TOTAL, index, 0);
+            return;
+        }
+        if((index = rule_name_index(rule_cpu_counter_names, NUM_RULE_CPU_COUNTERS, field, field_length)) >= 0)
+        {
+            emit_rule_op(parser, RULE_CPU_COUNTER, index, 0);
+            return;
+        }
+    }
+    else if(prefix > 3 && memcmp(name, "cpu", 3) == 0 && isdigit((unsigned char)name[3]))
+    {
+        uint32_t cpu = 0;
+        const char *digit = name + 3;
+        while(digit < dot && isdigit((unsigned char)*digit) && cpu < 1000000) cpu = cpu * 10 + (uint32_t)(*digit++ - '0');
+        rule->sources |= RULE_SOURCE_CPU;
+        if(digit == dot && (index = rule_name_index(rule_cpu_rate_names, NUM_CPU_RATES, field, field_length)) >= 0)
+        {
+            emit_rule_op(parser, RULE_CPU_CORE, index, cpu);
+            return;
+        }
+    }
+    else if(prefix == 3 && memcmp(name, "mem", 3) == 0)
+    {
+        rule->sources |= RULE_SOURCE_MEM;
+        if((index = rule_name_index(rule_mem_pct_names, NUM_RULE_MEM_PCTS, field, field_length)) >= 0)
+        {
+            emit_rule_op(parser, RULE_MEM_PCT, index, 0);
+            return;
+        }
+        if((index = rule_meminfo_key(field, field_length)) >= 0)
+        {
+            emit_rule_op(parser, RULE_MEMINFO, 0, (uint32_t)index);
+            return;
+        }
+    }
+    else if(last_dot != dot && ((prefix == 3 && memcmp(name, "net", 3) == 0) || (prefix == 4 && memcmp(name, "disk", 4) == 0)))
+    {
+        //The interface or disk is everything between the first and last dots, eth0.100 included
+        int network = prefix == 3;
+        const char *rate = last_dot + 1;
+        size_t rate_length = (size_t)(end - rate);
+        index = network ? rule_name_index(rule_network_rate_names, NUM_NETWORK_RATES, rate, rate_length)
+                        : rule_name_index(rule_disk_rate_names, NUM_DISK_RATES, rate, rate_length);
+        if(index >= 0)
+        {
+            int source = network ? RULE_SOURCE_NETWORK : RULE_SOURCE_DISK;
+            rule->sources |= (unsigned int)source;
+            emit_rule_op(parser, network ? RULE_NETWORK : RULE_DISK, index,
+                         add_rule_binding(parser, source, field, (size_t)(last_dot - field)));
+            return;
+        }
+    }
+    else if(last_dot != dot && prefix == 8 && memcmp(name, "pressure", 8) == 0)
+    {
+        //pressure.RESOURCE.KIND_avg10, _avg60, _avg300 or _pct
+        int resource = rule_name_index(pressure_resource_names, NUM_PRESSURE_RESOURCES, field, (size_t)(last_dot - field));
+        const char *line = last_dot + 1;
+        const char *underscore = memchr(line, '_', (size_t)(end - line));
+        int kind = underscore != NULL ? rule_name_index(pressure_kind_names, NUM_PRESSURE_KINDS, line, (size_t)(underscore - line)) : -1;
+        if(resource >= 0 && kind >= 0)
+        {
+            const char *what = underscore + 1;
+            size_t what_length = (size_t)(end - what);
+            uint32_t index_of_line = (uint32_t)(resource * NUM_PRESSURE_KINDS + kind);
+            rule->sources |= RULE_SOURCE_PRESSURE;
+            if(what_length == 3 && memcmp(what, "pct", 3) == 0)
+            {
+                emit_rule_op(parser, RULE_PRESSURE_STALL, 0, index_of_line);
+                return;
+            }
+            if((index = rule_name_index(rule_pressure_average_names, NUM_PRESSURE_AVERAGES, what, what_length)) >= 0)
+            {
+                emit_rule_op(parser, RULE_PRESSURE_AVERAGE, index, index_of_line);
+                return;
+            }
+        }
+    }
+
+    char metric[128];
+    snprintf(metric, sizeof(metric), "%.*s", (int)length, name);
+    fatal_error("--rule reads a metric sys_mon does not have, ", metric);
+}
+
+static inline int rule_name_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+/*
+* @brief Finds the end of the metric name at start. A - only belongs to
+*        it in the interface or disk of a net. or disk. metric, before the
+*        last dot; anywhere else it is a minus, so mem.MemFree-1 is a
+*        subtraction while net.veth-a.rx_bytes_rate-1 is one too.
+*/
+const char *rule_metric_end(const char *start)
+{
+    const char *end = start;
+    if(strncmp(start, "net.", 4) != 0 && strncmp(start, "disk.", 5) != 0)
+    {
+        while(rule_name_char(*end)) end++;
+        return end;
+    }
+
+    const char *last_dot = NULL;
+    while(rule_name_char(*end) || *end == '-')
+    {
+        if(*end == '.') last_dot = end;
+        end++;
+    }
+    const char *minus = memchr(last_dot, '-', (size_t)(end - last_dot));
+    return minus != NULL ? minus : end;
+}
+
+void skip_rule_spaces(struct rule_parser *parser)
+{
+    while(isspace((unsigned char)*parser->cursor)) parser->cursor++;
+}
+
+/*
+* @brief Takes symbol, an operator or a word, if the text continues with it.
+*
+* @returns 1 if it did
+*/
+int accept_rule_symbol(struct rule_parser *parser, const char *symbol)
+{
+    skip_rule_spaces(parser);
+    size_t length = strlen(symbol);
+    if(strncmp(parser->cursor, symbol, length) != 0) return 0;
+    if(isalpha((unsigned char)symbol[0]) && rule_name_char(parser->cursor[length])) return 0;
+    parser->cursor += length;
+    return 1;
+}
+
+void parse_rule_expression(struct rule_parser *parser);
+
+/*
+* @brief Parses a number, a metric, a negation or an expression in
+*        brackets. A number may end in k, M, G or T for powers of 1000.
+*/
+void parse_rule_operand(struct rule_parser *parser)
+{
+    skip_rule_spaces(parser);
+    const char *start = parser->cursor;
+    if(accept_rule_symbol(parser, "("))
+    {
+        parse_rule_expression(parser);
+        if(!accept_rule_symbol(parser, ")")) fatal_error("--rule is missing a ) in ", parser->rule->text);
+    }
+    else if(accept_rule_symbol(parser, "-"))
+    {
+        parse_rule_operand(parser);
+        emit_rule_op(parser, RULE_NEGATE, 0, 0);
+    }
+    else if(isdigit((unsigned char)*start) || (*start == '.' && isdigit((unsigned char)start[1])))
+    {
+        char *end;
+        double value = strtod(start, &end);
+        static const char powers[] = "kMGT";
+        const char *suffix = *end != '\0' ? strchr(powers, *end) : NULL;
+        if(suffix != NULL)
+        {
+            for(const char *power = powers; power <= suffix; power++) value *= 1000;
+            end++;
+        }
+        if(rule_name_char(*end)) fatal_error("--rule has a number it cannot read in ", parser->rule->text);
+        emit_rule_op(parser, RULE_PUSH, 0, add_rule_constant(value));
+        parser->cursor = end;
+    }
+    else if(isalpha((unsigned char)*start))
+    {
+        parser->cursor = rule_metric_end(start);
+        compile_rule_metric(parser, start, (size_t)(parser->cursor - start));
+    }
+    else fatal_error("--rule expected a metric, a number or ( in ", parser->rule->text);
+}
+
+void parse_rule_product(struct rule_parser *parser)
+{
+    parse_rule_operand(parser);
+    for(;;)
+    {
+        int code = accept_rule_symbol(parser, "*") ? RULE_MULTIPLY : accept_rule_symbol(parser, "/") ? RULE_DIVIDE : -1;
+        if(code < 0) return;
+        parse_rule_operand(parser);
+        emit_rule_op(parser, code, 0, 0);
+    }
+}
+
+void parse_rule_sum(struct rule_parser *parser)
+{
+    parse_rule_product(parser);
+    for(;;)
+    {
+        int code = accept_rule_symbol(parser, "+") ? RULE_ADD : accept_rule_symbol(parser, "-") ? RULE_SUBTRACT : -1;
+        if(code < 0) return;
+        parse_rule_product(parser);
+        emit_rule_op(parser, code, 0, 0);
+    }
+}
+
+void parse_rule_comparison(struct rule_parser *parser)
+{
+    const char *symbols[] = {">=", "<=", "==", "!=", ">", "<"};
+    const int codes[] = {RULE_GREATER_EQUAL, RULE_LESS_EQUAL, RULE_EQUAL, RULE_NOT_EQUAL, RULE_GREATER, RULE_LESS};
+    parse_rule_sum(parser);
+    for(int i = 0; i < (int)(sizeof(symbols) / sizeof(symbols[0])); i++)
+    {
+        if(accept_rule_symbol(parser, symbols[i]))
+        {
+            parse_rule_sum(parser);
+            emit_rule_op(parser, codes[i], 0, 0);
+            return;
+        }
+    }
+}
+
+void parse_rule_conjunction(struct rule_parser *parser)
+{
+    parse_rule_comparison(parser);
+    while(accept_rule_symbol(parser, "and") || accept_rule_symbol(parser, "&&"))
+    {
+        parse_rule_comparison(parser);
+        emit_rule_op(parser, RULE_AND, 0, 0);
+    }
+}
+
+void parse_rule_expression(struct rule_parser *parser)
+{
+    parse_rule_conjunction(parser);
+    while(accept_rule_symbol(parser, "or") || accept_rule_symbol(parser, "||"))
+    {
+        parse_rule_conjunction(parser);
+        emit_rule_op(parser, RULE_OR, 0, 0);
+    }
+}
+
+/*
+* @brief Reads the duration after for, such as 5s, 500ms, 2m or 1h, or a
+*        bare number of seconds.
+*
+* @returns it in nanoseconds
+*/
+uint64_t parse_rule_duration(struct rule_parser *parser)
+{
+    skip_rule_spaces(parser);
+    char *end;
+    double value = strtod(parser->cursor, &end);
+    if(end == parser->cursor || value < 0) fatal_error("--rule needs a duration such as 5s after for in ", parser->rule->text);
+    double scale = 1e9;
+    if(strncmp(end, "ms", 2) == 0) {scale = 1e6; end += 2;}
+    else if(*end == 's') end++;
+    else if(*end == 'm') {scale = 60e9; end++;}
+    else if(*end == 'h') {scale = 3600e9; end++;}
+    if(rule_name_char(*end)) fatal_error("--rule needs a duration such as 5s after for in ", parser->rule->text);
+    parser->cursor = end;
+    return (uint64_t)(value * scale + 0.5);
+}
+
+/*
+* @brief Compiles a --rule, EXPRESSION [for DURATION], exiting on anything
+*        it cannot read. text must outlive the rule set, as argv does.
+*/
+void add_rule(const char *text)
+{
+    if(rule_set.num_rules == rule_set.capacity)
+    {
+        rule_set.capacity = rule_set.capacity > 0 ? rule_set.capacity * 2 : 16;
+        rule_set.rules = counted_realloc(rule_set.rules, (size_t)rule_set.capacity * sizeof(struct rule));
+    }
+    struct rule *rule = &rule_set.rules[rule_set.num_rules];
+    memset(rule, 0, sizeof(*rule));
+    rule->text = text;
+    rule->first_op = rule_set.num_ops;
+    rule->report_op = UINT32_MAX;
+
+    struct rule_parser parser = {text, rule, 0};
+    parse_rule_expression(&parser);
+    if(accept_rule_symbol(&parser, "for")) rule->for_ns = parse_rule_duration(&parser);
+    skip_rule_spaces(&parser);
+    if(*parser.cursor != '\0') fatal_error("--rule has more than an expression and for DURATION in ", text);
+
+    rule->num_ops = rule_set.num_ops - rule->first_op;
+    if(rule->report_op == UINT32_MAX) rule->report_op = rule->first_op;
+    rule->value = NAN;
+    rule_set.sources |= rule->sources;
+    rule_set.num_rules++;
+}
+
+/*
+* @brief Starts handing alert lines to alert.
+*/
+void open_rules(void (*alert)(const char *line))
+{
+    rule_set.alert = alert;
+}
+
+/*
+* @brief Finds where the interface of a binding is in the latest sample.
+*/
+void bind_rule_interface(struct rule_binding *binding)
+{
+    binding->generation = network_rates.generation;
+    binding->device = -1;
+    binding->id = find_network_interface(binding->name);
+    if(binding->id < 0) return;
+    for(int i = 0; i < network_info.num_devices; i++)
+    {
+        if(network_info.devices[i].id == binding->id)
+        {
+            binding->device = i;
+            return;
+        }
+    }
+}
+
+static inline double rule_network_rate(struct rule_binding *binding, int field)
+{
+    int device = binding->device;
+    if(binding->generation != network_rates.generation || (device >= 0 &&
+       (device >= network_info.num_devices || network_info.devices[device].id != binding->id)))
+    {
+        bind_rule_interface(binding);
+        device = binding->device;
+    }
+    if(device < 0 || !network_rates.devices[device].valid) return NAN;
+    return network_rates.devices[device].rate[field];
+}
+
+/*
+* @brief Finds the disk of a binding in the latest sample, by name, and
+*        keeps its device numbers to check it by from then on.
+*/
+void bind_rule_disk(struct rule_binding *binding)
+{
+    binding->resolved_ns = disk_stats.sample_ns;
+    binding->device = -1;
+    for(int i = 0; i < disk_stats.num_devices; i++)
+    {
+        const struct disk_device *device = &disk_stats.devices[i];
+        if(strcmp(device->name, binding->name) == 0)
+        {
+            binding->device = i;
+            binding->major = device->major;
+            binding->minor = device->minor;
+            return;
+        }
+    }
+}
+
+static inline double rule_disk_rate(struct rule_binding *binding, int field)
+{
+    int device = binding->device;
+    if(device < 0 || device >= disk_stats.num_devices || disk_stats.devices[device].major != binding->major ||
+       disk_stats.devices[device].minor != binding->minor)
+    {
+        if(binding->resolved_ns == disk_stats.sample_ns) return NAN;
+        bind_rule_disk(binding);
+        device = binding->device;
+        if(device < 0) return NAN;
+    }
+    if(!disk_rates.devices[device].valid) return NAN;
+    return disk_rates.devices[device].rate[field];
+}
+
+/*
+* @brief The truth of a value: not zero and not NaN.
+*/
+static inline double rule_truth(double value)
+{
+    return value < 0 || value > 0;
+}
+
+/*
+* @brief Runs a rule's ops against the latest samples, keeping the value
+*        of its report_op in value.
+*
+* @returns what the expression came to, a comparison's 1 or 0
+*/
+double evaluate_rule(struct rule *rule)
+{
+    double stack[RULE_STACK_DEPTH];
+    int top = -1;
+    const struct rule_op *op = &rule_set.ops[rule->first_op];
+    const struct rule_op *end = op + rule->num_ops;
+    const struct rule_op *report = &rule_set.ops[rule->report_op];
+    for(; op < end; op++)
+    {
+        double left;
+        double right;
+        switch(op->code)
+        {
+            case RULE_PUSH: stack[++top] = rule_set.constants[op->index]; break;
+            case RULE_CPU_TOTAL: stack[++top] = cpu_rates.have_previous ? cpu_rates.total[op->field] : NAN; break;
+            case RULE_CPU_CORE:
+                stack[++top] = op->index < (uint32_t)cpu_stats.num_cpus && cpu_rates.valid[op->index] ? cpu_rates.pct[op->field][op->index] : NAN;
+                break;
+            case RULE_CPU_COUNTER:
+                switch(op->field)
+                {
+                    case RULE_CPU_CONTEXT_SWITCHES: stack[++top] = cpu_rates.have_previous ? cpu_rates.context_switches_per_second : NAN; break;
+                    case RULE_CPU_INTERRUPTS: stack[++top] = cpu_rates.have_previous ? cpu_rates.interrupts_per_second : NAN; break;
+                    case RULE_CPU_SOFTIRQS: stack[++top] = cpu_rates.have_previous ? cpu_rates.softirqs_per_second : NAN; break;
+                    case RULE_CPU_RUNNING: stack[++top] = (double)cpu_stats.proccesses_running; break;
+                    default: stack[++top] = (double)cpu_stats.proccesses_blocked; break;
+                }
+                break;
+            case RULE_MEMINFO: stack[++top] = meminfo_has(&meminfo_snapshot, (int)op->index) ? (double)meminfo_snapshot.value[op->index] : NAN; break;
+            case RULE_MEM_PCT:
+                if(!meminfo_has(&meminfo_snapshot, MEMINFO_MEMTOTAL) || !meminfo_has(&meminfo_snapshot, MEMINFO_MEMAVAILABLE) ||
+                   meminfo_snapshot.value[MEMINFO_MEMTOTAL] == 0) stack[++top] = NAN;
+                else
+                {
+                    double available = (double)meminfo_snapshot.value[MEMINFO_MEMAVAILABLE] * 100 / (double)meminfo_snapshot.value[MEMINFO_MEMTOTAL];
+                    stack[++top] = op->field == RULE_MEM_AVAILABLE_PCT ? available : 100 - available;
+                }
+                break;
+            case RULE_NETWORK: stack[++top] = rule_network_rate(&rule_set.bindings[op->index], op->field); break;
+            case RULE_DISK: stack[++top] = rule_disk_rate(&rule_set.bindings[op->index], op->field); break;
+            case RULE_PRESSURE_AVERAGE:
+            {
+                int resource = (int)op->index / NUM_PRESSURE_KINDS;
+                const struct pressure_line *line = &pressure_stats.line[resource][op->index % NUM_PRESSURE_KINDS];
+                int available = pressure_stats.available[resource] && line->present;
+                stack[++top] = available ? line->average[op->field] / 100.0 : NAN;
+                break;
+            }
+            case RULE_PRESSURE_STALL:
+            {
+                int resource = (int)op->index / NUM_PRESSURE_KINDS;
+                int kind = (int)op->index % NUM_PRESSURE_KINDS;
+                stack[++top] = pressure_rates.valid[resource][kind] ? pressure_rates.stall_pct[resource][kind] : NAN;
+                break;
+            }
+            case RULE_NEGATE: stack[top] = -stack[top]; break;
+            default:
+                right = stack[top--];
+                left = stack[top];
+                switch(op->code)
+                {
+                    case RULE_ADD: stack[top] = left + right; break;
+                    case RULE_SUBTRACT: stack[top] = left - right; break;
+                    case RULE_MULTIPLY: stack[top] = left * right; break;
+                    case RULE_DIVIDE: stack[top] = right != 0 ? left / right : NAN; break;
+                    case RULE_GREATER: stack[top] = left > right; break;
+                    case RULE_GREATER_EQUAL: stack[top] = left >= right; break;
+                    case RULE_LESS: stack[top] = left < right; break;
+                    case RULE_LESS_EQUAL: stack[top] = left <= right; break;
+                    case RULE_EQUAL: stack[top] = left == right; break;
+                    case RULE_NOT_EQUAL: stack[top] = left < right || left > right; break;
+                    case RULE_AND: stack[top] = rule_truth(left) && rule_truth(right); break;
+                    default: stack[top] = rule_truth(left) || rule_truth(right); break;
+                }
+                break;
+        }
+        if(op == report) rule->value = stack[top];
+    }
+    return stack[0];
+}
+
+/*
+* @brief Reaps the hooks that finished, without waiting for the others.
+*/
+void reap_rule_hooks()
+{
+    while(rule_set.hooks_running > 0 && waitpid(-1, NULL, WNOHANG) > 0) rule_set.hooks_running--;
+}
+
+/*
+* @brief Starts --rule-hook for an alert, with the rule, whether it is
+*        firing or resolved, its value and the alert line in its
+*        environment as SYS_MON_RULE, SYS_MON_STATE, SYS_MON_VALUE and
+*        SYS_MON_ALERT.
+*/
+void run_rule_hook(const struct rule *rule, const char *state, const char *line)
+{
+    if(rule_set.hooks_running >= RULE_MAX_HOOKS)
+    {
+        rule_set.hooks_skipped++;
+        return;
+    }
+    char rule_variable[RULE_ALERT_LENGTH];
+    char state_variable[32];
+    char value_variable[64];
+    char alert_variable[RULE_ALERT_LENGTH + 16];
+    snprintf(rule_variable, sizeof(rule_variable), "SYS_MON_RULE=%s", rule->text);
+    snprintf(state_variable, sizeof(state_variable), "SYS_MON_STATE=%s", state);
+    snprintf(value_variable, sizeof(value_variable), "SYS_MON_VALUE=%.6g", rule->value);
+    snprintf(alert_variable, sizeof(alert_variable), "SYS_MON_ALERT=%s", line);
+
+    //Ahead of the inherited environment, so they win over any of the same name
+    int num_inherited = 0;
+    while(environ[num_inherited] != NULL) num_inherited++;
+    char **environment = counted_malloc((size_t)(num_inherited + 5) * sizeof(char *));
+    environment[0] = rule_variable;
+    environment[1] = state_variable;
+    environment[2] = value_variable;
+    environment[3] = alert_variable;
+    memcpy(environment + 4, environ, (size_t)(num_inherited + 1) * sizeof(char *));
+
+    char *arguments[] = {"sh", "-c", (char *)rule_set.hook, NULL};
+    pid_t pid;
+    if(posix_spawn(&pid, "/bin/sh", NULL, NULL, arguments, environment) == 0) rule_set.hooks_running++;
+    free(environment);
+}
+
+/*
+* @brief Writes the alert line of a rule that started firing or resolved
+*        at sample_ns, hands it to alert and runs the hook.
+*/
+void raise_rule_alert(struct rule *rule, uint64_t sample_ns, int firing)
+{
+    char when[32];
+    time_t seconds = (time_t)(sample_ns / 1000000000ull);
+    struct tm local;
+    strftime(when, sizeof(when), "%H:%M:%S", localtime_r(&seconds, &local));
+
+    char *line = rule_set.recent[rule_set.alerts % RULE_RECENT_ALERTS];
+    rule_set.alerts++;
+    if(rule_set.num_recent < RULE_RECENT_ALERTS) rule_set.num_recent++;
+    if(firing) snprintf(line, RULE_ALERT_LENGTH, "%s.%03" PRIu64 " FIRING %s, value %.6g", when, sample_ns / 1000000 % 1000, rule->text, rule->value);
+    else
+    {
+        snprintf(line, RULE_ALERT_LENGTH, "%s.%03" PRIu64 " RESOLVED %s, value %.6g, matched for %.1f s", when,
+                 sample_ns / 1000000 % 1000, rule->text, rule->value, (double)(sample_ns - rule->matching_since_ns) / 1e9);
+    }
+    if(rule_set.alert != NULL) rule_set.alert(line);
+    if(rule_set.hook != NULL) run_rule_hook(rule, firing ? "firing" : "resolved", line);
+}
+
+/*
+* @brief Evaluates every rule against the collectors' latest samples,
+*        taken at sample_ns, CLOCK_REALTIME, and raises the alerts of the
+*        rules that start or stop firing.
+*
+* @returns the number of alerts raised
+*/
+int evaluate_rules(uint64_t sample_ns)
+{
+    uint64_t start = monotonic_ns();
+    if(rule_set.hooks_running > 0) reap_rule_hooks();
+    int alerts = 0;
+    for(int i = 0; i < rule_set.num_rules; i++)
+    {
+        struct rule *rule = &rule_set.rules[i];
+        if(rule_truth(evaluate_rule(rule)))
+        {
+            if(rule->matching_since_ns == 0) rule->matching_since_ns = sample_ns;
+            if(!rule->firing && sample_ns - rule->matching_since_ns >= rule->for_ns)
+            {
+                rule->firing = 1;
+                rule->fired++;
+                rule_set.num_firing++;
+                raise_rule_alert(rule, sample_ns, 1);
+                alerts++;
+            }
+        }
+        else
+        {
+            if(rule->firing)
+            {
+                rule->firing = 0;
+                rule_set.num_firing--;
+                raise_rule_alert(rule, sample_ns, 0);
+                alerts++;
+            }
+            rule->matching_since_ns = 0;
+        }
+    }
+    rule_set.evaluations++;
+    rule_set.evaluate_ns = monotonic_ns() - start;
+    probe_end(PROBE_RULES, start);
+    return alerts;
+}
+
+/*
+* @brief Frees the rules. Hooks still running are left to finish.
+*/
+void close_rules()
+{
+    reap_rule_hooks();
+    free(rule_set.rules);
+    free(rule_set.ops);
+    free(rule_set.constants);
+    free(rule_set.bindings);
+    memset(&rule_set, 0, sizeof(rule_set));
+}
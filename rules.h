@@ -0,0 +1,171 @@
+/*
+ * File: rules.h
+ * Description: --rule threshold rules, compiled once into bytecode that
+ *              reads the collectors' latest samples, and evaluated on every
+ *              sample, with an alert line or a hook when one starts or
+ *              stops matching.
+ */
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdint.h>
+
+#include "sys_mon.h"
+
+#define RULE_STACK_DEPTH            16 //Values a rule's expression holds at once
+#define RULE_NAME_LENGTH            32 //Longest interface or disk name a rule names
+#define RULE_RECENT_ALERTS          8  //Alerts the loop modes' screen keeps
+#define RULE_ALERT_LENGTH           320
+#define RULE_MAX_HOOKS              16 //--rule-hook commands running at once
+#define RULES_SHOWN_FIRING          10 //Firing rules the loop modes' screen lists
+
+/*
+* The collectors a rule reads, the bits of rule.sources.
+*/
+enum rule_source
+{
+    RULE_SOURCE_CPU = 1,
+    RULE_SOURCE_MEM = 2,
+    RULE_SOURCE_NETWORK = 4,
+    RULE_SOURCE_DISK = 8,
+    RULE_SOURCE_PRESSURE = 16
+};
+
+/*
+* The instructions of the rule machine, a stack of doubles. The loads push
+* a value of the latest samples, NaN when there is none, such as an
+* interface that is gone; a comparison with NaN does not match.
+*/
+enum rule_opcode
+{
+    RULE_PUSH,                          //rule_set.constants[index]
+    RULE_CPU_TOTAL,                     //cpu_rates.total[field]
+    RULE_CPU_CORE,                      //cpu_rates.pct[field][index]
+    RULE_CPU_COUNTER,                   //rule_cpu_counter field
+    RULE_MEMINFO,                       //meminfo_snapshot.value[index], in kB
+    RULE_MEM_PCT,                       //rule_mem_pct field
+    RULE_NETWORK,                       //network_rate field of rule_set.bindings[index]
+    RULE_DISK,                          //disk_rate field of rule_set.bindings[index]
+    RULE_PRESSURE_AVERAGE,              //pressure_average field of line index, resource * NUM_PRESSURE_KINDS + kind
+    RULE_PRESSURE_STALL,                //pressure_rates.stall_pct of line index
+    RULE_ADD,
+    RULE_SUBTRACT,
+    RULE_MULTIPLY,
+    RULE_DIVIDE,
+    RULE_NEGATE,
+    RULE_GREATER,
+    RULE_GREATER_EQUAL,
+    RULE_LESS,
+    RULE_LESS_EQUAL,
+    RULE_EQUAL,
+    RULE_NOT_EQUAL,
+    RULE_AND,
+    RULE_OR
+};
+
+enum rule_cpu_counter
+{
+    RULE_CPU_CONTEXT_SWITCHES,          //Per second
+    RULE_CPU_INTERRUPTS,
+    RULE_CPU_SOFTIRQS,
+    RULE_CPU_RUNNING,
+    RULE_CPU_BLOCKED,
+    NUM_RULE_CPU_COUNTERS
+};
+
+enum rule_mem_pct
+{
+    RULE_MEM_USED_PCT,                  //Of MemTotal, less MemAvailable
+    RULE_MEM_AVAILABLE_PCT,
+    NUM_RULE_MEM_PCTS
+};
+
+struct rule_op
+{
+    uint8_t code;
+    uint8_t field;
+    uint32_t index;
+};
+
+/*
+* An interface or disk a rule names, resolved to where its rates are the
+* first time it is seen and again only when the interfaces or disks change,
+* so a sample is evaluated without looking a name up.
+*/
+struct rule_binding
+{
+    char name[RULE_NAME_LENGTH];
+    int source;                         //RULE_SOURCE_NETWORK or RULE_SOURCE_DISK
+    int device;                         //Index of its rates, -1 while it is not there
+    int id;                             //Interface id
+    uint64_t generation;                //network_rates.generation when resolved
+    unsigned int major;                 //Disk device numbers
+    unsigned int minor;
+    uint64_t resolved_ns;               //disk_stats.sample_ns when resolved
+};
+
+/*
+* A compiled rule: its ops are a run of rule_set.ops. It fires once its
+* expression has held on every sample for for_ns, and resolves on the
+* first sample it no longer does.
+*/
+struct rule
+{
+    const char *text;                   //As given to --rule
+    uint32_t first_op;
+    uint32_t num_ops;
+    uint32_t report_op;                 //The load whose value alert lines show
+    uint64_t for_ns;
+    unsigned int sources;
+    uint64_t matching_since_ns;         //0 while the expression does not hold
+    int firing;
+    double value;
+    uint64_t fired;
+};
+
+/*
+* Every rule, with the ops, constants and bindings of all of them in one
+* array each. Each alert line is handed to alert and, with a hook, to the
+* hook's environment; the latest are kept for the screen.
+*/
+struct rule_set
+{
+    int num_rules;
+    int capacity;
+    struct rule *rules;
+    struct rule_op *ops;
+    uint32_t num_ops;
+    uint32_t ops_capacity;
+    double *constants;
+    uint32_t num_constants;
+    uint32_t constants_capacity;
+    struct rule_binding *bindings;
+    int num_bindings;
+    int bindings_capacity;
+    unsigned int sources;               //Of every rule
+
+    const char *hook;                   //--rule-hook, run with /bin/sh -c
+    void (*alert)(const char *line);
+    int num_firing;
+    uint64_t alerts;
+    uint64_t evaluations;
+    uint64_t evaluate_ns;               //The last evaluation of every rule
+    int hooks_running;
+    uint64_t hooks_skipped;             //Not run as RULE_MAX_HOOKS were
+    int num_recent;
+    char recent[RULE_RECENT_ALERTS][RULE_ALERT_LENGTH]; //Ring, the newest at (alerts - 1) % RULE_RECENT_ALERTS
+};
+
+extern struct rule_set rule_set;
+extern const char *rule_cpu_rate_names[NUM_CPU_RATES];
+extern const char *rule_cpu_counter_names[NUM_RULE_CPU_COUNTERS];
+extern const char *rule_mem_pct_names[NUM_RULE_MEM_PCTS];
+extern const char *rule_network_rate_names[NUM_NETWORK_RATES];
+
+void add_rule(const char *text);
+void open_rules(void (*alert)(const char *line));
+double evaluate_rule(struct rule *rule);
+int evaluate_rules(uint64_t sample_ns);
+void close_rules();
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * File: scan.c
+ * Description: Single pass scanner for the text of proc files. Blank runs
+ *              and digit runs are found 16 bytes at a time with SSE2 where
+ *              the cpu has it, with a scalar loop otherwise.
+ */
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "scan.h"
+
+/*
+* @brief Skips spaces and tabs.
+*
+* @returns the first character that is not a blank
+*/
+const char *skip_blanks(const char *p)
+{
+#if defined(__SSE2__)
+    //The zero padding after the data is never blank, so this stops in bounds
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    while(1)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(blank);
+        if(mask != 0xFFFF) return p + __builtin_ctz(~mask);
+        p += 16;
+    }
+#else
+    while(*p == ' ' || *p == '\t') p++;
+    return p;
+#endif
+}
+
+/*
+* @brief Counts the decimal digits at the start of p, looking at most 16 ahead.
+*/
+static inline int digit_run(const char *p)
+{
+#if defined(__SSE2__)
+    __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+    __m128i offset = _mm_sub_epi8(chunk, _mm_set1_epi8('0'));
+    __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset);
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(digit);
+    return __builtin_ctz(~mask); //Bit 16 and up of ~mask are always set
+#else
+    int run = 0;
+    while(run < 16 && (unsigned char)(p[run] - '0') < 10) run++;
+    return run;
+#endif
+}
+
+/*
+* @brief Converts exactly 8 ascii digits to their value in a few multiplies.
+*/
+static inline uint64_t eight_digits(const char *p)
+{
+    uint64_t chunk;
+    memcpy(&chunk, p, sizeof(chunk));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    chunk = ((chunk & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+    chunk = ((chunk & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+    chunk = ((chunk & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32;
+    return chunk;
+#else
+    uint64_t value = 0;
+    for(int i = 0; i < 8; i++) value = value * 10 + (uint64_t)(p[i] - '0');
+    return value;
+#endif
+}
+
+/*
+* @brief Converts the decimal number at *cursor and moves the cursor past it.
+*/
+static inline uint64_t scan_number(const char **cursor)
+{
+    const char *p = *cursor;
+    uint64_t value = 0;
+    int run;
+    do
+    {
+        run = digit_run(p);
+        int i = 0;
+        for(; i + 8 <= run; i += 8) value = value * 100000000ull + eight_digits(p + i);
+        for(; i < run; i++) value = value * 10 + (uint64_t)(p[i] - '0');
+        p += run;
+    } while(run == 16);
+
+    *cursor = p;
+    return value;
+}
+
+/*
+* @brief Converts up to max_fields blank separated numbers from *cursor into
+*        fields. Stops at the end of the line or at anything that is not a
+*        number, leaving the cursor there.
+*
+* @returns the number of fields converted
+*/
+int scan_fields(const char **cursor, uint64_t *fields, int max_fields)
+{
+    const char *p = *cursor;
+    int num_fields = 0;
+    while(num_fields < max_fields)
+    {
+        p = skip_blanks(p);
+        if((unsigned char)(*p - '0') >= 10) break;
+        fields[num_fields++] = scan_number(&p);
+    }
+    *cursor = p;
+    return num_fields;
+}
+
+/*
+* @brief Converts up to max_fields numbers printed as " %10u", as the per
+*        cpu columns of /proc/interrupts are, from *cursor into fields. Each
+*        is converted in one go without looking for where its digits
+*        start. From the first field laid out otherwise on, scan_fields
+*        takes over, so any text converts correctly, only slower.
+*
+* @returns the number of fields converted
+*/
+int scan_aligned_fields(const char **cursor, uint64_t *fields, int max_fields)
+{
+    int num_fields = 0;
+#if defined(__SSE2__)
+    const char *p = *cursor;
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i space = _mm_set1_epi8(' ');
+    while(num_fields < max_fields && *p == ' ')
+    {
+        //p[1] to p[10] are the padded number, p[11] must not be a digit.
+        //The padding after the data keeps the load in bounds.
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(p + 1));
+        __m128i offset = _mm_sub_epi8(chunk, zero);
+        unsigned int digits = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset));
+        unsigned int blanks = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, space)) & 0x3FF;
+        if(((digits | blanks) & 0x7FF) != 0x3FF || (blanks & (blanks + 1)) != 0 || !(digits & 0x200)) break;
+
+        //A blank with bit 4 set is '0', so the padding reads as leading zeros
+        char text[16];
+        _mm_storeu_si128((__m128i*)text, _mm_or_si128(chunk, _mm_set1_epi8(0x10)));
+        fields[num_fields++] = (uint64_t)((text[0] - '0') * 10 + (text[1] - '0')) * 100000000ull + eight_digits(text + 2);
+        p += 11;
+    }
+    *cursor = p;
+#endif
+    return num_fields + scan_fields(cursor, fields + num_fields, max_fields - num_fields);
+}
+
+/*
+* @brief Finds the next blank separated token on the line at *cursor.
+*
+* @returns the length of the token, 0 at the end of the line
+*/
+size_t scan_token(const char **cursor, const char **token)
+{
+    const char *p = skip_blanks(*cursor);
+    const char *start = p;
+    while(*p != ' ' && *p != '\t' && *p != '\n' && *p != '\0') p++;
+
+    *token = start;
+    *cursor = p;
+    return (size_t)(p - start);
+}
+
+/*
+* @brief Moves past the rest of the line at p.
+*
+* @returns the start of the next line, or the terminating nul
+*/
+const char *skip_line(const char *p)
+{
+    const char *newline = strchr(p, '\n');
+    return newline != NULL ? newline + 1 : p + strlen(p);
+}
+
+/*
+* @brief Compares a token that is not nul terminated with a string.
+*/
+int token_is(const char *token, size_t length, const char *word)
+{
+    return strlen(word) == length && memcmp(token, word, length) == 0;
+}
@@ -0,0 +1,20 @@
+/*
+ * File: scan.h
+ * Description: Single pass scanner for the text of proc files. Buffers
+ *              handed to it must be nul terminated and followed by
+ *              SCAN_PADDING zero bytes.
+ */
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+const char *skip_blanks(const char *p);
+int scan_fields(const char **cursor, uint64_t *fields, int max_fields);
+int scan_aligned_fields(const char **cursor, uint64_t *fields, int max_fields);
+size_t scan_token(const char **cursor, const char **token);
+const char *skip_line(const char *p);
+int token_is(const char *token, size_t length, const char *word);
+
+#endif
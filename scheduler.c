@@ -0,0 +1,219 @@
+/*
+ * File: scheduler.c
+ * Description: Runs the collectors of the loop modes, each at its own
+ *              interval, on absolute wall clock deadlines.
+ *
+ * Notes:
+ *      Every job has a timerfd armed with TFD_TIMER_ABSTIME on its first
+ *      aligned deadline and a period of its interval, so the kernel keeps
+ *      the schedule and the time a tick takes never shifts the next one.
+ *      All the timerfds sit in one epoll set. If the wall clock is set the
+ *      timers are cancelled and rearmed on the new clock. Watched
+ *      descriptors share the set, after the jobs. A threaded job's timer
+ *      is waited on by its own thread instead, see pipeline.c.
+ */
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+
+#include "sys_mon.h"
+#include "scheduler.h"
+
+struct scheduled_job scheduled_jobs[MAX_SCHEDULED_JOBS];
+int num_scheduled_jobs = 0;
+uint64_t scheduler_tick_ns = 0;          //Deadline of the tick being run
+volatile sig_atomic_t stop_requested = 0;
+struct watched_descriptor watched_descriptors[MAX_WATCHED_DESCRIPTORS];
+int num_watched_descriptors = 0;
+
+/*
+* @brief Adds a job for run_scheduler to run every interval_ns.
+*/
+struct scheduled_job *schedule_job(const char *name, uint64_t interval_ns, void (*tick)())
+{
+    if(num_scheduled_jobs == MAX_SCHEDULED_JOBS) fatal_error("too many loop modes, could not add ", name);
+    struct scheduled_job *job = &scheduled_jobs[num_scheduled_jobs++];
+    memset(job, 0, sizeof(*job));
+    job->name = name;
+    job->tick = tick;
+    job->interval_ns = interval_ns;
+    job->fd = -1;
+    return job;
+}
+
+/*
+* @brief Adds a descriptor for run_scheduler to wait on alongside the timers,
+*        for events.
+*/
+void watch_descriptor(int fd, uint32_t events, int (*ready)(int fd))
+{
+    if(num_watched_descriptors == MAX_WATCHED_DESCRIPTORS) fatal_error("too many descriptors to watch, could not add ", "another");
+    watched_descriptors[num_watched_descriptors].fd = fd;
+    watched_descriptors[num_watched_descriptors].events = events;
+    watched_descriptors[num_watched_descriptors].ready = ready;
+    num_watched_descriptors++;
+}
+
+/*
+* @brief First multiple of interval_ns since the epoch after now_ns.
+*/
+uint64_t aligned_deadline(uint64_t now_ns, uint64_t interval_ns)
+{
+    return (now_ns / interval_ns + 1) * interval_ns;
+}
+
+/*
+* @brief Arms a job's timer on its next aligned deadline.
+*/
+void arm_job(struct scheduled_job *job)
+{
+    job->deadline_ns = aligned_deadline(realtime_ns(), job->interval_ns);
+
+    struct itimerspec timer;
+    timer.it_value.tv_sec = (time_t)(job->deadline_ns / 1000000000ull);
+    timer.it_value.tv_nsec = (long)(job->deadline_ns % 1000000000ull);
+    timer.it_interval.tv_sec = (time_t)(job->interval_ns / 1000000000ull);
+    timer.it_interval.tv_nsec = (long)(job->interval_ns % 1000000000ull);
+    if(timerfd_settime(job->fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &timer, NULL) != 0)
+    {
+        fatal_error("failed to arm the timer of ", job->name);
+    }
+}
+
+/*
+* @brief Creates a job's timer and arms it.
+*/
+void open_job_timer(struct scheduled_job *job)
+{
+    job->fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(job->fd < 0) fatal_error("failed to create the timer of ", job->name);
+    arm_job(job);
+}
+
+/*
+* @brief Lets the scheduler finish on SIGINT or SIGTERM.
+*/
+void request_stop(int signal_number)
+{
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+/*
+* @brief Takes the expirations of a job's timer and counts its missed
+*        deadlines and jitter. A timer that expired more than once since it
+*        was last read means deadlines were missed, and only the latest one
+*        is to be run.
+*
+* @returns the deadline to run the job for, or 0 if there is none
+*/
+uint64_t expire_job(struct scheduled_job *job)
+{
+    uint64_t expirations;
+    ssize_t length = read(job->fd, &expirations, sizeof(expirations));
+    if(length < 0 && errno == ECANCELED)
+    {
+        arm_job(job);
+        return 0;
+    }
+    if(length != sizeof(expirations) || expirations == 0) return 0;
+
+    uint64_t deadline = job->deadline_ns + (expirations - 1) * job->interval_ns;
+    job->deadline_ns = deadline + job->interval_ns;
+
+    //Stored atomically, as the screen reads them while a threaded job runs
+    uint64_t now = realtime_ns();
+    uint64_t jitter = now > deadline ? now - deadline : 0;
+    __atomic_store_n(&job->missed, job->missed + expirations - 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&job->jitter_sum_ns, job->jitter_sum_ns + jitter, __ATOMIC_RELAXED);
+    if(jitter > job->jitter_max_ns) __atomic_store_n(&job->jitter_max_ns, jitter, __ATOMIC_RELAXED);
+    __atomic_store_n(&job->ticks, job->ticks + 1, __ATOMIC_RELAXED);
+    return deadline;
+}
+
+/*
+* @brief Runs a job whose timer expired, for the latest deadline.
+*
+* @returns 1 if a tick ran that should redraw the screen
+*/
+int run_job(struct scheduled_job *job)
+{
+    uint64_t deadline = expire_job(job);
+    if(deadline == 0) return 0;
+    scheduler_tick_ns = deadline;
+    job->tick();
+    return !job->quiet;
+}
+
+/*
+* @brief Runs the scheduled jobs until SIGINT or SIGTERM, calling render
+*        once after each batch of jobs that were due together, unless they
+*        were all quiet.
+*/
+void run_scheduler(void (*render)())
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    //The default 50 us of timer slack would show up as jitter
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd < 0) fatal_error("failed to create ", "the scheduler's epoll set");
+    for(int i = 0; i < num_scheduled_jobs; i++)
+    {
+        struct scheduled_job *job = &scheduled_jobs[i];
+        if(job->threaded) continue;
+        open_job_timer(job);
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u32 = (uint32_t)i;
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, job->fd, &event) != 0) fatal_error("failed to watch the timer of ", job->name);
+    }
+    for(int i = 0; i < num_watched_descriptors; i++)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = watched_descriptors[i].events;
+        event.data.u32 = (uint32_t)(MAX_SCHEDULED_JOBS + i);
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, watched_descriptors[i].fd, &event) != 0) fatal_error("failed to watch ", "a descriptor");
+    }
+
+    struct epoll_event events[MAX_SCHEDULED_JOBS + MAX_WATCHED_DESCRIPTORS];
+    while(!stop_requested)
+    {
+        int ready = epoll_wait(epoll_fd, events, MAX_SCHEDULED_JOBS + MAX_WATCHED_DESCRIPTORS, -1);
+        if(ready < 0)
+        {
+            if(errno == EINTR) continue;
+            fatal_error("failed to wait for ", "the scheduler's timers");
+        }
+        int redraw = 0;
+        for(int i = 0; i < ready; i++)
+        {
+            uint32_t index = events[i].data.u32;
+            if(index >= MAX_SCHEDULED_JOBS)
+            {
+                const struct watched_descriptor *watched = &watched_descriptors[index - MAX_SCHEDULED_JOBS];
+                redraw |= watched->ready(watched->fd);
+            }
+            else redraw |= run_job(&scheduled_jobs[index]);
+        }
+        if(redraw) render();
+    }
+
+    for(int i = 0; i < num_scheduled_jobs; i++)
+    {
+        if(scheduled_jobs[i].threaded) continue;
+        close(scheduled_jobs[i].fd);
+        scheduled_jobs[i].fd = -1;
+    }
+    close(epoll_fd);
+}
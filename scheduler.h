@@ -0,0 +1,65 @@
+/*
+ * File: scheduler.h
+ * Description: Runs the collectors of the loop modes, each at its own
+ *              interval, on absolute wall clock deadlines.
+ */
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define MAX_SCHEDULED_JOBS          16
+#define MAX_WATCHED_DESCRIPTORS     16
+#define DEFAULT_INTERVAL_NS         1000000000ull
+
+/*
+* A collector the scheduler runs every interval_ns. Its deadlines are the
+* multiples of interval_ns since the epoch, so every host running with the
+* same interval samples at the same wall clock instants.
+*/
+struct scheduled_job
+{
+    const char *name;
+    void (*tick)();
+    uint64_t interval_ns;
+    int fd;                             //timerfd on CLOCK_REALTIME
+    uint64_t deadline_ns;               //Next deadline
+    int quiet;                          //Its ticks do not redraw the screen
+    int threaded;                       //Its timer is run by a pipeline thread, not run_scheduler
+
+    uint64_t ticks;
+    uint64_t missed;                    //Deadlines that passed while a tick was running
+    uint64_t jitter_sum_ns;             //Time from each deadline until its tick started
+    uint64_t jitter_max_ns;
+};
+
+/*
+* A descriptor the scheduler waits on next to the timers, for a mode that
+* answers requests or events between its ticks. ready is called with it
+* whenever one of events is signalled, EPOLLIN or EPOLLPRI, and redraws
+* the screen when it returns 1.
+*/
+struct watched_descriptor
+{
+    int fd;
+    uint32_t events;
+    int (*ready)(int fd);
+};
+
+extern struct scheduled_job scheduled_jobs[MAX_SCHEDULED_JOBS];
+extern int num_scheduled_jobs;
+extern struct watched_descriptor watched_descriptors[MAX_WATCHED_DESCRIPTORS];
+extern int num_watched_descriptors;
+extern uint64_t scheduler_tick_ns;
+extern volatile sig_atomic_t stop_requested;
+
+struct scheduled_job *schedule_job(const char *name, uint64_t interval_ns, void (*tick)());
+void watch_descriptor(int fd, uint32_t events, int (*ready)(int fd));
+uint64_t aligned_deadline(uint64_t now_ns, uint64_t interval_ns);
+void open_job_timer(struct scheduled_job *job);
+uint64_t expire_job(struct scheduled_job *job);
+void run_scheduler(void (*render)());
+
+#endif
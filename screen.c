@@ -0,0 +1,220 @@
+/*
+ * File: screen.c
+ * Description: Draws the frames of the loop modes on the terminal, writing
+ *              only the cells that changed since the previous frame.
+ *
+ * Notes:
+ *      Text wider than the terminal is cut at its edge and rows below it
+ *      are dropped, so a frame never scrolls. A resize is picked up by
+ *      the next frame, which clears the terminal and sends every cell.
+ *      Outside a frame screen_printf is plain printf, so the displays work
+ *      the same in the one-shot modes.
+ */
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/ioctl.h>
+
+#include "sys_mon.h"
+#include "screen.h"
+
+struct screen screen;
+volatile sig_atomic_t screen_resized = 1;
+
+void note_resize(int signal_number)
+{
+    (void)signal_number;
+    screen_resized = 1;
+}
+
+/*
+* @brief Writes all of a buffer to stdout, however many write() calls the
+*        terminal takes.
+*/
+void write_terminal(const char *data, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t written = write(STDOUT_FILENO, data, length);
+        if(written < 0)
+        {
+            if(errno == EINTR) continue;
+            return; //The terminal went away, nothing left to draw on
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+}
+
+/*
+* @brief Sizes the grids to the terminal, or to the defaults when stdout is
+*        not one, and makes the next frame a full redraw.
+*/
+void resize_screen()
+{
+    struct winsize size;
+    int rows = SCREEN_DEFAULT_ROWS;
+    int columns = SCREEN_DEFAULT_COLUMNS;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0)
+    {
+        rows = size.ws_row;
+        columns = size.ws_col;
+    }
+    screen_resized = 0;
+    screen.full_redraw = 1;
+    if(rows == screen.rows && columns == screen.columns) return;
+
+    size_t cells = (size_t)rows * (size_t)columns;
+    screen.rows = rows;
+    screen.columns = columns;
+    screen.cells = counted_realloc(screen.cells, cells);
+    screen.previous = counted_realloc(screen.previous, cells);
+    //Worst case every other cell changes: a cursor move for each run of
+    //SCREEN_MAX_GAP + 2 cells, plus the escapes around the frame
+    screen.output_capacity = cells + (cells / (SCREEN_MAX_GAP + 2) + (size_t)rows) * 16 + 64;
+    screen.output = counted_realloc(screen.output, screen.output_capacity);
+}
+
+/*
+* @brief Takes over the terminal for the loop modes.
+*/
+void open_screen()
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = note_resize;
+    sigaction(SIGWINCH, &action, NULL);
+
+    screen_resized = 1;
+    fflush(stdout);
+    write_terminal("\033[?25l", 6); //Hide the cursor while it jumps around
+}
+
+/*
+* @brief Starts a frame. Until screen_end_frame, screen_printf draws into it.
+*/
+void screen_begin_frame()
+{
+    if(screen_resized) resize_screen();
+    memset(screen.cells, ' ', (size_t)screen.rows * (size_t)screen.columns);
+    screen.row = 0;
+    screen.column = 0;
+    screen.used_rows = 0;
+    screen.frame_bytes = 0;
+    screen.active = 1;
+}
+
+/*
+* @brief printf into the frame being drawn, or to stdout outside a frame.
+*/
+int screen_printf(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    if(!screen.active)
+    {
+        int length = vprintf(format, args);
+        va_end(args);
+        return length;
+    }
+
+    char text[SCREEN_TEXT_LENGTH];
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if(length < 0) return length;
+    size_t placed = (size_t)length < sizeof(text) ? (size_t)length : sizeof(text) - 1;
+
+    screen.frame_bytes += placed;
+    for(size_t i = 0; i < placed; i++)
+    {
+        if(text[i] == '\n')
+        {
+            screen.row++;
+            screen.column = 0;
+            continue;
+        }
+        if(screen.row < screen.rows && screen.column < screen.columns)
+        {
+            screen.cells[screen.row * screen.columns + screen.column] = text[i];
+            if(screen.row >= screen.used_rows) screen.used_rows = screen.row + 1;
+        }
+        screen.column++;
+    }
+    return length;
+}
+
+/*
+* @brief Sends the cells that differ from what the terminal shows, runs of
+*        changes less than SCREEN_MAX_GAP apart together, with one write().
+*/
+void screen_end_frame()
+{
+    char *out = screen.output;
+    size_t length = 0;
+    if(screen.full_redraw)
+    {
+        memcpy(out, "\033[2J", 4);
+        length = 4;
+        memset(screen.previous, ' ', (size_t)screen.rows * (size_t)screen.columns);
+        screen.full_redraw = 0;
+    }
+
+    for(int row = 0; row < screen.rows; row++)
+    {
+        const char *now = screen.cells + (size_t)row * (size_t)screen.columns;
+        const char *was = screen.previous + (size_t)row * (size_t)screen.columns;
+        int column = 0;
+        while(column < screen.columns)
+        {
+            if(now[column] == was[column])
+            {
+                column++;
+                continue;
+            }
+
+            int start = column;
+            int end = column + 1;
+            for(int gap = 0, next = end; next < screen.columns && gap <= SCREEN_MAX_GAP; next++)
+            {
+                if(now[next] != was[next])
+                {
+                    end = next + 1;
+                    gap = 0;
+                }
+                else gap++;
+            }
+            length += (size_t)snprintf(out + length, screen.output_capacity - length, "\033[%d;%dH", row + 1, start + 1);
+            memcpy(out + length, now + start, (size_t)(end - start));
+            length += (size_t)(end - start);
+            column = end;
+        }
+    }
+
+    fflush(stdout);
+    write_terminal(out, length);
+    char *shown = screen.previous;
+    screen.previous = screen.cells;
+    screen.cells = shown;
+
+    screen.active = 0;
+    screen.last_bytes = length;
+    screen.last_frame_bytes = screen.frame_bytes;
+    screen.frames++;
+}
+
+/*
+* @brief Leaves the cursor below the last frame and gives the terminal back.
+*/
+void close_screen()
+{
+    char text[32];
+    int length = snprintf(text, sizeof(text), "\033[%d;1H\033[?25h", screen.used_rows + 1);
+    write_terminal(text, (size_t)length);
+
+    signal(SIGWINCH, SIG_DFL);
+    free(screen.cells);
+    free(screen.previous);
+    free(screen.output);
+    memset(&screen, 0, sizeof(screen));
+}
@@ -0,0 +1,54 @@
+/*
+ * File: screen.h
+ * Description: Draws the frames of the loop modes on the terminal, writing
+ *              only the cells that changed since the previous frame.
+ */
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <signal.h>
+
+#define SCREEN_DEFAULT_COLUMNS      250 //Size used when stdout is not a terminal
+#define SCREEN_DEFAULT_ROWS         100
+#define SCREEN_MAX_GAP              8   //Unchanged cells rewritten rather than jumped with a cursor move
+#define SCREEN_TEXT_LENGTH          4096 //Longest text one screen_printf places
+
+/*
+* The terminal as a grid of rows * columns cells. A frame is drawn into
+* cells, compared with previous, which holds what the terminal shows, and
+* the changed runs are sent with one write(). The grids and the output
+* buffer are only allocated when the terminal size changes.
+*/
+struct screen
+{
+    int active;                         //Between screen_begin_frame and screen_end_frame
+    int rows;
+    int columns;
+    char *cells;
+    char *previous;
+    char *output;
+    size_t output_capacity;
+    int full_redraw;                    //The terminal was cleared, every cell is sent
+
+    int row;                            //Where the next screen_printf goes
+    int column;
+    int used_rows;                      //Rows the frame printed to
+
+    size_t frame_bytes;                 //Text printed into the frame, what a full redraw writes
+    size_t last_bytes;                  //Written to the terminal for the last frame
+    size_t last_frame_bytes;
+    uint64_t frames;
+};
+
+extern struct screen screen;
+extern volatile sig_atomic_t screen_resized; //Set by SIGWINCH, the next frame is a full redraw
+
+void open_screen();
+void screen_begin_frame();
+int screen_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void screen_end_frame();
+void close_screen();
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * File: selfstats.c
+ * Description: What sys_mon itself costs: a latency histogram per collector
+ *              and renderer, and the process' own cpu time, memory and
+ *              syscalls.
+ *
+ * Notes:
+ *      The probes are written on the sampling path and only read when the
+ *      numbers are shown or exported. The usage is read from the kernel on
+ *      demand, never on the sampling path.
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "sys_mon.h"
+#include "selfstats.h"
+
+struct probe probes[NUM_PROBES];
+const char *probe_names[NUM_PROBES] = {
+    "cpu",
+    "memory",
+    "network",
+    "disk",
+    "interrupts",
+    "pressure",
+    "high-freq cpu",
+    "high-freq network",
+    "record",
+    "proc-top",
+    "export",
+    "shm",
+    "rules",
+    "cgroup",
+    "render cpu",
+    "render memory",
+    "render network",
+    "render disk",
+    "render interrupts",
+    "render pressure",
+    "render high-freq",
+    "render proc-top",
+    "render cgroup",
+    "render frame"
+};
+
+uint64_t self_stats_start_ns = 0;
+uint64_t self_stats_start_cpu_ns = 0;
+
+uint64_t self_cpu_ns()
+{
+    struct timespec cpu;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    return (uint64_t)cpu.tv_sec * 1000000000ull + (uint64_t)cpu.tv_nsec;
+}
+
+void init_self_stats()
+{
+    memset(probes, 0, sizeof(probes));
+    self_stats_start_ns = monotonic_ns();
+    self_stats_start_cpu_ns = self_cpu_ns();
+}
+
+/*
+* @brief Finds the latency below which fraction of a probe's samples fall.
+*
+* @returns the top of the bucket the percentile is in, at most the maximum
+*          seen, or 0 if the probe has no samples
+*/
+uint64_t probe_percentile(const struct probe *probe, double fraction)
+{
+    uint64_t count = __atomic_load_n(&probe->count, __ATOMIC_RELAXED);
+    if(count == 0) return 0;
+    uint64_t rank = (uint64_t)(fraction * (double)count);
+    if(rank >= count) rank = count - 1;
+
+    uint64_t seen = 0;
+    for(int bucket = 0; bucket < NUM_PROBE_BUCKETS; bucket++)
+    {
+        seen += __atomic_load_n(&probe->buckets[bucket], __ATOMIC_RELAXED);
+        if(seen <= rank) continue;
+        if(bucket < PROBE_SUB_BUCKETS) return (uint64_t)bucket;
+
+        int exponent = bucket / PROBE_SUB_BUCKETS + PROBE_SUB_BUCKET_BITS - 1;
+        uint64_t width = 1ull << (exponent - PROBE_SUB_BUCKET_BITS);
+        uint64_t top = (uint64_t)(PROBE_SUB_BUCKETS + bucket % PROBE_SUB_BUCKETS) * width + width - 1;
+        uint64_t max = __atomic_load_n(&probe->max_ns, __ATOMIC_RELAXED);
+        return top < max ? top : max;
+    }
+    return __atomic_load_n(&probe->max_ns, __ATOMIC_RELAXED);
+}
+
+/*
+* @brief Reads a small file of /proc/self into buffer.
+*
+* @returns 0, or -1 if it could not be read
+*/
+int read_self_file(const char *path, char *buffer, size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return -1;
+    ssize_t length = read(fd, buffer, size - 1);
+    close(fd);
+    if(length <= 0) return -1;
+    buffer[length] = '\0';
+    return 0;
+}
+
+/*
+* @brief Finds "key: value" in the text of /proc/self/io.
+*/
+uint64_t self_io_value(const char *text, const char *key)
+{
+    const char *line = strstr(text, key);
+    if(line == NULL) return 0;
+    return strtoull(line + strlen(key), NULL, 10);
+}
+
+/*
+* @brief Reads the process' own cpu time, resident memory and syscall
+*        counts from the kernel. Always the real /proc, not --proc-root.
+*/
+void read_self_usage(struct self_usage *usage)
+{
+    memset(usage, 0, sizeof(*usage));
+    usage->wall_ns = monotonic_ns() - self_stats_start_ns;
+    usage->cpu_ns = self_cpu_ns() - self_stats_start_cpu_ns;
+
+    char text[512];
+    if(read_self_file("/proc/self/statm", text, sizeof(text)) == 0)
+    {
+        char *end;
+        strtoull(text, &end, 10); //Total program size, then the resident pages
+        usage->rss_bytes = strtoull(end, NULL, 10) * (uint64_t)sysconf(_SC_PAGESIZE);
+    }
+    //The kernel updates the high water mark lazily, so it can trail statm
+    struct rusage rusage;
+    if(getrusage(RUSAGE_SELF, &rusage) == 0) usage->max_rss_bytes = (uint64_t)rusage.ru_maxrss * 1024;
+    if(usage->max_rss_bytes < usage->rss_bytes) usage->max_rss_bytes = usage->rss_bytes;
+    if(read_self_file("/proc/self/io", text, sizeof(text)) == 0)
+    {
+        usage->read_syscalls = self_io_value(text, "syscr:");
+        usage->write_syscalls = self_io_value(text, "syscw:");
+        usage->bytes_read = self_io_value(text, "rchar:");
+    }
+}
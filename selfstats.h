@@ -0,0 +1,112 @@
+/*
+ * File: selfstats.h
+ * Description: What sys_mon itself costs: a latency histogram per collector
+ *              and renderer, and the process' own cpu time, memory and
+ *              syscalls.
+ */
+#ifndef SELFSTATS_H
+#define SELFSTATS_H
+
+#include <stdint.h>
+
+#include "sys_mon.h"
+
+#define PROBE_SUB_BUCKET_BITS       3
+#define PROBE_SUB_BUCKETS           (1 << PROBE_SUB_BUCKET_BITS)
+#define PROBE_MAX_EXPONENT          39 //Latencies of 2^40 ns (18 minutes) and more share the last bucket
+#define NUM_PROBE_BUCKETS           ((PROBE_MAX_EXPONENT - PROBE_SUB_BUCKET_BITS + 2) * PROBE_SUB_BUCKETS)
+
+enum probe_id
+{
+    PROBE_CPU,
+    PROBE_MEM,
+    PROBE_NETWORK,
+    PROBE_DISK,
+    PROBE_INTERRUPTS,
+    PROBE_PRESSURE,
+    PROBE_HIGH_FREQ_CPU,
+    PROBE_HIGH_FREQ_NETWORK,
+    PROBE_RECORD,
+    PROBE_PROC_TOP,
+    PROBE_EXPORT,                       //Writing a snapshot in every export format
+    PROBE_SHM,                          //Publishing a snapshot to shared memory
+    PROBE_RULES,                        //Evaluating every --rule
+    PROBE_CGROUP,
+    PROBE_RENDER_CPU,
+    PROBE_RENDER_MEM,
+    PROBE_RENDER_NETWORK,
+    PROBE_RENDER_DISK,
+    PROBE_RENDER_INTERRUPTS,
+    PROBE_RENDER_PRESSURE,
+    PROBE_RENDER_HIGH_FREQ,
+    PROBE_RENDER_PROC_TOP,
+    PROBE_RENDER_CGROUP,
+    PROBE_RENDER_FRAME,                 //A whole loop mode frame, written out
+    NUM_PROBES
+};
+
+/*
+* Latencies of one collector or renderer in a log-linear histogram: each
+* power of two is split into PROBE_SUB_BUCKETS buckets, so a percentile is
+* within 12.5% of the true value. Each probe has one writer, which updates
+* the counters with relaxed atomic stores so a reader on another thread
+* never sees a torn value. Nothing is locked or allocated.
+*/
+struct probe
+{
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t buckets[NUM_PROBE_BUCKETS];
+};
+
+/*
+* The process' own resource usage, read from the kernel when asked for.
+*/
+struct self_usage
+{
+    uint64_t wall_ns;                   //Since init_self_stats
+    uint64_t cpu_ns;                    //User and system time since init_self_stats
+    uint64_t rss_bytes;
+    uint64_t max_rss_bytes;
+    uint64_t read_syscalls;             //As the kernel counts them, 0 if /proc/self/io is unreadable
+    uint64_t write_syscalls;
+    uint64_t bytes_read;
+};
+
+extern struct probe probes[NUM_PROBES];
+extern const char *probe_names[NUM_PROBES];
+
+static inline int probe_bucket(uint64_t ns)
+{
+    if(ns < PROBE_SUB_BUCKETS) return (int)ns;
+    int exponent = 63 - __builtin_clzll(ns);
+    if(exponent > PROBE_MAX_EXPONENT) return NUM_PROBE_BUCKETS - 1;
+    int sub = (int)(ns >> (exponent - PROBE_SUB_BUCKET_BITS)) & (PROBE_SUB_BUCKETS - 1);
+    return (exponent - PROBE_SUB_BUCKET_BITS + 1) * PROBE_SUB_BUCKETS + sub;
+}
+
+static inline void probe_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+/*
+* @brief Records one latency of a probe, measured from start_ns, a
+*        monotonic_ns() taken before the work.
+*/
+static inline void probe_end(int id, uint64_t start_ns)
+{
+    uint64_t ns = monotonic_ns() - start_ns;
+    struct probe *probe = &probes[id];
+    probe_add(&probe->buckets[probe_bucket(ns)], 1);
+    probe_add(&probe->sum_ns, ns);
+    if(ns > probe->max_ns) __atomic_store_n(&probe->max_ns, ns, __ATOMIC_RELAXED);
+    probe_add(&probe->count, 1);
+}
+
+void init_self_stats();
+uint64_t probe_percentile(const struct probe *probe, double fraction);
+void read_self_usage(struct self_usage *usage);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * File: shm.c
+ * Description: Publishes the latest cpu, memory and network sample into a
+ *              POSIX shared memory segment for shmreader.h readers.
+ *
+ * Notes:
+ *      The layout is described in shmreader.h. Each publication makes the
+ *      sequence odd, copies the snapshot in and makes it even again, so
+ *      the readers copy around the writer and it never waits for them.
+ *      The segment is sized for the cpus and interfaces there are when it
+ *      is made; one that outgrows it is replaced by a bigger segment under
+ *      the same name, and the old one is marked stale once the new one
+ *      holds a sample.
+ */
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "sys_mon.h"
+#include "selfstats.h"
+#include "shm.h"
+#include "meminfo.h"
+
+struct shm_publisher shm_publisher;
+
+static inline size_t shm_align(size_t offset)
+{
+    return (offset + 63) & ~(size_t)63;
+}
+
+/*
+* @brief Creates a segment under the publisher's name for the cpus there
+*        are and interface_capacity interfaces, replacing any segment of
+*        that name, and writes its layout. magic is left unset until the
+*        first publication.
+*/
+void create_shm_segment(uint32_t interface_capacity)
+{
+    uint32_t cpu_capacity = (uint32_t)cpu_stats.num_cpus;
+    size_t names_offset = shm_align(sizeof(struct shm_header));
+    size_t mem_offset = shm_align(names_offset + (size_t)NUM_MEMINFO_KEYS * SHM_NAME_LENGTH);
+    size_t cpu_offset = shm_align(mem_offset + (size_t)NUM_MEMINFO_KEYS * sizeof(uint64_t));
+    size_t interface_offset = shm_align(cpu_offset + (size_t)cpu_capacity * sizeof(struct shm_cpu));
+    size_t size = interface_offset + (size_t)interface_capacity * sizeof(struct shm_interface);
+
+    //Readers of a segment already under the name keep their mapping until they see it stale
+    shm_unlink(shm_publisher.name);
+    int fd = shm_open(shm_publisher.name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if(fd < 0) fatal_error("failed to create the shared memory segment ", shm_publisher.name);
+    if(ftruncate(fd, (off_t)size) != 0) fatal_error("failed to size the shared memory segment ", shm_publisher.name);
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) fatal_error("failed to map the shared memory segment ", shm_publisher.name);
+
+    struct shm_header *header = map;
+    header->version = SHM_VERSION;
+    header->size = size;
+    header->writer_pid = (uint64_t)getpid();
+    header->mem_capacity = NUM_MEMINFO_KEYS;
+    header->cpu_capacity = cpu_capacity;
+    header->interface_capacity = interface_capacity;
+    header->names_offset = (uint32_t)names_offset;
+    header->mem_offset = (uint32_t)mem_offset;
+    header->cpu_offset = (uint32_t)cpu_offset;
+    header->interface_offset = (uint32_t)interface_offset;
+    char (*names)[SHM_NAME_LENGTH] = (char (*)[SHM_NAME_LENGTH])((char*)map + names_offset);
+    for(int i = 0; i < NUM_MEMINFO_KEYS; i++) snprintf(names[i], SHM_NAME_LENGTH, "%s", meminfo_key_names[i]);
+
+    shm_publisher.header = header;
+    shm_publisher.size = size;
+    shm_publisher.segments++;
+}
+
+/*
+* @brief Copies the snapshot the collectors hold into the segment, between
+*        the two updates of the sequence.
+*/
+void write_shm_snapshot(struct shm_header *header, uint64_t sample_ns)
+{
+    struct shm_summary *summary = &header->summary;
+    summary->sample_ns = sample_ns;
+    summary->publications = shm_publisher.publications + 1;
+    summary->num_cpus = (uint32_t)cpu_stats.num_cpus;
+    summary->num_online = (uint32_t)cpu_stats.num_online;
+    summary->num_interfaces = (uint32_t)network_info.num_devices;
+    summary->num_mem = NUM_MEMINFO_KEYS;
+    memcpy(summary->cpu_total, cpu_stats.total.time, sizeof(summary->cpu_total));
+    summary->context_switches = cpu_stats.num_context_switches;
+    summary->interrupts = cpu_stats.num_interrupts;
+    summary->softirqs = cpu_stats.num_softirqs;
+    summary->boot_time = cpu_stats.boot_time;
+    summary->processes_created = cpu_stats.num_proccesses_created;
+    summary->processes_running = cpu_stats.proccesses_running;
+    summary->processes_blocked = cpu_stats.proccesses_blocked;
+
+    uint64_t *mem = (uint64_t*)((char*)header + header->mem_offset);
+    for(int i = 0; i < NUM_MEMINFO_KEYS; i++)
+    {
+        mem[i] = meminfo_has(&meminfo_snapshot, i) ? meminfo_snapshot.value[i] : SHM_ABSENT;
+    }
+
+    struct shm_cpu *cpus = (struct shm_cpu*)((char*)header + header->cpu_offset);
+    for(int cpu = 0; cpu < cpu_stats.num_cpus; cpu++)
+    {
+        for(int field = 0; field < NUM_CPU_FIELDS; field++) cpus[cpu].time[field] = cpu_stats.time[field][cpu];
+        cpus[cpu].online = cpu_stats.online[cpu];
+    }
+
+    struct shm_interface *interfaces = (struct shm_interface*)((char*)header + header->interface_offset);
+    for(int i = 0; i < network_info.num_devices; i++)
+    {
+        memcpy(interfaces[i].face, network_info.devices[i].face, SHM_FACE_LENGTH);
+        memcpy(interfaces[i].counter, network_info.devices[i].counter, sizeof(interfaces[i].counter));
+    }
+}
+
+/*
+* @brief Publishes the snapshot the collectors hold, moving to a bigger
+*        segment first if it no longer fits.
+*/
+void publish_shm_snapshot(uint64_t sample_ns)
+{
+    uint64_t start = monotonic_ns();
+    struct shm_header *outgrown = NULL;
+    size_t outgrown_size = 0;
+    if((uint32_t)cpu_stats.num_cpus > shm_publisher.header->cpu_capacity ||
+       (uint32_t)network_info.num_devices > shm_publisher.header->interface_capacity)
+    {
+        outgrown = shm_publisher.header;
+        outgrown_size = shm_publisher.size;
+        uint32_t capacity = outgrown->interface_capacity;
+        while(capacity < (uint32_t)network_info.num_devices) capacity *= 2;
+        create_shm_segment(capacity);
+    }
+
+    struct shm_header *header = shm_publisher.header;
+    uint64_t sequence = header->sequence;
+    __atomic_store_n(&header->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    write_shm_snapshot(header, sample_ns);
+    __atomic_store_n(&header->sequence, sequence + 2, __ATOMIC_RELEASE);
+    if(header->magic != SHM_MAGIC) __atomic_store_n(&header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+    if(outgrown != NULL)
+    {
+        __atomic_store_n(&outgrown->stale, 1, __ATOMIC_RELEASE);
+        munmap(outgrown, outgrown_size);
+    }
+    shm_publisher.publications++;
+    shm_publisher.publish_ns = monotonic_ns() - start;
+    probe_end(PROBE_SHM, start);
+}
+
+/*
+* @brief Creates the segment called name, /sys_mon for SHM_DEFAULT_NAME,
+*        sized for the interfaces there are now.
+*/
+void open_shm_publisher(const char *name)
+{
+    if(name[0] != '/' || strchr(name + 1, '/') != NULL || strlen(name) >= sizeof(shm_publisher.name))
+    {
+        fatal_error("a shared memory name is a / and up to 30 other characters, not ", name);
+    }
+    snprintf(shm_publisher.name, sizeof(shm_publisher.name), "%s", name);
+    uint32_t capacity = SHM_MIN_INTERFACES;
+    while(capacity < (uint32_t)network_info.num_devices * 2) capacity *= 2;
+    create_shm_segment(capacity);
+    shm_publisher.active = 1;
+}
+
+/*
+* @brief Marks the segment stale, so readers stop waiting on it, and
+*        removes it.
+*/
+void close_shm_publisher()
+{
+    if(!shm_publisher.active) return;
+    __atomic_store_n(&shm_publisher.header->stale, 1, __ATOMIC_RELEASE);
+    munmap(shm_publisher.header, shm_publisher.size);
+    shm_unlink(shm_publisher.name);
+    memset(&shm_publisher, 0, sizeof(shm_publisher));
+}
@@ -0,0 +1,40 @@
+/*
+ * File: shm.h
+ * Description: Publishes the latest cpu, memory and network sample into a
+ *              POSIX shared memory segment for shmreader.h readers.
+ */
+#ifndef SHM_H
+#define SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sys_mon.h"
+#include "shmreader.h"
+
+#define SHM_MIN_INTERFACES          64 //Interfaces a new segment holds at least, it doubles past them
+#define SHM_READ_BACKOFFS           100 //Times read-shm waits out a busy writer before giving up
+#define SHM_READ_BACKOFF_US         10000
+
+/*
+* The segment the writer has mapped, with the capacities its layout was
+* made for.
+*/
+struct shm_publisher
+{
+    int active;
+    char name[SHM_NAME_LENGTH];
+    struct shm_header *header;
+    size_t size;
+    uint64_t publications;
+    uint64_t segments;                  //Created, the first one included
+    uint64_t publish_ns;                //What the last publication took
+};
+
+extern struct shm_publisher shm_publisher;
+
+void open_shm_publisher(const char *name);
+void publish_shm_snapshot(uint64_t sample_ns);
+void close_shm_publisher();
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * File: shmreader.c
+ * Description: Reads the shared memory segment sys_mon publishes its
+ *              latest cpu, memory and network sample into.
+ *
+ * Notes:
+ *      Opening maps the segment and allocates a snapshot sized to it. A
+ *      read after that is a copy of the summary, and of the cpus and
+ *      interfaces when asked for, between two loads of the sequence: no
+ *      syscall, no lock and no allocation, and the writer never waits.
+ *      The copy races with the writer by design; a torn one is detected by
+ *      the sequence and taken again, up to SHM_SPIN_LIMIT times. Only then
+ *      is there a syscall, kill with signal 0, to tell a busy writer from
+ *      one that died mid-update.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmreader.h"
+
+/*
+* @brief Maps the segment called name and sizes snapshot to it.
+*
+* @returns SHM_OK, or SHM_NOT_READY if there is no segment yet or it is not
+*          written yet, in which case nothing is left open
+*/
+int shm_open_reader(struct shm_reader *reader, struct shm_snapshot *snapshot, const char *name)
+{
+    memset(reader, 0, sizeof(*reader));
+    memset(snapshot, 0, sizeof(*snapshot));
+    if(strlen(name) >= sizeof(reader->name)) return SHM_NOT_READY;
+    memcpy(reader->name, name, strlen(name) + 1);
+
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if(fd < 0) return SHM_NOT_READY;
+    struct stat status;
+    if(fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(struct shm_header))
+    {
+        close(fd);
+        return SHM_NOT_READY;
+    }
+    void *map = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return SHM_NOT_READY;
+
+    const struct shm_header *header = map;
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC || header->version != SHM_VERSION ||
+       header->size > (uint64_t)status.st_size)
+    {
+        munmap(map, (size_t)status.st_size);
+        return SHM_NOT_READY;
+    }
+
+    reader->header = header;
+    reader->size = (size_t)status.st_size;
+    reader->names = (const char (*)[SHM_NAME_LENGTH])((const char*)map + header->names_offset);
+    reader->mem_capacity = header->mem_capacity;
+    reader->cpu_capacity = header->cpu_capacity;
+    reader->interface_capacity = header->interface_capacity;
+    snapshot->mem = calloc(reader->mem_capacity + 1, sizeof(uint64_t));
+    snapshot->cpus = calloc(reader->cpu_capacity + 1, sizeof(struct shm_cpu));
+    snapshot->interfaces = calloc(reader->interface_capacity + 1, sizeof(struct shm_interface));
+    if(snapshot->mem == NULL || snapshot->cpus == NULL || snapshot->interfaces == NULL)
+    {
+        shm_close_reader(reader, snapshot);
+        return SHM_NOT_READY;
+    }
+    return SHM_OK;
+}
+
+/*
+* @brief Tells whether the process that wrote the segment still exists. One
+*        that is there but not ours to signal is alive too.
+*/
+static int shm_writer_alive(const struct shm_header *header)
+{
+    pid_t pid = (pid_t)header->writer_pid;
+    return pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+/*
+* @brief Copies the latest sample into snapshot: the summary and memory,
+*        and the parts asked for, SHM_READ_CPUS and SHM_READ_INTERFACES.
+*        Gives up after SHM_SPIN_LIMIT tries, leaving snapshot torn.
+*
+* @returns SHM_OK, SHM_STALE if the writer has moved to a new segment,
+*          SHM_BUSY if it was updating the whole time or SHM_DEAD if it
+*          died while updating
+*/
+int shm_read(struct shm_reader *reader, struct shm_snapshot *snapshot, int parts)
+{
+    const struct shm_header *header = reader->header;
+    const char *base = (const char*)header;
+    for(uint32_t tries = 0;; tries++)
+    {
+        if(__atomic_load_n(&header->stale, __ATOMIC_ACQUIRE)) return SHM_STALE;
+        if(tries == SHM_SPIN_LIMIT) return shm_writer_alive(header) ? SHM_BUSY : SHM_DEAD;
+        uint64_t begin = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+        if(begin & 1)
+        {
+            snapshot->retries++;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+            continue;
+        }
+
+        snapshot->summary = header->summary;
+        //The counts may be torn, they are only trusted once the sequence says so
+        uint32_t num_mem = snapshot->summary.num_mem < reader->mem_capacity ? snapshot->summary.num_mem : reader->mem_capacity;
+        memcpy(snapshot->mem, base + header->mem_offset, num_mem * sizeof(uint64_t));
+        if(parts & SHM_READ_CPUS)
+        {
+            uint32_t num_cpus = snapshot->summary.num_cpus < reader->cpu_capacity ? snapshot->summary.num_cpus : reader->cpu_capacity;
+            memcpy(snapshot->cpus, base + header->cpu_offset, num_cpus * sizeof(struct shm_cpu));
+        }
+        if(parts & SHM_READ_INTERFACES)
+        {
+            uint32_t num_interfaces = snapshot->summary.num_interfaces < reader->interface_capacity ?
+                                      snapshot->summary.num_interfaces : reader->interface_capacity;
+            memcpy(snapshot->interfaces, base + header->interface_offset, num_interfaces * sizeof(struct shm_interface));
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&header->sequence, __ATOMIC_RELAXED) == begin) return SHM_OK;
+        snapshot->retries++;
+    }
+}
+
+/*
+* @brief Opens the reader's segment again, after shm_read found it stale.
+*
+* @returns what shm_open_reader returns
+*/
+int shm_reopen(struct shm_reader *reader, struct shm_snapshot *snapshot)
+{
+    char name[SHM_NAME_LENGTH];
+    memcpy(name, reader->name, sizeof(name));
+    uint64_t retries = snapshot->retries;
+    shm_close_reader(reader, snapshot);
+    int result = shm_open_reader(reader, snapshot, name);
+    snapshot->retries = retries;
+    return result;
+}
+
+void shm_close_reader(struct shm_reader *reader, struct shm_snapshot *snapshot)
+{
+    if(reader->header != NULL) munmap((void*)reader->header, reader->size);
+    free(snapshot->mem);
+    free(snapshot->cpus);
+    free(snapshot->interfaces);
+    memset(reader, 0, sizeof(*reader));
+    memset(snapshot, 0, sizeof(*snapshot));
+}
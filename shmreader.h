@@ -0,0 +1,144 @@
+/*
+ * File: shmreader.h
+ * Description: Layout of the shared memory segment sys_mon publishes its
+ *              latest cpu, memory and network sample into, and a reader
+ *              that takes a consistent copy of it without locks or
+ *              syscalls. Needs nothing else from sys_mon.
+ *
+ * Layout:
+ *      The segment is a POSIX shared memory object, /sys_mon by default.
+ *      Every field is in the byte order of the host and every offset is
+ *      from the start of the segment.
+ *
+ *      0                   struct shm_header
+ *      names_offset        mem_capacity names of SHM_NAME_LENGTH bytes, the
+ *                          /proc/meminfo key of each mem value, written
+ *                          before magic and never changed
+ *      mem_offset          mem_capacity uint64_t, kB but for the count of
+ *                          the HugePages_ keys, SHM_ABSENT when the
+ *                          kernel has no such line
+ *      cpu_offset          cpu_capacity struct shm_cpu, by cpu number
+ *      interface_offset    interface_capacity struct shm_interface, in the
+ *                          order of /proc/net/dev
+ *
+ *      header.summary and everything from mem_offset on are guarded by
+ *      header.sequence, a seqlock: the writer makes it odd, updates them
+ *      and makes it even again. A copy is consistent when sequence was the
+ *      same even number before and after it. The writer never waits for
+ *      the readers. A reader gives up after SHM_SPIN_LIMIT tries and looks
+ *      at whether writer_pid is alive, so a writer killed between its two
+ *      stores does not leave the readers spinning.
+ *
+ *      When more interfaces appear than the segment holds, the writer
+ *      unlinks it, creates a bigger one under the same name and then sets
+ *      stale in the old one. A reader seeing stale opens the name again.
+ */
+#ifndef SHMREADER_H
+#define SHMREADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHM_MAGIC                   0x314d48534e4f4d53ull //"SMONSHM1" in memory, set once the segment is ready
+#define SHM_VERSION                 1
+#define SHM_DEFAULT_NAME            "/sys_mon"
+#define SHM_NAME_LENGTH             32
+#define SHM_FACE_LENGTH             16
+#define SHM_CPU_FIELDS              10 //user nice system idle iowait irq softirq steal guest guest_nice, jiffies
+#define SHM_NETWORK_FIELDS          16 //The columns of /proc/net/dev, receive then transmit
+#define SHM_ABSENT                  UINT64_MAX
+
+#define SHM_READ_CPUS               1 //Parts shm_read copies besides the summary
+#define SHM_READ_INTERFACES         2
+#define SHM_READ_ALL                (SHM_READ_CPUS | SHM_READ_INTERFACES)
+
+#define SHM_OK                      0
+#define SHM_NOT_READY               -1 //No segment, or not written yet
+#define SHM_STALE                   -2 //The writer moved to a new segment, shm_reopen
+#define SHM_BUSY                    -3 //The writer held the sequence odd for SHM_SPIN_LIMIT tries, back off and read again
+#define SHM_DEAD                    -4 //The writer died holding the sequence odd, the segment will not change again
+
+#define SHM_SPIN_LIMIT              (1u << 20) //Tries of one shm_read, about 30 ms of pauses on a recent x86
+
+/*
+* The totals of a sample. The counts say how much of each array is in use.
+*/
+struct shm_summary
+{
+    uint64_t sample_ns;                 //CLOCK_REALTIME of the sample
+    uint64_t publications;
+    uint32_t num_cpus;                  //Possible cpus, entries of the cpu array in use
+    uint32_t num_online;
+    uint32_t num_interfaces;
+    uint32_t num_mem;
+    uint64_t cpu_total[SHM_CPU_FIELDS];
+    uint64_t context_switches;
+    uint64_t interrupts;
+    uint64_t softirqs;
+    uint64_t boot_time;
+    uint64_t processes_created;
+    uint64_t processes_running;
+    uint64_t processes_blocked;
+};
+
+struct shm_header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t stale;
+    uint64_t sequence;
+    uint64_t size;                      //Of the whole segment
+    uint64_t writer_pid;
+    uint32_t mem_capacity;
+    uint32_t cpu_capacity;
+    uint32_t interface_capacity;
+    uint32_t names_offset;
+    uint32_t mem_offset;
+    uint32_t cpu_offset;
+    uint32_t interface_offset;
+    uint32_t reserved;
+    struct shm_summary summary;
+};
+
+struct shm_cpu
+{
+    uint64_t time[SHM_CPU_FIELDS];
+    uint32_t online;
+    uint32_t reserved;
+};
+
+struct shm_interface
+{
+    char face[SHM_FACE_LENGTH];
+    uint64_t counter[SHM_NETWORK_FIELDS];
+};
+
+/*
+* A copy of the segment, sized to it by shm_open_reader.
+*/
+struct shm_snapshot
+{
+    struct shm_summary summary;
+    uint64_t *mem;
+    struct shm_cpu *cpus;
+    struct shm_interface *interfaces;
+    uint64_t retries;                   //Copies started over because the writer was updating
+};
+
+struct shm_reader
+{
+    char name[SHM_NAME_LENGTH];
+    const struct shm_header *header;
+    size_t size;
+    const char (*names)[SHM_NAME_LENGTH]; //Key of each mem value
+    uint32_t mem_capacity;
+    uint32_t cpu_capacity;
+    uint32_t interface_capacity;
+};
+
+int shm_open_reader(struct shm_reader *reader, struct shm_snapshot *snapshot, const char *name);
+int shm_read(struct shm_reader *reader, struct shm_snapshot *snapshot, int parts);
+int shm_reopen(struct shm_reader *reader, struct shm_snapshot *snapshot);
+void shm_close_reader(struct shm_reader *reader, struct shm_snapshot *snapshot);
+
+#endif
@@ -0,0 +1,317 @@
+/*
+ * File: sys_mon.h
+ * Description: Snapshot types and the collector interface shared by
+ *              sys_mon and sys_mon_bench.
+ */
+#ifndef SYS_MON_H
+#define SYS_MON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#define EXIT_FAILED                 1
+#define EXIT_SUCCESS                0
+
+#define PROC_ROOT                   "/proc"
+#define CPU_STATS_FILE              "stat"
+#define MEM_INFO_FILE               "meminfo"
+#define NETWORK_ACTIVITY_FILE       "net/dev"
+
+#define CPU_POSSIBLE_FILEPATH       "/sys/devices/system/cpu/possible"
+#define PROC_PATH_LENGTH            4096
+#define MAX_NETWORK_FACE_LENGTH     16
+#define PROC_SOURCE_INITIAL_SIZE    4096
+#define SCAN_PADDING                16 //Zeroed bytes kept after the data for 16 byte loads
+#define COUNTER_WRAP_MARGIN         (1ull << 30) //Furthest a 32 bit counter is taken to have counted past a wrap
+
+/*
+* A proc file that stays open for the life of the program. Every sample
+* re-reads it with pread from offset 0 into the same buffer, which only
+* grows when the file outgrows it. The data is followed by SCAN_PADDING
+* zero bytes so the scanner can load past the end of it.
+*/
+struct proc_source
+{
+    const char *name;           //Path below the proc root, e.g. "net/dev"
+    char path[PROC_PATH_LENGTH];
+    int fd;
+    char *buffer;
+    size_t capacity;
+    size_t length;
+    uint64_t read_ns;           //CLOCK_MONOTONIC time of the last read
+};
+
+/*
+* Counters for what the sampler costs. The loop modes print the per tick
+* difference so the steady state can be seen to do no allocation.
+*/
+struct sampler_stats
+{
+    unsigned long allocations;
+    unsigned long read_syscalls;
+    unsigned long bytes_read;
+};
+
+/*
+* Columns of a cpu line in /proc/stat, in the order the kernel prints them.
+* All values are in USER_HZ jiffies.
+*/
+enum cpu_field
+{
+    CPU_USER,
+    CPU_NICE,
+    CPU_SYSTEM,
+    CPU_IDLE,
+    CPU_IOWAIT,
+    CPU_IRQ,
+    CPU_SOFTIRQ,
+    CPU_STEAL,
+    CPU_GUEST,
+    CPU_GUEST_NICE,
+    NUM_CPU_FIELDS
+};
+
+/*
+* Lines of /proc/meminfo the loop modes, history and recordings keep, out
+* of meminfo_snapshot. Values are in kB.
+*/
+enum mem_field
+{
+    MEM_TOTAL,
+    MEM_FREE,
+    MEM_AVAILABLE,
+    MEM_BUFFERS,
+    MEM_CACHED,
+    MEM_ACTIVE,
+    MEM_INACTIVE,
+    MEM_DIRTY,
+    MEM_PAGE_TABLES,
+    MEM_PERCPU,
+    MEM_HARDWARE_CORRUPTED,
+    NUM_MEM_FIELDS
+};
+
+/*
+* Columns of a device line in /proc/net/dev, in the order the kernel prints them.
+*/
+enum network_field
+{
+    NET_R_BYTES,
+    NET_R_PACKETS,
+    NET_R_ERRS,
+    NET_R_DROP,
+    NET_R_FIFO,
+    NET_R_FRAME,
+    NET_R_COMPRESSED,
+    NET_R_MULTICAST,
+    NET_T_BYTES,
+    NET_T_PACKETS,
+    NET_T_ERRS,
+    NET_T_DROP,
+    NET_T_FIFO,
+    NET_T_COLLS,
+    NET_T_CARRIER,
+    NET_T_COMPRESSED,
+    NUM_NETWORK_FIELDS
+};
+
+struct cpu_line
+{
+    uint64_t time[NUM_CPU_FIELDS];
+};
+
+/*
+* Per core counters are kept as one column per cpu_field, each num_cpus
+* long, so time[CPU_IDLE][n] is the idle time of cpu n. The columns share
+* one allocation sized to the machine at startup.
+*/
+struct cpu_stats
+{
+    struct cpu_line total;
+    int num_cpus;                       //Number of possible cpus, offline ones included
+    int num_online;                     //Cores that had a line in the last sample
+    uint64_t *time[NUM_CPU_FIELDS];
+    uint8_t *online;
+    uint64_t sample_ns;
+    uint64_t num_context_switches;
+    uint64_t num_interrupts;            //First number of the intr line, every interrupt since boot
+    uint64_t num_softirqs;
+    uint64_t boot_time;
+    uint64_t num_proccesses_created;
+    uint64_t proccesses_running;
+    uint64_t proccesses_blocked;
+};
+
+struct mem_info
+{
+    uint64_t value[NUM_MEM_FIELDS];
+    unsigned int present; //Bit per mem_field, older kernels lack some lines
+    uint64_t sample_ns;
+};
+
+struct network_device
+{
+    char face[MAX_NETWORK_FACE_LENGTH];
+    int id;                             //Its interface in network_rates, -1 until update_network_rates finds it
+    uint64_t counter[NUM_NETWORK_FIELDS];
+};
+
+/*
+* Every line of /proc/net/dev. The array grows with the file and is never
+* shrunk, so a steady state sample allocates nothing.
+*/
+struct network_info
+{
+    struct network_device *devices;
+    int num_devices;
+    int capacity;
+    uint64_t sample_ns;
+};
+
+/*
+* Percentages of cpu time between two samples. User includes nice, system
+* includes irq and softirq.
+*/
+enum cpu_rate_field
+{
+    CPU_RATE_USER,
+    CPU_RATE_SYSTEM,
+    CPU_RATE_IOWAIT,
+    CPU_RATE_STEAL,
+    CPU_RATE_IDLE,
+    CPU_RATE_BUSY,                      //Everything but idle
+    NUM_CPU_RATES
+};
+
+/*
+* Per second rates of an interface between two samples.
+*/
+enum network_rate_field
+{
+    NET_RATE_R_BYTES,
+    NET_RATE_R_PACKETS,
+    NET_RATE_R_DROP,
+    NET_RATE_T_BYTES,
+    NET_RATE_T_PACKETS,
+    NET_RATE_T_DROP,
+    NUM_NETWORK_RATES
+};
+
+/*
+* The previous cpu sample and the percentages worked out from it. The per
+* core arrays use the same layout as cpu_stats and are resized with it.
+*/
+struct cpu_rates
+{
+    int have_previous;
+    uint64_t previous_ns;
+    uint64_t span_ns;                   //Between the two samples the rates are over
+    struct cpu_line previous_total;
+    uint64_t previous_context_switches;
+    uint64_t previous_interrupts;
+    uint64_t previous_softirqs;
+    uint64_t *previous[NUM_CPU_FIELDS];
+    uint8_t *previous_online;
+
+    float total[NUM_CPU_RATES];
+    float *pct[NUM_CPU_RATES];          //pct[CPU_RATE_IOWAIT][n] is the iowait of cpu n
+    uint8_t *valid;                     //Set when cpu n was online in both samples
+    double context_switches_per_second;
+    double interrupts_per_second;
+    double softirqs_per_second;
+};
+
+struct network_rate
+{
+    int valid;                          //Not set for an interface that is new this sample
+    double rate[NUM_NETWORK_RATES];
+};
+
+/*
+* An interface for as long as it keeps appearing in /proc/net/dev. Its id,
+* the index in network_rates.interfaces, stays the same however the lines
+* around it come and go, and is handed to a new interface once it is gone.
+*/
+struct network_interface
+{
+    char face[MAX_NETWORK_FACE_LENGTH];
+    int in_use;
+    uint64_t first_sample;              //Sample the interface appeared in
+    uint64_t seen_sample;               //Sample it last appeared in
+    uint64_t previous[NUM_NETWORK_FIELDS];
+};
+
+/*
+* The interfaces of the network samples, found by name through an open
+* addressing table, with the counters each had in the previous sample, and
+* the rates of each device in network_info, index for index.
+*/
+struct network_rates
+{
+    int have_previous;
+    uint64_t previous_ns;
+    uint64_t samples;
+    struct network_rate *devices;
+
+    struct network_interface *interfaces;
+    int num_interfaces;                 //Ids handed out, in use or free
+    int capacity;
+    int *free_ids;
+    int num_free;
+    int32_t *slots;                     //Interface id of each name, -1 for a free slot
+    uint32_t slot_mask;
+    int num_added;                      //Interfaces that appeared in the last sample
+    int num_removed;                    //and that were gone from it
+    uint64_t generation;                //Bumped whenever an interface is added or removed
+};
+
+extern struct proc_source cpu_source;
+extern struct proc_source mem_source;
+extern struct proc_source network_source;
+extern struct sampler_stats sampler_stats;
+extern char proc_root[PROC_PATH_LENGTH];
+
+extern const char *mem_field_keys[NUM_MEM_FIELDS];
+
+extern struct cpu_stats cpu_stats;
+extern struct mem_info mem_info;
+extern struct network_info network_info;
+extern struct cpu_rates cpu_rates;
+extern struct network_rates network_rates;
+
+int fatal_error(const char * error_msg, const char * additional_text);
+uint64_t monotonic_ns();
+uint64_t realtime_ns();
+void *counted_malloc(size_t size);
+void *counted_realloc(void *ptr, size_t size);
+
+void set_proc_root(const char *root);
+void open_proc_source(struct proc_source *source);
+size_t read_proc_source(struct proc_source *source);
+void close_proc_source(struct proc_source *source);
+
+int discover_num_cpus();
+int cpu_index_from_token(const char *token, size_t length);
+void resize_cpu_stats(int num_cpus);
+void update_cpu_stats();
+void update_meminfo();
+void update_network_info();
+void update_cpu_rates();
+void update_network_rates();
+void reserve_network_devices(int num_devices);
+int find_network_interface(const char *face);
+uint64_t jiffies_delta(uint64_t current, uint64_t previous);
+uint64_t counter_delta(uint64_t current, uint64_t previous);
+void cpu_line_rates(const uint64_t current[NUM_CPU_FIELDS], const uint64_t previous[NUM_CPU_FIELDS],
+                    float pct[NUM_CPU_RATES]);
+
+void sample_cpu_stats();
+void sample_mem_info();
+void sample_network_info();
+void init_collectors();
+void close_collectors();
+
+#endif